@@ -0,0 +1,180 @@
+/**************************************/
+//! ulc-codec: Ultra-Low-Complexity Audio Codec
+//! Copyright (C) 2022, Ruben Nunez (Aikku; aik AT aol DOT com DOT au)
+//! Refer to the project README file for license terms.
+/**************************************/
+#include "fourier.h"
+#include "fourierhelper.h"
+/**************************************/
+
+//! Implementation notes for FFT-based DCT-IV:
+//!  With M = N/2, the DCT-IV can be computed from an M-point
+//!  complex FFT by folding the even and reversed-odd inputs
+//!  into complex values and applying pre- and post-twiddles:
+//!   z[n] = (x[2n] + I*x[N-1-2n]) * E^(-I*Pi*(n+1/4)/N)
+//!   Z    = FFT(z)
+//!   Y[k] = Z[k] * E^(-I*Pi*k/N)
+//!   X[2k] = Re[Y[k]], X[N-1-2k] = -Im[Y[k]]
+//!  The FFT is a radix-2 decimation-in-frequency transform on
+//!  split real/imaginary arrays (Re in Tmp[0..M-1], Im in
+//!  Tmp[M..N-1]), leaving its output in bit-reversed order;
+//!  the post-twiddle stage reads it back in natural order.
+//!  Twiddles are generated by rotation, the same as in the
+//!  other transforms, so no tables are needed.
+
+/**************************************/
+
+//! Scalar Sin/Cos (for twiddle setup in vector builds)
+#if defined(__AVX__) && !FOURIER_DETERMINISTIC
+# define DCT4_FFT_SCALAR(x) _mm256_cvtss_f32(x)
+#elif defined(__SSE__)
+# define DCT4_FFT_SCALAR(x) _mm_cvtss_f32(x)
+#elif defined(__ARM_NEON)
+# define DCT4_FFT_SCALAR(x) vgetq_lane_f32(x, 0)
+#else
+# define DCT4_FFT_SCALAR(x) (x)
+#endif
+FOURIER_FORCED_INLINE float DCT4_FFT_Sin(float x)
+{
+    return DCT4_FFT_SCALAR(Fourier_Sin(FOURIER_VSET1(x)));
+}
+FOURIER_FORCED_INLINE float DCT4_FFT_Cos(float x)
+{
+    return DCT4_FFT_SCALAR(Fourier_Cos(FOURIER_VSET1(x)));
+}
+
+//! Bit-reversal of a 32-bit index
+FOURIER_FORCED_INLINE unsigned int DCT4_FFT_BitReverse(unsigned int x)
+{
+    x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+    x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+    x = ((x >> 4) & 0x0F0F0F0Fu) | ((x & 0x0F0F0F0Fu) << 4);
+    return __builtin_bswap32(x);
+}
+
+//! Radix-2 DIF butterflies for a single FFT stage (Half = butterfly span)
+static void DCT4_FFT_Stage(float *Re, float *Im, int M, int Half)
+{
+    int i, j;
+#if FOURIER_VSTRIDE > 1
+    if(Half >= 2*FOURIER_VSTRIDE)
+    {
+        //! Twiddles: E^(-I*Pi*j/Half), generated FOURIER_VSTRIDE lanes at a time
+        Fourier_Vec_t t0, t1 = FOURIER_VMUL(FOURIER_VSET1(2.0f/Half), FOURIER_VSET_LINEAR_RAMP());
+        Fourier_Vec_t c  = Fourier_Cos(t1);
+        Fourier_Vec_t s  = Fourier_Sin(t1);
+        Fourier_Vec_t wc = Fourier_Cos(FOURIER_VSET1(2.0f*FOURIER_VSTRIDE / Half));
+        Fourier_Vec_t ws = Fourier_Sin(FOURIER_VSET1(2.0f*FOURIER_VSTRIDE / Half));
+        for(j=0; j<Half; j+=FOURIER_VSTRIDE)
+        {
+            for(i=j; i<M; i+=2*Half)
+            {
+                Fourier_Vec_t ar = FOURIER_VLOAD(Re + i);
+                Fourier_Vec_t ai = FOURIER_VLOAD(Im + i);
+                Fourier_Vec_t br = FOURIER_VLOAD(Re + i + Half);
+                Fourier_Vec_t bi = FOURIER_VLOAD(Im + i + Half);
+                Fourier_Vec_t dr = FOURIER_VSUB(ar, br);
+                Fourier_Vec_t di = FOURIER_VSUB(ai, bi);
+                FOURIER_VSTORE(Re + i, FOURIER_VADD(ar, br));
+                FOURIER_VSTORE(Im + i, FOURIER_VADD(ai, bi));
+                FOURIER_VSTORE(Re + i + Half, FOURIER_VFMA(dr, c, FOURIER_VMUL(di, s)));
+                FOURIER_VSTORE(Im + i + Half, FOURIER_VFMS(di, c, FOURIER_VMUL(dr, s)));
+            }
+            t0 = c;
+            t1 = s;
+            c = FOURIER_VNFMA(t1, ws, FOURIER_VMUL(t0, wc));
+            s = FOURIER_VFMA (t1, wc, FOURIER_VMUL(t0, ws));
+        }
+        return;
+    }
+#endif
+    float c  = 1.0f;
+    float s  = 0.0f;
+    float wc = DCT4_FFT_Cos(2.0f / Half);
+    float ws = DCT4_FFT_Sin(2.0f / Half);
+    for(j=0; j<Half; j++)
+    {
+        for(i=j; i<M; i+=2*Half)
+        {
+            float ar = Re[i],      ai = Im[i];
+            float br = Re[i+Half], bi = Im[i+Half];
+            float dr = ar - br,    di = ai - bi;
+            Re[i]      = ar + br;
+            Im[i]      = ai + bi;
+            Re[i+Half] = dr*c + di*s;
+            Im[i+Half] = di*c - dr*s;
+        }
+        float a = c;
+        float b = s;
+        c = wc*a - ws*b;
+        s = ws*a + wc*b;
+    }
+}
+
+/**************************************/
+
+void Fourier_DCT4_FFT(float *Buf, float *Tmp, int N)
+{
+    int i;
+    FOURIER_ASSUME_ALIGNED(Buf, 32);
+    FOURIER_ASSUME_ALIGNED(Tmp, 32);
+    FOURIER_ASSUME(N >= 16);
+
+    int M = N/2;
+    float *Re = Tmp;
+    float *Im = Tmp + M;
+
+    //! Fold and pre-twiddle
+    {
+        const float *SrcLo = Buf;
+        const float *SrcHi = Buf + N;
+        float c  = DCT4_FFT_Cos(0.5f / N);
+        float s  = DCT4_FFT_Sin(0.5f / N);
+        float wc = DCT4_FFT_Cos(2.0f / N);
+        float ws = DCT4_FFT_Sin(2.0f / N);
+        for(i=0; i<M; i++)
+        {
+            float a = *SrcLo, b = *--SrcHi;
+            SrcLo += 2, SrcHi--;
+            Re[i] = a*c + b*s;
+            Im[i] = b*c - a*s;
+            a = c;
+            b = s;
+            c = wc*a - ws*b;
+            s = ws*a + wc*b;
+        }
+    }
+
+    //! Complex FFT (output is bit-reversed)
+    {
+        int Half;
+        for(Half=M/2; Half>=1; Half/=2) DCT4_FFT_Stage(Re, Im, M, Half);
+    }
+
+    //! Post-twiddle and unfold
+    {
+        int Log2M = 31 - __builtin_clz(M);
+        float *DstLo = Buf;
+        float *DstHi = Buf + N;
+        float c  = 1.0f;
+        float s  = 0.0f;
+        float wc = DCT4_FFT_Cos(2.0f / N);
+        float ws = DCT4_FFT_Sin(2.0f / N);
+        for(i=0; i<M; i++)
+        {
+            int k = DCT4_FFT_BitReverse(i) >> (32-Log2M);
+            float a = Re[k], b = Im[k];
+            *DstLo = a*c + b*s;
+            *--DstHi = a*s - b*c;
+            DstLo += 2, DstHi--;
+            a = c;
+            b = s;
+            c = wc*a - ws*b;
+            s = ws*a + wc*b;
+        }
+    }
+}
+
+/**************************************/
+//! EOF
+/**************************************/
@@ -40,7 +40,7 @@ void Fourier_IMDCT(float *BufOut, const float *BufIn, float *BufLap, float *BufT
 
     //! Undo transform
     for(i=0; i<N; i++) BufTmp[i] = BufIn[i];
-    Fourier_DCT4(BufTmp, BufOut, N);
+    Fourier_DCT4_Planned(BufTmp, BufOut, N);
 
     //! Undo lapping
 #if FOURIER_VSTRIDE > 1
@@ -163,8 +163,8 @@ void Fourier_MDCT_MDST(float *MDCT, float *MDST, const float *New, float *Lap, f
     }
 
     //! Do actual transforms
-    Fourier_DCT4T(MDCT, BufTmp, N);
-    Fourier_DCT4T(MDST, BufTmp, N);
+    Fourier_DCT4T_Planned(MDCT, BufTmp, N);
+    Fourier_DCT4T_Planned(MDST, BufTmp, N);
 
     //! Reverse array for MDST
     {
@@ -0,0 +1,215 @@
+/**************************************/
+//! ulc-codec: Ultra-Low-Complexity Audio Codec
+//! Copyright (C) 2022, Ruben Nunez (Aikku; aik AT aol DOT com DOT au)
+//! Refer to the project README file for license terms.
+/**************************************/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+/**************************************/
+#include "fourier.h"
+#include "fourierhelper.h"
+/**************************************/
+
+//! Plan table, indexed by Log2[N]
+//! Entries that have not been measured (or loaded from
+//! wisdom) are marked with FOURIER_PLAN_UNPLANNED, and
+//! fall back to the radix-2 DCT-IV.
+#define FOURIER_PLAN_UNPLANNED (-1)
+#define FOURIER_PLAN_MIN_LOG2N   4
+#define FOURIER_PLAN_MAX_LOG2N  15
+static signed char Fourier_PlanTable[FOURIER_PLAN_MAX_LOG2N+1] =
+{
+    -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1,
+};
+
+//! ISA identifier for wisdom files
+//! Timings are only meaningful for the code paths that
+//! were actually compiled in, so wisdom is keyed on these.
+#if defined(__AVX__) && defined(__FMA__)
+# define FOURIER_PLAN_ISA "avx+fma"
+#elif defined(__AVX__)
+# define FOURIER_PLAN_ISA "avx"
+#elif defined(__SSE__) && defined(__FMA__)
+# define FOURIER_PLAN_ISA "sse+fma"
+#elif defined(__SSE__)
+# define FOURIER_PLAN_ISA "sse"
+#elif defined(__ARM_NEON) && defined(__ARM_FEATURE_FMA)
+# define FOURIER_PLAN_ISA "neon+fma"
+#elif defined(__ARM_NEON)
+# define FOURIER_PLAN_ISA "neon"
+#else
+# define FOURIER_PLAN_ISA "scalar"
+#endif
+#define FOURIER_WISDOM_MAGIC "ulc-fourier-wisdom 1"
+
+/**************************************/
+
+static inline int Fourier_Plan_Log2(int N)
+{
+    return 31 - __builtin_clz(N);
+}
+static inline int Fourier_Plan_GetAlgorithm(int N)
+{
+#if FOURIER_DETERMINISTIC
+    //! The FFT and radix-2 algorithms round differently, so a
+    //! plan chosen by timing would make the output depend on
+    //! the machine; always use radix-2 instead.
+    (void)N;
+    return FOURIER_DCT4_ALGORITHM_RADIX2;
+#endif
+    int Log2N = Fourier_Plan_Log2(N);
+    if(Log2N > FOURIER_PLAN_MAX_LOG2N) return FOURIER_DCT4_ALGORITHM_RADIX2;
+    return (Fourier_PlanTable[Log2N] == FOURIER_DCT4_ALGORITHM_FFT) ? FOURIER_DCT4_ALGORITHM_FFT : FOURIER_DCT4_ALGORITHM_RADIX2;
+}
+
+/**************************************/
+
+void Fourier_DCT4_Planned(float *Buf, float *Tmp, int N)
+{
+    if(Fourier_Plan_GetAlgorithm(N) == FOURIER_DCT4_ALGORITHM_FFT)
+        Fourier_DCT4_FFT(Buf, Tmp, N);
+    else
+        Fourier_DCT4(Buf, Tmp, N);
+}
+void Fourier_DCT4T_Planned(float *Buf, float *Tmp, int N)
+{
+    if(Fourier_Plan_GetAlgorithm(N) == FOURIER_DCT4_ALGORITHM_FFT)
+        Fourier_DCT4_FFT(Buf, Tmp, N);
+    else
+        Fourier_DCT4T(Buf, Tmp, N);
+}
+
+/**************************************/
+
+//! Time a single algorithm for size N (in nanoseconds per call)
+//! NOTE: We take the best of several runs, as we are only
+//! interested in the cost of the transform itself, rather
+//! than interference from the rest of the system.
+static double Fourier_Plan_TimeAlgorithm(void (*Func)(float*, float*, int), float *Buf, float *Tmp, int N)
+{
+    int i, Run, nIter = (1 << 16) / N;
+    if(nIter < 4) nIter = 4;
+    double Best = -1.0;
+    for(Run=0; Run<5; Run++)
+    {
+        struct timespec t0, t1;
+        for(i=0; i<N; i++) Buf[i] = (float)((i*7919) % 257) * (1.0f/256) - 0.5f;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        for(i=0; i<nIter; i++) Func(Buf, Tmp, N);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        double t = ((t1.tv_sec - t0.tv_sec)*1.0e9 + (t1.tv_nsec - t0.tv_nsec)) / nIter;
+        if(Best < 0.0 || t < Best) Best = t;
+    }
+    return Best;
+}
+
+int Fourier_Plan_Measure(int MinN, int MaxN)
+{
+    int Log2N;
+#if FOURIER_DETERMINISTIC
+    //! Nothing to measure; plans are fixed
+    (void)MinN, (void)MaxN;
+    return 1;
+#endif
+    int MinLog2N = Fourier_Plan_Log2(MinN);
+    int MaxLog2N = Fourier_Plan_Log2(MaxN);
+    if(MinLog2N < FOURIER_PLAN_MIN_LOG2N) MinLog2N = FOURIER_PLAN_MIN_LOG2N;
+    if(MaxLog2N > FOURIER_PLAN_MAX_LOG2N) MaxLog2N = FOURIER_PLAN_MAX_LOG2N;
+
+    //! Skip allocating anything if everything is already planned
+    for(Log2N=MinLog2N; Log2N<=MaxLog2N; Log2N++)
+    {
+        if(Fourier_PlanTable[Log2N] == FOURIER_PLAN_UNPLANNED) break;
+    }
+    if(Log2N > MaxLog2N) return 1;
+
+    //! Allocate aligned benchmarking buffers
+    int BufSize = 1 << MaxLog2N;
+    void *BufferData = malloc(64-1 + sizeof(float)*BufSize*2);
+    if(!BufferData) return -1;
+    float *Buf = (float*)((char*)BufferData + ((-(uintptr_t)BufferData) & (64-1)));
+    float *Tmp = Buf + BufSize;
+
+    //! Measure each size we haven't planned yet
+    for(Log2N=MinLog2N; Log2N<=MaxLog2N; Log2N++)
+    {
+        if(Fourier_PlanTable[Log2N] != FOURIER_PLAN_UNPLANNED) continue;
+        int N = 1 << Log2N;
+        double tRadix2 = Fourier_Plan_TimeAlgorithm(Fourier_DCT4,     Buf, Tmp, N);
+        double tFFT    = Fourier_Plan_TimeAlgorithm(Fourier_DCT4_FFT, Buf, Tmp, N);
+        Fourier_PlanTable[Log2N] = (tFFT < tRadix2) ? FOURIER_DCT4_ALGORITHM_FFT : FOURIER_DCT4_ALGORITHM_RADIX2;
+    }
+    free(BufferData);
+    return 1;
+}
+
+/**************************************/
+
+void Fourier_Plan_Set(int N, int Algorithm)
+{
+    int Log2N = Fourier_Plan_Log2(N);
+    if(Log2N < FOURIER_PLAN_MIN_LOG2N || Log2N > FOURIER_PLAN_MAX_LOG2N) return;
+    Fourier_PlanTable[Log2N] = Algorithm;
+}
+
+int Fourier_Plan_Get(int N)
+{
+    return Fourier_Plan_GetAlgorithm(N);
+}
+
+/**************************************/
+
+//! Wisdom file format (plain text):
+//!  ulc-fourier-wisdom 1
+//!  <ISA> <N> <Algorithm>
+//!  ...
+//! Lines for a different ISA are kept in the file by the
+//! caller's discretion (ie. one file per machine type), but
+//! are ignored on loading.
+int Fourier_Plan_SaveWisdom(const char *Filename)
+{
+    int Log2N;
+    FILE *File = fopen(Filename, "w");
+    if(!File) return -1;
+    fprintf(File, "%s\n", FOURIER_WISDOM_MAGIC);
+    for(Log2N=FOURIER_PLAN_MIN_LOG2N; Log2N<=FOURIER_PLAN_MAX_LOG2N; Log2N++)
+    {
+        if(Fourier_PlanTable[Log2N] == FOURIER_PLAN_UNPLANNED) continue;
+        fprintf(File, "%s %d %d\n", FOURIER_PLAN_ISA, 1 << Log2N, Fourier_PlanTable[Log2N]);
+    }
+    return (fclose(File) == 0) ? 1 : -1;
+}
+
+int Fourier_Plan_LoadWisdom(const char *Filename)
+{
+    char Line[128];
+    FILE *File = fopen(Filename, "r");
+    if(!File) return -1;
+    if(!fgets(Line, sizeof(Line), File) || strncmp(Line, FOURIER_WISDOM_MAGIC, sizeof(FOURIER_WISDOM_MAGIC)-1))
+    {
+        fclose(File);
+        return -1;
+    }
+    int nLoaded = 0;
+    while(fgets(Line, sizeof(Line), File))
+    {
+        char Isa[32];
+        int  N, Algorithm;
+        if(sscanf(Line, "%31s %d %d", Isa, &N, &Algorithm) != 3) continue;
+        if(strcmp(Isa, FOURIER_PLAN_ISA)) continue;
+        if(N < 16 || (N & (-N)) != N) continue;
+        if(Algorithm != FOURIER_DCT4_ALGORITHM_RADIX2 && Algorithm != FOURIER_DCT4_ALGORITHM_FFT) continue;
+        Fourier_Plan_Set(N, Algorithm);
+        nLoaded++;
+    }
+    fclose(File);
+    return nLoaded;
+}
+
+/**************************************/
+//! EOF
+/**************************************/
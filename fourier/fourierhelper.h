@@ -11,12 +11,35 @@
 #if defined(__SSE__)
 # include <xmmintrin.h>
 #endif
+#if defined(__ARM_NEON)
+# include <arm_neon.h>
+#endif
 /**************************************/
 #define FOURIER_FORCED_INLINE static inline __attribute__((always_inline))
 #define FOURIER_ASSUME(Cond) (Cond) ? ((void)0) : __builtin_unreachable()
 #define FOURIER_ASSUME_ALIGNED(x,Align) x = __builtin_assume_aligned(x,Align)
 /**************************************/
-#if defined(__AVX__)
+
+//! Deterministic builds avoid fused multiply-adds (and timing-based
+//! planning), so that every target rounds identically
+#ifndef FOURIER_DETERMINISTIC
+# define FOURIER_DETERMINISTIC 0
+#endif
+#if (defined(__FMA__) || defined(__ARM_FEATURE_FMA)) && !FOURIER_DETERMINISTIC
+# define FOURIER_USE_FMA 1
+#else
+# define FOURIER_USE_FMA 0
+#endif
+
+/**************************************/
+
+//! Vector width
+//! The order of operations of the transforms depends on the vector
+//! width (eg. through the reordering of butterflies and twiddles),
+//! so deterministic builds always use the 128-bit paths, which give
+//! the same results on SSE and NEON.
+/**************************************/
+#if defined(__AVX__) && !FOURIER_DETERMINISTIC
 typedef __m256 Fourier_Vec_t;
 # define FOURIER_VSTRIDE            8
 # define FOURIER_VLOAD(Src)         _mm256_load_ps(Src)
@@ -31,7 +54,7 @@ typedef __m256 Fourier_Vec_t;
 # define FOURIER_VREVERSE_LANE(x)   _mm256_shuffle_ps(x, x, 0x1B)
 # define FOURIER_VREVERSE(x)        _mm256_permute2f128_ps(FOURIER_VREVERSE_LANE(x), FOURIER_VREVERSE_LANE(x), 0x01)
 # define FOURIER_VNEGATE_ODD(x)     _mm256_xor_ps(x, _mm256_setr_ps(0.0f, -0.0f, 0.0f, -0.0f, 0.0f, -0.0f, 0.0f, -0.0f))
-# if defined(__FMA__)
+# if FOURIER_USE_FMA
 #  define FOURIER_VFMA(x, y, a)     _mm256_fmadd_ps(x, y, a)
 #  define FOURIER_VFMS(x, y, a)     _mm256_fmsub_ps(x, y, a)
 #  define FOURIER_VNFMA(x, y, a)    _mm256_fnmadd_ps(x, y, a)
@@ -76,7 +99,7 @@ typedef __m128 Fourier_Vec_t;
 # define FOURIER_VMUL(x, y)         _mm_mul_ps(x, y)
 # define FOURIER_VREVERSE(x)        _mm_shuffle_ps(x, x, 0x1B)
 # define FOURIER_VNEGATE_ODD(x)     _mm_xor_ps(x, _mm_setr_ps(0.0f, -0.0f, 0.0f, -0.0f))
-# if defined(__FMA__)
+# if FOURIER_USE_FMA
 #  define FOURIER_VFMA(x, y, a)     _mm_fmadd_ps(x, y, a)
 #  define FOURIER_VFMS(x, y, a)     _mm_fmsub_ps(x, y, a)
 #  define FOURIER_VNFMA(x, y, a)    _mm_fnmadd_ps(x, y, a)
@@ -100,6 +123,48 @@ FOURIER_FORCED_INLINE void FOURIER_VSPLIT_EVEN_ODDREV(Fourier_Vec_t l, Fourier_V
     *Even = _mm_shuffle_ps(l, h, 0x88);
     *Odd  = _mm_shuffle_ps(h, l, 0x77);
 }
+#elif defined(__ARM_NEON)
+typedef float32x4_t Fourier_Vec_t;
+# define FOURIER_VSTRIDE            4
+# define FOURIER_VLOAD(Src)         vld1q_f32(Src)
+# define FOURIER_VLOADU(Src)        vld1q_f32(Src)
+# define FOURIER_VSTORE(Dst, x)     vst1q_f32(Dst, x)
+# define FOURIER_VSTOREU(Dst, x)    vst1q_f32(Dst, x)
+# define FOURIER_VSET1(x)           vdupq_n_f32(x)
+# define FOURIER_VSET_LINEAR_RAMP() ((float32x4_t){0.0f, 1.0f, 2.0f, 3.0f})
+# define FOURIER_VADD(x, y)         vaddq_f32(x, y)
+# define FOURIER_VSUB(x, y)         vsubq_f32(x, y)
+# define FOURIER_VMUL(x, y)         vmulq_f32(x, y)
+# define FOURIER_VREVERSE_PAIRS(x)  vrev64q_f32(x)
+# define FOURIER_VREVERSE(x)        vcombine_f32(vget_high_f32(FOURIER_VREVERSE_PAIRS(x)), vget_low_f32(FOURIER_VREVERSE_PAIRS(x)))
+# define FOURIER_VNEGATE_ODD(x)     vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(x), ((uint32x4_t){0, 0x80000000u, 0, 0x80000000u})))
+# if FOURIER_USE_FMA
+#  define FOURIER_VFMA(x, y, a)     vfmaq_f32(a, x, y)
+#  define FOURIER_VFMS(x, y, a)     vfmaq_f32(vnegq_f32(a), x, y)
+#  define FOURIER_VNFMA(x, y, a)    vfmsq_f32(a, x, y)
+# else
+#  define FOURIER_VFMA(x, y, a)     vaddq_f32(vmulq_f32(x, y), a)
+#  define FOURIER_VFMS(x, y, a)     vsubq_f32(vmulq_f32(x, y), a)
+#  define FOURIER_VNFMA(x, y, a)    vsubq_f32(a, vmulq_f32(x, y))
+# endif
+FOURIER_FORCED_INLINE void FOURIER_VINTERLEAVE(Fourier_Vec_t a, Fourier_Vec_t b, Fourier_Vec_t *Lo, Fourier_Vec_t *Hi)
+{
+    float32x4x2_t t = vzipq_f32(a, b);
+    *Lo = t.val[0];
+    *Hi = t.val[1];
+}
+FOURIER_FORCED_INLINE void FOURIER_VSPLIT_EVEN_ODD(Fourier_Vec_t l, Fourier_Vec_t h, Fourier_Vec_t *Even, Fourier_Vec_t *Odd)
+{
+    float32x4x2_t t = vuzpq_f32(l, h);
+    *Even = t.val[0];
+    *Odd  = t.val[1];
+}
+FOURIER_FORCED_INLINE void FOURIER_VSPLIT_EVEN_ODDREV(Fourier_Vec_t l, Fourier_Vec_t h, Fourier_Vec_t *Even, Fourier_Vec_t *Odd)
+{
+    float32x4x2_t t = vuzpq_f32(l, h);
+    *Even = t.val[0];
+    *Odd  = FOURIER_VREVERSE(t.val[1]);
+}
 #else
 typedef float Fourier_Vec_t;
 # define FOURIER_VSTRIDE        1
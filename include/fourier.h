@@ -32,6 +32,49 @@ void Fourier_DCT3 (float *Buf, float *Tmp, int N);
 void Fourier_DCT4 (float *Buf, float *Tmp, int N);
 void Fourier_DCT4T(float *Buf, float *Tmp, int N);
 
+//! DCT-IV via complex FFT (scaled)
+//! Arguments:
+//!  Buf[N]
+//!  Tmp[N]
+//! Computes the same transform (and scaling) as Fourier_DCT4(),
+//! by way of an N/2-point radix-2 complex FFT with pre- and
+//! post-twiddles. Depending on the machine and transform size,
+//! this may be faster or slower than the direct factorization.
+//! NOTE:
+//!  -N must be a power of two, and >= 16
+void Fourier_DCT4_FFT(float *Buf, float *Tmp, int N);
+
+//! Planned DCT-IV
+//! These dispatch to whichever DCT-IV algorithm was selected
+//! for size N by Fourier_Plan_Measure(), Fourier_Plan_Set(),
+//! or Fourier_Plan_LoadWisdom(). Unplanned sizes use the
+//! radix-2 factorization (Fourier_DCT4()/Fourier_DCT4T()).
+//! NOTE:
+//!  -The plan table is global and not thread-safe to modify;
+//!   planning should be done before starting any threads that
+//!   use the transforms (eg. during encoder/decoder init).
+#define FOURIER_DCT4_ALGORITHM_RADIX2 0
+#define FOURIER_DCT4_ALGORITHM_FFT    1
+void Fourier_DCT4_Planned (float *Buf, float *Tmp, int N);
+void Fourier_DCT4T_Planned(float *Buf, float *Tmp, int N);
+
+//! Transform planning
+//! Fourier_Plan_Measure() times every available DCT-IV algorithm
+//! for each power-of-two size in [MinN, MaxN] that has not yet
+//! been planned, and selects the fastest. Returns 1 on success,
+//! or -1 on memory allocation failure.
+//! Fourier_Plan_SaveWisdom() writes the current plans to a text
+//! file, and Fourier_Plan_LoadWisdom() reads them back (ignoring
+//! any entries measured with a different instruction set), so
+//! that measurement can be skipped on later runs. SaveWisdom()
+//! returns 1 on success, and LoadWisdom() returns the number of
+//! plans loaded; both return -1 on file errors.
+int  Fourier_Plan_Measure(int MinN, int MaxN);
+void Fourier_Plan_Set(int N, int Algorithm);
+int  Fourier_Plan_Get(int N);
+int  Fourier_Plan_SaveWisdom(const char *Filename);
+int  Fourier_Plan_LoadWisdom(const char *Filename);
+
 //! MDCT+MDST/IMDCT (based on DCT-IV; scaled)
 //! Arguments:
 //!  MDCT[N]
@@ -50,7 +93,7 @@ void Fourier_DCT4T(float *Buf, float *Tmp, int N);
 //!   always used for lapping.
 //!  -New can be the same as BufTmp. However, this
 //!   implies trashing of the buffer contents.
-//!  -MDCT uses Fourier_DCT4T() internally
+//!  -MDCT uses Fourier_DCT4T_Planned() internally
 void Fourier_MDCT_MDST(float *MDCT, float *MDST, const float *New, float *Lap, float *BufTmp, int N, int Overlap);
 
 //! IMDCT (based on DCT-IV; scaled)
@@ -70,7 +113,7 @@ void Fourier_MDCT_MDST(float *MDCT, float *MDST, const float *New, float *Lap, f
 //!   in the MDCT implementation from above.
 //!  -BufIn can be the same as BufTmp. However, this
 //!   implies trashing of the buffer contents.
-//!  -IMDCT uses Fourier_DCT4() internally
+//!  -IMDCT uses Fourier_DCT4_Planned() internally
 void Fourier_IMDCT(float *BufOut, const float *BufIn, float *BufLap, float *BufTmp, int N, int Overlap);
 
 /**************************************/
@@ -4,32 +4,146 @@
 //! Refer to the project README file for license terms.
 /**************************************/
 #pragma once
+/**************************************/
+#include <stdint.h>
+/**************************************/
+#include "ulcresampler.h"
+/**************************************/
+
+//! Output formats
+#define ULC_DECODER_OUTPUT_FLOAT32 0
+#define ULC_DECODER_OUTPUT_PCM16   1
+
+//! Low-power decoding flags
+//! These trade fidelity for decoding speed (eg. for thermally
+//! constrained devices). With no flags set, output is unchanged.
+//!  NO_NOISE_FILL:    Leave noise-filled regions as zeros.
+//!  COARSE_SUBBLOCKS: Synthesize subblocks smaller than BlockSize/2 by
+//!                    merging them (interleaving their spectra) into a
+//!                    single half-block transform. This loses the time
+//!                    resolution of transients within that half (ie.
+//!                    pre-echo), but limits synthesis to at most two
+//!                    transforms per channel per block.
+//!                    NOTE: This only saves the overhead of each
+//!                    transform call: the merged transform does more
+//!                    arithmetic than the small ones it replaces, so
+//!                    with the planned FFT transforms decoding is
+//!                    about 10% slower on x86. It is only worth it
+//!                    where per-call overhead dominates.
+//!  HALF_RATE:        Only synthesize the lower half of the spectrum, with
+//!                    half-size transforms, giving output at RateHz/2 (and
+//!                    BlockSize/2 samples per block). When OutputRateHz is
+//!                    set, the output is resampled from RateHz/2.
+#define ULC_DECODER_FLAG_NO_NOISE_FILL    0x1
+#define ULC_DECODER_FLAG_COARSE_SUBBLOCKS 0x2
+#define ULC_DECODER_FLAG_HALF_RATE        0x4
+
+//! Memory-saving flags
+//!  F16_LAP: Store the lapping buffer (the only state that persists from
+//!           block to block) as float16, halving its size. Each lapped
+//!           sample is rounded to 11 significant bits, so the error grows
+//!           with the signal level (up to about 16LSB at 16-bit output
+//!           for full-scale signals; around -90dBFS RMS on music).
+#define ULC_DECODER_FLAG_F16_LAP          0x8
+
+/**************************************/
+
+//! Parsed block
+//! This holds everything read from a block by ULC_DecodeBlock_Parse(),
+//! for use by ULC_DecodeBlock_Synthesize(): the window control, the
+//! stereo mode of each channel pair (0 = M/S, 1 = L/R, 2 = Parametric;
+//! parametric pairs are synthesized as M/S), and the dequantized
+//! coefficients of every [sub]block of every channel, one channel
+//! after another. With long-term prediction, it also holds the lag
+//! (0 = Not predicted) and the gain nybble of each band (0 = Off) for
+//! every channel; the prediction itself is added during synthesis.
+struct ULC_DecoderBlock_t
+{
+    int      WindowCtrl;
+    void    *BufferData;
+    float   *Coef;       //! [nChan * BlockSize]
+    uint8_t *StereoMode; //! [nChan/2]
+    int     *LTPLag;     //! [nChan]                  (NULL without LongTermPrediction)
+    uint8_t *LTPGain;    //! [nChan * ULC_LTP_NBANDS] (NULL without LongTermPrediction)
+};
+
 /**************************************/
 
 //! Decoder state structure
 //! NOTE:
 //!  -The global state data must be set before calling ULC_DecoderState_Init()
-//!  -{nChan, BlockSize,} must not change after calling ULC_EncoderState_Init()
+//!  -{nChan, BlockSize, RateHz, OutputRateHz, OutputFormat, Flags, LongTermPrediction} must not change after calling ULC_DecoderState_Init()
+//!  -RateHz is only needed when OutputRateHz is non-zero.
+//!  -LongTermPrediction must match the setting used by the encoder,
+//!   as it changes the block syntax.
+//!  -ScratchBuffer may point to a caller-owned area of at least
+//!   ULC_DecoderState_ScratchSize() bytes, to be used in place of the
+//!   decoder's own scratch buffers (see ULC_DecoderState_ScratchSize()).
 struct ULC_DecoderState_t
 {
     //! Global state (do not change after initialization)
-    int nChan;     //! Channels in encoding scheme
-    int BlockSize; //! Transform block size
+    int nChan;        //! Channels in encoding scheme
+    int BlockSize;    //! Transform block size
+    int RateHz;       //! Playback rate of the stream
+    int OutputRateHz; //! Output rate (0 = Same as RateHz; no resampling)
+    int OutputFormat; //! Output format (ULC_DECODER_OUTPUT_*)
+    int Flags;        //! Decoding flags (ULC_DECODER_FLAG_*; 0 = Full quality)
+    int LongTermPrediction; //! Stream uses long-term prediction (0 = No, 1 = Yes)
+    void *ScratchBuffer;    //! Shared scratch area (NULL = Allocate privately)
 
     //! Decoding state
     //! Buffer memory layout:
-    //!  Data:
+    //!  Scratch (ScratchBuffer, or the start of Data):
     //!   char  _Padding[];
     //!   float TransformBuffer[BlockSize]
-    //!   float TransformTemp  [nChan * BlockSize]
-    //!   float TransformInvLap[nChan * BlockSize/2]
+    //!   float TransformTemp  [nChan * BlockSize * 2]
+    //!   float TransformNoise [BlockSize]
+    //!   float LTPBuffer      [BlockSize * 2]                (only with LongTermPrediction)
+    //!  Data:
+    //!   char  _Padding[];
+    //!   float TransformInvLap[nChan * BlockSize/2] (uint16_t with ULC_DECODER_FLAG_F16_LAP)
+    //!   float LTPHistory     [nChan * ULC_LTP_HISTORY_SIZE] (only with LongTermPrediction)
+    //!   int   LTPLag         [nChan]                        (only with LongTermPrediction)
+    //!   uint8_t LTPGain      [nChan * ULC_LTP_NBANDS]       (only with LongTermPrediction)
+    //!   uint8_t StereoLR     [nChan/2]
+    //!   uint8_t StereoMode   [nChan/2]
     //! BufferData contains the pointer returned by malloc()
+    //! Block holds the parsed state used by ULC_DecodeBlock(), with
+    //! TransformBuffer[], StereoMode[], LTPLag[] and LTPGain[] as its
+    //! buffers. As ULC_DecodeBlock() parses and synthesizes one channel
+    //! at a time, its Coef[] only holds a single channel, so Block must
+    //! not be passed to ULC_DecodeBlock_Parse().
+    //! StereoLR[] holds the coding mode for each channel pair in the
+    //! last decoded block (0 = M/S, 1 = L/R); TransformInvLap[] is
+    //! kept in this same domain, and converted when the mode changes.
+    //! With ULC_DECODER_FLAG_F16_LAP, TransformInvLapF16[] is used in
+    //! place of TransformInvLap[] (which is then NULL), and is expanded
+    //! to float for each channel around its inverse transforms.
+    //! TransformNoise[] holds the noise-fill tails of the first channel
+    //! of the pair being decoded, for coupled noise fill.
+    //! LTPHistory[] holds the last synthesized samples of each channel
+    //! (before undoing M/S, and so in the same domain as the lapping
+    //! buffer), from which blocks are predicted; LTPBuffer[] is scratch
+    //! space for the prediction.
     //! TransformTemp[] is large because we need to interleave the output.
+    //! When resampling, the IMDCT output is written straight into the
+    //! resampler's input buffers, and the resampler then undoes M/S,
+    //! interleaves, and converts to the output format in a single pass.
     int    LastSubBlockSize; //! Size of last [sub]block processed
+    int    MaxOutputSize;    //! Largest number of samples (per channel) output per block
+    int    nOutputSamples;   //! Number of samples (per channel) output by the last block
+    uint32_t NoiseSeed;      //! Noise-fill random seed
     void  *BufferData;
     float *TransformBuffer;
     float *TransformTemp;
     float *TransformInvLap;
+    uint16_t *TransformInvLapF16;
+    float *TransformNoise;
+    float *LTPHistory;
+    float *LTPBuffer;
+    uint8_t *StereoLR;
+    struct ULC_DecoderBlock_t   Block;
+    struct ULC_ResamplerState_t Resampler;
 };
 
 /**************************************/
@@ -42,19 +156,121 @@ int ULC_DecoderState_Init(struct ULC_DecoderState_t *State);
 //! Destroy decoder state
 void ULC_DecoderState_Destroy(struct ULC_DecoderState_t *State);
 
+//! Get the size of the scratch area
+//! Only the lapping buffer (along with the long-term prediction
+//! history and the stereo mode of each pair) is carried from block to
+//! block; everything else is scratch space that is only used during
+//! a call to ULC_DecodeBlock(), and makes up most of the memory of a
+//! decoder (eg. 48KiB of 56KiB for stereo at BlockSize=2048). So when
+//! many decoders are run one after another (eg. the voices of a game's
+//! mixer), they can share a single scratch area, by setting their
+//! ScratchBuffer to it before initialization.
+//! Only the {nChan, BlockSize, LongTermPrediction} fields of State
+//! are used; a scratch area can be shared between decoders of
+//! different formats by using the largest size among them.
+//! NOTE: Decoders that share a scratch area must not decode at the
+//! same time. Blocks from ULC_DecoderBlock_Init() have their own
+//! buffers, and are not part of the scratch area.
+//! Returns the size in bytes (including padding for alignment), or a
+//! negative value if the parameters are invalid.
+int ULC_DecoderState_ScratchSize(const struct ULC_DecoderState_t *State);
+
 /**************************************/
 
 //! Decode block
 //! NOTE:
-//!  -Output data will have its channels arranged sequentially;
-//!   For example:
-//!   {
-//!    0,1,2,3...BlockSize-1, //! Chan0
-//!    0,1,2,3...BlockSize-1, //! Chan1
-//!   }
+//!  -Output data will have its channels interleaved, in the
+//!   format given by OutputFormat.
+//!  -DstData must have space for nChan*BlockSize floats when not
+//!   resampling (as it is also used as scratch space), or for
+//!   nChan*MaxOutputSize samples when resampling.
+//!  -The number of samples output is stored to nOutputSamples.
+//!   This is always BlockSize when not resampling (BlockSize/2 with
+//!   ULC_DECODER_FLAG_HALF_RATE), but varies from block to block
+//!   otherwise.
 //!  -SrcBuffer will only be accessed via bytes.
 //! Returns the number of bits read.
-int ULC_DecodeBlock(struct ULC_DecoderState_t *State, float *DstData, const void *SrcBuffer);
+int ULC_DecodeBlock(struct ULC_DecoderState_t *State, void *DstData, const void *SrcBuffer);
+
+//! Two-phase decoding
+//! ULC_DecodeBlock() gives the same output as ULC_DecodeBlock_Parse()
+//! followed by ULC_DecodeBlock_Synthesize(), but runs both phases on
+//! one channel at a time, so that it needs no whole-block buffer.
+//! Parsing reads the nybble stream of every channel and fills in the
+//! coefficients (including noise fill and parametric stereo), while
+//! synthesis performs all inverse transforms, lapping, and output.
+//! Keeping the phases apart means the branchy parser and the SIMD
+//! transforms don't keep evicting each other's working set, and the
+//! phases only share the {nChan, BlockSize, LongTermPrediction} fields
+//! of State, so they may run on different threads: eg. parsing block
+//! k+1 into one ULC_DecoderBlock_t while synthesizing block k from
+//! another. Blocks must still be parsed in order and synthesized in
+//! order.
+//! NOTE:
+//!  -Blocks are created with ULC_DecoderBlock_Init() (each holding
+//!   the coefficients of all nChan channels), and must be destroyed
+//!   with ULC_DecoderBlock_Destroy(). State->Block must not be used
+//!   with either phase.
+//!  -ULC_DecodeBlock_Parse() returns the number of bits read, or 0 if
+//!   the block is corrupt (in which case Block must not be synthesized).
+//!  -ULC_DecodeBlock_Synthesize() does not modify Block, and has the
+//!   same output semantics as ULC_DecodeBlock().
+int  ULC_DecoderBlock_Init(const struct ULC_DecoderState_t *State, struct ULC_DecoderBlock_t *Block);
+void ULC_DecoderBlock_Destroy(struct ULC_DecoderBlock_t *Block);
+int  ULC_DecodeBlock_Parse(struct ULC_DecoderState_t *State, struct ULC_DecoderBlock_t *Block, const void *SrcBuffer);
+void ULC_DecodeBlock_Synthesize(struct ULC_DecoderState_t *State, void *DstData, const struct ULC_DecoderBlock_t *Block);
+
+//! Scan block
+//! This parses a block without decoding it, to find where it ends
+//! (eg. for building seek tables, or splicing streams). Only the
+//! {nChan, BlockSize, LongTermPrediction} fields of State are used.
+//! Returns the number of bits in the block (0 if corrupt).
+int ULC_ScanBlock(const struct ULC_DecoderState_t *State, const void *SrcBuffer);
+
+//! Apply gain to a block
+//! Quantizers are exact powers of two (Quantizer = 2^-(5+qi), with
+//! 0 <= qi <= 0xE+0xC), and everything else in a block (coefficients,
+//! noise fill, coupled noise, and parametric stereo) is relative to
+//! these, so subtracting Shift from every quantizer of every channel
+//! scales the decoded output by exactly 2^Shift (ie. Shift*6.02dB)
+//! without any requantization. Quantizers are promoted to or demoted
+//! from their extended form (Fh,Eh,Xh) as needed, so the block may
+//! grow or shrink by a few nybbles. The long-term prediction of a
+//! block is also relative to the (equally scaled) output. Only the
+//! {nChan, BlockSize, LongTermPrediction} fields of State are used.
+//! NOTE:
+//!  -DstBuffer must have space for twice the size of the source block.
+//!  -ULC_BlockGainRange() narrows [*MinShift,*MaxShift] to the shifts
+//!   that keep every quantizer of the block in range (so to find the
+//!   range of a whole stream, start with [INT_MIN,INT_MAX] and call
+//!   this for every block).
+//! Both return the number of bits read from SrcBuffer (0 if corrupt;
+//! for ULC_BlockGain(), also if Shift takes a quantizer out of range),
+//! and ULC_BlockGain() stores the number of bits written to DstSize.
+int ULC_BlockGain(const struct ULC_DecoderState_t *State, void *DstBuffer, int *DstSize, const void *SrcBuffer, int Shift);
+int ULC_BlockGainRange(const struct ULC_DecoderState_t *State, const void *SrcBuffer, int *MinShift, int *MaxShift);
+
+/**************************************/
+
+//! Long-term prediction
+//! Sustained tonal sounds repeat nearly the same spectrum from one
+//! block to the next, so streams may predict the coefficients of a
+//! block from the decoder's own output: the last Lag samples of the
+//! history of a channel are repeated to cover the block's transform
+//! (ie. a pitch predictor with a period of Lag samples), which is
+//! then windowed and transformed just as in the encoder's MDCT. The
+//! stream gives a gain for each band of the prediction, and codes
+//! only the residual.
+//! This stores the prediction of the BlockSize coefficients (halved
+//! for ULC_DECODER_FLAG_HALF_RATE) of channel Chan, for a block with
+//! WindowCtrl that codes its pair in L/R (IsLR != 0) or M/S, to Dst.
+//! It is called by synthesis, and by the encoder (on its own copy of
+//! the decoder) so that both sides form exactly the same prediction.
+//! NOTE:
+//!  -Only valid with LongTermPrediction, and must be called before
+//!   the block is synthesized.
+//!  -Dst must be aligned to 64 bytes, and must not be in LTPBuffer[].
+void ULC_DecodeBlock_Predict(const struct ULC_DecoderState_t *State, float *Dst, int Chan, int IsLR, int Lag, int WindowCtrl);
 
 /**************************************/
 //! EOF
@@ -5,15 +5,47 @@
 /**************************************/
 #pragma once
 /**************************************/
+#include <stdint.h>
+/**************************************/
+#include "ulcdecoder.h"
+/**************************************/
+
+//! 0 == Use the fastest code paths (output may differ slightly between CPU targets)
+//! 1 == Bit-identical output on every CPU target (set by building with DETERMINISTIC=1)
+#ifndef ULC_DETERMINISTIC
+# define ULC_DETERMINISTIC 0
+#endif
 
 //! 0 == No psychoacoustic optimizations
 //! 1 == Use psychoacoustic model
 #define ULC_USE_PSYCHOACOUSTICS 1
 
+//! 0 == No temporal (forward) masking
+//! 1 == Carry masking levels across blocks (requires ULC_USE_PSYCHOACOUSTICS)
+//! NOTE: This is off by default, as it has not yet been shown to keep
+//! quality at a fixed rate (by SNR, it loses 0.05..0.25dB at 128kbps).
+#define ULC_USE_TEMPORAL_MASKING 0
+
+//! 0 == Always use M/S stereo for channel pairs
+//! 1 == Switch between L/R and M/S stereo per block, per channel pair, when StereoSwitching is set
+#define ULC_USE_STEREO_SWITCHING 1
+
+//! 0 == No parametric stereo
+//! 1 == Allow channel pairs to send only M plus per-band S parameters, when ParametricStereo is set (requires ULC_USE_STEREO_SWITCHING)
+#define ULC_USE_PARAMETRIC_STEREO 1
+
 //! 0 == No noise-fill coding
 //! 1 == Use noise-fill where useful
 #define ULC_USE_NOISE_CODING 1
 
+//! 0 == Code noise fill separately for each channel of a pair
+//! 1 == Allow the second channel of a pair to reuse the noise-fill tail of the first, when NoiseCoupling is set (requires ULC_USE_NOISE_CODING)
+#define ULC_USE_NOISE_COUPLING 1
+
+//! 0 == No long-term prediction
+//! 1 == Allow predicting blocks from the decoder's past output, when LongTermPrediction is set
+#define ULC_USE_LONG_TERM_PREDICTION 1
+
 //! 0 == No window switching
 //! 1 == Use window switching
 #define ULC_USE_WINDOW_SWITCHING 1
@@ -40,17 +72,65 @@
 //! Encoder state structure
 //! NOTE:
 //!  -The global state data must be set before calling ULC_EncoderState_Init()
-//!  -{RateHz, nChan, BlockSize, ModulationWindow} must not change after calling ULC_EncoderState_Init()
+//!  -{RateHz, nChan, BlockSize, ModulationWindow, BitReservoirSize, ChanGroupSize, ABRLookahead, LongTermPrediction} must not change after calling ULC_EncoderState_Init()
+//!  -ChanGroupSize splits the channels into groups of consecutive
+//!   channels (the last group may be smaller), each with its own
+//!   masking analysis and coefficient ranking. The coefficients to
+//!   code are then shared between groups in proportion to their
+//!   number of codeable coefficients. This is meant for streams with
+//!   many channels (eg. immersive beds), where ranking everything
+//!   jointly both misallocates bits between unrelated channels and
+//!   makes sorting the bottleneck; groups are analyzed independently
+//!   of each other, so the cost scales linearly with the channel count.
+//!   Channel pairs must not straddle groups, so the size must be
+//!   even (unless it covers all channels).
+//!  -WindowCtrlOverride allows forcing the window decision for the
+//!   block being passed in; this is used for loop encoding, where the
+//!   blocks at the loop end must repeat the window decisions made at
+//!   the loop start so that the lapping matches at the seam.
+//!  -LongTermPrediction changes the block syntax (the decoder must be
+//!   told; see ULC_DecodeBlock_Predict()), and the encoder then keeps
+//!   a decoder of its own so that it predicts from exactly what will
+//!   be decoded. This can't be used with ABRLookahead, as blocks are
+//!   analyzed before the blocks preceding them are coded.
 struct ULC_TransientData_t
 {
     float Sum, SumW;
 };
+struct ULC_EncoderAnalysis_t
+{
+    //! Analyzed block waiting in the lookahead queue
+    //! This holds everything that Block_Transform() produces for the
+    //! coding passes, so that a block can be swapped back into the
+    //! encoder state and coded later without redoing its analysis.
+    int    WindowCtrl;
+    int    MaxCoef;
+    float  BlockComplexity;
+    float *TransformBuffer;
+#if ULC_USE_NOISE_CODING
+    float *TransformNoise;
+#endif
+    int   *TransformIndex;
+    int   *ChanGroupNzCoef;
+    uint8_t *StereoLR;
+#if ULC_USE_PARAMETRIC_STEREO
+    uint8_t *StereoParametric;
+    uint8_t *StereoParams;
+#endif
+};
 struct ULC_EncoderState_t
 {
     //! Global state (do not change after initialization)
     int RateHz;     //! Playback rate (used for rate control)
     int nChan;      //! Channels in encoding scheme
     int BlockSize;  //! Transform block size
+    int BitReservoirSize; //! CBR decoder buffer size (in bits; 0 = No bit reservoir)
+    int StereoSwitching;  //! Switch channel pairs between L/R and M/S per block (0 = No, 1 = Yes)
+    int ParametricStereo; //! Code channel pairs parametrically where possible (0 = No, 1 = Yes)
+    int NoiseCoupling;    //! Let the second channel of a pair reuse the noise fill of the first (0 = No, 1 = Yes)
+    int ChanGroupSize;    //! Channels per psychoacoustic group (0 = All channels; set to nChan on initialization)
+    int ABRLookahead;     //! Blocks analyzed ahead by ULC_EncodeBlock_ABR_Lookahead() (0 = None)
+    int LongTermPrediction; //! Predict tonal blocks from past output (0 = No, 1 = Yes)
 
     //! Encoding state
     //! Buffer memory layout:
@@ -61,12 +141,40 @@ struct ULC_EncoderState_t
     //!   float TransformFwdLap[nChan*BlockSize]
     //!   float TransformTemp  [MAX(2,nChan)*BlockSize]
     //!   float FreqWeightTable[2*BlockSize-BlockSize/ULC_MAX_BLOCK_DECIMATION_FACTOR] <- With ULC_USE_PSYCHOACOUSTICS only
+    //!   float MaskingMemory  [nChanGroups*BlockSize/2] <- With ULC_USE_PSYCHOACOUSTICS && ULC_USE_TEMPORAL_MASKING only
     //!   int   TransformIndex [nChan*BlockSize]
+    //!   char  ABRQueueData   [] <- Buffers of each ABRQueue[] entry; with ABRLookahead only
+    //!   ULC_EncoderAnalysis_t ABRQueue[ABRLookahead+1] <- With ABRLookahead only
     //!   ULC_TransientData_t TransientBuffer[ULC_MAX_BLOCK_DECIMATION_FACTOR*2]
+    //!   float LTPTemp        [MAX(nChan*BlockSize, 2*BlockSize + ULC_LTP_HISTORY_SIZE*3/2)] <- With LongTermPrediction only
+    //!   int   LTPLag         [nChan]                      <- With LongTermPrediction only
+    //!   uint8_t LTPGain      [nChan * ULC_LTP_NBANDS]     <- With LongTermPrediction only
+    //!   int   ChanGroupNzCoef[nChanGroups]
+    //!   uint8_t StereoLR     [nChan/2]
+    //!   uint8_t StereoParametric[nChan/2] <- With ULC_USE_PARAMETRIC_STEREO only
+    //!   uint8_t StereoParams [nChan/2 * ULC_MAX_SUBBLOCKS*ULC_PARAMETRIC_STEREO_NBANDS] <- With ULC_USE_PARAMETRIC_STEREO only
     //! BufferData contains the original pointer returned by malloc()
+    //! StereoLR[] holds the coding mode for each channel pair in the
+    //! last coded block (0 = M/S, 1 = L/R); TransformFwdLap[] is kept
+    //! in this same domain. StereoParametric[] marks pairs (always in
+    //! M/S) that code only M, and StereoParams[] holds the quantized
+    //! parameters of their S channel (low nybble = Level, high = Spread).
+    //! LTPLag[] and LTPGain[] hold the long-term prediction of each
+    //! channel in the last coded block (Lag = 0 when not predicted; see
+    //! ULC_DecodeBlock_Predict()), and LTPDecoder decodes every coded
+    //! block into LTPTemp[] to keep the history of the prediction.
     int    WindowCtrl;        //! Window control parameter (for last coded block)
     int    NextWindowCtrl;    //! Window control parameter (for data in SampleBuffer)
+    int    WindowCtrlOverride; //! If >= 0, replaces the analyzed NextWindowCtrl on the next call (then reset to -1)
     float  BlockComplexity;   //! Coefficient distribution complexity (0 = Highly tonal, 1 = Highly noisy)
+    int    nChanGroups;       //! Number of channel groups
+    int    BitReservoirLevel; //! CBR decoder buffer fill level (in bits)
+    float  BitReservoirAvgComplexity;
+    int    ABRHead;           //! Oldest entry in ABRQueue[]
+    int    ABRnQueued;        //! Number of analyzed blocks in ABRQueue[]
+    double ABRDebt;           //! Bits spent beyond the nominal rate so far
+    double ABRComplexitySum;  //! Sum of the complexity of all blocks analyzed so far
+    double ABRnAnalyzed;      //! Number of blocks analyzed so far
     float  TransientFilter[3];
     void  *BufferData;
     float *SampleBuffer;
@@ -78,9 +186,25 @@ struct ULC_EncoderState_t
     float *TransformTemp;
 #if ULC_USE_PSYCHOACOUSTICS
     float *FreqWeightTable;
+#endif
+#if ULC_USE_PSYCHOACOUSTICS && ULC_USE_TEMPORAL_MASKING
+    float *MaskingMemory;
 #endif
     int   *TransformIndex;
     struct ULC_TransientData_t *TransientBuffer;
+    int   *ChanGroupNzCoef;   //! Codeable coefficients in each channel group (for last coded block)
+    uint8_t *StereoLR;
+#if ULC_USE_PARAMETRIC_STEREO
+    uint8_t *StereoParametric;
+    uint8_t *StereoParams;
+#endif
+#if ULC_USE_LONG_TERM_PREDICTION
+    float   *LTPTemp;
+    int     *LTPLag;
+    uint8_t *LTPGain;
+    struct ULC_DecoderState_t LTPDecoder;
+#endif
+    struct ULC_EncoderAnalysis_t *ABRQueue;
 };
 
 /**************************************/
@@ -110,6 +234,23 @@ void ULC_EncoderState_Destroy(struct ULC_EncoderState_t *State);
 //!   128.01kbps, 127.0kbps will always be chosen).
 //!   The rate is matched via binary search, and so this encoding
 //!   mode (and ABR, which uses the same mechanism) is the slowest.
+//!   With a non-zero BitReservoirSize, blocks may instead borrow or
+//!   bank bits (distributed by complexity, as in ABR mode), while
+//!   guaranteeing that a decoder with a buffer of BitReservoirSize
+//!   bits (filled at RateKbps, starting full) never underflows. No
+//!   block will be larger than BitReservoirSize bits.
+//!  -With StereoSwitching set, channel pairs may switch from M/S to
+//!   L/R coding per block (eg. for hard-panned sources). Streams with
+//!   L/R or parametric pairs need a decoder that knows the prefixes
+//!   marking these (baseline decoders only know M/S pairs).
+//!  -With NoiseCoupling set, the second channel of a pair may fill
+//!   its tail with the noise fill of the first channel, scaled by a
+//!   gain. As with StereoSwitching, this needs a decoder that knows
+//!   the syntax.
+//!  -With ParametricStereo set, channel pairs may be coded as M plus
+//!   a few parameters per band for S (in any mode), which saves most
+//!   of the bits spent on S at low rates, at the cost of a less exact
+//!   stereo image.
 //!  -ABR mode tries to balance the number of coefficients in each
 //!   block based on their complexity. It will achieve an average
 //!   bitrate very close to the target, but may be slightly off due
@@ -118,7 +259,8 @@ void ULC_EncoderState_Destroy(struct ULC_EncoderState_t *State);
 //!   average complexity, and then this is passed to the routine
 //!   alongside the desired RateKbps (note that AvgComplexity can be
 //!   passed arbitrarily without a pre-pass, but the target bitrate
-//!   might not be achieved).
+//!   might not be achieved). ULC_EncodeBlock_ABR_Lookahead() avoids
+//!   the need for this pre-pass.
 //!   This encoding mode is just as slow as CBR mode, as the algorithm
 //!   chooses a target bitrate for each block, which must go through
 //!   the CBR encoding routine for each block.
@@ -142,6 +284,56 @@ const void *ULC_EncodeBlock_CBR(struct ULC_EncoderState_t *State, const float *S
 const void *ULC_EncodeBlock_ABR(struct ULC_EncoderState_t *State, const float *SrcData, int *Size, float RateKbps, float AvgComplexity);
 const void *ULC_EncodeBlock_VBR(struct ULC_EncoderState_t *State, const float *SrcData, int *Size, float Quality);
 
+//! Encode block (ABR mode, with lookahead)
+//! Rather than coding each block in isolation, this analyzes the
+//! input ABRLookahead (which must be non-zero) blocks ahead of the block being coded, and
+//! plans that block's bits from the complexity of all the analyzed
+//! blocks, along with the bits spent so far. So long as the blocks
+//! coming up are still close to average, this keeps the running
+//! average rate close to RateKbps, and hits it closely at the end
+//! of the stream without an analysis pre-pass.
+//! NOTE:
+//!  -Blocks are coded ABRLookahead calls after their input is passed
+//!   in (so the first ABRLookahead calls return NULL, with a Size of
+//!   0). To flush the last blocks, call with SrcData == NULL another
+//!   ABRLookahead times; this codes the remaining blocks in order,
+//!   without analyzing anything new (and returns NULL once empty).
+//!  -AvgComplexity may be 0, in which case the average complexity is
+//!   estimated from all the blocks analyzed so far. If a previous
+//!   analysis pass is available, passing its AvgComplexity gives a
+//!   better bit distribution near the start of the stream.
+//!  -WindowCtrlOverride applies to the block being passed in, not to
+//!   the block being returned.
+//!  -This must not be mixed with the other ULC_EncodeBlock_*() routines
+//!   on the same encoder state.
+const void *ULC_EncodeBlock_ABR_Lookahead(struct ULC_EncoderState_t *State, const float *SrcData, int *Size, float RateKbps, float AvgComplexity);
+
+//! Encode block from MDCT coefficients
+//! This skips the forward transform, and only performs the analysis
+//! and rate control needed to code a block from its coefficients (eg.
+//! for mixing streams of the same BlockSize, by summing the output of
+//! ULC_DecodeBlock_Parse(), with channel pairs converted to M/S).
+//! NOTE:
+//!  -Coef[] has the same layout as the Coef[] of ULC_DecoderBlock_t,
+//!   and the block is coded with WindowCtrl. NextWindowCtrl must be
+//!   the window that the following block will be coded with, as the
+//!   overlap of this block's last [sub]block depends on it.
+//!  -The encoder's time-domain state is not updated, so in order to
+//!   continue with the normal ULC_EncodeBlock_*() routines, the input
+//!   data for the two preceding blocks must first be passed through
+//!   ULC_EncodeBlock_Prime() (with WindowCtrlOverride set to the
+//!   NextWindowCtrl of the last coefficient-coded block before the
+//!   second of these), so that lapping continues seamlessly.
+//!  -Returns the same as ULC_EncodeBlock_CBR() and ULC_EncodeBlock_VBR().
+const void *ULC_EncodeBlock_CBR_Coefs(struct ULC_EncoderState_t *State, const float *Coef, int WindowCtrl, int NextWindowCtrl, int *Size, float RateKbps);
+const void *ULC_EncodeBlock_VBR_Coefs(struct ULC_EncoderState_t *State, const float *Coef, int WindowCtrl, int NextWindowCtrl, int *Size, float Quality);
+
+//! Prime encoder with input data
+//! This runs the analysis of ULC_EncodeBlock_*() on SrcData, without
+//! coding anything. The encoder's state is left as if the block had
+//! been coded (except for the bit reservoir).
+void ULC_EncodeBlock_Prime(struct ULC_EncoderState_t *State, const float *SrcData);
+
 /**************************************/
 //! EOF
 /**************************************/
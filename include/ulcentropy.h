@@ -0,0 +1,87 @@
+/**************************************/
+//! ulc-codec: Ultra-Low-Complexity Audio Codec
+//! Copyright (C) 2022, Ruben Nunez (Aikku; aik AT aol DOT com DOT au)
+//! Refer to the project README file for license terms.
+/**************************************/
+#pragma once
+/**************************************/
+#include <stdint.h>
+/**************************************/
+
+//! Entropy coding layer
+//! This codes the nybble stream output by ULC_EncodeBlock_*()
+//! using static rANS, with a model built once per file. The
+//! block syntax itself is left untouched: blocks are entropy
+//! decoded back to their original nybbles and then passed to
+//! ULC_DecodeBlock() as usual.
+//! Each nybble is coded in a context formed by the previous
+//! nybble and a class of the nybble before that (control code,
+//! positive, or negative). The context is reset at the start
+//! of each block, so that blocks remain independent.
+
+//! Probability precision and number of contexts
+#define ULC_ENTROPY_PROB_BITS  12
+#define ULC_ENTROPY_PROB_SCALE (1 << ULC_ENTROPY_PROB_BITS)
+#define ULC_ENTROPY_NCLASSES   6
+#define ULC_ENTROPY_NCONTEXTS  (16 * ULC_ENTROPY_NCLASSES)
+
+/**************************************/
+
+//! Entropy model
+//! Freq[] contains the normalized frequency of each symbol in
+//! each context (summing to ULC_ENTROPY_PROB_SCALE, or to 0 for
+//! contexts that never occur), and Cum[] contains the cumulative
+//! frequency at the start of each symbol.
+struct ULC_EntropyModel_t
+{
+    uint16_t Freq[ULC_ENTROPY_NCONTEXTS][16];
+    uint16_t Cum [ULC_ENTROPY_NCONTEXTS][16];
+};
+
+/**************************************/
+
+//! Accumulate symbol statistics for a block
+//! Counts[] must have ULC_ENTROPY_NCONTEXTS*16 entries, and be
+//! cleared before the first call.
+void ULC_EntropyModel_Count(uint32_t *Counts, const uint8_t *Block, int nBytes);
+
+//! Build model from accumulated statistics
+void ULC_EntropyModel_Build(struct ULC_EntropyModel_t *Model, const uint32_t *Counts);
+
+//! Get the maximum size of a serialized model
+#define ULC_ENTROPY_MODEL_MAX_SIZE (ULC_ENTROPY_NCONTEXTS * (2 + 16*2))
+
+//! Serialize model
+//! Returns the number of bytes written.
+int ULC_EntropyModel_Write(const struct ULC_EntropyModel_t *Model, uint8_t *Dst);
+
+//! Deserialize model
+//! On success, returns the number of bytes read.
+//! On failure, returns a negative value.
+int ULC_EntropyModel_Read(struct ULC_EntropyModel_t *Model, const uint8_t *Src, int SrcSize);
+
+/**************************************/
+
+//! Get the maximum size of an entropy-coded block
+//! NOTE: Each nybble can take at most ULC_ENTROPY_PROB_BITS bits
+//! to code, plus the rANS state, the block size prefix, and some
+//! slack for renormalization rounding.
+#define ULC_ENTROPY_MAX_ENCODED_SIZE(nBytes) (2*(nBytes)*ULC_ENTROPY_PROB_BITS/8 + 4 + 5 + 8)
+
+//! Encode block
+//! Dst must have space for ULC_ENTROPY_MAX_ENCODED_SIZE(nBytes).
+//! Returns the number of bytes written.
+//! NOTE: All symbols in the block must have been counted in the
+//! statistics used to build Model.
+int ULC_Entropy_EncodeBlock(const struct ULC_EntropyModel_t *Model, uint8_t *Dst, const uint8_t *Src, int nBytes);
+
+//! Decode block
+//! The original block is written to Dst (up to DstSize bytes),
+//! and its size is stored to nBytes.
+//! On success, returns the number of bytes read from Src.
+//! On failure (corrupt data), returns 0.
+int ULC_Entropy_DecodeBlock(const struct ULC_EntropyModel_t *Model, uint8_t *Dst, int DstSize, int *nBytes, const uint8_t *Src, int SrcSize);
+
+/**************************************/
+//! EOF
+/**************************************/
@@ -0,0 +1,108 @@
+/**************************************/
+//! ulc-codec: Ultra-Low-Complexity Audio Codec
+//! Copyright (C) 2022, Ruben Nunez (Aikku; aik AT aol DOT com DOT au)
+//! Refer to the project README file for license terms.
+/**************************************/
+#pragma once
+/**************************************/
+#include <stdint.h>
+/**************************************/
+
+//! Number of filter phases in the polyphase table
+//! Coefficients between phases are linearly interpolated.
+#define ULC_RESAMPLER_PHASES_LOG2 8
+#define ULC_RESAMPLER_PHASES (1 << ULC_RESAMPLER_PHASES_LOG2)
+
+//! Number of filter taps when upsampling
+//! When downsampling, this is scaled by the rate ratio (so
+//! that the filter's width stays constant in output samples
+//! and provides the needed anti-aliasing), up to a maximum
+//! of ULC_RESAMPLER_MAX_TAPS.
+#define ULC_RESAMPLER_BASE_TAPS 16
+#define ULC_RESAMPLER_MAX_TAPS  64
+
+//! Processing flags
+//!  MIDSIDE:
+//!   Channel pairs {0,1}, {2,3}, etc. are M/S-coded (as output
+//!   by the decoder's IMDCT stage), and are converted to L/R
+//!   as part of filtering (L = M+S, R = M-S).
+//!  OUTPUT_PCM16:
+//!   Output int16_t samples (saturated), rather than float.
+#define ULC_RESAMPLER_MIDSIDE      (1 << 0)
+#define ULC_RESAMPLER_OUTPUT_PCM16 (1 << 1)
+
+/**************************************/
+
+//! Resampler state structure
+//! NOTE:
+//!  -The global state data must be set before calling ULC_ResamplerState_Init()
+//!  -{nChan, RateHz, OutputRateHz, MaxInputSize} must not change after calling ULC_ResamplerState_Init()
+struct ULC_ResamplerState_t
+{
+    //! Global state (do not change after initialization)
+    int nChan;        //! Number of channels
+    int RateHz;       //! Input rate
+    int OutputRateHz; //! Output rate
+    int MaxInputSize; //! Largest number of samples (per channel) passed per call
+
+    //! Resampling state
+    //! Buffer memory layout:
+    //!  Data:
+    //!   char  _Padding[];
+    //!   float FilterTable[ULC_RESAMPLER_PHASES * nTaps * 2]
+    //!   float InputBuffer[nChan * InputStride]
+    //! BufferData contains the pointer returned by malloc()
+    //! FilterTable[] stores, for each phase, the coefficients
+    //! followed by their delta to the next phase's coefficients.
+    //! Each channel in InputBuffer[] contains HistorySize samples
+    //! of history (of which only the last nTaps-1 are used),
+    //! followed by the new input data. HistorySize is rounded so
+    //! that the new input data is aligned to BUFFER_ALIGNMENT.
+    int      nTaps;
+    int      HistorySize;
+    int      InputStride;
+    int      Pos;      //! Position of the next filter window (relative to the window base)
+    uint32_t PosFrac;  //! Fractional position (.32fxp)
+    int      StepInt;  //! Input samples per output sample (integer part)
+    uint32_t StepFrac; //! Input samples per output sample (.32fxp fractional part)
+    void    *BufferData;
+    float   *FilterTable;
+    float   *InputBuffer;
+};
+
+/**************************************/
+
+//! Initialize resampler state
+//! On success, returns a non-negative value
+//! On failure, returns a negative value
+int ULC_ResamplerState_Init(struct ULC_ResamplerState_t *State);
+
+//! Destroy resampler state
+void ULC_ResamplerState_Destroy(struct ULC_ResamplerState_t *State);
+
+/**************************************/
+
+//! Get the maximum number of output samples (per channel) for nIn input samples
+int ULC_Resampler_MaxOutputSize(const struct ULC_ResamplerState_t *State, int nIn);
+
+//! Get the input buffer for a channel
+//! New data (up to MaxInputSize samples) should be written
+//! here before calling ULC_Resampler_Process(). This allows
+//! producers (such as the decoder) to write their output in
+//! place, avoiding an extra copy.
+//! NOTE: The returned pointer is aligned to BUFFER_ALIGNMENT.
+float *ULC_Resampler_GetInputBuffer(const struct ULC_ResamplerState_t *State, int Chan);
+
+//! Process nIn samples from the input buffers
+//! Output data will be interleaved.
+//! Returns the number of samples (per channel) written to Dst.
+int ULC_Resampler_Process(struct ULC_ResamplerState_t *State, void *Dst, int nIn, int Flags);
+
+//! Process nIn samples from interleaved input data
+//! This copies Src into the input buffers and then calls
+//! ULC_Resampler_Process().
+int ULC_Resampler_ProcessInterleaved(struct ULC_ResamplerState_t *State, void *Dst, const float *Src, int nIn, int Flags);
+
+/**************************************/
+//! EOF
+/**************************************/
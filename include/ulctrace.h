@@ -0,0 +1,68 @@
+/**************************************/
+//! ulc-codec: Ultra-Low-Complexity Audio Codec
+//! Copyright (C) 2022, Ruben Nunez (Aikku; aik AT aol DOT com DOT au)
+//! Refer to the project README file for license terms.
+/**************************************/
+#pragma once
+/**************************************/
+#include <stdint.h>
+/**************************************/
+
+//! Hot-path tracer
+//! When built with ULC_TRACING=1 (see the Makefile), the encoder and
+//! decoder time each stage of their block processing and record it
+//! as an event in a ring buffer owned by the calling thread, which
+//! can later be exported as Chrome trace JSON (chrome://tracing,
+//! Perfetto). Events are nested by time, so that eg. each probe of
+//! a CBR rate search appears inside the block it was coded for.
+//! Recording an event never blocks nor allocates (except for the
+//! first event on each thread); once a ring is full, the oldest
+//! events are overwritten.
+//! When ULC_TRACING=0, the tracing macros expand to nothing.
+#ifndef ULC_TRACING
+# define ULC_TRACING 0
+#endif
+
+//! Number of events kept per thread (must be a power of 2)
+#define ULC_TRACE_RING_SIZE 65536
+
+/**************************************/
+#if ULC_TRACING
+/**************************************/
+
+//! Get a timestamp (TSC ticks where available, nanoseconds otherwise)
+#if defined(__x86_64__) || defined(__i386__)
+# include <x86intrin.h>
+static inline uint64_t ULC_Trace_Now(void) { return __rdtsc(); }
+#else
+uint64_t ULC_Trace_Now(void);
+#endif
+
+//! Record an event
+//! Name and ArgName must point to static strings (ArgName may be
+//! NULL if there is no argument).
+void ULC_Trace_Event(const char *Name, const char *ArgName, int Arg, uint64_t Start, uint64_t End);
+
+//! Time the code between ULC_TRACE_BEGIN() and ULC_TRACE_END()
+#define ULC_TRACE_BEGIN(Var) uint64_t Var = ULC_Trace_Now()
+#define ULC_TRACE_END(Var, Name, ArgName, Arg) ULC_Trace_Event(Name, ArgName, Arg, Var, ULC_Trace_Now())
+
+/**************************************/
+#else
+/**************************************/
+
+#define ULC_TRACE_BEGIN(Var)
+#define ULC_TRACE_END(Var, Name, ArgName, Arg)
+
+/**************************************/
+#endif
+/**************************************/
+
+//! Write the events of all threads to a Chrome trace JSON file
+//! This must not be called while other threads are still recording.
+//! Returns 1 on success, 0 if tracing is disabled, or -1 on failure.
+int ULC_Trace_Dump(const char *Filename);
+
+/**************************************/
+//! EOF
+/**************************************/
@@ -79,6 +79,19 @@ const char *WAV_ErrorCodeToString(int e);
 //!  -Only PCM8, PCM16, PCM24, PCM32, and FLOAT32 are supported formats.
 int WAV_OpenR(struct WAV_State_t *WavState, const char *Filename);
 
+//! WAV_OpenRFromFile(WavState, File)
+//! Description: Open WAV file for reading, from an already-opened file.
+//! Arguments:
+//!   WavState: Structure to store internal state in.
+//!   File:     File to read from (positioned at the RIFF header).
+//! Returns:
+//!   As WAV_OpenR().
+//! Notes:
+//!  -On success, the file is owned by WavState (and closed by WAV_Close()).
+//!   On failure, the file is left open.
+//!  -This can be used to parse a file held in memory (eg. with fmemopen()).
+int WAV_OpenRFromFile(struct WAV_State_t *WavState, FILE *File);
+
 //! WAV_ReadAsFloat(WavState, Dst, nSmpPoints)
 //! Description: Read samples from file into float-type buffer.
 //! Arguments:
@@ -6,10 +6,14 @@
 #include <math.h>
 #include <stdint.h>
 #include <stdlib.h>
+#if defined(__F16C__)
+# include <immintrin.h>
+#endif
 /**************************************/
 #include "fourier.h"
 #include "ulcdecoder.h"
 #include "ulchelper.h"
+#include "ulctrace.h"
 /**************************************/
 #define BUFFER_ALIGNMENT 64u //! Always align memory to 64-byte boundaries (preparation for AVX-512)
 /**************************************/
@@ -22,39 +26,136 @@
 
 /**************************************/
 
+//! Get the layout of the scratch buffers
+//! NOTE: Offsets are relative to an aligned base.
+struct ULC_DecoderScratchLayout_t
+{
+    int TransformBuffer;
+    int TransformTemp;
+    int TransformNoise;
+    int LTPBuffer;
+    int Size;
+};
+static void ULC_DecoderState_GetScratchLayout(const struct ULC_DecoderState_t *State, struct ULC_DecoderScratchLayout_t *Layout)
+{
+    int nChan     = State->nChan;
+    int BlockSize = State->BlockSize;
+    int LTP       = (State->LongTermPrediction != 0);
+    int Size = 0;
+#define CREATE_BUFFER(Name, Sz) Layout->Name = Size; Size += Sz
+    CREATE_BUFFER(TransformBuffer, sizeof(float) * (       BlockSize   ));
+    CREATE_BUFFER(TransformTemp,   sizeof(float) * (nChan* BlockSize   ) * 2);
+    CREATE_BUFFER(TransformNoise,  sizeof(float) * (       BlockSize   ));
+    CREATE_BUFFER(LTPBuffer,       sizeof(float) * (       BlockSize   ) * 2 * LTP);
+#undef CREATE_BUFFER
+    Layout->Size = Size;
+}
+
+/**************************************/
+
+//! Get the size of the scratch area
+int ULC_DecoderState_ScratchSize(const struct ULC_DecoderState_t *State)
+{
+    struct ULC_DecoderScratchLayout_t Scratch;
+    if(State->nChan     < MIN_CHANS || State->nChan     > MAX_CHANS) return -1;
+    if(State->BlockSize < MIN_BANDS || State->BlockSize > MAX_BANDS) return -1;
+    ULC_DecoderState_GetScratchLayout(State, &Scratch);
+    return BUFFER_ALIGNMENT-1 + Scratch.Size;
+}
+
+/**************************************/
+
 //! Initialize decoder state
 int ULC_DecoderState_Init(struct ULC_DecoderState_t *State)
 {
-    //! Clear anything that is needed for EncoderState_Destroy()
+    //! Clear anything that is needed for DecoderState_Destroy()
     State->BufferData  = NULL;
+    State->Resampler.BufferData = NULL;
 
     //! Verify parameters
     int nChan     = State->nChan;
     int BlockSize = State->BlockSize;
+    int LapF16    = (State->Flags & ULC_DECODER_FLAG_F16_LAP) != 0;
+    int LTP       = (State->LongTermPrediction != 0);
     if(nChan     < MIN_CHANS || nChan     > MAX_CHANS) return -1;
     if(BlockSize < MIN_BANDS || BlockSize > MAX_BANDS) return -1;
     if((BlockSize & (-BlockSize)) != BlockSize)        return -1;
 
     //! Get buffer offsets and allocation size
-    int AllocSize = 0;
+    //! NOTE: Without a shared scratch area, the scratch buffers are
+    //! placed at the start of our own allocation.
+    struct ULC_DecoderScratchLayout_t Scratch;
+    ULC_DecoderState_GetScratchLayout(State, &Scratch);
+    int AllocSize = State->ScratchBuffer ? 0 : Scratch.Size;
 #define CREATE_BUFFER(Name, Sz) int Name##_Offs = AllocSize; AllocSize += Sz
-    CREATE_BUFFER(TransformBuffer, sizeof(float) * (       BlockSize   ));
-    CREATE_BUFFER(TransformTemp,   sizeof(float) * (nChan* BlockSize   ) * 2);
-    CREATE_BUFFER(TransformInvLap, sizeof(float) * (nChan*(BlockSize/2)));
+    CREATE_BUFFER(TransformInvLap, (LapF16 ? sizeof(uint16_t) : sizeof(float)) * (nChan*(BlockSize/2)));
+    CREATE_BUFFER(LTPHistory,      sizeof(float) * (nChan*ULC_LTP_HISTORY_SIZE) * LTP);
+    CREATE_BUFFER(LTPLag,          sizeof(int)   * (nChan              ) * LTP);
+    CREATE_BUFFER(LTPGain,         sizeof(uint8_t) * (nChan*ULC_LTP_NBANDS) * LTP);
+    CREATE_BUFFER(StereoLR,        sizeof(uint8_t) * (nChan/2));
+    CREATE_BUFFER(StereoMode,      sizeof(uint8_t) * (nChan/2));
 #undef CREATE_BUFFER
 
+    //! Create resampler
+    //! NOTE: Half-rate synthesis outputs BlockSize/2 samples per block,
+    //! at RateHz/2, so the resampler starts from there.
+    int RateShift = (State->Flags & ULC_DECODER_FLAG_HALF_RATE) ? 1 : 0;
+    if(State->OutputRateHz != 0 && State->OutputRateHz != (State->RateHz >> RateShift))
+    {
+        State->Resampler.nChan        = nChan;
+        State->Resampler.RateHz       = State->RateHz >> RateShift;
+        State->Resampler.OutputRateHz = State->OutputRateHz;
+        State->Resampler.MaxInputSize = BlockSize >> RateShift;
+        if(ULC_ResamplerState_Init(&State->Resampler) < 0) return -1;
+        State->MaxOutputSize = ULC_Resampler_MaxOutputSize(&State->Resampler, BlockSize >> RateShift);
+    }
+    else
+    {
+        State->Resampler.BufferData = NULL;
+        State->MaxOutputSize = BlockSize >> RateShift;
+    }
+
     //! Allocate buffer space
     char *Buf = State->BufferData = malloc(BUFFER_ALIGNMENT-1 + AllocSize);
-    if(!Buf) return -1;
+    if(!Buf)
+    {
+        ULC_ResamplerState_Destroy(&State->Resampler);
+        return -1;
+    }
 
     //! Initialize state
     int i;
     Buf += (-(uintptr_t)Buf) & (BUFFER_ALIGNMENT-1);
+    char *ScratchBuf = State->ScratchBuffer ? (char*)State->ScratchBuffer : Buf;
+    ScratchBuf += (-(uintptr_t)ScratchBuf) & (BUFFER_ALIGNMENT-1);
     State->LastSubBlockSize = 0;
-    State->TransformBuffer = (float*)(Buf + TransformBuffer_Offs);
-    State->TransformTemp   = (float*)(Buf + TransformTemp_Offs);
-    State->TransformInvLap = (float*)(Buf + TransformInvLap_Offs);
-    for(i=0; i<nChan*(BlockSize/2); i++) State->TransformInvLap[i] = 0.0f;
+    State->nOutputSamples   = 0;
+    State->NoiseSeed        = 1234567;
+    State->TransformBuffer = (float*)(ScratchBuf + Scratch.TransformBuffer);
+    State->TransformTemp   = (float*)(ScratchBuf + Scratch.TransformTemp);
+    State->TransformInvLap    = LapF16 ? NULL : (float*)(Buf + TransformInvLap_Offs);
+    State->TransformInvLapF16 = LapF16 ? (uint16_t*)(Buf + TransformInvLap_Offs) : NULL;
+    State->TransformNoise  = (float*)(ScratchBuf + Scratch.TransformNoise);
+    State->LTPHistory      = LTP ? (float*)(Buf + LTPHistory_Offs) : NULL;
+    State->LTPBuffer       = LTP ? (float*)(ScratchBuf + Scratch.LTPBuffer) : NULL;
+    State->StereoLR        = (uint8_t*)(Buf + StereoLR_Offs);
+    State->Block.WindowCtrl = 0;
+    State->Block.BufferData = NULL;
+    State->Block.Coef       = State->TransformBuffer;
+    State->Block.StereoMode = (uint8_t*)(Buf + StereoMode_Offs);
+    State->Block.LTPLag     = LTP ? (int    *)(Buf + LTPLag_Offs)  : NULL;
+    State->Block.LTPGain    = LTP ? (uint8_t*)(Buf + LTPGain_Offs) : NULL;
+    if(LapF16) for(i=0; i<nChan*(BlockSize/2); i++) State->TransformInvLapF16[i] = 0; //! 0x0000 = +0.0
+    else       for(i=0; i<nChan*(BlockSize/2); i++) State->TransformInvLap   [i] = 0.0f;
+    if(LTP)    for(i=0; i<nChan*ULC_LTP_HISTORY_SIZE; i++) State->LTPHistory[i] = 0.0f;
+    for(i=0; i<nChan/2;             i++) State->StereoLR       [i] = 0;
+
+    //! Select the fastest transform algorithm for each subblock size
+    //! NOTE: This is only measured once per process for each size (or
+    //! never, if plans were loaded from wisdom beforehand). Failure is
+    //! not fatal, as unplanned sizes simply use the default algorithm.
+    //! NOTE: The smallest possible subblock is BlockSize/8.
+    Fourier_Plan_Measure((BlockSize / 8) >> RateShift, BlockSize >> RateShift);
 
     //! Success
     return 1;
@@ -67,6 +168,45 @@ void ULC_DecoderState_Destroy(struct ULC_DecoderState_t *State)
 {
     //! Free buffer space
     free(State->BufferData);
+    ULC_ResamplerState_Destroy(&State->Resampler);
+}
+
+/**************************************/
+
+//! Initialize parsed block
+int ULC_DecoderBlock_Init(const struct ULC_DecoderState_t *State, struct ULC_DecoderBlock_t *Block)
+{
+    int nChan     = State->nChan;
+    int BlockSize = State->BlockSize;
+    int LTP       = (State->LongTermPrediction != 0);
+
+    //! Get buffer offsets and allocation size
+    int AllocSize = 0;
+#define CREATE_BUFFER(Name, Sz) int Name##_Offs = AllocSize; AllocSize += Sz
+    CREATE_BUFFER(Coef,       sizeof(float)   * (nChan*BlockSize));
+    CREATE_BUFFER(LTPLag,     sizeof(int)     * (nChan) * LTP);
+    CREATE_BUFFER(LTPGain,    sizeof(uint8_t) * (nChan*ULC_LTP_NBANDS) * LTP);
+    CREATE_BUFFER(StereoMode, sizeof(uint8_t) * (nChan/2));
+#undef CREATE_BUFFER
+
+    //! Allocate buffer space
+    char *Buf = Block->BufferData = malloc(BUFFER_ALIGNMENT-1 + AllocSize);
+    if(!Buf) return -1;
+
+    //! Initialize block
+    Buf += (-(uintptr_t)Buf) & (BUFFER_ALIGNMENT-1);
+    Block->WindowCtrl = 0;
+    Block->Coef       = (float  *)(Buf + Coef_Offs);
+    Block->StereoMode = (uint8_t*)(Buf + StereoMode_Offs);
+    Block->LTPLag     = LTP ? (int    *)(Buf + LTPLag_Offs)  : NULL;
+    Block->LTPGain    = LTP ? (uint8_t*)(Buf + LTPGain_Offs) : NULL;
+    return 1;
+}
+
+//! Destroy parsed block
+void ULC_DecoderBlock_Destroy(struct ULC_DecoderBlock_t *Block)
+{
+    free(Block->BufferData);
 }
 
 /**************************************/
@@ -74,13 +214,17 @@ void ULC_DecoderState_Destroy(struct ULC_DecoderState_t *State)
 //! Decode block
 #define ESCAPE_SEQUENCE_STOP           (-1)
 #define ESCAPE_SEQUENCE_STOP_NOISEFILL (-2)
-static inline uint32_t Block_Decode_UpdateRandomSeed(void)
+#define ESCAPE_SEQUENCE_STOP_COUPLED   (-3)
+#define NOISE_TAIL_NONE   0 //! Not part of a channel pair
+#define NOISE_TAIL_RECORD 1 //! First channel of a pair (store noise-fill tail)
+#define NOISE_TAIL_COUPLE 2 //! Second channel of a pair (may reuse noise-fill tail)
+static inline uint32_t Block_Decode_UpdateRandomSeed(uint32_t *Seed)
 {
-    static uint32_t Seed = 1234567;
-    Seed ^= Seed << 13; //! Xorshift
-    Seed ^= Seed >> 17;
-    Seed ^= Seed <<  5;
-    return Seed;
+    uint32_t x = *Seed;
+    x ^= x << 13; //! Xorshift
+    x ^= x >> 17;
+    x ^= x <<  5;
+    return *Seed = x;
 }
 static inline uint8_t Block_Decode_ReadNybble(const uint8_t **Src, int *Size)
 {
@@ -95,18 +239,98 @@ static inline int Block_Decode_ReadQuantizer(const uint8_t **Src, int *Size)
     int           qi  = Block_Decode_ReadNybble(Src, Size); //! Fh,0h..Dh:      Quantizer change
     if(qi == 0xF) return ESCAPE_SEQUENCE_STOP_NOISEFILL;    //! Fh,Fh,Zh,Yh,Xh: Noise fill (to end; exp-decay)
     if(qi == 0xE) qi += Block_Decode_ReadNybble(Src, Size); //! Fh,Eh,0h..Ch:   Quantizer change (extended precision)
+    if(qi == 0xE + 0xE) return ESCAPE_SEQUENCE_STOP_COUPLED;//! Fh,Eh,Eh,Xh:    Coupled noise fill (to end)
     if(qi == 0xE + 0xF) return ESCAPE_SEQUENCE_STOP;        //! Fh,Eh,Fh:       Zeros fill (to end)
     return qi;
 }
+#define STEREO_MODE_MS         0
+#define STEREO_MODE_LR         1
+#define STEREO_MODE_PARAMETRIC 2
+static inline int Block_Decode_ReadStereoMode(const uint8_t **Src, int *Size)
+{
+    //! Eh,Dh:       L/R coding for this channel pair
+    //! Eh,Dh,Eh,Dh: Parametric coding for this channel pair
+    //! NOTE: These are only valid in place of the first quantizer of
+    //! the first channel of a pair, so if they aren't there, rewind.
+    //! Eh,Dh is never a valid quantizer, so the second one can't be
+    //! mistaken for the start of the coefficients.
+    int Mode;
+    for(Mode=STEREO_MODE_MS; Mode<STEREO_MODE_PARAMETRIC; Mode++)
+    {
+        const uint8_t *OldSrc  = *Src;
+        int            OldSize = *Size;
+        if(Block_Decode_ReadNybble(Src, Size) != 0xE || Block_Decode_ReadNybble(Src, Size) != 0xD)
+        {
+            *Src  = OldSrc;
+            *Size = OldSize;
+            break;
+        }
+    }
+    return Mode;
+}
+static inline int Block_Decode_ReadLTP(const uint8_t **Src, int *Size, int *Lag, uint8_t *Gain)
+{
+    //! Xh[,Zh,Yh,Xh,Gh[Xh]]: Long-term prediction (see ULC_LTPBandEnd())
+    //! Returns the number of bands, or -1 if this is corrupt.
+    int Band, nBands = Block_Decode_ReadNybble(Src, Size);
+    if(nBands > ULC_LTP_NBANDS) return -1;
+    *Lag = 0;
+    if(nBands)
+    {
+        int v;
+        v  = Block_Decode_ReadNybble(Src, Size);
+        v  = Block_Decode_ReadNybble(Src, Size) | (v<<4);
+        v  = Block_Decode_ReadNybble(Src, Size) | (v<<4);
+        *Lag = v + ULC_LTP_MIN_LAG;
+    }
+    for(Band=0; Band<nBands;         Band++) Gain[Band] = Block_Decode_ReadNybble(Src, Size);
+    for(      ; Band<ULC_LTP_NBANDS; Band++) Gain[Band] = 0;
+    return nBands;
+}
 static inline float Block_Decode_ExpandQuantizer(int qi)
 {
     return 0x1.0p-31f * ((1u<<(31-5)) >> qi); //! 1 / (2^5 * 2^qi)
 }
-static inline int Block_Decode_DecodeSubBlockCoefs(float *CoefDst, int N, const uint8_t **Src, int *Size)
+static inline void Block_Decode_CoupledNoiseFill(float *CoefDst, int Pos, int N, const float *Noise, int NoiseStart, const uint8_t **Src, int *Size)
+{
+    //! [Fh,]Eh,Eh,Xh: Coupled noise fill (to end)
+    //! This reuses the noise-fill tail of the first channel of the
+    //! pair, scaled by a signed gain of (Xh+0.5)/8. Anything before
+    //! the start of that tail is filled with zeros.
+    int   v = Block_Decode_ReadNybble(Src, Size);
+    float g = (((v^0x8) - 0x8) + 0.5f) * (1.0f/8);
+    for(; N && Pos < NoiseStart; N--, Pos++) *CoefDst++ = 0.0f;
+    for(; N;                     N--, Pos++) *CoefDst++ = g * Noise[Pos];
+}
+static inline void Block_Decode_ParametricStereo(float *CoefDst, const float *CoefM, int N, const uint8_t **Src, int *Size, uint32_t *Seed)
+{
+    //! Xh,Yh[ULC_PARAMETRIC_STEREO_NBANDS]: Parametric S channel
+    //! S is rebuilt from the decoded M coefficients of the [sub]block
+    //! as S = (Level + Spread*Sign)*M, with a random Sign for each
+    //! line; the random part decorrelates S from M, with the same
+    //! spectral envelope as M, for no extra cost.
+    int n, Band;
+    for(n=0,Band=0; Band<ULC_PARAMETRIC_STEREO_NBANDS; Band++)
+    {
+        int   Level  = Block_Decode_ReadNybble(Src, Size);
+        int   Spread = Block_Decode_ReadNybble(Src, Size);
+        float a = ((Level^0x8) - 0x8) * (1.0f/7);
+        float b = Spread * (1.0f/8);
+        int BandEnd = ULC_ParametricStereoBandEnd(Band, N);
+        for(; n<BandEnd; n++)
+        {
+            float g = (Block_Decode_UpdateRandomSeed(Seed) & 0x80000000) ? (a-b) : (a+b);
+            CoefDst[n] = g * CoefM[n];
+        }
+    }
+}
+static inline int Block_Decode_DecodeSubBlockCoefs(float *CoefDst, int N, const uint8_t **Src, int *Size, float *Noise, int *NoiseStart, int NoiseMode, int NoiseFill, uint32_t *Seed)
 {
     int32_t n, v;
+    float *CoefBase = CoefDst;
 
     //! Check first quantizer for Stop code
+    if(NoiseMode == NOISE_TAIL_RECORD) *NoiseStart = N;
     v = Block_Decode_ReadQuantizer(Src, Size);
     if(v == ESCAPE_SEQUENCE_STOP)
     {
@@ -115,6 +339,12 @@ static inline int Block_Decode_DecodeSubBlockCoefs(float *CoefDst, int N, const
         while(--N);
         return 1;
     }
+    if(v == ESCAPE_SEQUENCE_STOP_COUPLED)
+    {
+        if(NoiseMode != NOISE_TAIL_COUPLE) return 0;
+        Block_Decode_CoupledNoiseFill(CoefDst, 0, N, Noise, *NoiseStart, Src, Size);
+        return 1;
+    }
 
     //! Unpack the [sub]block's coefficients
     float Quant = Block_Decode_ExpandQuantizer(v);
@@ -169,11 +399,17 @@ static inline int Block_Decode_DecodeSubBlockCoefs(float *CoefDst, int N, const
             n += 16;
             if(n > N) return 0;
             N -= n;
+            if(!NoiseFill)
+            {
+                do *CoefDst++ = 0.0f;
+                while(--n);
+            }
+            else
             {
                 float p = (v*v) * Quant * (1.0f/4);
                 do
                 {
-                    if(Block_Decode_UpdateRandomSeed() & 0x80000000) p = -p;
+                    if(Block_Decode_UpdateRandomSeed(Seed) & 0x80000000) p = -p;
                     *CoefDst++ = p;
                 }
                 while(--n);
@@ -199,17 +435,53 @@ static inline int Block_Decode_DecodeSubBlockCoefs(float *CoefDst, int N, const
             n = Block_Decode_ReadNybble(Src, Size) | (n<<4);
             float p = (v*v) * Quant * (1.0f/16);
             float r = 1.0f + (n*n)*-0x1.0p-19f;
-            do
+            if(!NoiseFill)
             {
-                if(Block_Decode_UpdateRandomSeed() & 0x80000000) p = -p;
-                *CoefDst++ = p, p *= r;
+                //! NOTE: The tail is still recorded (as zeros), so
+                //! that coupled noise fill also gives zeros.
+                n = CoefDst - CoefBase;
+                if(NoiseMode == NOISE_TAIL_RECORD) *NoiseStart = n, Noise += n;
+                do
+                {
+                    if(NoiseMode == NOISE_TAIL_RECORD) *Noise++ = 0.0f;
+                    *CoefDst++ = 0.0f;
+                }
+                while(--N);
             }
-            while(--N);
+            else if(NoiseMode == NOISE_TAIL_RECORD)
+            {
+                //! Keep a copy of the tail for the second channel
+                n = CoefDst - CoefBase;
+                *NoiseStart = n;
+                Noise += n;
+                do
+                {
+                    if(Block_Decode_UpdateRandomSeed(Seed) & 0x80000000) p = -p;
+                    *CoefDst++ = *Noise++ = p, p *= r;
+                }
+                while(--N);
+            }
+            else
+            {
+                do
+                {
+                    if(Block_Decode_UpdateRandomSeed(Seed) & 0x80000000) p = -p;
+                    *CoefDst++ = p, p *= r;
+                }
+                while(--N);
+            }
+            break;
+        }
+
+        //! Fh,Eh,Eh,Xh: Coupled noise fill (to end)
+        if(v == ESCAPE_SEQUENCE_STOP_COUPLED)
+        {
+            if(NoiseMode != NOISE_TAIL_COUPLE) return 0;
+            Block_Decode_CoupledNoiseFill(CoefDst, CoefDst - CoefBase, N, Noise, *NoiseStart, Src, Size);
             break;
         }
 
         //! Fh,Eh,Dh: Unused
-        //! Fh,Eh,Eh: Unused
         //! Fh,Eh,Fh: Zeros fill (to end)
         if(v == ESCAPE_SEQUENCE_STOP)
         {
@@ -220,123 +492,938 @@ static inline int Block_Decode_DecodeSubBlockCoefs(float *CoefDst, int N, const
     }
     return 1;
 }
-int ULC_DecodeBlock(struct ULC_DecoderState_t *State, float *DstData, const void *_SrcBuffer)
+static inline int Block_Decode_ReadWindowCtrl(const uint8_t **Src, int *Size)
+{
+    int WindowCtrl = Block_Decode_ReadNybble(Src, Size);
+    if(WindowCtrl & 0x8) WindowCtrl |= Block_Decode_ReadNybble(Src, Size) << 4;
+    else                 WindowCtrl |= 1 << 4;
+    return WindowCtrl;
+}
+//! Parse one channel of a block into Coef[] (BlockSize coefficients)
+//! Returns 0 if the block is corrupt.
+static int Block_Decode_ParseChannel(struct ULC_DecoderState_t *State, struct ULC_DecoderBlock_t *Block, int Chan, float *Coef, const float *CoefM, const uint8_t **Src, int *Size, int *NoiseTailStart)
+{
+    int nChan      = State->nChan;
+    int BlockSize  = State->BlockSize;
+    int WindowCtrl = Block->WindowCtrl;
+    int NoiseFill  = !(State->Flags & ULC_DECODER_FLAG_NO_NOISE_FILL);
+
+    //! Read the stereo mode at the start of each channel pair
+    int StereoMode = STEREO_MODE_MS;
+    if((Chan&1) == 0 && Chan+1 < nChan)
+    {
+        StereoMode = Block_Decode_ReadStereoMode(Src, Size);
+        Block->StereoMode[Chan/2] = StereoMode;
+    }
+    else if((Chan&1) != 0) StereoMode = Block->StereoMode[Chan/2];
+
+    //! Read the long-term prediction parameters
+    if(State->LongTermPrediction)
+    {
+        Block->LTPLag[Chan] = 0;
+        if(ULC_LTPAllowed(WindowCtrl) && StereoMode != STEREO_MODE_PARAMETRIC)
+        {
+            if(Block_Decode_ReadLTP(Src, Size, &Block->LTPLag[Chan], Block->LTPGain + Chan*ULC_LTP_NBANDS) < 0)
+            {
+                //! Corrupt block
+                return 0;
+            }
+        }
+    }
+
+    //! Process subblocks
+    //! The first channel of a pair stores its noise-fill tails,
+    //! and the second channel may then reuse them
+    //! NOTE: The second channel of a parametric pair is built from
+    //! the coefficients of the first channel, at CoefM[].
+    int NoiseMode = NOISE_TAIL_NONE;
+    if((Chan&1) == 0 && Chan+1 < nChan) NoiseMode = NOISE_TAIL_RECORD;
+    if((Chan&1) != 0)                   NoiseMode = NOISE_TAIL_COUPLE;
+    int   SubBlock = 0;
+    float *Noise   = State->TransformNoise;
+    ULC_SubBlockDecimationPattern_t DecimationPattern = ULC_SubBlockDecimationPattern(WindowCtrl);
+    do
+    {
+        int SubBlockSize = BlockSize >> (DecimationPattern&0x7);
+        ULC_TRACE_BEGIN(TraceCoefs);
+        if(StereoMode == STEREO_MODE_PARAMETRIC && (Chan&1) != 0)
+        {
+            Block_Decode_ParametricStereo(Coef, CoefM, SubBlockSize, Src, Size, &State->NoiseSeed);
+        }
+        else
+        {
+            int Ok = Block_Decode_DecodeSubBlockCoefs(Coef, SubBlockSize, Src, Size, Noise, &NoiseTailStart[SubBlock], NoiseMode, NoiseFill, &State->NoiseSeed);
+            if(!Ok)
+            {
+                //! Corrupt block
+                return 0;
+            }
+        }
+        ULC_TRACE_END(TraceCoefs, "Decode:Coefs", "Chan", Chan);
+        Coef += SubBlockSize, CoefM += SubBlockSize, Noise += SubBlockSize, SubBlock++;
+    }
+    while(DecimationPattern >>= 4);
+    return 1;
+}
+int ULC_DecodeBlock_Parse(struct ULC_DecoderState_t *State, struct ULC_DecoderBlock_t *Block, const void *_SrcBuffer)
+{
+    int nChan     = State->nChan;
+    int BlockSize = State->BlockSize;
+    const uint8_t *SrcBuffer = _SrcBuffer;
+
+    //! Read window control information, then parse each channel
+    int Chan, Size = 0;
+    int NoiseTailStart[4]; //! <- At most 4 subblocks per block
+    Block->WindowCtrl = Block_Decode_ReadWindowCtrl(&SrcBuffer, &Size);
+    for(Chan=0; Chan<nChan; Chan++)
+    {
+        float *Coef = Block->Coef + Chan*BlockSize;
+        if(!Block_Decode_ParseChannel(State, Block, Chan, Coef, (Chan&1) ? (Coef - BlockSize) : Coef, &SrcBuffer, &Size, NoiseTailStart)) return 0;
+    }
+
+    //! Return the number of bits read
+    return Size;
+}
+
+/**************************************/
+
+//! Convert lapping buffer between float32 and float16
+//! NOTE: N must be a multiple of 8. Values are rounded to nearest-even
+//! and are never large enough to overflow, nor small enough that
+//! flushing subnormals to zero would matter.
+static inline void Block_Decode_LapToF32(float *Dst, const uint16_t *Src, int N)
+{
+    int n;
+#if defined(__F16C__)
+    for(n=0; n<N; n+=8) _mm256_storeu_ps(Dst+n, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(Src+n))));
+#else
+    for(n=0; n<N; n++)
+    {
+        union { float f; uint32_t u; } v;
+        uint32_t Sign = (Src[n] & 0x8000u) << 16;
+        uint32_t Abs  =  Src[n] & 0x7FFFu;
+        if(Abs >= 0x0400u) v.u = (Abs << 13) + 0x38000000u; //! Normal: Rebias exponent (or Inf/NaN, which can't happen)
+        else               v.f = Abs * 0x1.0p-24f;          //! Subnormal
+        v.u |= Sign;
+        Dst[n] = v.f;
+    }
+#endif
+}
+static inline void Block_Decode_LapToF16(uint16_t *Dst, const float *Src, int N)
+{
+    int n;
+#if defined(__F16C__)
+    for(n=0; n<N; n+=8) _mm_storeu_si128((__m128i*)(Dst+n), _mm256_cvtps_ph(_mm256_loadu_ps(Src+n), _MM_FROUND_TO_NEAREST_INT));
+#else
+    for(n=0; n<N; n++)
+    {
+        union { float f; uint32_t u; } v = { Src[n] };
+        uint32_t Sign = (v.u >> 16) & 0x8000u;
+        uint32_t Abs  =  v.u & 0x7FFFFFFFu;
+        if(Abs >= 0x477FF000u) Abs = 0x7C00u; //! Overflow (>= 65520) -> Inf
+        else if(Abs < 0x38800000u)
+        {
+            //! Subnormal (< 2^-14): Adding 0.5 aligns the ulp to 2^-24,
+            //! so that the FPU rounds the mantissa for us
+            v.u = Abs, v.f += 0.5f;
+            Abs = v.u - 0x3F000000u;
+        }
+        else Abs = (Abs - 0x38000000u + 0x0FFFu + ((Abs >> 13) & 1)) >> 13; //! Rebias exponent and round to nearest-even
+        Dst[n] = (uint16_t)(Sign | Abs);
+    }
+#endif
+}
+
+/**************************************/
+
+//! Merge subblocks into a single half-block for coarse synthesis
+//! Each subblock of size N/r takes every r-th line, at an offset given
+//! by bit-reversing its index within the half-block, so that the
+//! subblocks tile the spectrum exactly; scaling by 1/Sqrt[r] keeps
+//! the level. This consumes subblocks from DecimationPattern until
+//! the half-block is filled (always possible, as decimated patterns
+//! tile each half of the block), leaving the last one in the pattern.
+//! NOTE: Subblock sizes are in synthesis units, and the coefficients
+//! of each subblock are stored at SubBlockSize<<RateShift.
+//! Returns the new Src position.
+static inline const float *Block_Decode_MergeSubBlocks(float *Dst, const float *Src, int BlockSize, int RateShift, ULC_SubBlockDecimationPattern_t *DecimationPattern, int *LastSubBlockSize)
+{
+    int n, N = BlockSize/2, Pos = 0;
+    for(;;)
+    {
+        int Log2r = (*DecimationPattern & 0x7) - 1;
+        int SubBlockSize = N >> Log2r;
+        int Idx = Pos >> (31 - __builtin_clz(SubBlockSize)), Offs = 0;
+        for(n=0; n<Log2r; n++) Offs = (Offs << 1) | ((Idx >> n) & 1);
+        float Scale = (Log2r & 1) ? (0x1.6A09E6p-1f / (1 << (Log2r/2))) : (1.0f / (1 << (Log2r/2))); //! 0x1.6A09E6p-1 = Sqrt[1/2]
+        for(n=0; n<SubBlockSize; n++) Dst[(n << Log2r) + Offs] = Src[n] * Scale;
+        Src += SubBlockSize << RateShift;
+        Pos += SubBlockSize;
+        *LastSubBlockSize = SubBlockSize;
+        if(Pos == N) return Src;
+        *DecimationPattern >>= 4;
+    }
+}
+
+//! Form the long-term prediction of a block
+//! NOTE: The right side of the transform belongs to the next block,
+//! whose overlap isn't known yet, so full overlap is assumed.
+void ULC_DecodeBlock_Predict(const struct ULC_DecoderState_t *State, float *Dst, int Chan, int IsLR, int Lag, int WindowCtrl)
+{
+    int n;
+    int RateShift = (State->Flags & ULC_DECODER_FLAG_HALF_RATE) ? 1 : 0;
+    int N = State->BlockSize >> RateShift;
+    int L = Lag >> RateShift;
+    float *Ext = State->LTPBuffer;
+
+    //! Repeat the last period of the history over the transform
+    //! NOTE: If the stereo mode of the pair changed, the history is
+    //! converted in the same way as synthesis would do it.
+    {
+        int nCopy = (L < 2*N) ? L : (2*N);
+        const float *Hist = State->LTPHistory + Chan*ULC_LTP_HISTORY_SIZE + ULC_LTP_HISTORY_SIZE - L;
+        int PairChan = ((Chan&1) != 0 || Chan+1 < State->nChan);
+        if(PairChan && IsLR != State->StereoLR[Chan/2])
+        {
+            float s = IsLR ? 1.0f : 0.5f;
+            const float *HistA = State->LTPHistory + (Chan&~1)*ULC_LTP_HISTORY_SIZE + ULC_LTP_HISTORY_SIZE - L;
+            const float *HistB = HistA + ULC_LTP_HISTORY_SIZE;
+            if(Chan&1) for(n=0; n<nCopy; n++) Ext[n] = (HistA[n] - HistB[n]) * s;
+            else       for(n=0; n<nCopy; n++) Ext[n] = (HistA[n] + HistB[n]) * s;
+        }
+        else for(n=0; n<nCopy; n++) Ext[n] = Hist[n];
+        for(n=nCopy; n<2*N; n++) Ext[n] = Ext[n-L];
+    }
+
+    //! Get the overlap with the last block, as in synthesis
+    int Overlap = N;
+    if(ULC_SubBlockDecimationPattern(WindowCtrl) & 0x8) Overlap >>= (WindowCtrl & 0x7);
+    if(Overlap < 16) Overlap = 16;
+    if(Overlap > State->LastSubBlockSize) Overlap = State->LastSubBlockSize;
+
+    //! Window and fold into DCT-IV inputs (see Fourier_MDCT_MDST())
+    {
+        const float *Old = Ext;
+        const float *New = Ext + N;
+        float *DstMid = Dst + N/2;
+        float c, s, wc, ws, t;
+        for(n=0; n<(N-Overlap)/2; n++) DstMid[n] = Old[N-1-n];
+        if(n < N/2)
+        {
+            c  = cosf(0x1.921FB6p0f * 0.5f / Overlap); //! 0x1.921FB6p0 = Pi/2
+            s  = sinf(0x1.921FB6p0f * 0.5f / Overlap);
+            wc = cosf(0x1.921FB6p0f * 1.0f / Overlap);
+            ws = sinf(0x1.921FB6p0f * 1.0f / Overlap);
+            for(; n<N/2; n++)
+            {
+                DstMid[n] = c*Old[N-1-n] - s*Old[n];
+                t = c;
+                c = wc*t - ws*s;
+                s = ws*t + wc*s;
+            }
+        }
+        c  = cosf(0x1.921FB6p0f * 0.5f / N);
+        s  = sinf(0x1.921FB6p0f * 0.5f / N);
+        wc = cosf(0x1.921FB6p0f * 1.0f / N);
+        ws = sinf(0x1.921FB6p0f * 1.0f / N);
+        for(n=0; n<N/2; n++)
+        {
+            DstMid[-1-n] = c*New[n] + s*New[N-1-n];
+            t = c;
+            c = wc*t - ws*s;
+            s = ws*t + wc*s;
+        }
+    }
+
+    //! Transform and normalize
+    Fourier_DCT4T_Planned(Dst, Ext, N);
+    float Norm = 2.0f / N;
+    for(n=0; n<N; n++) Dst[n] *= Norm;
+}
+
+/**************************************/
+
+//! Synthesize one channel of a block
+//! Returns the size of the channel's last [sub]block.
+static int Block_Decode_SynthesizeChannel(struct ULC_DecoderState_t *State, float *DstData, const struct ULC_DecoderBlock_t *Block, int Chan, const float *Src)
 {
     //! Spill state to local variables to make things easier to read
+    //! NOTE: With half-rate synthesis, BlockSize and all subblock sizes
+    //! refer to the synthesized (half-size) transforms; the coefficients
+    //! of each subblock are still stored at their full size.
     int    n;
     int    nChan           = State->nChan;
-    int    BlockSize       = State->BlockSize;
-    float *TransformBuffer = State->TransformBuffer;
+    int    RateShift       = (State->Flags & ULC_DECODER_FLAG_HALF_RATE) ? 1 : 0;
+    int    Coarse          = (State->Flags & ULC_DECODER_FLAG_COARSE_SUBBLOCKS);
+    int    LapF16          = (State->Flags & ULC_DECODER_FLAG_F16_LAP);
+    int    LTP             = State->LongTermPrediction;
+    int    BlockSize       = State->BlockSize >> RateShift;
     float *TransformTemp   = State->TransformTemp;
     float *TransformInvLap = State->TransformInvLap;
-    const uint8_t *SrcBuffer = _SrcBuffer;
+    uint16_t *TransformInvLapF16 = State->TransformInvLapF16;
+    int    Resampling      = (State->Resampler.BufferData != NULL);
+    int    WindowCtrl      = Block->WindowCtrl;
 
-    //! Begin decoding
-    int Chan, Size = 0;
-    int LastSubBlockSize = 0; //! <- Shuts gcc up
-    int WindowCtrl;
+    //! Move the lapping buffer to the stereo domain of each channel
+    //! pair if it changed
+    //! NOTE: L = M+S, R = M-S; M = (L+R)/2, S = (L-R)/2.
+    //! NOTE: Parametric pairs are always in M/S.
+    if((Chan&1) == 0 && Chan+1 < nChan)
     {
-        //! Read window control information
-        WindowCtrl = Block_Decode_ReadNybble(&SrcBuffer, &Size);
-        if(WindowCtrl & 0x8) WindowCtrl |= Block_Decode_ReadNybble(&SrcBuffer, &Size) << 4;
-        else                 WindowCtrl |= 1 << 4;
+        int IsLR = (Block->StereoMode[Chan/2] == STEREO_MODE_LR);
+        if(IsLR != State->StereoLR[Chan/2])
+        {
+            float s = IsLR ? 1.0f : 0.5f;
+            float *LapA = LapF16 ? TransformTemp : (TransformInvLap + Chan*(BlockSize/2));
+            float *LapB = LapA + BlockSize/2;
+            if(LapF16) Block_Decode_LapToF32(LapA, TransformInvLapF16 + Chan*(BlockSize/2), BlockSize);
+            for(n=0; n<BlockSize/2; n++)
+            {
+                float a = LapA[n];
+                float b = LapB[n];
+                LapA[n] = (a+b) * s;
+                LapB[n] = (a-b) * s;
+            }
+            if(LapF16) Block_Decode_LapToF16(TransformInvLapF16 + Chan*(BlockSize/2), LapA, BlockSize);
+            if(LTP)
+            {
+                float *HistA = State->LTPHistory + Chan*ULC_LTP_HISTORY_SIZE;
+                float *HistB = HistA + ULC_LTP_HISTORY_SIZE;
+                for(n=0; n<ULC_LTP_HISTORY_SIZE; n++)
+                {
+                    float a = HistA[n];
+                    float b = HistB[n];
+                    HistA[n] = (a+b) * s;
+                    HistB[n] = (a-b) * s;
+                }
+            }
+            State->StereoLR[Chan/2] = IsLR;
+        }
     }
-    for(Chan=0; Chan<nChan; Chan++)
+
+    //! Start from the overlap of the last block
+    int LastSubBlockSize = State->LastSubBlockSize;
+
+    //! Add the long-term prediction to the coefficients
+    //! NOTE: This is only used by blocks with a single [sub]block,
+    //! and the sum is stored to TransformTemp[] for the IMDCT, which
+    //! also uses it as its scratch space.
+    const float *LTPSrc = NULL;
+    if(LTP && Block->LTPLag[Chan])
     {
-        //! Reset overlap scaling for this channel
-        LastSubBlockSize = State->LastSubBlockSize;
+        int Band;
+        float *Sum = TransformTemp;
+        const uint8_t *Gain = Block->LTPGain + Chan*ULC_LTP_NBANDS;
+        ULC_TRACE_BEGIN(TracePredict);
+        int IsLR = ((Chan&1) != 0 || Chan+1 < nChan) ? State->StereoLR[Chan/2] : 0;
+        ULC_DecodeBlock_Predict(State, Sum, Chan, IsLR, Block->LTPLag[Chan], WindowCtrl);
+        for(n=0,Band=0; Band<ULC_LTP_NBANDS; Band++)
+        {
+            float g = Gain[Band] * (1.0f/16);
+            int BandEnd = ULC_LTPBandEnd(Band, State->BlockSize);
+            for(; n<BandEnd; n++) Sum[n] = Src[n] + g*Sum[n];
+        }
+        for(; n<BlockSize; n++) Sum[n] = Src[n];
+        LTPSrc = Sum;
+        ULC_TRACE_END(TracePredict, "Decode:Predict", "Lag", Block->LTPLag[Chan]);
+    }
 
-        //! Process subblocks
-        float *Dst = DstData + Chan*BlockSize;
-        float *Src = TransformBuffer;
-        float *Lap = TransformInvLap;
-        ULC_SubBlockDecimationPattern_t DecimationPattern = ULC_SubBlockDecimationPattern(WindowCtrl);
-        do
+    //! Process subblocks
+    float *Dst = Resampling ? ULC_Resampler_GetInputBuffer(&State->Resampler, Chan) : (DstData + Chan*BlockSize);
+    float *DstStart = Dst;
+    //! NOTE: A float16 lapping buffer is expanded to the end of
+    //! TransformTemp[] (past any data used by the IMDCT stage).
+    float *Lap;
+    if(LapF16)
+    {
+        Lap = TransformTemp + BlockSize*3/2;
+        Block_Decode_LapToF32(Lap, TransformInvLapF16 + Chan*(BlockSize/2), BlockSize/2);
+    }
+    else Lap = TransformInvLap + Chan*(BlockSize/2);
+    ULC_SubBlockDecimationPattern_t DecimationPattern = ULC_SubBlockDecimationPattern(WindowCtrl);
+    do
+    {
+        int SubBlockSize = BlockSize >> (DecimationPattern&0x7);
+
+        //! Get+update overlap size and limit to that of the last subblock
+        //! NOTE: Half-rate synthesis can halve the overlap below the
+        //! smallest size supported by the IMDCT.
+        int OverlapSize = SubBlockSize;
+        if(DecimationPattern&0x8)
+            OverlapSize >>= (WindowCtrl & 0x7);
+        if(OverlapSize < 16)
+            OverlapSize = 16;
+        if(OverlapSize > LastSubBlockSize)
+            OverlapSize = LastSubBlockSize;
+        LastSubBlockSize = SubBlockSize;
+
+        //! A single long block can be read straight into the output buffer
+        ULC_TRACE_BEGIN(TraceIMDCT);
+        if(SubBlockSize == BlockSize)
         {
-            int SubBlockSize = BlockSize >> (DecimationPattern&0x7);
-            if(!Block_Decode_DecodeSubBlockCoefs(Src, SubBlockSize, &SrcBuffer, &Size))
+            Fourier_IMDCT(Dst, LTPSrc ? LTPSrc : Src, Lap, TransformTemp, SubBlockSize, OverlapSize);
+            ULC_TRACE_END(TraceIMDCT, "Decode:IMDCT", "SubBlockSize", SubBlockSize);
+            Src += SubBlockSize << RateShift;
+            break;
+        }
+
+        //! With coarse synthesis, subblocks smaller than half the
+        //! block are merged and synthesized together
+        //! NOTE: The lapping of the merged subblocks still follows
+        //! the first (for the overlap) and last (for the next one).
+        const float *SubBlockSrc = Src;
+        if(Coarse && SubBlockSize < BlockSize/2)
+        {
+            SubBlockSrc  = TransformTemp + BlockSize;
+            SubBlockSize = BlockSize/2;
+            Src = Block_Decode_MergeSubBlocks(TransformTemp + BlockSize, Src, BlockSize, RateShift, &DecimationPattern, &LastSubBlockSize);
+        }
+        else Src += SubBlockSize << RateShift;
+
+        //! For small blocks, we store the decoded data to a scratch buffer
+        float *DecBuf = TransformTemp + SubBlockSize;
+        Fourier_IMDCT(DecBuf, SubBlockSrc, Lap, TransformTemp, SubBlockSize, OverlapSize);
+
+        //! Output samples from the lapping buffer, and cycle
+        //! the new samples through it for the next call
+        int nAvailable = (BlockSize - SubBlockSize) / 2;
+        float *LapDst = Lap + BlockSize/2;
+        const float *LapSrc = LapDst;
+        if(SubBlockSize <= nAvailable)
+        {
+            //! We have enough data in the lapping buffer
+            //! to output a full subblock directly from it,
+            //! so we do that and then shift any remaining
+            //! data before re-filling the buffer.
+            for(n=0; n<SubBlockSize; n++) *Dst++    = *--LapSrc;
+            for(   ; n<nAvailable  ; n++) *--LapDst = *--LapSrc;
+            for(n=0; n<SubBlockSize; n++) *--LapDst = *DecBuf++;
+        }
+        else
+        {
+            //! We only have enough data for a partial output
+            //! from the lapping buffer, so output what we can
+            //! and output the rest from the decoded buffer
+            //! before re-filling.
+            for(n=0; n<nAvailable;  n++) *Dst++    = *--LapSrc;
+            for(   ; n<SubBlockSize; n++) *Dst++    = *DecBuf++;
+            for(n=0; n<nAvailable;  n++) *--LapDst = *DecBuf++;
+        }
+        ULC_TRACE_END(TraceIMDCT, "Decode:IMDCT", "SubBlockSize", SubBlockSize);
+    }
+    while(DecimationPattern >>= 4);
+
+    //! Store the lapping buffer back
+    if(LapF16) Block_Decode_LapToF16(TransformInvLapF16 + Chan*(BlockSize/2), Lap, BlockSize/2);
+
+    //! Append the output to the prediction history
+    if(LTP)
+    {
+        float *Hist = State->LTPHistory + Chan*ULC_LTP_HISTORY_SIZE;
+        if(BlockSize < ULC_LTP_HISTORY_SIZE)
+        {
+            for(n=0; n<ULC_LTP_HISTORY_SIZE-BlockSize; n++) Hist[n] = Hist[n+BlockSize];
+            for(   ; n<ULC_LTP_HISTORY_SIZE;           n++) Hist[n] = *DstStart++;
+        }
+        else for(n=0; n<ULC_LTP_HISTORY_SIZE; n++) Hist[n] = DstStart[BlockSize-ULC_LTP_HISTORY_SIZE+n];
+    }
+    return LastSubBlockSize;
+}
+
+//! Undo M/S, interleave, and convert the synthesized channels
+static void Block_Decode_Output(struct ULC_DecoderState_t *State, float *DstData)
+{
+    int    n, Chan;
+    int    nChan         = State->nChan;
+    int    RateShift     = (State->Flags & ULC_DECODER_FLAG_HALF_RATE) ? 1 : 0;
+    int    BlockSize     = State->BlockSize >> RateShift;
+    float *TransformTemp = State->TransformTemp;
+    int    Resampling    = (State->Resampler.BufferData != NULL);
+    int    nPairsMS = 0, nPairsLR = 0;
+    for(Chan=1; Chan<nChan; Chan+=2)
+    {
+        if(State->StereoLR[Chan/2]) nPairsLR++; else nPairsMS++;
+    }
+
+    ULC_TRACE_BEGIN(TraceOutput);
+    if(Resampling)
+    {
+        //! Resample, undo M/S, interleave, and convert in a single pass
+        //! NOTE: The resampler undoes M/S for all pairs or for none, so
+        //! when both modes are present, L/R pairs are moved to M/S. This
+        //! can only happen with more than two channels.
+        int Flags = 0;
+        if(nPairsMS)
+        {
+            Flags |= ULC_RESAMPLER_MIDSIDE;
+            if(nPairsLR) for(Chan=1; Chan<nChan; Chan+=2)
+                {
+                    if(!State->StereoLR[Chan/2]) continue;
+                    float *BufA = ULC_Resampler_GetInputBuffer(&State->Resampler, Chan-1);
+                    float *BufB = ULC_Resampler_GetInputBuffer(&State->Resampler, Chan);
+                    for(n=0; n<BlockSize; n++)
+                    {
+                        float a = BufA[n];
+                        float b = BufB[n];
+                        BufA[n] = (a+b) * 0.5f;
+                        BufB[n] = (a-b) * 0.5f;
+                    }
+                }
+        }
+        if(State->OutputFormat == ULC_DECODER_OUTPUT_PCM16) Flags |= ULC_RESAMPLER_OUTPUT_PCM16;
+        State->nOutputSamples = ULC_Resampler_Process(&State->Resampler, DstData, BlockSize, Flags);
+    }
+    else
+    {
+        //! Undo M/S transform (L/R pairs need no processing)
+        //! NOTE: Not orthogonal; must be fully normalized on the encoder side.
+        for(Chan=1; Chan<nChan; Chan+=2)
+        {
+            if(State->StereoLR[Chan/2]) continue;
+            float *Buf = DstData + Chan*BlockSize;
+            for(n=0; n<BlockSize; n++)
             {
-                //! Corrupt block
-                return 0;
+                float a = Buf[n - BlockSize];
+                float b = Buf[n];
+                Buf[n - BlockSize] = (a+b);
+                Buf[n]             = (a-b);
             }
+        }
 
-            //! Get+update overlap size and limit to that of the last subblock
-            int OverlapSize = SubBlockSize;
-            if(DecimationPattern&0x8)
-                OverlapSize >>= (WindowCtrl & 0x7);
-            if(OverlapSize > LastSubBlockSize)
-                OverlapSize = LastSubBlockSize;
-            LastSubBlockSize = SubBlockSize;
+        //! Interleave channels
+        if(nChan != 1)
+        {
+            for(n=0; n<BlockSize*nChan; n++) TransformTemp[n] = DstData[n];
+            for(Chan=0; Chan<nChan; Chan++) for(n=0; n<BlockSize; n++)
+                {
+                    DstData[n*nChan+Chan] = TransformTemp[Chan*BlockSize+n];
+                }
+        }
 
-            //! A single long block can be read straight into the output buffer
-            if(SubBlockSize == BlockSize)
+        //! Convert to output format
+        //! NOTE: This is done in-place; int16_t output always trails
+        //! the float input, so we never overwrite unread samples.
+        if(State->OutputFormat == ULC_DECODER_OUTPUT_PCM16)
+        {
+            int16_t *Out = (int16_t*)DstData;
+            for(n=0; n<BlockSize*nChan; n++)
             {
-                Fourier_IMDCT(Dst, Src, Lap, TransformTemp, SubBlockSize, OverlapSize);
-                break;
+                float x = DstData[n] * 0x1.0p15f;
+                x = (x < -0x8000) ? -0x8000 : (x > +0x7FFF) ? +0x7FFF : x;
+                Out[n] = (int16_t)lrintf(x);
             }
+        }
+        State->nOutputSamples = BlockSize;
+    }
+    ULC_TRACE_END(TraceOutput, "Decode:Output", "Resampling", Resampling);
+}
+
+/**************************************/
+
+void ULC_DecodeBlock_Synthesize(struct ULC_DecoderState_t *State, void *DstData, const struct ULC_DecoderBlock_t *Block)
+{
+    int Chan, LastSubBlockSize = 0; //! <- Shuts gcc up
+    for(Chan=0; Chan<State->nChan; Chan++)
+    {
+        LastSubBlockSize = Block_Decode_SynthesizeChannel(State, DstData, Block, Chan, Block->Coef + Chan*State->BlockSize);
+    }
+    Block_Decode_Output(State, DstData);
+
+    //! Store the last [sub]block size
+    State->LastSubBlockSize = LastSubBlockSize;
+}
+
+/**************************************/
+
+int ULC_DecodeBlock(struct ULC_DecoderState_t *State, void *DstData, const void *_SrcBuffer)
+{
+    //! Parse and synthesize one channel at a time, so that only a
+    //! single channel of coefficients is held in TransformBuffer[]
+    //! NOTE: The second channel of a parametric pair is built in
+    //! place from the coefficients of the first channel, which are
+    //! left untouched by its synthesis.
+    int Chan, Size = 0;
+    int LastSubBlockSize = 0; //! <- Shuts gcc up
+    int NoiseTailStart[4];    //! <- At most 4 subblocks per block
+    struct ULC_DecoderBlock_t *Block = &State->Block;
+    const uint8_t *SrcBuffer = _SrcBuffer;
+    ULC_TRACE_BEGIN(TraceBlock);
+    Block->WindowCtrl = Block_Decode_ReadWindowCtrl(&SrcBuffer, &Size);
+    for(Chan=0; Chan<State->nChan; Chan++)
+    {
+        if(!Block_Decode_ParseChannel(State, Block, Chan, Block->Coef, Block->Coef, &SrcBuffer, &Size, NoiseTailStart))
+        {
+            //! Corrupt block
+            Size = 0;
+            break;
+        }
+        LastSubBlockSize = Block_Decode_SynthesizeChannel(State, DstData, Block, Chan, Block->Coef);
+    }
+    if(Size)
+    {
+        Block_Decode_Output(State, DstData);
+        State->LastSubBlockSize = LastSubBlockSize;
+    }
+    ULC_TRACE_END(TraceBlock, "ULC_DecodeBlock", "WindowCtrl", Block->WindowCtrl);
+    return Size;
+}
+
+/**************************************/
 
-            //! For small blocks, we store the decoded data to a scratch buffer
-            float *DecBuf = TransformTemp + SubBlockSize;
-            Fourier_IMDCT(DecBuf, Src, Lap, TransformTemp, SubBlockSize, OverlapSize);
+//! Scan block
+static inline int Block_Scan_SubBlockCoefs(int N, const uint8_t **Src, int *Size, int NoiseMode)
+{
+    int32_t n, v;
 
-            //! Output samples from the lapping buffer, and cycle
-            //! the new samples through it for the next call
-            int nAvailable = (BlockSize - SubBlockSize) / 2;
-            float *LapDst = Lap + BlockSize/2;
-            const float *LapSrc = LapDst;
-            if(SubBlockSize <= nAvailable)
+    //! Check first quantizer for Stop code
+    v = Block_Decode_ReadQuantizer(Src, Size);
+    if(v == ESCAPE_SEQUENCE_STOP) return 1;
+    if(v == ESCAPE_SEQUENCE_STOP_COUPLED)
+    {
+        if(NoiseMode != NOISE_TAIL_COUPLE) return 0;
+        Block_Decode_ReadNybble(Src, Size);
+        return 1;
+    }
+
+    //! Skip over the [sub]block's coefficients
+    //! NOTE: This must follow Block_Decode_DecodeSubBlockCoefs() exactly.
+    for(;;)
+    {
+        //! -7h..-2h, +2..+7h: Normal
+        v = Block_Decode_ReadNybble(Src, Size);
+        if(v != 0x0 && v != 0x1 && v != 0x8 && v != 0xF)
+        {
+            if(--N == 0) break;
+            continue;
+        }
+
+        //! 0h,0h..Fh: Zeros fill (1 .. 16 coefficients)
+        //! 1h,Yh,Xh: 33 .. 288 zeros fill
+        //! 8h,Zh,Yh,Xh: 16 .. 527 noise fill
+        if(v != 0xF)
+        {
+            if(v == 0x0)
             {
-                //! We have enough data in the lapping buffer
-                //! to output a full subblock directly from it,
-                //! so we do that and then shift any remaining
-                //! data before re-filling the buffer.
-                for(n=0; n<SubBlockSize; n++) *Dst++    = *--LapSrc;
-                for(   ; n<nAvailable  ; n++) *--LapDst = *--LapSrc;
-                for(n=0; n<SubBlockSize; n++) *--LapDst = *DecBuf++;
+                n  = Block_Decode_ReadNybble(Src, Size) + 1;
             }
             else
             {
-                //! We only have enough data for a partial output
-                //! from the lapping buffer, so output what we can
-                //! and output the rest from the decoded buffer
-                //! before re-filling.
-                for(n=0; n<nAvailable;  n++) *Dst++    = *--LapSrc;
-                for(   ; n<SubBlockSize; n++) *Dst++    = *DecBuf++;
-                for(n=0; n<nAvailable;  n++) *--LapDst = *DecBuf++;
+                n  = Block_Decode_ReadNybble(Src, Size);
+                n  = Block_Decode_ReadNybble(Src, Size) | (n<<4);
+                if(v == 0x1) n += 33;
+                else n = ((Block_Decode_ReadNybble(Src, Size)&1) | (n<<1)) + 16;
             }
+            if(n > N) return 0;
+            N -= n;
+            if(N == 0) break;
+            continue;
         }
-        while(DecimationPattern >>= 4);
 
-        //! Move to next channel
-        TransformInvLap += BlockSize/2;
+        //! Fh,0h..Dh:    Quantizer change
+        //! Fh,Eh,0h..Ch: Quantizer change (extended precision)
+        v = Block_Decode_ReadQuantizer(Src, Size);
+        if(v >= 0) continue;
+
+        //! Fh,Fh,Zh,Yh,Xh: Noise fill (to end; exp-decay)
+        //! Fh,Eh,Eh,Xh:    Coupled noise fill (to end)
+        //! Fh,Eh,Fh:       Zeros fill (to end)
+        if(v == ESCAPE_SEQUENCE_STOP_NOISEFILL)
+        {
+            Block_Decode_ReadNybble(Src, Size);
+            Block_Decode_ReadNybble(Src, Size);
+            Block_Decode_ReadNybble(Src, Size);
+        }
+        if(v == ESCAPE_SEQUENCE_STOP_COUPLED)
+        {
+            if(NoiseMode != NOISE_TAIL_COUPLE) return 0;
+            Block_Decode_ReadNybble(Src, Size);
+        }
+        break;
     }
+    return 1;
+}
+int ULC_ScanBlock(const struct ULC_DecoderState_t *State, const void *_SrcBuffer)
+{
+    int nChan     = State->nChan;
+    int BlockSize = State->BlockSize;
+    const uint8_t *SrcBuffer = _SrcBuffer;
 
-    //! Undo M/S transform
-    //! NOTE: Not orthogonal; must be fully normalized on the encoder side.
-    for(Chan=1; Chan<nChan; Chan+=2)
+    //! Read window control information
+    int Chan, Size = 0;
+    int WindowCtrl = Block_Decode_ReadNybble(&SrcBuffer, &Size);
+    if(WindowCtrl & 0x8) WindowCtrl |= Block_Decode_ReadNybble(&SrcBuffer, &Size) << 4;
+    else                 WindowCtrl |= 1 << 4;
+
+    //! Skip over each channel's [sub]blocks
+    int StereoMode = STEREO_MODE_MS;
+    for(Chan=0; Chan<nChan; Chan++)
     {
-        float *Buf = DstData + Chan*BlockSize;
-        for(n=0; n<BlockSize; n++)
+        int NoiseMode = NOISE_TAIL_NONE;
+        if((Chan&1) == 0) StereoMode = STEREO_MODE_MS;
+        if((Chan&1) == 0 && Chan+1 < nChan)
+        {
+            StereoMode = Block_Decode_ReadStereoMode(&SrcBuffer, &Size);
+            NoiseMode = NOISE_TAIL_RECORD;
+        }
+        if((Chan&1) != 0) NoiseMode = NOISE_TAIL_COUPLE;
+        if(State->LongTermPrediction && ULC_LTPAllowed(WindowCtrl) && StereoMode != STEREO_MODE_PARAMETRIC)
+        {
+            //! Xh[,Zh,Yh,Xh,Gh[Xh]]: Long-term prediction
+            int Lag;
+            uint8_t Gain[ULC_LTP_NBANDS];
+            if(Block_Decode_ReadLTP(&SrcBuffer, &Size, &Lag, Gain) < 0) return 0;
+        }
+        ULC_SubBlockDecimationPattern_t DecimationPattern = ULC_SubBlockDecimationPattern(WindowCtrl);
+        do
         {
-            float a = Buf[n - BlockSize];
-            float b = Buf[n];
-            Buf[n - BlockSize] = (a+b);
-            Buf[n]             = (a-b);
+            int SubBlockSize = BlockSize >> (DecimationPattern&0x7);
+            if(StereoMode == STEREO_MODE_PARAMETRIC && (Chan&1) != 0)
+            {
+                //! Xh,Yh[ULC_PARAMETRIC_STEREO_NBANDS]: Parametric S channel
+                Size += 8*ULC_PARAMETRIC_STEREO_NBANDS;
+                SrcBuffer += ULC_PARAMETRIC_STEREO_NBANDS;
+            }
+            else if(!Block_Scan_SubBlockCoefs(SubBlockSize, &SrcBuffer, &Size, NoiseMode)) return 0;
         }
+        while(DecimationPattern >>= 4);
     }
+    return Size;
+}
 
-    //! Interleave channels
-    if(nChan != 1)
+/**************************************/
+
+//! Apply gain to a block
+//! This follows Block_Scan_SubBlockCoefs() and ULC_ScanBlock(), copying
+//! every nybble to the output (when Dst != NULL) except for quantizers,
+//! which are re-written with Shift subtracted. The range of the original
+//! quantizers is also recorded, so that the same pass can find the
+//! shifts that a block allows.
+#define BLOCK_GAIN_OUT_OF_RANGE (-4)
+struct Block_Gain_t
+{
+    const uint8_t *Src;
+    int      SrcSize;
+    uint8_t *Dst;
+    int      DstSize;
+    int      Shift;
+    int      qMin, qMax;
+};
+static inline int Block_Gain_ReadNybble(struct Block_Gain_t *Gain)
+{
+    return Block_Decode_ReadNybble(&Gain->Src, &Gain->SrcSize);
+}
+static inline void Block_Gain_WriteNybble(struct Block_Gain_t *Gain, int x)
+{
+    if(Gain->Dst)
+    {
+        if(Gain->DstSize%8u == 0) *Gain->Dst = x;
+        else *Gain->Dst++ |= x << 4;
+    }
+    Gain->DstSize += 4;
+}
+static inline int Block_Gain_CopyNybble(struct Block_Gain_t *Gain)
+{
+    int x = Block_Gain_ReadNybble(Gain);
+    Block_Gain_WriteNybble(Gain, x);
+    return x;
+}
+static inline int Block_Gain_Quantizer(struct Block_Gain_t *Gain)
+{
+    //! Returns the same as Block_Decode_ReadQuantizer(), or
+    //! BLOCK_GAIN_OUT_OF_RANGE if the new quantizer can't be coded
+    //! NOTE: Fh,Eh,Dh (unused; a zero quantizer) is left as it is.
+    int qi = Block_Gain_ReadNybble(Gain);
+    if(qi == 0xF)
+    {
+        Block_Gain_WriteNybble(Gain, qi);
+        return ESCAPE_SEQUENCE_STOP_NOISEFILL;
+    }
+    if(qi == 0xE)
     {
-        for(n=0; n<BlockSize*nChan; n++) TransformTemp[n] = DstData[n];
-        for(Chan=0; Chan<nChan; Chan++) for(n=0; n<BlockSize; n++)
+        qi += Block_Gain_ReadNybble(Gain);
+        if(qi > 0xE + 0xC)
+        {
+            Block_Gain_WriteNybble(Gain, 0xE);
+            Block_Gain_WriteNybble(Gain, qi - 0xE);
+            if(qi == 0xE + 0xE) return ESCAPE_SEQUENCE_STOP_COUPLED;
+            if(qi == 0xE + 0xF) return ESCAPE_SEQUENCE_STOP;
+            return qi;
+        }
+    }
+    if(qi < Gain->qMin) Gain->qMin = qi;
+    if(qi > Gain->qMax) Gain->qMax = qi;
+    int q = qi - Gain->Shift;
+    if(q < 0 || q > 0xE + 0xC) return BLOCK_GAIN_OUT_OF_RANGE;
+    if(q < 0xE) Block_Gain_WriteNybble(Gain, q);
+    else
+    {
+        Block_Gain_WriteNybble(Gain, 0xE);
+        Block_Gain_WriteNybble(Gain, q - 0xE);
+    }
+    return qi;
+}
+static inline int Block_Gain_SubBlockCoefs(struct Block_Gain_t *Gain, int N, int NoiseMode)
+{
+    int32_t n, v;
+
+    //! Check first quantizer for Stop code
+    //! NOTE: Fh is not a valid first quantizer.
+    v = Block_Gain_Quantizer(Gain);
+    if(v == ESCAPE_SEQUENCE_STOP) return 1;
+    if(v == ESCAPE_SEQUENCE_STOP_COUPLED)
+    {
+        if(NoiseMode != NOISE_TAIL_COUPLE) return 0;
+        Block_Gain_CopyNybble(Gain);
+        return 1;
+    }
+    if(v < 0) return 0;
+
+    //! Copy the [sub]block's coefficients
+    //! NOTE: This must follow Block_Decode_DecodeSubBlockCoefs() exactly.
+    for(;;)
+    {
+        //! -7h..-2h, +2..+7h: Normal
+        v = Block_Gain_ReadNybble(Gain);
+        if(v != 0xF) Block_Gain_WriteNybble(Gain, v);
+        if(v != 0x0 && v != 0x1 && v != 0x8 && v != 0xF)
+        {
+            if(--N == 0) break;
+            continue;
+        }
+
+        //! 0h,0h..Fh: Zeros fill (1 .. 16 coefficients)
+        //! 1h,Yh,Xh: 33 .. 288 zeros fill
+        //! 8h,Zh,Yh,Xh: 16 .. 527 noise fill
+        if(v != 0xF)
+        {
+            if(v == 0x0)
+            {
+                n  = Block_Gain_CopyNybble(Gain) + 1;
+            }
+            else
             {
-                DstData[n*nChan+Chan] = TransformTemp[Chan*BlockSize+n];
+                n  = Block_Gain_CopyNybble(Gain);
+                n  = Block_Gain_CopyNybble(Gain) | (n<<4);
+                if(v == 0x1) n += 33;
+                else n = ((Block_Gain_CopyNybble(Gain)&1) | (n<<1)) + 16;
             }
+            if(n > N) return 0;
+            N -= n;
+            if(N == 0) break;
+            continue;
+        }
+
+        //! Fh,0h..Dh:    Quantizer change
+        //! Fh,Eh,0h..Ch: Quantizer change (extended precision)
+        Block_Gain_WriteNybble(Gain, 0xF);
+        v = Block_Gain_Quantizer(Gain);
+        if(v >= 0) continue;
+
+        //! Fh,Fh,Zh,Yh,Xh: Noise fill (to end; exp-decay)
+        //! Fh,Eh,Eh,Xh:    Coupled noise fill (to end)
+        //! Fh,Eh,Fh:       Zeros fill (to end)
+        if(v == ESCAPE_SEQUENCE_STOP_NOISEFILL)
+        {
+            Block_Gain_CopyNybble(Gain);
+            Block_Gain_CopyNybble(Gain);
+            Block_Gain_CopyNybble(Gain);
+        }
+        if(v == ESCAPE_SEQUENCE_STOP_COUPLED)
+        {
+            if(NoiseMode != NOISE_TAIL_COUPLE) return 0;
+            Block_Gain_CopyNybble(Gain);
+        }
+        if(v < ESCAPE_SEQUENCE_STOP_COUPLED) return 0;
+        break;
     }
+    return 1;
+}
+static int Block_Gain_Process(const struct ULC_DecoderState_t *State, struct Block_Gain_t *Gain)
+{
+    int n;
+    int nChan     = State->nChan;
+    int BlockSize = State->BlockSize;
 
-    //! Store the last [sub]block size, and return the number of bits read
-    State->LastSubBlockSize = LastSubBlockSize;
+    //! Copy window control information
+    int Chan;
+    int WindowCtrl = Block_Gain_CopyNybble(Gain);
+    if(WindowCtrl & 0x8) WindowCtrl |= Block_Gain_CopyNybble(Gain) << 4;
+    else                 WindowCtrl |= 1 << 4;
+
+    //! Process each channel's [sub]blocks
+    int StereoMode = STEREO_MODE_MS;
+    for(Chan=0; Chan<nChan; Chan++)
+    {
+        int NoiseMode = NOISE_TAIL_NONE;
+        if((Chan&1) == 0) StereoMode = STEREO_MODE_MS;
+        if((Chan&1) == 0 && Chan+1 < nChan)
+        {
+            StereoMode = Block_Decode_ReadStereoMode(&Gain->Src, &Gain->SrcSize);
+            for(n=0; n<StereoMode; n++)
+            {
+                Block_Gain_WriteNybble(Gain, 0xE);
+                Block_Gain_WriteNybble(Gain, 0xD);
+            }
+            NoiseMode = NOISE_TAIL_RECORD;
+        }
+        if((Chan&1) != 0) NoiseMode = NOISE_TAIL_COUPLE;
+        if(State->LongTermPrediction && ULC_LTPAllowed(WindowCtrl) && StereoMode != STEREO_MODE_PARAMETRIC)
+        {
+            //! Xh[,Zh,Yh,Xh,Gh[Xh]]: Long-term prediction
+            int Lag, nBands;
+            uint8_t LTPGain[ULC_LTP_NBANDS];
+            nBands = Block_Decode_ReadLTP(&Gain->Src, &Gain->SrcSize, &Lag, LTPGain);
+            if(nBands < 0) return 0;
+            Block_Gain_WriteNybble(Gain, nBands);
+            if(nBands)
+            {
+                Lag -= ULC_LTP_MIN_LAG;
+                Block_Gain_WriteNybble(Gain, (Lag >> 8) & 0xF);
+                Block_Gain_WriteNybble(Gain, (Lag >> 4) & 0xF);
+                Block_Gain_WriteNybble(Gain, (Lag >> 0) & 0xF);
+            }
+            for(n=0; n<nBands; n++) Block_Gain_WriteNybble(Gain, LTPGain[n]);
+        }
+        ULC_SubBlockDecimationPattern_t DecimationPattern = ULC_SubBlockDecimationPattern(WindowCtrl);
+        do
+        {
+            int SubBlockSize = BlockSize >> (DecimationPattern&0x7);
+            if(StereoMode == STEREO_MODE_PARAMETRIC && (Chan&1) != 0)
+            {
+                //! Xh,Yh[ULC_PARAMETRIC_STEREO_NBANDS]: Parametric S channel
+                for(n=0; n<2*ULC_PARAMETRIC_STEREO_NBANDS; n++) Block_Gain_CopyNybble(Gain);
+            }
+            else if(!Block_Gain_SubBlockCoefs(Gain, SubBlockSize, NoiseMode)) return 0;
+        }
+        while(DecimationPattern >>= 4);
+    }
+    return Gain->SrcSize;
+}
+int ULC_BlockGain(const struct ULC_DecoderState_t *State, void *DstBuffer, int *DstSize, const void *SrcBuffer, int Shift)
+{
+    struct Block_Gain_t Gain = {
+        .Src = SrcBuffer, .SrcSize = 0,
+        .Dst = DstBuffer, .DstSize = 0,
+        .Shift = Shift, .qMin = 0xE + 0xC, .qMax = 0,
+    };
+    int Size = Block_Gain_Process(State, &Gain);
+    if(DstSize) *DstSize = Gain.DstSize;
+    return Size;
+}
+int ULC_BlockGainRange(const struct ULC_DecoderState_t *State, const void *SrcBuffer, int *MinShift, int *MaxShift)
+{
+    struct Block_Gain_t Gain = {
+        .Src = SrcBuffer, .SrcSize = 0,
+        .Dst = NULL, .DstSize = 0,
+        .Shift = 0, .qMin = 0xE + 0xC, .qMax = 0,
+    };
+    int Size = Block_Gain_Process(State, &Gain);
+    if(Size && Gain.qMin <= Gain.qMax)
+    {
+        //! 0 <= qi-Shift <= 0xE+0xC
+        if(Gain.qMax - (0xE + 0xC) > *MinShift) *MinShift = Gain.qMax - (0xE + 0xC);
+        if(Gain.qMin               < *MaxShift) *MaxShift = Gain.qMin;
+    }
     return Size;
 }
 
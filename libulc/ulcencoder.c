@@ -10,6 +10,7 @@
 #include "fourier.h"
 #include "ulcencoder.h"
 #include "ulchelper.h"
+#include "ulctrace.h"
 /**************************************/
 #include "ulcencoder_blocktransform.h"
 #include "ulcencoder_encode.h"
@@ -31,6 +32,10 @@ int ULC_EncoderState_Init(struct ULC_EncoderState_t *State)
 {
     //! Clear anything that is needed for EncoderState_Destroy()
     State->BufferData = NULL;
+#if ULC_USE_LONG_TERM_PREDICTION
+    State->LTPDecoder.BufferData = NULL;
+    State->LTPDecoder.Resampler.BufferData = NULL;
+#endif
 
     //! Verify parameters
     int nChan      = State->nChan;
@@ -38,10 +43,41 @@ int ULC_EncoderState_Init(struct ULC_EncoderState_t *State)
     if(nChan     < MIN_CHANS || nChan     > MAX_CHANS) return -1;
     if(BlockSize < MIN_BANDS || BlockSize > MAX_BANDS) return -1;
     if((BlockSize & (-BlockSize)) != BlockSize)        return -1;
+    if(State->ChanGroupSize < 0) return -1;
+    if(State->ChanGroupSize < nChan && (State->ChanGroupSize & 1)) return -1; //! Keep channel pairs together
+    if(State->ABRLookahead  < 0) return -1;
+#if ULC_USE_LONG_TERM_PREDICTION
+    int LTP = (State->LongTermPrediction != 0);
+    if(LTP && State->ABRLookahead) return -1;
+#else
+    if(State->LongTermPrediction) return -1;
+#endif
+    if(State->ChanGroupSize == 0 || State->ChanGroupSize > nChan) State->ChanGroupSize = nChan;
+    int nChanGroups = State->nChanGroups = (nChan + State->ChanGroupSize-1) / State->ChanGroupSize;
+
+    //! Get the layout of each ABRQueue[] entry (padded for alignment)
+    int nQueued = State->ABRLookahead ? (State->ABRLookahead+1) : 0;
+    int QueueEntrySize = 0;
+#define CREATE_BUFFER(Name, Sz) int Name##_EntryOffs = QueueEntrySize; QueueEntrySize += Sz
+    CREATE_BUFFER(TransformBuffer, sizeof(float) * (nChan*BlockSize));
+#if ULC_USE_NOISE_CODING
+    CREATE_BUFFER(TransformNoise,  sizeof(float) * (nChan*BlockSize));
+#endif
+    CREATE_BUFFER(TransformIndex,  sizeof(int)   * (nChan*BlockSize));
+    CREATE_BUFFER(ChanGroupNzCoef, sizeof(int)   * nChanGroups);
+    CREATE_BUFFER(StereoLR,        sizeof(uint8_t) * (nChan/2));
+#if ULC_USE_PARAMETRIC_STEREO
+    CREATE_BUFFER(StereoParametric, sizeof(uint8_t) * (nChan/2));
+    CREATE_BUFFER(StereoParams,    sizeof(uint8_t) * (nChan/2) * ULC_MAX_SUBBLOCKS*ULC_PARAMETRIC_STEREO_NBANDS);
+#endif
+#undef CREATE_BUFFER
+    QueueEntrySize = (QueueEntrySize + BUFFER_ALIGNMENT-1) &~ (BUFFER_ALIGNMENT-1);
 
     //! Get buffer offsets and allocation size
     //! NOTE: TransformTemp must be able to contain at least two
     //! blocks' worth of data (MDCT+MDST coefficients for analysis).
+    //! This also leaves enough space for the amplitude spectrum of
+    //! each channel group during analysis (nChanGroups <= nChan).
     int AllocSize = 0;
 #define CREATE_BUFFER(Name, Sz) int Name##_Offs = AllocSize; AllocSize += Sz
     CREATE_BUFFER(SampleBuffer,    sizeof(float) * (nChan*BlockSize) * 2);
@@ -53,9 +89,27 @@ int ULC_EncoderState_Init(struct ULC_EncoderState_t *State)
     CREATE_BUFFER(TransformTemp,   sizeof(float) * ((nChan + (nChan < 2)) * BlockSize));
 #if ULC_USE_PSYCHOACOUSTICS
     CREATE_BUFFER(FreqWeightTable, sizeof(float) * (2*BlockSize - BlockSize/ULC_MAX_BLOCK_DECIMATION_FACTOR));
+#endif
+#if ULC_USE_PSYCHOACOUSTICS && ULC_USE_TEMPORAL_MASKING
+    CREATE_BUFFER(MaskingMemory,   sizeof(float) * (nChanGroups*BlockSize/2));
 #endif
     CREATE_BUFFER(TransformIndex,  sizeof(int)   * (nChan*BlockSize));
+    CREATE_BUFFER(ABRQueueData,    QueueEntrySize * nQueued);
+    CREATE_BUFFER(ABRQueue,        sizeof(struct ULC_EncoderAnalysis_t) * nQueued);
     CREATE_BUFFER(TransientBuffer, sizeof(struct ULC_TransientData_t) * ULC_MAX_BLOCK_DECIMATION_FACTOR*2);
+#if ULC_USE_LONG_TERM_PREDICTION
+    int LTPTempSize = 2*BlockSize + ULC_LTP_HISTORY_SIZE*3/2;
+    if(LTPTempSize < nChan*BlockSize) LTPTempSize = nChan*BlockSize;
+    CREATE_BUFFER(LTPTemp,         sizeof(float) * LTPTempSize * LTP);
+    CREATE_BUFFER(LTPLag,          sizeof(int)   * nChan * LTP);
+    CREATE_BUFFER(LTPGain,         sizeof(uint8_t) * (nChan*ULC_LTP_NBANDS) * LTP);
+#endif
+    CREATE_BUFFER(ChanGroupNzCoef, sizeof(int)   * nChanGroups);
+    CREATE_BUFFER(StereoLR,        sizeof(uint8_t) * (nChan/2));
+#if ULC_USE_PARAMETRIC_STEREO
+    CREATE_BUFFER(StereoParametric, sizeof(uint8_t) * (nChan/2));
+    CREATE_BUFFER(StereoParams,    sizeof(uint8_t) * (nChan/2) * ULC_MAX_SUBBLOCKS*ULC_PARAMETRIC_STEREO_NBANDS);
+#endif
 #undef CREATE_BUFFER
 
     //! Allocate buffer space
@@ -63,6 +117,7 @@ int ULC_EncoderState_Init(struct ULC_EncoderState_t *State)
     if(!Buf) return -1;
 
     //! Initialize pointers
+    int i;
     Buf += (-(uintptr_t)Buf) & (BUFFER_ALIGNMENT-1);
     State->SampleBuffer    = (float*)(Buf + SampleBuffer_Offs);
     State->TransformBuffer = (float*)(Buf + TransformBuffer_Offs);
@@ -73,16 +128,61 @@ int ULC_EncoderState_Init(struct ULC_EncoderState_t *State)
     State->TransformTemp   = (float*)(Buf + TransformTemp_Offs);
 #if ULC_USE_PSYCHOACOUSTICS
     State->FreqWeightTable = (float*)(Buf + FreqWeightTable_Offs);
+#endif
+#if ULC_USE_PSYCHOACOUSTICS && ULC_USE_TEMPORAL_MASKING
+    State->MaskingMemory   = (float*)(Buf + MaskingMemory_Offs);
 #endif
     State->TransformIndex  = (int  *)(Buf + TransformIndex_Offs);
     State->TransientBuffer = (struct ULC_TransientData_t*)(Buf + TransientBuffer_Offs);
+#if ULC_USE_LONG_TERM_PREDICTION
+    State->LTPTemp         = LTP ? (float  *)(Buf + LTPTemp_Offs) : NULL;
+    State->LTPLag          = LTP ? (int    *)(Buf + LTPLag_Offs)  : NULL;
+    State->LTPGain         = LTP ? (uint8_t*)(Buf + LTPGain_Offs) : NULL;
+#endif
+    State->ChanGroupNzCoef = (int  *)(Buf + ChanGroupNzCoef_Offs);
+    State->StereoLR        = (uint8_t*)(Buf + StereoLR_Offs);
+#if ULC_USE_PARAMETRIC_STEREO
+    State->StereoParametric = (uint8_t*)(Buf + StereoParametric_Offs);
+    State->StereoParams    = (uint8_t*)(Buf + StereoParams_Offs);
+#endif
+    State->ABRQueue        = nQueued ? (struct ULC_EncoderAnalysis_t*)(Buf + ABRQueue_Offs) : NULL;
+    for(i=0; i<nQueued; i++)
+    {
+        char *EntryBuf = Buf + ABRQueueData_Offs + i*QueueEntrySize;
+        struct ULC_EncoderAnalysis_t *Entry = &State->ABRQueue[i];
+        Entry->TransformBuffer = (float*)(EntryBuf + TransformBuffer_EntryOffs);
+#if ULC_USE_NOISE_CODING
+        Entry->TransformNoise  = (float*)(EntryBuf + TransformNoise_EntryOffs);
+#endif
+        Entry->TransformIndex  = (int  *)(EntryBuf + TransformIndex_EntryOffs);
+        Entry->ChanGroupNzCoef = (int  *)(EntryBuf + ChanGroupNzCoef_EntryOffs);
+        Entry->StereoLR        = (uint8_t*)(EntryBuf + StereoLR_EntryOffs);
+#if ULC_USE_PARAMETRIC_STEREO
+        Entry->StereoParametric = (uint8_t*)(EntryBuf + StereoParametric_EntryOffs);
+        Entry->StereoParams    = (uint8_t*)(EntryBuf + StereoParams_EntryOffs);
+#endif
+    }
 
     //! Set initial state
-    int i;
     State->NextWindowCtrl = 0x10; //! No decimation, full overlap. Doesn't really matter, though.
+    State->WindowCtrlOverride = -1;
+    State->BitReservoirLevel = State->BitReservoirSize; //! Decoder starts with a full buffer
+    State->BitReservoirAvgComplexity = 0.0f;
+    State->ABRHead          = 0;
+    State->ABRnQueued       = 0;
+    State->ABRDebt          = 0.0;
+    State->ABRComplexitySum = 0.0;
+    State->ABRnAnalyzed     = 0.0;
     for(i=0; i<3;                i++) State->TransientFilter[i] = 0.0f;
     for(i=0; i<nChan*BlockSize*2; i++) State->SampleBuffer   [i] = 0.0f;
     for(i=0; i<nChan*BlockSize;  i++) State->TransformFwdLap[i] = 0.0f;
+    for(i=0; i<nChan/2;          i++) State->StereoLR       [i] = 0;
+#if ULC_USE_PARAMETRIC_STEREO
+    for(i=0; i<nChan/2;          i++) State->StereoParametric[i] = 0;
+#endif
+#if ULC_USE_PSYCHOACOUSTICS && ULC_USE_TEMPORAL_MASKING
+    for(i=0; i<nChanGroups*BlockSize/2; i++) State->MaskingMemory[i] = ULC_TEMPORAL_MASKING_FLOOR_NP;
+#endif
     for(i=0; i<ULC_MAX_BLOCK_DECIMATION_FACTOR*2; i++)
     {
         State->TransientBuffer[i] = (struct ULC_TransientData_t)
@@ -93,6 +193,28 @@ int ULC_EncoderState_Init(struct ULC_EncoderState_t *State)
 #if ULC_USE_PSYCHOACOUSTICS
     Block_Transform_CalculatePsychoacoustics_CalcFreqWeightTable(State->FreqWeightTable, BlockSize, State->RateHz*0.5f);
 #endif
+#if ULC_USE_LONG_TERM_PREDICTION
+    //! Create the decoder that tracks the prediction history
+    if(LTP)
+    {
+        for(i=0; i<nChan; i++) State->LTPLag[i] = 0;
+        State->LTPDecoder.nChan        = nChan;
+        State->LTPDecoder.BlockSize    = BlockSize;
+        State->LTPDecoder.RateHz       = State->RateHz;
+        State->LTPDecoder.OutputRateHz = 0;
+        State->LTPDecoder.OutputFormat = ULC_DECODER_OUTPUT_FLOAT32;
+        State->LTPDecoder.Flags        = 0;
+        State->LTPDecoder.LongTermPrediction = 1;
+        State->LTPDecoder.ScratchBuffer      = NULL;
+        if(ULC_DecoderState_Init(&State->LTPDecoder) < 0) return -1;
+    }
+#endif
+
+    //! Select the fastest transform algorithm for each subblock size
+    //! NOTE: This is only measured once per process for each size (or
+    //! never, if plans were loaded from wisdom beforehand). Failure is
+    //! not fatal, as unplanned sizes simply use the default algorithm.
+    Fourier_Plan_Measure(BlockSize / ULC_MAX_BLOCK_DECIMATION_FACTOR, BlockSize);
     //! Success
     return 1;
 }
@@ -104,23 +226,46 @@ void ULC_EncoderState_Destroy(struct ULC_EncoderState_t *State)
 {
     //! Free buffer space
     free(State->BufferData);
+#if ULC_USE_LONG_TERM_PREDICTION
+    ULC_DecoderState_Destroy(&State->LTPDecoder);
+#endif
+}
+
+/**************************************/
+
+//! Get the number of bits available to a block at a given rate
+static inline int ULC_GetBitBudget(const struct ULC_EncoderState_t *State, float RateKbps)
+{
+    return (int)((State->BlockSize * RateKbps) * 1000.0f/State->RateHz); //! NOTE: Truncate
+}
+
+//! Decode a coded block to update the long-term prediction history
+static inline void ULC_EncodeBlock_UpdateLTP(struct ULC_EncoderState_t *State, const void *Buf)
+{
+#if ULC_USE_LONG_TERM_PREDICTION
+    if(State->LongTermPrediction) ULC_DecodeBlock(&State->LTPDecoder, State->LTPTemp, Buf);
+#else
+    (void)State, (void)Buf;
+#endif
 }
 
 /**************************************/
 
 //! Encode block (CBR mode)
-int ULC_EncodeBlock_CBR_Core(struct ULC_EncoderState_t *State, void *DstBuffer, float RateKbps, int MaxCoef)
+int ULC_EncodeBlock_CBR_Core(struct ULC_EncoderState_t *State, void *DstBuffer, int BitBudget, int MaxCoef)
 {
     int Size;
     int nOutCoef  = -1;
-    int BitBudget = (int)((State->BlockSize * RateKbps) * 1000.0f/State->RateHz); //! NOTE: Truncate
+    int nProbes   = 0;
 
     //! Perform a binary search for the optimal nOutCoef
+    ULC_TRACE_BEGIN(TraceSearch);
     int Lo = 0, Hi = MaxCoef;
     if(Lo < Hi) do
         {
             nOutCoef = (Lo + Hi) / 2u;
             Size = Block_Encode_EncodePass(State, DstBuffer, nOutCoef);
+            nProbes++;
             if(Size < BitBudget) Lo = nOutCoef;
             else if(Size > BitBudget) Hi = nOutCoef-1;
             else
@@ -134,15 +279,76 @@ int ULC_EncodeBlock_CBR_Core(struct ULC_EncoderState_t *State, void *DstBuffer,
 
     //! Avoid going over budget
     int nOutCoefFinal = Lo;
-    if(nOutCoefFinal != nOutCoef) Size = Block_Encode_EncodePass(State, DstBuffer, nOutCoef = nOutCoefFinal);
+    if(nOutCoefFinal != nOutCoef)
+    {
+        Size = Block_Encode_EncodePass(State, DstBuffer, nOutCoef = nOutCoefFinal);
+        nProbes++;
+    }
+    ULC_TRACE_END(TraceSearch, "Encode:RateSearch", "nProbes", nProbes);
+    (void)nProbes; //! <- Only used for tracing
+    return Size;
+}
+static int ULC_EncodeBlock_CBR_Reservoir(struct ULC_EncoderState_t *State, void *DstBuffer, int BitBudget, int MaxCoef)
+{
+    //! Model the decoder's buffer as a leaky bucket: each block
+    //! period, BitBudget bits arrive (anything beyond the buffer
+    //! size is lost), and each decoded block removes its bits.
+    //! A block can never be larger than the current fill level,
+    //! so a decoder with this buffer size (starting full) never
+    //! underflows. A reservoir smaller than a block's budget is
+    //! treated as exactly one block's budget, which is plain CBR.
+    int BufferSize = State->BitReservoirSize;
+    if(BufferSize < BitBudget) BufferSize = BitBudget;
+    int Level = State->BitReservoirLevel;
+    if(Level > BufferSize) Level = BufferSize;
+
+    //! Share bits between blocks based on their complexity, in the
+    //! same way as ABR mode, relative to a running average of the
+    //! complexity. Bits borrowed by complex blocks are repaid by
+    //! drawing the fill level back towards full, so that the long-
+    //! term rate stays at RateKbps.
+    float Complexity = State->BlockComplexity;
+    float AvgComplexity = State->BitReservoirAvgComplexity;
+    if(AvgComplexity == 0.0f) AvgComplexity = Complexity;
+    AvgComplexity += (Complexity - AvgComplexity) * (1.0f/16);
+    State->BitReservoirAvgComplexity = AvgComplexity;
+    float Demand = (AvgComplexity > 0.0f) ? (Complexity / AvgComplexity) : 1.0f;
+    int Target = (int)(BitBudget*Demand + (Level - BufferSize)*0.125f);
+
+    //! Never underflow, and avoid wasting bits on overflow
+    //! NOTE: Blocks are stored in whole bytes, so the target is
+    //! rounded down to whole bytes, and the fill level is charged
+    //! for the padded size (which Block_Encode_EncodePass() already
+    //! returns, but the model shouldn't rely on it).
+    int MinTarget = Level + BitBudget - BufferSize;
+    if(Target < MinTarget) Target = MinTarget;
+    if(Target > Level)     Target = Level;
+    Target &= ~7;
+
+    //! Encode, and update the fill level
+    int Size = ULC_EncodeBlock_CBR_Core(State, DstBuffer, Target, MaxCoef);
+    Level += BitBudget - ((Size+7) &~ 7);
+    if(Level > BufferSize) Level = BufferSize;
+    State->BitReservoirLevel = Level;
     return Size;
 }
+static int ULC_EncodeBlock_CBR_RateControl(struct ULC_EncoderState_t *State, void *DstBuffer, int MaxCoef, float RateKbps)
+{
+    int BitBudget = ULC_GetBitBudget(State, RateKbps);
+    if(State->BitReservoirSize > 0)
+        return ULC_EncodeBlock_CBR_Reservoir(State, DstBuffer, BitBudget, MaxCoef);
+    else
+        return ULC_EncodeBlock_CBR_Core(State, DstBuffer, BitBudget, MaxCoef);
+}
 const void *ULC_EncodeBlock_CBR(struct ULC_EncoderState_t *State, const float *SrcData, int *Size, float RateKbps)
 {
+    ULC_TRACE_BEGIN(TraceBlock);
     void *Buf = (void*)State->TransformTemp;
     int MaxCoef = Block_Transform(State, SrcData);
-    int Sz = ULC_EncodeBlock_CBR_Core(State, Buf, RateKbps, MaxCoef);
+    int Sz = ULC_EncodeBlock_CBR_RateControl(State, Buf, MaxCoef, RateKbps);
+    ULC_EncodeBlock_UpdateLTP(State, Buf);
     if(Size) *Size = Sz;
+    ULC_TRACE_END(TraceBlock, "ULC_EncodeBlock", "WindowCtrl", State->WindowCtrl);
     return Buf;
 }
 
@@ -151,24 +357,126 @@ const void *ULC_EncodeBlock_CBR(struct ULC_EncoderState_t *State, const float *S
 //! Encode block (ABR mode)
 const void *ULC_EncodeBlock_ABR(struct ULC_EncoderState_t *State, const float *SrcData, int *Size, float RateKbps, float AvgComplexity)
 {
+    ULC_TRACE_BEGIN(TraceBlock);
     void *Buf = (void*)State->TransformTemp;
     int MaxCoef = Block_Transform(State, SrcData);
     float TargetKbps = RateKbps * State->BlockComplexity / AvgComplexity;
-    int Sz = ULC_EncodeBlock_CBR_Core(State, Buf, TargetKbps, MaxCoef);
+    int Sz = ULC_EncodeBlock_CBR_Core(State, Buf, ULC_GetBitBudget(State, TargetKbps), MaxCoef);
+    ULC_EncodeBlock_UpdateLTP(State, Buf);
+    if(Size) *Size = Sz;
+    ULC_TRACE_END(TraceBlock, "ULC_EncodeBlock", "WindowCtrl", State->WindowCtrl);
+    return Buf;
+}
+
+//! Encode block (ABR mode, with lookahead)
+#define ABR_FEEDBACK_HORIZON 16 //! Extra blocks (beyond the lookahead) over which to spread corrections
+#define SWAP(a, b) do { __typeof__(a) t_ = (a); (a) = (b); (b) = t_; } while(0)
+static void ULC_EncodeBlock_ABR_SwapAnalysis(struct ULC_EncoderState_t *State, struct ULC_EncoderAnalysis_t *Entry)
+{
+    //! Swap the analysis buffers (and results) of the encoder state
+    //! with those of the queue entry, without copying anything
+    SWAP(State->WindowCtrl,      Entry->WindowCtrl);
+    SWAP(State->BlockComplexity, Entry->BlockComplexity);
+    SWAP(State->TransformBuffer, Entry->TransformBuffer);
+#if ULC_USE_NOISE_CODING
+    SWAP(State->TransformNoise,  Entry->TransformNoise);
+#endif
+    SWAP(State->TransformIndex,  Entry->TransformIndex);
+    SWAP(State->ChanGroupNzCoef, Entry->ChanGroupNzCoef);
+    SWAP(State->StereoLR,        Entry->StereoLR);
+#if ULC_USE_PARAMETRIC_STEREO
+    SWAP(State->StereoParametric, Entry->StereoParametric);
+    SWAP(State->StereoParams,    Entry->StereoParams);
+#endif
+}
+#undef SWAP
+static int ULC_EncodeBlock_ABR_PlanBudget(const struct ULC_EncoderState_t *State, float RateKbps, float AvgComplexity, int Flushing)
+{
+    //! Each block's demand is its share of the nominal budget, scaled
+    //! by its complexity relative to the average (as in ABR mode).
+    //! The bits spent beyond the nominal budget so far, plus those that
+    //! the blocks in the lookahead window will need beyond it, are then
+    //! spread over the coming blocks, so that upcoming complex passages
+    //! are saved for ahead of time, rather than only repaid afterwards.
+    //! Once flushing, the end of the stream is known to be within the
+    //! queue, and so the correction is spread over those blocks only.
+    //! NOTE: The correction is limited to one block's nominal budget,
+    //! so that a burst of complex blocks can't starve the others.
+    int n, K = State->ABRLookahead, nQueued = State->ABRnQueued;
+    float Budget = (State->BlockSize * RateKbps) * 1000.0f/State->RateHz;
+    if(AvgComplexity == 0.0f) AvgComplexity = (float)(State->ABRComplexitySum / State->ABRnAnalyzed);
+    if(!(AvgComplexity > 0.0f)) return (int)Budget; //! <- Nothing but silence so far
+    float  Scale  = Budget / AvgComplexity;
+    float  Demand = State->BlockComplexity * Scale;
+    double Ahead  = 0.0;
+    for(n=1; n<nQueued; n++)
+    {
+        const struct ULC_EncoderAnalysis_t *Entry = &State->ABRQueue[(State->ABRHead + n) % (K+1)];
+        Ahead += Entry->BlockComplexity*Scale - Budget;
+    }
+    float Correction = (float)((State->ABRDebt + Ahead) / (Flushing ? nQueued : (nQueued + ABR_FEEDBACK_HORIZON)));
+    if(Correction < -Budget) Correction = -Budget;
+    if(Correction > +Budget) Correction = +Budget;
+    float Target = Demand - Correction;
+    return (Target > 0.0f) ? (int)Target : 0;
+}
+const void *ULC_EncodeBlock_ABR_Lookahead(struct ULC_EncoderState_t *State, const float *SrcData, int *Size, float RateKbps, float AvgComplexity)
+{
+    ULC_TRACE_BEGIN(TraceBlock);
+    int n, K = State->ABRLookahead;
+    void *Buf = (void*)State->TransformTemp;
+    struct ULC_EncoderAnalysis_t *Queue = State->ABRQueue;
+
+    //! Analyze the new block, and move it to the end of the queue
+    //! NOTE: The transform keeps its lapping buffer in the stereo
+    //! domain of the last analyzed block, so StereoLR[] must always
+    //! hold that block's modes between calls.
+    struct ULC_EncoderAnalysis_t *Tail = &Queue[(State->ABRHead + State->ABRnQueued + K) % (K+1)];
+    if(SrcData)
+    {
+        Tail = &Queue[(State->ABRHead + State->ABRnQueued) % (K+1)];
+        Tail->MaxCoef = Block_Transform(State, SrcData);
+        State->ABRComplexitySum += State->BlockComplexity;
+        State->ABRnAnalyzed     += 1.0;
+        ULC_EncodeBlock_ABR_SwapAnalysis(State, Tail);
+        if(++State->ABRnQueued <= K)
+        {
+            for(n=0; n<State->nChan/2; n++) State->StereoLR[n] = Tail->StereoLR[n];
+            if(Size) *Size = 0;
+            ULC_TRACE_END(TraceBlock, "ULC_EncodeBlock", "WindowCtrl", Tail->WindowCtrl);
+            return NULL;
+        }
+    }
+    else if(!State->ABRnQueued)
+    {
+        if(Size) *Size = 0;
+        return NULL;
+    }
+
+    //! Swap the oldest block back in, and code it
+    struct ULC_EncoderAnalysis_t *Head = &Queue[State->ABRHead];
+    ULC_EncodeBlock_ABR_SwapAnalysis(State, Head);
+    int Target = ULC_EncodeBlock_ABR_PlanBudget(State, RateKbps, AvgComplexity, !SrcData);
+    int Sz = ULC_EncodeBlock_CBR_Core(State, Buf, Target, Head->MaxCoef);
+    State->ABRDebt += Sz - (State->BlockSize * RateKbps) * 1000.0/State->RateHz;
+    State->ABRHead  = (State->ABRHead + 1) % (K+1);
+    State->ABRnQueued--;
     if(Size) *Size = Sz;
+    ULC_TRACE_END(TraceBlock, "ULC_EncodeBlock", "WindowCtrl", State->WindowCtrl);
+
+    //! Restore the stereo modes of the last analyzed block
+    if(Tail != Head) for(n=0; n<State->nChan/2; n++) State->StereoLR[n] = Tail->StereoLR[n];
     return Buf;
 }
 
 /**************************************/
 
 //! Encode block (VBR mode)
-const void *ULC_EncodeBlock_VBR(struct ULC_EncoderState_t *State, const float *SrcData, int *Size, float Quality)
+static int ULC_EncodeBlock_VBR_RateControl(struct ULC_EncoderState_t *State, void *DstBuffer, int MaxCoef, float Quality)
 {
     //! NOTE: The constant in front of the logarithm was experimentally
     //! dervied; I have no idea what relation it bears to actual encoding.
-    void *Buf = (void*)State->TransformTemp;
-    float TargetComplexity = 0x1.E4EFB7p3f*logf(100.0f / Quality); //! 0x1.E4EFB7p3 = E^E. This seems to closely match ABR mode's peak rates
-    int MaxCoef  = Block_Transform(State, SrcData);
+    float TargetComplexity = 0x1.E4EFB7p3f*ULC_Logf(100.0f / Quality); //! 0x1.E4EFB7p3 = E^E. This seems to closely match ABR mode's peak rates
     int nTargetCoef = MaxCoef;
     {
         //! TargetComplexity == 0 which would result in a
@@ -180,11 +488,52 @@ const void *ULC_EncodeBlock_VBR(struct ULC_EncoderState_t *State, const float *S
             if(fTarget < MaxCoef) nTargetCoef = (int)fTarget;
         }
     }
-    int Sz = Block_Encode_EncodePass(State, Buf, nTargetCoef);
+    return Block_Encode_EncodePass(State, DstBuffer, nTargetCoef);
+}
+const void *ULC_EncodeBlock_VBR(struct ULC_EncoderState_t *State, const float *SrcData, int *Size, float Quality)
+{
+    ULC_TRACE_BEGIN(TraceBlock);
+    void *Buf = (void*)State->TransformTemp;
+    int MaxCoef = Block_Transform(State, SrcData);
+    int Sz = ULC_EncodeBlock_VBR_RateControl(State, Buf, MaxCoef, Quality);
+    ULC_EncodeBlock_UpdateLTP(State, Buf);
+    if(Size) *Size = Sz;
+    ULC_TRACE_END(TraceBlock, "ULC_EncodeBlock", "WindowCtrl", State->WindowCtrl);
+    return Buf;
+}
+
+/**************************************/
+
+//! Encode block from MDCT coefficients
+const void *ULC_EncodeBlock_CBR_Coefs(struct ULC_EncoderState_t *State, const float *Coef, int WindowCtrl, int NextWindowCtrl, int *Size, float RateKbps)
+{
+    ULC_TRACE_BEGIN(TraceBlock);
+    void *Buf = (void*)State->TransformTemp;
+    int MaxCoef = Block_Transform_FromCoefs(State, Coef, WindowCtrl, NextWindowCtrl);
+    int Sz = ULC_EncodeBlock_CBR_RateControl(State, Buf, MaxCoef, RateKbps);
+    ULC_EncodeBlock_UpdateLTP(State, Buf);
+    if(Size) *Size = Sz;
+    ULC_TRACE_END(TraceBlock, "ULC_EncodeBlock", "WindowCtrl", State->WindowCtrl);
+    return Buf;
+}
+const void *ULC_EncodeBlock_VBR_Coefs(struct ULC_EncoderState_t *State, const float *Coef, int WindowCtrl, int NextWindowCtrl, int *Size, float Quality)
+{
+    ULC_TRACE_BEGIN(TraceBlock);
+    void *Buf = (void*)State->TransformTemp;
+    int MaxCoef = Block_Transform_FromCoefs(State, Coef, WindowCtrl, NextWindowCtrl);
+    int Sz = ULC_EncodeBlock_VBR_RateControl(State, Buf, MaxCoef, Quality);
+    ULC_EncodeBlock_UpdateLTP(State, Buf);
     if(Size) *Size = Sz;
+    ULC_TRACE_END(TraceBlock, "ULC_EncodeBlock", "WindowCtrl", State->WindowCtrl);
     return Buf;
 }
 
+//! Prime encoder with input data
+void ULC_EncodeBlock_Prime(struct ULC_EncoderState_t *State, const float *SrcData)
+{
+    Block_Transform(State, SrcData);
+}
+
 /**************************************/
 //! EOF
 /**************************************/
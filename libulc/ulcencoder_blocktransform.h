@@ -13,10 +13,14 @@
 #include "ulcencoder_psycho.h"
 #include "ulcencoder_windowcontrol.h"
 #include "ulchelper.h"
+#include "ulctrace.h"
 /**************************************/
 #if ULC_USE_NOISE_CODING
 #include "ulcencoder_noisefill.h"
 #endif
+#if ULC_USE_LONG_TERM_PREDICTION
+#include "ulcencoder_ltp.h"
+#endif
 /**************************************/
 
 //! Transform a block and prepare its coefficients
@@ -84,12 +88,485 @@ static inline void Block_Transform_SortIndices(int *SortedIndices, const float *
         SortedIndices[Order[0]] = n;
     }
 }
+#if ULC_USE_STEREO_SWITCHING
+static inline void Block_Transform_SetStereoModes(struct ULC_EncoderState_t *State, float *Data, int ParametricStereo)
+{
+    //! Data[] holds the M/S data of the block (samples, or MDCT
+    //! coefficients when coding from these), which is converted in
+    //! place for pairs that switch to L/R. L/R pairs are only
+    //! considered when StereoSwitching is set, and parametric pairs
+    //! only when ParametricStereo is set.
+    int n, Chan;
+    int nChan     = State->nChan;
+    int BlockSize = State->BlockSize;
+    for(Chan=1; Chan<nChan; Chan+=2)
+    {
+        //! Get the energy of each channel in both domains
+        //! NOTE: The data is M/S-coded at this point, and L = M+S,
+        //! R = M-S, so we only need the M/S energies and their cross
+        //! term. To compare on an orthonormal basis, M and S must be
+        //! scaled by Sqrt[2], so that EM*ES is scaled by 4.
+        float *BufM = Data + (Chan-1)*BlockSize;
+        float *BufS = Data + (Chan  )*BlockSize;
+        float EM = 0.0f, ES = 0.0f, EMS = 0.0f;
+        for(n=0; n<BlockSize; n++)
+        {
+            EM  += SQR(BufM[n]);
+            ES  += SQR(BufS[n]);
+            EMS += BufM[n] * BufS[n];
+        }
+        float EL = EM + ES + 2.0f*EMS;
+        float ER = EM + ES - 2.0f*EMS;
+
+        //! The coding cost of a pair is roughly proportional to the
+        //! log of the product of its energies, so pick the domain that
+        //! minimizes this. M/S is preferred unless L/R is at least 3dB
+        //! better, as the psychoacoustic weighting assumes M/S coding.
+        //! NOTE: With L/R pairs re-normalized (see
+        //! Block_Transform_NormalizeStereoPairs()), switching gave
+        //! the same or better SNR at the same or lower rate on all test
+        //! clips (eg. hard-panned sources, or one channel 20-80dB down:
+        //! 0.1-1.7dB better at VBR -50, at 3-22% lower rates). Without
+        //! the 3dB margin, some clips gained ~1dB more, but mixed ones
+        //! grew slightly for no gain, so the margin is kept.
+        int UseLR = (State->StereoSwitching && EL*ER < (4.0f*0.5f)*EM*ES);
+#if ULC_USE_PARAMETRIC_STEREO
+        //! Parametric pairs rebuild S from M, so only use these when
+        //! most of S can be predicted from M: the unpredictable part of
+        //! S is synthesized as decorrelated noise, which suits ambience
+        //! but not independent sources (eg. wide-panned instruments).
+        //! Parametric pairs are always coded in M/S.
+        int UsePS = (ParametricStereo && (ES - SQR(EMS)/(EM + 0x1.0p-126f)) < 0.5f*EM);
+        if(UsePS) UseLR = 0;
+        State->StereoParametric[Chan/2] = UsePS;
+#endif
+
+        //! Move the forward lapping buffer to the new domain, and
+        //! convert this block's data to L/R if needed
+        float *LapM = State->TransformFwdLap + (Chan-1)*BlockSize;
+        float *LapS = State->TransformFwdLap + (Chan  )*BlockSize;
+        if(UseLR != State->StereoLR[Chan/2])
+        {
+            float s = UseLR ? 1.0f : 0.5f;
+            for(n=0; n<BlockSize; n++)
+            {
+                float a = LapM[n];
+                float b = LapS[n];
+                LapM[n] = (a+b) * s;
+                LapS[n] = (a-b) * s;
+            }
+        }
+        if(UseLR) for(n=0; n<BlockSize; n++)
+            {
+                float a = BufM[n];
+                float b = BufS[n];
+                BufM[n] = (a+b);
+                BufS[n] = (a-b);
+            }
+        State->StereoLR[Chan/2] = UseLR;
+    }
+}
+
+//! Re-normalize the importance levels of L/R pairs
+//! Each channel's levels are normalized by the energy of its own
+//! [sub]block (see Block_Transform_WeighSubBlock()). In M/S pairs,
+//! both channels carry the louder source, but in L/R pairs, this
+//! would rank a much quieter channel as highly as the louder one,
+//! and take bits from it (eg. a channel 40dB down would be coded to
+//! a similar SNR, at a large cost to the other). So the quieter
+//! channel is normalized by the energy of the louder one instead.
+static inline void Block_Transform_NormalizeStereoPairs(struct ULC_EncoderState_t *State, int WindowCtrl)
+{
+    int n, Chan;
+    int nChan     = State->nChan;
+    int BlockSize = State->BlockSize;
+    for(Chan=1; Chan<nChan; Chan+=2) if(State->StereoLR[Chan/2])
+        {
+            const float *CoefL = State->TransformBuffer + (Chan-1)*BlockSize;
+            const float *CoefR = State->TransformBuffer + (Chan  )*BlockSize;
+            float *IndexL = (float*)State->TransformIndex + (Chan-1)*BlockSize;
+            float *IndexR = (float*)State->TransformIndex + (Chan  )*BlockSize;
+            ULC_SubBlockDecimationPattern_t DecimationPattern = ULC_SubBlockDecimationPattern(WindowCtrl);
+            do
+            {
+                int SubBlockSize = BlockSize >> (DecimationPattern&0x7);
+                float EL = 0x1.0p-126f, ER = 0x1.0p-126f;
+                for(n=0; n<SubBlockSize; n++)
+                {
+                    EL += SQR(CoefL[n]);
+                    ER += SQR(CoefR[n]);
+                }
+                float *Index = (EL < ER) ? IndexL : IndexR;
+                float  Bias  = (EL < ER) ? ULC_Logf(EL / ER) : ULC_Logf(ER / EL);
+                for(n=0; n<SubBlockSize; n++) Index[n] += Bias;
+                CoefL  += SubBlockSize, CoefR  += SubBlockSize;
+                IndexL += SubBlockSize, IndexR += SubBlockSize;
+            }
+            while(DecimationPattern >>= 4);
+        }
+}
+#endif
+#if ULC_USE_PARAMETRIC_STEREO
+static inline int Block_Transform_SetParametricStereo(struct ULC_EncoderState_t *State, int Chan, int WindowCtrl)
+{
+    //! Get the parameters of each band from the pseudo-DFT (MDCT+MDST)
+    //! of M and S: Level is the projection of S onto M, and Spread is
+    //! the energy of what remains, relative to M. The S channel is then
+    //! removed from the codeable coefficients.
+    //! NOTE: The MDST coefficients are still in SampleBuffer[] at this
+    //! point, but have not been normalized.
+    //! Returns the number of codeable coefficients removed.
+    int n, Band, nRemoved = 0;
+    int BlockSize = State->BlockSize;
+    const float *ReM = State->TransformBuffer + (Chan-1)*BlockSize;
+    const float *ReS = State->TransformBuffer + (Chan  )*BlockSize;
+    const float *ImM = State->SampleBuffer    + (Chan-1)*BlockSize;
+    const float *ImS = State->SampleBuffer    + (Chan  )*BlockSize;
+    float   *IndexS  = (float*)State->TransformIndex + Chan*BlockSize;
+    uint8_t *Params  = State->StereoParams + (Chan/2)*(ULC_MAX_SUBBLOCKS*ULC_PARAMETRIC_STEREO_NBANDS);
+    ULC_SubBlockDecimationPattern_t DecimationPattern = ULC_SubBlockDecimationPattern(WindowCtrl);
+    do
+    {
+        int SubBlockSize = BlockSize >> (DecimationPattern&0x7);
+        float Norm = 2.0f / SubBlockSize;
+        for(n=0,Band=0; Band<ULC_PARAMETRIC_STEREO_NBANDS; Band++)
+        {
+            float EM = 0.0f, ES = 0.0f, EMS = 0.0f;
+            int BandEnd = ULC_ParametricStereoBandEnd(Band, SubBlockSize);
+            for(; n<BandEnd; n++)
+            {
+                float mIm = ImM[n] * Norm;
+                float sIm = ImS[n] * Norm;
+                EM  += SQR(ReM[n]) + SQR(mIm);
+                ES  += SQR(ReS[n]) + SQR(sIm);
+                EMS += ReM[n]*ReS[n] + mIm*sIm;
+            }
+            int Level = 0, Spread = 0;
+            if(EM > 0.0f)
+            {
+                float a  = EMS / EM;
+                float b2 = ES / EM - SQR(a);
+                Level = (int)lrintf(a * 7.0f);
+                if(Level < -8) Level = -8;
+                if(Level > +7) Level = +7;
+                if(b2 > 0.0f)
+                {
+                    Spread = (int)lrintf(sqrtf(b2) * 8.0f);
+                    if(Spread > 0xF) Spread = 0xF;
+                }
+            }
+            *Params++ = (Level & 0xF) | (Spread << 4);
+        }
+        for(n=0; n<SubBlockSize; n++)
+        {
+            //! NOTE: Compare against a finite value, as -INFINITY is
+            //! not reliable under -ffast-math.
+            if(IndexS[n] > -0x1.0p99f) nRemoved++;
+            IndexS[n] = -INFINITY;
+        }
+        ReM += SubBlockSize, ImM += SubBlockSize;
+        ReS += SubBlockSize, ImS += SubBlockSize;
+        IndexS += SubBlockSize;
+    }
+    while(DecimationPattern >>= 4);
+    return nRemoved;
+}
+#endif
+//! Estimate the MDST power from the MDCT
+//! With a sine window, the MDST of a block is the sum of a term from
+//! its own MDCT (exactly 0.5*(MDCT[n+1]-MDCT[n-1])), and a term from
+//! each neighbouring block, whose line m leaks into line m+d with a
+//! weight of 1/4 (d=+/-1) or 1/(Pi*(d^2-1)) (d even). We don't have the
+//! neighbouring blocks, so we assume they have the same power spectrum
+//! as this one (with unrelated phase), and add their leakage in power.
+//! NOTE: The leakage matters far more than its small weights suggest.
+//! Coefficients taken from a coded stream have many lines zeroed out,
+//! and without the leakage, these leave holes in the spectrum that
+//! throw off the masking estimates (costing ~6dB SNR at 128kbps).
+#define ULC_MDST_LEAKAGE_TAPS 16
+static void Block_Transform_EstimateMDSTPower(float *Dst, const float *MDCT, int N)
+{
+    //! 2*(1/(Pi*(d^2-1)))^2 for d = 0,2,4..16 (the weights of both neighbours)
+    static const float Leakage[ULC_MDST_LEAKAGE_TAPS/2+1] =
+    {
+        0x1.9F02F6p-3f,  0x1.70E630p-6f,  0x1.D830E2p-11f, 0x1.5AEA72p-13f, 0x1.AC4A86p-15f,
+        0x1.5AE162p-16f, 0x1.4C8338p-17f, 0x1.65A2C0p-18f, 0x1.A245E0p-19f,
+    };
+    int n, d;
+    for(n=0; n<N; n++)
+    {
+        float a = (n > 0)   ? MDCT[n-1] : 0.0f;
+        float b = (n < N-1) ? MDCT[n+1] : 0.0f;
+        Dst[n] = SQR(0.5f*(b - a)) + Leakage[0]*SQR(MDCT[n]) + 0.125f*(SQR(a) + SQR(b)); //! 0.125 = 2*(1/4)^2
+    }
+
+    //! Add the leakage from further lines
+    //! NOTE: Looping over lines for each tap, rather than the other
+    //! way around, lets these loops vectorize.
+    for(d=2; d<=ULC_MDST_LEAKAGE_TAPS && d<N; d+=2)
+    {
+        float w = Leakage[d/2];
+        for(n=d; n<N;   n++) Dst[n] += w*SQR(MDCT[n-d]);
+        for(n=0; n<N-d; n++) Dst[n] += w*SQR(MDCT[n+d]);
+    }
+}
+
+//! Weigh the coefficients of a subblock for rate control
+//! This normalizes the MDCT coefficients, stores the importance of
+//! each one to BufferIndex[] (before the psychoacoustic adjustment),
+//! and accumulates the noise and psychoacoustic spectra, and the
+//! complexity measure.
+//! When coding from MDCT coefficients alone (BufferMDST == NULL; see
+//! Block_Transform_FromCoefs()), these must already be normalized, and
+//! the MDST is estimated from them.
+//! Returns the number of codeable coefficients.
+ULC_FORCED_INLINE int Block_Transform_WeighSubBlock(
+    const struct ULC_EncoderState_t *State,
+    float *BufferMDCT,
+    const float *BufferMDST,
+    float *BufferIndex,
+#if ULC_USE_NOISE_CODING
+    float *BufferNoise,
+#endif
+#if ULC_USE_PSYCHOACOUSTICS
+    float *BufferAmp2,
+#endif
+    float *BufferTemp,
+    int    SubBlockSize,
+    float *Complexity,
+    float *ComplexityW
+)
+{
+    int n, nNzCoef = 0;
+    (void)State, (void)BufferTemp; //! <- Needed to avoid warnings with ULC_USE_NOISE_CODING==0
+
+    //! Get the total energy of this subblock, so as to normalize
+    //! the final weight. This reduces dropouts on transients.
+    //! NOTE: Because the MDCT/MDST spectrum has not been normalized
+    //! yet, the coefficients should be divided by SubBlockSize.
+    float LogSubBlockEnergy = 0.0f;
+    if(BufferMDST)
+    {
+        for(n=0; n<SubBlockSize; n++)
+        {
+            LogSubBlockEnergy += SQR(BufferMDCT[n]) + SQR(BufferMDST[n]);
+        }
+        LogSubBlockEnergy = ULC_Logf(0x1.0p-127f + LogSubBlockEnergy/SQR(SubBlockSize));
+    }
+    else
+    {
+        //! Normalized coefficients are scaled by 2/SubBlockSize
+        //! NOTE: The estimated MDST power is kept in BufferTemp[], which
+        //! is free until the noise spectrum is computed.
+        Block_Transform_EstimateMDSTPower(BufferTemp, BufferMDCT, SubBlockSize);
+        for(n=0; n<SubBlockSize; n++)
+        {
+            LogSubBlockEnergy += SQR(BufferMDCT[n]) + BufferTemp[n];
+        }
+        LogSubBlockEnergy = ULC_Logf(0x1.0p-127f + LogSubBlockEnergy*0.25f);
+    }
+
+    //! Normalize the spectra, and then accumulate the
+    //! coefficients for psychoacoustic analysis.
+    //! MDCT is treated as the Real part of a DFT,
+    //! while MDST is treated as the Imaginary part.
+    float Norm = 2.0f / SubBlockSize;
+    for(n=0; n<SubBlockSize; n++)
+    {
+        //! NOTE: MDST is only used here, so don't bother
+        //! storing back the normalized data once we're done.
+        //! NOTE: When the MDCT coefficient is out of bounds
+        //! for encoding, set an extremely large negative
+        //! value so that it gets sent to the back of the
+        //! priority list for rate/quality control.
+        //! NOTE: When storing to BufferIndex[], we form the
+        //! first part of the psychoacoustics equation, and
+        //! will correct it after we've got that data.
+        float Re, Re2, Im2;
+        if(BufferMDST)
+        {
+            Re = (BufferMDCT[n] *= Norm), Re2 = SQR(Re);
+            float Im = (BufferMDST[n] * Norm);
+            Im2 = SQR(Im);
+        }
+        else Re = BufferMDCT[n], Re2 = SQR(Re), Im2 = BufferTemp[n];
+        (void)Im2; //! <- Needed to avoid warning with ULC_USE_PSYCHOACOUSTICS==0
+        float AbsRe = ABS(Re);
+#if ULC_USE_NOISE_CODING || ULC_USE_PSYCHOACOUSTICS
+        float Abs2 = Re2 + Im2;
+#endif
+        if(AbsRe < 0.5f*ULC_COEF_EPS)
+        {
+            BufferIndex[n] = -INFINITY;
+        }
+        else
+        {
+            //! We use Re*Abs^2 here, not as a tradeoff, but because
+            //! both weights are important: Re is needed to select
+            //! frequency bands that actually encode meaningful data
+            //! while Abs^2 is used for psychoacoustics (we will later
+            //! subtract Log[MaskLevel^2])
+            float Level = Re2;
+#if ULC_USE_PSYCHOACOUSTICS
+            Level *= Abs2;
+#endif
+            BufferIndex[n] = ULC_Logf(Level) - LogSubBlockEnergy;
+            nNzCoef++;
+        }
+#if ULC_USE_NOISE_CODING
+        BufferNoise[n/2] += Abs2; //! <- DCT/DFT weirdness; two MDCT+MDST coefficients = One frequency line
+#endif
+#if ULC_USE_PSYCHOACOUSTICS
+        BufferAmp2[n/2] += Abs2;  //! <- DCT/DFT weirdness
+#endif
+        //! NOTE: Using MDCT coefficients for complexity analysis
+        //! works out much better than combined MDCT+MDST as the
+        //! behaviour is far less eratic (and also gives accurate
+        //! statistics about the encoding performance, since we
+        //! don't actually code MDST coefficients).
+        *Complexity  += Re2;
+        *ComplexityW += AbsRe;
+    }
+#if ULC_USE_NOISE_CODING
+    //! Compute noise spectrum
+    //! NOTE: This outputs 2*(SubBlockSize/2) values into BufferNoise,
+    //! corresponding to {Weight,Weight*LogNoiseLevel} pairs.
+    const float *ThisFreqWeightTable = State->FreqWeightTable + (SubBlockSize-State->BlockSize/ULC_MAX_BLOCK_DECIMATION_FACTOR)/2;
+    Block_Transform_CalculateNoiseLogSpectrum(BufferNoise, BufferTemp, SubBlockSize, State->RateHz, ThisFreqWeightTable);
+#endif
+    return nNzCoef;
+}
+
+/**************************************/
+
+//! Finish the analysis of a block
+//! This computes the block complexity, applies the psychoacoustic
+//! model, and ranks the coefficients of each channel group, once the
+//! coefficients of all channels have been weighed.
+//! Returns the number of codeable coefficients.
+static int Block_Transform_Finish(struct ULC_EncoderState_t *State, int WindowCtrl, int nNzCoef, float Complexity, float ComplexityW)
+{
+    int nChan       = State->nChan;
+    int BlockSize   = State->BlockSize;
+    int GroupSize   = State->ChanGroupSize;
+    int nChanGroups = State->nChanGroups;
+    int Group;
+#if ULC_USE_PSYCHOACOUSTICS
+    int n, Chan;
+    float *BufferIndex = (float*)State->TransformIndex;
+    float *BufferTemp  = State->TransformTemp;
+    float *MaskingNp   = State->SampleBuffer;         //! NOTE: Aliasing of SampleBuffer; [nChanGroups*BlockSize/2]
+    float *GroupAmp2   = BufferTemp + BlockSize;      //! NOTE: Using upper part of TransformTemp; [nChanGroups*BlockSize/2]
+#else
+    (void)WindowCtrl;
+#endif
+
+    //! Finalize and store block complexity
+    if(Complexity)
+    {
+        //! Based off the same principles of normalized entropy:
+        //!  Entropy = (Log[Total[x]] - Total[x*Log[x]]/Total[x]) / Log[N]
+        //! Instead of accumulating log values, we accumulate
+        //! raw values, meaning we need to take the log:
+        //!  Total[x*Log[x]]/Total[x] -> Log[Total[x*x]/Total[x]]
+        //! Simplifying:
+        //!   (Log[Total[x]] - Log[Total[x*x]/Total[x]]) / Log[N]
+        //!  =(Log[Total[x] / (Total[x*x]/Total[x])) / Log[N]
+        //!  =Log[Total[x]^2 / Total[x^2]] / Log[N]
+        float ComplexityScale = 0x1.62E430p-1f*(31 - __builtin_clz(BlockSize)); //! 0x1.62E430p-1 = 1/Log2[E] for change-of-base
+        Complexity = ULC_Logf(SQR(ComplexityW) / Complexity) / ComplexityScale;
+        if(Complexity < 0.0f) Complexity = 0.0f; //! In case of round-off error
+        if(Complexity > 1.0f) Complexity = 1.0f;
+    }
+    State->BlockComplexity = Complexity;
+#if ULC_USE_PSYCHOACOUSTICS
+    ULC_TRACE_BEGIN(TracePsycho);
+    //! Perform psychoacoustics analysis for each group
+    //! NOTE: Trashes GroupAmp2[]. BufferTemp is only used up to
+    //! BlockSize/2 as scratch, so doesn't overlap GroupAmp2[].
+    for(Group=0; Group<nChanGroups; Group++)
+    {
+#if ULC_USE_TEMPORAL_MASKING
+        float *MaskingMemory = State->MaskingMemory + Group*(BlockSize/2);
+#else
+        float *MaskingMemory = NULL;
+#endif
+        Block_Transform_CalculatePsychoacoustics(
+            MaskingNp + Group*(BlockSize/2),
+            MaskingMemory,
+            GroupAmp2 + Group*(BlockSize/2),
+            BufferTemp,
+            BlockSize,
+            State->RateHz,
+            State->FreqWeightTable,
+            WindowCtrl
+        );
+    }
+
+    //! Add the psychoacoustics adjustment to the importance levels
+    //! NOTE: No need to split this section into subblock handling.
+    //! All the coefficients and their levels are in order relative
+    //! to that of the output of psychoacoustics.
+    //! NOTE: Because we stored out-of-range values as -INFINITY,
+    //! we can do simple arithmetic on them without affecting things.
+    for(Chan=0; Chan<nChan; Chan++)
+    {
+        const float *ChanMaskingNp = MaskingNp + (Chan/GroupSize)*(BlockSize/2);
+
+        //! Side channels of M/S pairs are de-emphasized
+        float SideBias = 0.0f;
+        if(Chan&1)
+        {
+            SideBias = 0x1.62E430p0f; //! -0x1.62E430p0 = Log[0.5^2]
+#if ULC_USE_STEREO_SWITCHING
+            if(State->StereoLR[Chan/2]) SideBias = 0.0f;
+#endif
+        }
+        for(n=0; n<BlockSize; n++)
+        {
+            float ValNp = BufferIndex[n];
+            //if(ValNp != -INFINITY) {
+            BufferIndex[n] = ValNp - (ChanMaskingNp[n/2] + SideBias);
+            //}
+        }
+        BufferIndex += BlockSize;
+    }
+    ULC_TRACE_END(TracePsycho, "Encode:Psychoacoustics", NULL, 0);
+#endif
+
+#if ULC_USE_STEREO_SWITCHING
+    Block_Transform_NormalizeStereoPairs(State, WindowCtrl);
+#endif
+
+    //! Create the coefficient sorting indices
+    //! NOTE: Each group is ranked on its own, so that the indices
+    //! give the order of coefficients within their group.
+    ULC_TRACE_BEGIN(TraceSort);
+    {
+        int *BufferTmp = (int*)State->TransformTemp;
+        int *BufferIdx = State->TransformIndex;
+        for(Group=0; Group<nChanGroups; Group++)
+        {
+            int nGroupChan = nChan - Group*GroupSize;
+            if(nGroupChan > GroupSize) nGroupChan = GroupSize;
+            Block_Transform_SortIndices(BufferIdx, (float*)BufferIdx, BufferTmp, nGroupChan * BlockSize);
+            BufferIdx += nGroupChan * BlockSize;
+        }
+    }
+    ULC_TRACE_END(TraceSort, "Encode:Sort", "nNzCoef", nNzCoef);
+    return nNzCoef;
+}
+
+
+/**************************************/
+
 static int Block_Transform(struct ULC_EncoderState_t *State, const float *Data)
 {
     int nChan     = State->nChan;
     int BlockSize = State->BlockSize;
 
     //! Append new data samples
+    ULC_TRACE_BEGIN(TraceInput);
     {
         int n, Chan;
         float *Old = State->SampleBuffer;
@@ -118,8 +595,10 @@ static int Block_Transform(struct ULC_EncoderState_t *State, const float *Data)
             }
         }
     }
+    ULC_TRACE_END(TraceInput, "Encode:Input", NULL, 0);
 
     //! Get the window control parameters for this block and the next
+    ULC_TRACE_BEGIN(TraceWindowCtrl);
     int WindowCtrl     = State->WindowCtrl     = State->NextWindowCtrl;
     int NextWindowCtrl = State->NextWindowCtrl = Block_Transform_GetWindowCtrl(
                              State->SampleBuffer,
@@ -130,19 +609,43 @@ static int Block_Transform(struct ULC_EncoderState_t *State, const float *Data)
                              nChan,
                              State->RateHz
                          );
+    if(State->WindowCtrlOverride >= 0)
+    {
+        //! Still run the analysis above, so that the transient
+        //! detector's history stays continuous
+        NextWindowCtrl = State->NextWindowCtrl = State->WindowCtrlOverride;
+        State->WindowCtrlOverride = -1;
+    }
+    ULC_TRACE_END(TraceWindowCtrl, "Encode:WindowCtrl", "NextWindowCtrl", NextWindowCtrl);
     int NextBlockOverlap;
     {
         int Pattern = ULC_SubBlockDecimationPattern(NextWindowCtrl);
         NextBlockOverlap = BlockSize >> (Pattern&0x7);
         if(Pattern&0x8) NextBlockOverlap >>= (NextWindowCtrl&0x7);
     }
+#if ULC_USE_STEREO_SWITCHING
+    //! Select L/R or M/S coding for each channel pair
+    //! NOTE: This must happen after window control analysis, as
+    //! that still reads the M/S data of the block we're coding.
+    ULC_TRACE_BEGIN(TraceStereo);
+    Block_Transform_SetStereoModes(State, State->SampleBuffer, State->ParametricStereo);
+    ULC_TRACE_END(TraceStereo, "Encode:StereoModes", NULL, 0);
+#endif
 
     //! Transform channels and insert keys for each codeable coefficient
     //! It's not /strictly/ required to calculate nNzCoef, but it can
     //! speed things up in the rate-control step
+    //! NOTE: Each channel group is analyzed separately from here on; the
+    //! only shared state is the block's WindowCtrl and complexity measure,
+    //! so the groups could be processed in parallel if needed.
+    ULC_TRACE_BEGIN(TraceTransform);
     int nNzCoef = 0;
+    int GroupSize   = State->ChanGroupSize;
+    int nChanGroups = State->nChanGroups;
+    int *GroupNzCoef = State->ChanGroupNzCoef;
     {
-        int n, Chan;
+        int n, Chan, Group;
+        for(Group=0; Group<nChanGroups; Group++) GroupNzCoef[Group] = 0;
         float *BufferSamples = State->SampleBuffer;
         float *BufferMDCT    = State->TransformBuffer;
         float *BufferIndex   = (float*)State->TransformIndex;
@@ -156,16 +659,19 @@ static int Block_Transform(struct ULC_EncoderState_t *State, const float *Data)
 #endif
         float *BufferTemp    = State->TransformTemp;
 #if ULC_USE_PSYCHOACOUSTICS
-        float *MaskingNp     = BufferSamples;          //! NOTE: Aliasing of BufferSamples
-        float *BufferAmp2    = BufferTemp + BlockSize; //! NOTE: Using upper half of BufferTemp
+        float *GroupAmp2     = BufferTemp + BlockSize; //! NOTE: Using upper part of BufferTemp; [nChanGroups*BlockSize/2]
 
-        //! Clear the amplitude buffer; we'll be accumulating all channels here
-        for(n=0; n<BlockSize/2; n++) BufferAmp2[n] = 0.0f;
+        //! Clear the amplitude buffers; we'll be accumulating all channels of each group here
+        for(n=0; n<nChanGroups*BlockSize/2; n++) GroupAmp2[n] = 0.0f;
 #endif
         //! Transform the input data and get complexity measure (ABR, VBR modes)
         float Complexity = 0.0f, ComplexityW = 0.0f;
         for(Chan=0; Chan<nChan; Chan++)
         {
+            int nNzCoefChan = nNzCoef;
+#if ULC_USE_PSYCHOACOUSTICS
+            float *BufferAmp2 = GroupAmp2 + (Chan/GroupSize)*(BlockSize/2);
+#endif
             ULC_SubBlockDecimationPattern_t DecimationPattern = ULC_SubBlockDecimationPattern(WindowCtrl);
             do
             {
@@ -256,79 +762,22 @@ static int Block_Transform(struct ULC_EncoderState_t *State, const float *Data)
                     OverlapSize
                 );
 
-                //! Get the total energy of this subblock, so as to normalize
-                //! the final weight. This reduces dropouts on transients.
-                //! NOTE: Because the MDCT/MDST spectrum has not been normalized
-                //! yet, the coefficients should be divided by SubBlockSize.
-                float LogSubBlockEnergy = 0.0f;
-                for(n=0; n<SubBlockSize; n++)
-                {
-                    LogSubBlockEnergy += SQR(BufferMDCT[n]) + SQR(BufferMDST[n]);
-                }
-                LogSubBlockEnergy = logf(0x1.0p-127f + LogSubBlockEnergy/SQR(SubBlockSize));
-
-                //! Normalize the spectra, and then accumulate the
-                //! coefficients for psychoacoustic analysis.
-                //! MDCT is treated as the Real part of a DFT,
-                //! while MDST is treated as the Imaginary part.
-                float Norm = 2.0f / SubBlockSize;
-                for(n=0; n<SubBlockSize; n++)
-                {
-                    //! NOTE: MDST is only used here, so don't bother
-                    //! storing back the normalized data once we're done.
-                    //! NOTE: When the MDCT coefficient is out of bounds
-                    //! for encoding, set an extremely large negative
-                    //! value so that it gets sent to the back of the
-                    //! priority list for rate/quality control.
-                    //! NOTE: When storing to BufferIndex[], we form the
-                    //! first part of the psychoacoustics equation, and
-                    //! will correct it after we've got that data.
-                    float Re = (BufferMDCT[n] *= Norm), Re2 = SQR(Re);
-                    float Im = (BufferMDST[n] *  Norm), Im2 = SQR(Im);
-                    (void)Im2; //! <- Needed to avoid warning with ULC_USE_PSYCHOACOUSTICS==0
-                    float AbsRe = ABS(Re);
-#if ULC_USE_NOISE_CODING || ULC_USE_PSYCHOACOUSTICS
-                    float Abs2 = Re2 + Im2;
-#endif
-                    if(AbsRe < 0.5f*ULC_COEF_EPS)
-                    {
-                        BufferIndex[n] = -INFINITY;
-                    }
-                    else
-                    {
-                        //! We use Re*Abs^2 here, not as a tradeoff, but because
-                        //! both weights are important: Re is needed to select
-                        //! frequency bands that actually encode meaningful data
-                        //! while Abs^2 is used for psychoacoustics (we will later
-                        //! subtract Log[MaskLevel^2])
-                        float Level = Re2;
-#if ULC_USE_PSYCHOACOUSTICS
-                        Level *= Abs2;
-#endif
-                        BufferIndex[n] = logf(Level) - LogSubBlockEnergy;
-                        nNzCoef++;
-                    }
+                nNzCoef += Block_Transform_WeighSubBlock(
+                    State,
+                    BufferMDCT,
+                    BufferMDST,
+                    BufferIndex,
 #if ULC_USE_NOISE_CODING
-                    BufferNoise[n/2] += Abs2; //! <- DCT/DFT weirdness; two MDCT+MDST coefficients = One frequency line
+                    BufferNoise,
 #endif
 #if ULC_USE_PSYCHOACOUSTICS
-                    BufferAmp2[n/2] += Abs2;  //! <- DCT/DFT weirdness
-#endif
-                    //! NOTE: Using MDCT coefficients for complexity analysis
-                    //! works out much better than combined MDCT+MDST as the
-                    //! behaviour is far less eratic (and also gives accurate
-                    //! statistics about the encoding performance, since we
-                    //! don't actually code MDST coefficients).
-                    Complexity  += Re2;
-                    ComplexityW += AbsRe;
-                }
-#if ULC_USE_NOISE_CODING
-                //! Compute noise spectrum
-                //! NOTE: This outputs 2*(SubBlockSize/2) values into BufferNoise,
-                //! corresponding to {Weight,Weight*LogNoiseLevel} pairs.
-                const float *ThisFreqWeightTable = State->FreqWeightTable + (SubBlockSize-BlockSize/ULC_MAX_BLOCK_DECIMATION_FACTOR)/2;
-                Block_Transform_CalculateNoiseLogSpectrum(BufferNoise, BufferTemp, SubBlockSize, State->RateHz, ThisFreqWeightTable);
+                    BufferAmp2,
 #endif
+                    BufferTemp,
+                    SubBlockSize,
+                    &Complexity,
+                    &ComplexityW
+                );
                 //! Move to the next subblock
                 BufferSamples += SubBlockSize;
                 BufferMDCT    += SubBlockSize;
@@ -344,63 +793,129 @@ static int Block_Transform(struct ULC_EncoderState_t *State, const float *Data)
 
             //! Move to the next channel
             BufferFwdLap += BlockSize;
-#if ULC_USE_PSYCHOACOUSTICS
-            BufferAmp2   -= BlockSize/2; //! <- Accumulated across all channels - rewind
-#endif
+            GroupNzCoef[Chan/GroupSize] += nNzCoef - nNzCoefChan;
         }
         BufferMDCT    -= BlockSize*nChan; //! Rewind to start of buffer
         BufferIndex   -= BlockSize*nChan;
-
-        //! Finalize and store block complexity
-        if(Complexity)
-        {
-            //! Based off the same principles of normalized entropy:
-            //!  Entropy = (Log[Total[x]] - Total[x*Log[x]]/Total[x]) / Log[N]
-            //! Instead of accumulating log values, we accumulate
-            //! raw values, meaning we need to take the log:
-            //!  Total[x*Log[x]]/Total[x] -> Log[Total[x*x]/Total[x]]
-            //! Simplifying:
-            //!   (Log[Total[x]] - Log[Total[x*x]/Total[x]]) / Log[N]
-            //!  =(Log[Total[x] / (Total[x*x]/Total[x])) / Log[N]
-            //!  =Log[Total[x]^2 / Total[x^2]] / Log[N]
-            float ComplexityScale = 0x1.62E430p-1f*(31 - __builtin_clz(BlockSize)); //! 0x1.62E430p-1 = 1/Log2[E] for change-of-base
-            Complexity = logf(SQR(ComplexityW) / Complexity) / ComplexityScale;
-            if(Complexity < 0.0f) Complexity = 0.0f; //! In case of round-off error
-            if(Complexity > 1.0f) Complexity = 1.0f;
-        }
-        State->BlockComplexity = Complexity;
-#if ULC_USE_PSYCHOACOUSTICS
-        //! Perform psychoacoustics analysis
-        //! NOTE: Trashes BufferAmp2[]
-        Block_Transform_CalculatePsychoacoustics(MaskingNp, BufferAmp2, BufferTemp, BlockSize, State->RateHz, State->FreqWeightTable, WindowCtrl);
-
-        //! Add the psychoacoustics adjustment to the importance levels
-        //! NOTE: No need to split this section into subblock handling.
-        //! All the coefficients and their levels are in order relative
-        //! to that of the output of psychoacoustics.
-        //! NOTE: Because we stored out-of-range values as -INFINITY,
-        //! we can do simple arithmetic on them without affecting things.
-        for(Chan=0; Chan<nChan; Chan++)
-        {
-            for(n=0; n<BlockSize; n++)
+#if ULC_USE_PARAMETRIC_STEREO
+        //! Get the parameters of parametric pairs
+        //! NOTE: This must happen before psychoacoustics analysis, as
+        //! that overwrites the MDST coefficients.
+        for(Chan=1; Chan<nChan; Chan+=2) if(State->StereoParametric[Chan/2])
             {
-                float ValNp = BufferIndex[n];
-                //if(ValNp != -INFINITY) {
-                BufferIndex[n] = ValNp - (MaskingNp[n/2] + 0x1.62E430p0f*(Chan&1)); //! -0x1.62E430p0 = Log[0.5^2]
-                //}
+                int nRemoved = Block_Transform_SetParametricStereo(State, Chan, WindowCtrl);
+                GroupNzCoef[Chan/GroupSize] -= nRemoved;
+                nNzCoef -= nRemoved;
             }
-            BufferIndex += BlockSize;
+#endif
+#if ULC_USE_LONG_TERM_PREDICTION
+        //! Predict tonal channels from the decoder's past output
+        //! NOTE: As with parametric stereo, this needs the MDST.
+        if(State->LongTermPrediction)
+        {
+            ULC_TRACE_BEGIN(TraceLTP);
+            nNzCoef -= Block_Transform_LTP(State, WindowCtrl);
+            ULC_TRACE_END(TraceLTP, "Encode:LTP", NULL, 0);
         }
 #endif
+
+        ULC_TRACE_END(TraceTransform, "Encode:Transform", "WindowCtrl", WindowCtrl);
+        nNzCoef = Block_Transform_Finish(State, WindowCtrl, nNzCoef, Complexity, ComplexityW);
     }
+    return nNzCoef;
+}
 
-    //! Create the coefficient sorting indices
+/**************************************/
+
+//! Prepare a block from its MDCT coefficients
+//! Coef[] holds the normalized coefficients of a block using WindowCtrl
+//! (in the same layout as TransformBuffer[], with channel pairs in M/S),
+//! and NextWindowCtrl becomes the window of the following block.
+//! NOTE: Without the MDST, this is estimated from the MDCT for the
+//! psychoacoustic model (see Block_Transform_EstimateMDSTPower()), and
+//! neither parametric stereo nor long-term prediction are available.
+//! NOTE: SampleBuffer[] and the transient detector are not updated, so
+//! before going back to Block_Transform(), the encoder must be primed
+//! with the last two blocks of input data (see ULC_EncodeBlock_Prime()).
+static int Block_Transform_FromCoefs(struct ULC_EncoderState_t *State, const float *Coef, int WindowCtrl, int NextWindowCtrl)
+{
+    int n, Chan, Group;
+    int nChan       = State->nChan;
+    int BlockSize   = State->BlockSize;
+    int GroupSize   = State->ChanGroupSize;
+    int nChanGroups = State->nChanGroups;
+    int *GroupNzCoef = State->ChanGroupNzCoef;
+    State->WindowCtrl     = WindowCtrl;
+    State->NextWindowCtrl = NextWindowCtrl;
+    State->WindowCtrlOverride = -1;
+#if ULC_USE_LONG_TERM_PREDICTION
+    //! Coefficients are never predicted (there is no MDST to weigh the
+    //! residual with), but the history is still kept up to date
+    if(State->LongTermPrediction) for(Chan=0; Chan<nChan; Chan++) State->LTPLag[Chan] = 0;
+#endif
+
+    //! Load coefficients and select the stereo mode of each pair
+    ULC_TRACE_BEGIN(TraceTransform);
+    float *BufferMDCT  = State->TransformBuffer;
+    float *BufferIndex = (float*)State->TransformIndex;
+    for(n=0; n<nChan*BlockSize; n++) BufferMDCT[n] = Coef[n];
+#if ULC_USE_STEREO_SWITCHING
+    Block_Transform_SetStereoModes(State, BufferMDCT, 0);
+#endif
+#if ULC_USE_NOISE_CODING
+    float *BufferNoise = State->TransformNoise;
+    for(n=0; n<nChan*BlockSize; n++) BufferNoise[n] = 0.0f;
+#endif
+    float *BufferTemp  = State->TransformTemp;
+#if ULC_USE_PSYCHOACOUSTICS
+    float *GroupAmp2   = BufferTemp + BlockSize;
+    for(n=0; n<nChanGroups*BlockSize/2; n++) GroupAmp2[n] = 0.0f;
+#endif
+
+    //! Weigh the coefficients of each subblock
+    int nNzCoef = 0;
+    float Complexity = 0.0f, ComplexityW = 0.0f;
+    for(Group=0; Group<nChanGroups; Group++) GroupNzCoef[Group] = 0;
+    for(Chan=0; Chan<nChan; Chan++)
     {
-        int *BufferTmp = (int*)State->TransformTemp;
-        int *BufferIdx = State->TransformIndex;
-        Block_Transform_SortIndices(BufferIdx, (float*)BufferIdx, BufferTmp, nChan * BlockSize);
+        int nNzCoefChan = nNzCoef;
+#if ULC_USE_PSYCHOACOUSTICS
+        float *BufferAmp2 = GroupAmp2 + (Chan/GroupSize)*(BlockSize/2);
+#endif
+        ULC_SubBlockDecimationPattern_t DecimationPattern = ULC_SubBlockDecimationPattern(WindowCtrl);
+        do
+        {
+            int SubBlockSize = BlockSize >> (DecimationPattern&0x7);
+            nNzCoef += Block_Transform_WeighSubBlock(
+                State,
+                BufferMDCT,
+                NULL,
+                BufferIndex,
+#if ULC_USE_NOISE_CODING
+                BufferNoise,
+#endif
+#if ULC_USE_PSYCHOACOUSTICS
+                BufferAmp2,
+#endif
+                BufferTemp,
+                SubBlockSize,
+                &Complexity,
+                &ComplexityW
+            );
+            BufferMDCT  += SubBlockSize;
+            BufferIndex += SubBlockSize;
+#if ULC_USE_PSYCHOACOUSTICS
+            BufferAmp2  += SubBlockSize/2;
+#endif
+#if ULC_USE_NOISE_CODING
+            BufferNoise += SubBlockSize;
+#endif
+        }
+        while(DecimationPattern >>= 4);
+        GroupNzCoef[Chan/GroupSize] += nNzCoef - nNzCoefChan;
     }
-    return nNzCoef;
+    ULC_TRACE_END(TraceTransform, "Encode:Transform", "WindowCtrl", WindowCtrl);
+    return Block_Transform_Finish(State, WindowCtrl, nNzCoef, Complexity, ComplexityW);
 }
 
 /**************************************/
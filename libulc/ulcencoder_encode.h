@@ -8,6 +8,7 @@
 /**************************************/
 #include "fourier.h"
 #include "ulcencoder.h"
+#include "ulctrace.h"
 /**************************************/
 #if ULC_USE_NOISE_CODING
 # include "ulcencoder_noisefill.h"
@@ -62,7 +63,7 @@ ULC_FORCED_INLINE int Block_Encode_BuildQuantizer(float MaxVal)
     //! in the syntax to allow for a full range (that is
     //! to say: 7^2 * 2^-5 = 1.53125, 1.53125 >= 4/Pi).
     //! We then round this up to the nearest integer.
-    int q = (int)ceilf(5.0f - 0x1.715476p0f*logf(MaxVal)); //! 0x1.715476p0 == 1/Ln[2] for change of base
+    int q = (int)ceilf(5.0f - 0x1.715476p0f*ULC_Logf(MaxVal)); //! 0x1.715476p0 == 1/Ln[2] for change of base
     if(q < 5) q = 5;
     if(q > 5 + 0xE + 0xC) q = 5 + 0xE + 0xC; //! 5+Eh+Ch = Maximum extended-precision quantizer value (including a bias of 5)
     return q;
@@ -70,6 +71,64 @@ ULC_FORCED_INLINE int Block_Encode_BuildQuantizer(float MaxVal)
 
 /**************************************/
 
+#if ULC_USE_NOISE_CODING && ULC_USE_NOISE_COUPLING
+
+//! Noise-fill tail of the first channel of a pair
+//! Idx is the start of that channel's [sub]block, and Start is
+//! the first coefficient of its noise-fill tail (relative to Idx;
+//! Start == SubBlockSize when there is no noise-fill tail).
+struct Block_Encode_NoiseTail_t
+{
+    int Idx;
+    int Start;
+};
+
+//! Get the gain code for a coupled noise-fill tail
+//! The second channel's tail reuses the noise of the first,
+//! so this is only useful when the uncoded coefficients of
+//! both channels are well correlated (|Rho| >= 0.5). The gain
+//! follows the energy ratio of the two channels, with the sign
+//! of their correlation.
+//! Returns -1 if coupling should not be used.
+static inline int Block_Encode_EncodePass_GetCoupledNoiseGain(
+    const float *Coef,
+    int          NextCodedIdx,
+    int          EndIdx,
+    int          SubBlockSize,
+    const struct Block_Encode_NoiseTail_t *Tail
+)
+{
+    int n, Start = NextCodedIdx - (EndIdx - SubBlockSize);
+    if(Start < Tail->Start) Start = Tail->Start;
+    if(SubBlockSize - Start < 16) return -1;
+
+    const float *CoefA = Coef + Tail->Idx;
+    const float *CoefB = Coef + EndIdx - SubBlockSize;
+    float EnergyA = 0.0f, EnergyB = 0.0f, Corr = 0.0f;
+    for(n=Start; n<SubBlockSize; n++)
+    {
+        float a = CoefA[n];
+        float b = CoefB[n];
+        EnergyA += SQR(a);
+        EnergyB += SQR(b);
+        Corr    += a*b;
+    }
+    if(EnergyA == 0.0f || EnergyB == 0.0f) return -1;
+    if(SQR(Corr) < 0.25f*EnergyA*EnergyB) return -1;
+
+    //! Xh = Signed gain in steps of 1/8, centered (ie. (Xh+0.5)/8)
+    float g = sqrtf(EnergyB / EnergyA);
+    if(g < 1.0f/32) return -1;
+    int v = (int)(g*8.0f);
+    if(v > 7) v = 7;
+    if(Corr < 0.0f) v = -1-v;
+    return v & 0xF;
+}
+
+#endif
+
+/**************************************/
+
 //! Encode a range of coefficients
 static inline int Block_Encode_EncodePass_WriteQuantizerZone(
     int           CurIdx,
@@ -269,6 +328,10 @@ static inline void Block_Encode_EncodePass_WriteSubBlock(
 #endif
     const int    *CoefIdx,
     int           nOutCoef,
+#if ULC_USE_NOISE_CODING && ULC_USE_NOISE_COUPLING
+    struct Block_Encode_NoiseTail_t       *RecordTail,
+    const struct Block_Encode_NoiseTail_t *CoupleTail,
+#endif
     BitStream_t **DstBuffer,
     int          *Size
 )
@@ -342,6 +405,26 @@ static inline void Block_Encode_EncodePass_WriteSubBlock(
     //! Decide what to do about the tail coefficients
     //! If we're at the edge of the block, it might work better to just fill with 0h
     int n = EndIdx - NextCodedIdx;
+#if ULC_USE_NOISE_CODING && ULC_USE_NOISE_COUPLING
+    if(RecordTail)
+    {
+        RecordTail->Idx   = EndIdx - SubBlockSize;
+        RecordTail->Start = SubBlockSize;
+    }
+    if(n > 4 && CoupleTail)
+    {
+        int Gain = Block_Encode_EncodePass_GetCoupledNoiseGain(Coef, NextCodedIdx, EndIdx, SubBlockSize, CoupleTail);
+        if(Gain >= 0)
+        {
+            //! [Fh,]Eh,Eh,Xh: Coupled noise fill (to end)
+            if(PrevQuant != -1) Block_Encode_WriteNybble(0xF, DstBuffer, Size);
+            Block_Encode_WriteNybble(0xE,  DstBuffer, Size);
+            Block_Encode_WriteNybble(0xE,  DstBuffer, Size);
+            Block_Encode_WriteNybble(Gain, DstBuffer, Size);
+            return;
+        }
+    }
+#endif
     if(n > 4)
     {
         //! If we coded anything, then we must specify the lead sequence
@@ -371,6 +454,9 @@ static inline void Block_Encode_EncodePass_WriteSubBlock(
             Block_Encode_WriteNybble(NoiseQ-1,      DstBuffer, Size);
             Block_Encode_WriteNybble(NoiseDecay>>4, DstBuffer, Size);
             Block_Encode_WriteNybble(NoiseDecay,    DstBuffer, Size);
+#if ULC_USE_NOISE_COUPLING
+            if(RecordTail) RecordTail->Start = NextCodedIdx - RecordTail->Idx;
+#endif
         }
         else
         {
@@ -406,6 +492,7 @@ static inline int Block_Encode_EncodePass(const struct ULC_EncoderState_t *State
     BitStream_t *DstBuffer = _DstBuffer;
 
     //! Begin coding
+    ULC_TRACE_BEGIN(TracePass);
     int Idx  = 0;
     int Size = 0; //! Block size (in bits)
     int WindowCtrl = State->WindowCtrl;
@@ -413,8 +500,90 @@ static inline int Block_Encode_EncodePass(const struct ULC_EncoderState_t *State
         Block_Encode_WriteNybble(WindowCtrl, &DstBuffer, &Size);
         if(WindowCtrl & 0x8) Block_Encode_WriteNybble(WindowCtrl >> 4, &DstBuffer, &Size);
     }
+#if ULC_USE_NOISE_CODING && ULC_USE_NOISE_COUPLING
+    struct Block_Encode_NoiseTail_t NoiseTail[ULC_MAX_SUBBLOCKS];
+#endif
+    //! Share the coefficients between channel groups in proportion
+    //! to their number of codeable coefficients; the indices of each
+    //! group are ranked separately (see Block_Transform()).
+    int GroupSize = State->ChanGroupSize, nGroupOutCoef = nOutCoef;
+    int nNzCoefTotal = 0;
+    {
+        int Group;
+        for(Group=0; Group<State->nChanGroups; Group++) nNzCoefTotal += State->ChanGroupNzCoef[Group];
+    }
     for(Chan=0; Chan<nChan; Chan++)
     {
+        if(Chan % GroupSize == 0 && nNzCoefTotal)
+        {
+            nGroupOutCoef = (int)((int64_t)nOutCoef * State->ChanGroupNzCoef[Chan/GroupSize] / nNzCoefTotal);
+        }
+#if ULC_USE_STEREO_SWITCHING
+        //! Eh,Dh: L/R coding for this channel pair
+        //! NOTE: This can only appear in place of the first quantizer
+        //! of the first channel of a pair.
+        if((Chan&1) == 0 && Chan+1 < nChan && State->StereoLR[Chan/2])
+        {
+            Block_Encode_WriteNybble(0xE, &DstBuffer, &Size);
+            Block_Encode_WriteNybble(0xD, &DstBuffer, &Size);
+        }
+#endif
+#if ULC_USE_PARAMETRIC_STEREO
+        //! Eh,Dh,Eh,Dh: Parametric coding for this channel pair
+        //! The second channel then only codes its parameters.
+        if((Chan&1) == 0 && Chan+1 < nChan && State->StereoParametric[Chan/2])
+        {
+            Block_Encode_WriteNybble(0xE, &DstBuffer, &Size);
+            Block_Encode_WriteNybble(0xD, &DstBuffer, &Size);
+            Block_Encode_WriteNybble(0xE, &DstBuffer, &Size);
+            Block_Encode_WriteNybble(0xD, &DstBuffer, &Size);
+        }
+        if((Chan&1) != 0 && State->StereoParametric[Chan/2])
+        {
+            int n, nParams = 0;
+            const uint8_t *Params = State->StereoParams + (Chan/2)*(ULC_MAX_SUBBLOCKS*ULC_PARAMETRIC_STEREO_NBANDS);
+            ULC_SubBlockDecimationPattern_t DecimationPattern = ULC_SubBlockDecimationPattern(WindowCtrl);
+            do nParams += ULC_PARAMETRIC_STEREO_NBANDS, Idx += BlockSize >> (DecimationPattern&0x7);
+            while(DecimationPattern >>= 4);
+            for(n=0; n<nParams; n++)
+            {
+                Block_Encode_WriteNybble(Params[n] & 0xF, &DstBuffer, &Size);
+                Block_Encode_WriteNybble(Params[n] >> 4,  &DstBuffer, &Size);
+            }
+            continue;
+        }
+#endif
+#if ULC_USE_LONG_TERM_PREDICTION
+        //! Xh[,Zh,Yh,Xh,Gh[Xh]]: Long-term prediction
+        //! NOTE: Neither channel of a parametric pair codes this (the
+        //! second channel has already moved on above).
+        int LTPPrefix = State->LongTermPrediction && ULC_LTPAllowed(WindowCtrl);
+#if ULC_USE_PARAMETRIC_STEREO
+        if(Chan+1 < nChan && State->StereoParametric[Chan/2]) LTPPrefix = 0;
+#endif
+        if(LTPPrefix)
+        {
+            int n, nBands = 0, Lag = State->LTPLag[Chan];
+            const uint8_t *Gain = State->LTPGain + Chan*ULC_LTP_NBANDS;
+            if(Lag) for(n=0; n<ULC_LTP_NBANDS; n++) if(Gain[n]) nBands = n+1;
+            Block_Encode_WriteNybble(nBands, &DstBuffer, &Size);
+            if(nBands)
+            {
+                Lag -= ULC_LTP_MIN_LAG;
+                Block_Encode_WriteNybble((Lag >> 8) & 0xF, &DstBuffer, &Size);
+                Block_Encode_WriteNybble((Lag >> 4) & 0xF, &DstBuffer, &Size);
+                Block_Encode_WriteNybble((Lag >> 0) & 0xF, &DstBuffer, &Size);
+                for(n=0; n<nBands; n++) Block_Encode_WriteNybble(Gain[n], &DstBuffer, &Size);
+            }
+        }
+#endif
+#if ULC_USE_NOISE_CODING && ULC_USE_NOISE_COUPLING
+        //! The first channel of a pair records its noise-fill tails,
+        //! and the second channel may then couple to them
+        int SubBlock = 0;
+        int IsPairA  = (State->NoiseCoupling && (Chan&1) == 0 && Chan+1 < nChan);
+        int IsPairB  = (State->NoiseCoupling && (Chan&1) != 0);
+#endif
         ULC_SubBlockDecimationPattern_t DecimationPattern = ULC_SubBlockDecimationPattern(WindowCtrl);
         do
         {
@@ -427,11 +596,18 @@ static inline int Block_Encode_EncodePass(const struct ULC_EncoderState_t *State
                 CoefNoise,
 #endif
                 CoefIdx,
-                nOutCoef,
+                nGroupOutCoef,
+#if ULC_USE_NOISE_CODING && ULC_USE_NOISE_COUPLING
+                IsPairA ? &NoiseTail[SubBlock] : NULL,
+                IsPairB ? &NoiseTail[SubBlock] : NULL,
+#endif
                 &DstBuffer,
                 &Size
             );
             Idx += SubBlockSize;
+#if ULC_USE_NOISE_CODING && ULC_USE_NOISE_COUPLING
+            SubBlock++;
+#endif
         }
         while(DecimationPattern >>= 4);
     }
@@ -439,6 +615,7 @@ static inline int Block_Encode_EncodePass(const struct ULC_EncoderState_t *State
     //! Align the output stream and pad size to bytes
     *DstBuffer >>= (-Size) % BISTREAM_NBITS;
     Size = (Size+7) &~ 7;
+    ULC_TRACE_END(TracePass, "Encode:Pass", "nOutCoef", nOutCoef);
     return Size;
 }
 
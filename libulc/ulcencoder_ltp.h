@@ -0,0 +1,283 @@
+/**************************************/
+//! ulc-codec: Ultra-Low-Complexity Audio Codec
+//! Copyright (C) 2022, Ruben Nunez (Aikku; aik AT aol DOT com DOT au)
+//! Refer to the project README file for license terms.
+/**************************************/
+#pragma once
+/**************************************/
+#include <math.h>
+#include <stdint.h>
+/**************************************/
+#include "ulcdecoder.h"
+#include "ulcencoder.h"
+#include "ulchelper.h"
+/**************************************/
+
+//! Long-term prediction parameters
+//!  MAX_CANDIDATES:  Lags (peaks of the history's autocorrelation) tried per channel.
+//!  MIN_CORRELATION: Smallest normalized autocorrelation of a candidate lag.
+//!  CORR_WINDOW:     Samples correlated at each lag (at half rate).
+//!  MAX_BAND_ERROR:  A band is only predicted if this removes at least half of its energy (3dB).
+//!  MIN_BENEFIT:     A channel is only predicted if this removes at least 30% of its energy.
+//! NOTE: Predicted coefficients lose importance, so the bits they free
+//! go to other coefficients, and a prediction that removes only a small
+//! part of the energy can cost more than it gains (eg. on busy material
+//! with several sources, where it mostly tracks one of them). Looser
+//! limits (20% per band, 5% per channel) lost up to 0.4dB on such
+//! material, where these stay within 0.15dB of coding without LTP.
+#define ULC_LTP_MAX_CANDIDATES  4
+#define ULC_LTP_MIN_CORRELATION 0.5f
+#define ULC_LTP_CORR_WINDOW     256
+#define ULC_LTP_MAX_BAND_ERROR  0.5f
+#define ULC_LTP_MIN_BENEFIT     0.3f
+
+/**************************************/
+
+//! Get the decoder's history of a channel in the stereo domain of this block
+//! NOTE: This follows the conversion in ULC_DecodeBlock_Synthesize().
+static inline void Block_Transform_LTP_GetHistory(const struct ULC_EncoderState_t *State, float *Dst, int Chan, int IsLR)
+{
+    int n;
+    const struct ULC_DecoderState_t *Decoder = &State->LTPDecoder;
+    const float *Hist = Decoder->LTPHistory + Chan*ULC_LTP_HISTORY_SIZE;
+    int PairChan = ((Chan&1) != 0 || Chan+1 < State->nChan);
+    if(PairChan && IsLR != Decoder->StereoLR[Chan/2])
+    {
+        float s = IsLR ? 1.0f : 0.5f;
+        const float *HistA = Decoder->LTPHistory + (Chan&~1)*ULC_LTP_HISTORY_SIZE;
+        const float *HistB = HistA + ULC_LTP_HISTORY_SIZE;
+        if(Chan&1) for(n=0; n<ULC_LTP_HISTORY_SIZE; n++) Dst[n] = (HistA[n] - HistB[n]) * s;
+        else       for(n=0; n<ULC_LTP_HISTORY_SIZE; n++) Dst[n] = (HistA[n] + HistB[n]) * s;
+    }
+    else for(n=0; n<ULC_LTP_HISTORY_SIZE; n++) Dst[n] = Hist[n];
+}
+
+//! Find the candidate lags of a channel
+//! The history is decimated by 2 and correlated against its own end,
+//! and the strongest peaks of the autocorrelation are then refined at
+//! the full rate. Only the history is searched, so the lags assume
+//! that the signal carries on in the same way through the block.
+//! Returns the number of lags found.
+static inline int Block_Transform_LTP_FindLags(int *Lags, const float *Hist, float *Temp)
+{
+    int n, q, nLags = 0;
+    float LagCorr[ULC_LTP_MAX_CANDIDATES];
+
+    //! Decimate, and get the energy of the correlation window
+    const int W = ULC_LTP_CORR_WINDOW, D = ULC_LTP_HISTORY_SIZE/2;
+    float *Dec = Temp;
+    for(n=0; n<D; n++) Dec[n] = Hist[2*n] + Hist[2*n+1];
+    const float *Ref = Dec + D - W;
+    double E0 = 0.0;
+    for(n=0; n<W; n++) E0 += SQR(Ref[n]);
+    if(E0 < 0x1.0p-40) return 0;
+
+    //! Find the peaks of the normalized autocorrelation
+    //! NOTE: Eq is the energy of the lagged window, which is slid one
+    //! sample back on each lag.
+    int MinQ = ULC_LTP_MIN_LAG/2, MaxQ = D - W;
+    double Eq = 0.0;
+    for(n=0; n<W; n++) Eq += SQR(Ref[n-MinQ]);
+    float r0 = 0.0f, r1 = 0.0f;
+    for(q=MinQ; q<=MaxQ; q++)
+    {
+        if(q > MinQ) Eq += SQR(Ref[-q]) - SQR(Ref[W-q]);
+        float Sum = 0.0f;
+        for(n=0; n<W; n++) Sum += Ref[n] * Ref[n-q];
+        float r = (Eq > 0.0) ? (float)(Sum / sqrt(E0*Eq)) : 0.0f;
+
+        //! Keep the strongest peaks (at q-1), sorted by correlation
+        if(q > MinQ+1 && r1 > r0 && r1 >= r && r1 >= ULC_LTP_MIN_CORRELATION)
+        {
+            if(nLags < ULC_LTP_MAX_CANDIDATES || r1 > LagCorr[nLags-1])
+            {
+                int i = (nLags < ULC_LTP_MAX_CANDIDATES) ? nLags++ : (nLags-1);
+                for(; i > 0 && LagCorr[i-1] < r1; i--) LagCorr[i] = LagCorr[i-1], Lags[i] = Lags[i-1];
+                LagCorr[i] = r1, Lags[i] = q-1;
+            }
+        }
+        r0 = r1, r1 = r;
+    }
+
+    //! Refine each lag at the full rate
+    const float *RefFull = Hist + ULC_LTP_HISTORY_SIZE - 2*W;
+    int MaxLag = ULC_LTP_HISTORY_SIZE - 2*W;
+    if(MaxLag > ULC_LTP_MAX_LAG) MaxLag = ULC_LTP_MAX_LAG;
+    for(q=0; q<nLags; q++)
+    {
+        int Lag, BestLag = 2*Lags[q];
+        float BestCorr = -1.0f;
+        for(Lag=BestLag-1; Lag<=2*Lags[q]+1; Lag++)
+        {
+            if(Lag < ULC_LTP_MIN_LAG || Lag > MaxLag) continue;
+            float Sum = 0.0f, E = 0.0f;
+            for(n=0; n<2*W; n++) Sum += RefFull[n] * RefFull[n-Lag], E += SQR(RefFull[n-Lag]);
+            float r = (E > 0.0f) ? (Sum / sqrtf(E)) : 0.0f;
+            if(r > BestCorr) BestCorr = r, BestLag = Lag;
+        }
+        Lags[q] = BestLag;
+    }
+    return nLags;
+}
+
+//! Get the quantized gain of each band for a prediction
+//! Returns the energy removed from the coefficients.
+static inline float Block_Transform_LTP_GetGains(uint8_t *Gain, float *ErrRatio, const float *Coef, const float *Pred, int BlockSize)
+{
+    int n, Band;
+    float Benefit = 0.0f;
+    for(n=0,Band=0; Band<ULC_LTP_NBANDS; Band++)
+    {
+        float Exx = 0.0f, Exp = 0.0f, Epp = 0.0f;
+        int BandEnd = ULC_LTPBandEnd(Band, BlockSize);
+        for(; n<BandEnd; n++)
+        {
+            Exx += SQR(Coef[n]);
+            Exp += Coef[n] * Pred[n];
+            Epp += SQR(Pred[n]);
+        }
+        Gain[Band] = 0, ErrRatio[Band] = 1.0f;
+        if(Exp > 0.0f)
+        {
+            int v = (int)lrintf(Exp / Epp * 16.0f);
+            if(v > 0xF) v = 0xF;
+            if(v > 0)
+            {
+                float g = v * (1.0f/16);
+                float Err = Exx - 2.0f*g*Exp + SQR(g)*Epp;
+                if(Err < ULC_LTP_MAX_BAND_ERROR*Exx)
+                {
+                    Gain[Band] = v;
+                    ErrRatio[Band] = Err / Exx;
+                    Benefit += Exx - Err;
+                }
+            }
+        }
+    }
+    return Benefit;
+}
+
+/**************************************/
+
+//! Apply long-term prediction to the block
+//! For each channel that can be predicted, this picks the lag and band
+//! gains that remove the most energy from the (normalized) coefficients
+//! of the block, and replaces these with the residual. The importance
+//! of each predicted coefficient and the noise spectrum are then scaled
+//! to match. Block complexity is left as it was, as this still reflects
+//! the masking and the spectral shape of the signal being coded.
+//! NOTE: The MDST coefficients are still in SampleBuffer[] at this
+//! point, but have not been normalized.
+//! Returns the number of codeable coefficients removed (ChanGroupNzCoef[]
+//! is updated to match).
+static int Block_Transform_LTP(struct ULC_EncoderState_t *State, int WindowCtrl)
+{
+    int n, Chan, Band, nRemoved = 0;
+    int nChan     = State->nChan;
+    int BlockSize = State->BlockSize;
+    int GroupSize = State->ChanGroupSize;
+    for(Chan=0; Chan<nChan; Chan++) State->LTPLag[Chan] = 0;
+    if(!ULC_LTPAllowed(WindowCtrl)) return 0;
+
+    //! Scratch buffers (all aligned, as BlockSize >= 256)
+    float *Pred     = State->LTPTemp;
+    float *BestPred = Pred + BlockSize;
+    float *Hist     = BestPred + BlockSize;
+    float *DecTemp  = Hist + ULC_LTP_HISTORY_SIZE;
+    for(Chan=0; Chan<nChan; Chan++)
+    {
+        int PairChan = ((Chan&1) != 0 || Chan+1 < nChan);
+        int IsLR = PairChan ? State->StereoLR[Chan/2] : 0;
+#if ULC_USE_PARAMETRIC_STEREO
+        if(PairChan && State->StereoParametric[Chan/2]) continue;
+#endif
+        float *Coef  = State->TransformBuffer + Chan*BlockSize;
+
+        //! Get the total energy; predicting must remove a decent part of it
+        float Energy = 0.0f;
+        for(n=0; n<BlockSize; n++) Energy += SQR(Coef[n]);
+        if(Energy == 0.0f) continue;
+
+        //! Try each candidate lag
+        int i, Lags[ULC_LTP_MAX_CANDIDATES];
+        Block_Transform_LTP_GetHistory(State, Hist, Chan, IsLR);
+        int nLags = Block_Transform_LTP_FindLags(Lags, Hist, DecTemp);
+        int BestLag = 0;
+        float BestBenefit = ULC_LTP_MIN_BENEFIT * Energy;
+        uint8_t BestGain[ULC_LTP_NBANDS];
+        float   BestErrRatio[ULC_LTP_NBANDS];
+        for(i=0; i<nLags; i++)
+        {
+            uint8_t Gain[ULC_LTP_NBANDS];
+            float   ErrRatio[ULC_LTP_NBANDS];
+            ULC_DecodeBlock_Predict(&State->LTPDecoder, Pred, Chan, IsLR, Lags[i], WindowCtrl);
+            float Benefit = Block_Transform_LTP_GetGains(Gain, ErrRatio, Coef, Pred, BlockSize);
+            if(Benefit > BestBenefit)
+            {
+                float *t = Pred; Pred = BestPred; BestPred = t;
+                BestLag = Lags[i], BestBenefit = Benefit;
+                for(Band=0; Band<ULC_LTP_NBANDS; Band++) BestGain[Band] = Gain[Band], BestErrRatio[Band] = ErrRatio[Band];
+            }
+        }
+        if(!BestLag) continue;
+        State->LTPLag[Chan] = BestLag;
+        for(Band=0; Band<ULC_LTP_NBANDS; Band++) State->LTPGain[Chan*ULC_LTP_NBANDS+Band] = BestGain[Band];
+
+        //! Code the residual of each predicted band
+        //! NOTE: The MDST of the residual isn't known, so the MDST is
+        //! assumed to shrink in the same way as the band's energy.
+        float *Index = (float*)State->TransformIndex + Chan*BlockSize;
+#if ULC_USE_PSYCHOACOUSTICS
+        const float *Im = State->SampleBuffer + Chan*BlockSize;
+        float Norm = 2.0f / BlockSize;
+#endif
+#if ULC_USE_NOISE_CODING
+        float *Noise = State->TransformNoise + Chan*BlockSize;
+#endif
+        for(n=0,Band=0; Band<ULC_LTP_NBANDS; Band++)
+        {
+            int BandEnd = ULC_LTPBandEnd(Band, BlockSize);
+            if(!BestGain[Band])
+            {
+                n = BandEnd;
+                continue;
+            }
+            float g = BestGain[Band] * (1.0f/16);
+            float LogErrRatio = ULC_Logf(BestErrRatio[Band]);
+#if ULC_USE_NOISE_CODING
+            for(i=n/2; i<BandEnd/2; i++) Noise[i*2+1] += Noise[i*2+0] * 0.5f*LogErrRatio;
+#endif
+            for(; n<BandEnd; n++)
+            {
+                float Re  = Coef[n];
+                float Res = Re - g*BestPred[n];
+                Coef[n] = Res;
+
+                //! NOTE: Coefficients that were out of range stay that
+                //! way, and those that are now out of range are removed.
+                //! NOTE: Compare against a finite value, as -INFINITY is
+                //! not reliable under -ffast-math.
+                if(!(Index[n] > -0x1.0p99f)) continue;
+                if(ABS(Res) < 0.5f*ULC_COEF_EPS)
+                {
+                    Index[n] = -INFINITY;
+                    State->ChanGroupNzCoef[Chan/GroupSize]--;
+                    nRemoved++;
+                    continue;
+                }
+                float Level = SQR(Res) / SQR(Re);
+#if ULC_USE_PSYCHOACOUSTICS
+                float Im2 = SQR(Im[n] * Norm);
+                Level *= (SQR(Res) + Im2*BestErrRatio[Band]) / (SQR(Re) + Im2);
+#endif
+                Index[n] += ULC_Logf(Level);
+            }
+            (void)LogErrRatio; //! <- Needed to avoid warning with ULC_USE_NOISE_CODING==0
+        }
+    }
+    return nRemoved;
+}
+
+/**************************************/
+//! EOF
+/**************************************/
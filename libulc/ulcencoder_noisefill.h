@@ -11,6 +11,9 @@
 #if defined(__SSE__)
 # include <xmmintrin.h>
 #endif
+#if defined(__ARM_NEON)
+# include <arm_neon.h>
+#endif
 /**************************************/
 #include <math.h>
 /**************************************/
@@ -67,6 +70,19 @@ static inline void Block_Transform_CalculateNoiseLogSpectrumWithWeights(
         _mm_store_ps(Dst+4, _mm_unpackhi_ps(y, x));
         Dst += 8;
     }
+#elif defined(__ARM_NEON)
+    for(n=0; n<N; n+=4)
+    {
+        float32x4x2_t t;
+        float32x4_t x = vld1q_f32(Src);
+        Src += 4;
+        float32x4_t y = vaddq_f32(vdupq_n_f32(1.0f), vmulq_f32(x, vdupq_n_f32(0.5f / (1 << Log2M))));
+        for(i=0; i<Log2M; i++) y = vmulq_f32(y, y);
+        t.val[0] = y;
+        t.val[1] = vmulq_f32(x, y);
+        vst2q_f32(Dst, t);
+        Dst += 8;
+    }
 #else
     for(n=0; n<N; n++)
     {
@@ -144,9 +160,9 @@ static inline void Block_Transform_CalculateNoiseLogSpectrum(float *Data, void *
         float ve = v * (1.0f - 0x1.6B5434p-2f*FreqWeightTable[n]); //! 0x1.6B5434p-2 = 10^(-9/20)
         float vw = 0x1.0p16f * sqrtf(ve);
         Weight  [n] = (vw <= 1.0f) ? 1 : (uint32_t)vw;
-        EnergyNp[n] = (ve <= 1.0f) ? 0 : (uint32_t)(logf(ve) * LogScale);
+        EnergyNp[n] = (ve <= 1.0f) ? 0 : (uint32_t)(ULC_Logf(ve) * LogScale);
     }
-    float LogNorm     = 0x1.62E430p-1f - 0.5f*logf(Norm); //! Pre-scale by Scale=4.0/2 for noise quantizer (by adding Log[Scale])
+    float LogNorm     = 0x1.62E430p-1f - 0.5f*ULC_Logf(Norm); //! Pre-scale by Scale=4.0/2 for noise quantizer (by adding Log[Scale])
     float InvLogScale = 0x1.62E430p-29f * N * (1.0f / FloorToMaskRatio);
 
     //! Extract the noise floor level in each line's noise bandwidth
@@ -232,7 +248,7 @@ static int Block_Encode_EncodePass_GetNoiseQ(const float *Data, int Band, int N,
             Sum += wy, SumW += w;
         }
         if(Sum == 0.0f) return 0;
-        Amplitude = expf(Sum/SumW);
+        Amplitude = ULC_Expf(Sum/SumW);
     }
 
     //! Quantize the noise amplitude into final code
@@ -286,8 +302,8 @@ static void Block_Encode_EncodePass_GetHFExtParams(const float *Data, int Band,
         }
 
         //! Convert to linear units
-        Amplitude = expf(Amplitude);
-        Decay     = (Decay < 0.0f) ? expf(Decay) : 1.0f; //! <- Ensure E^LogDecay is <= 1.0
+        Amplitude = ULC_Expf(Amplitude);
+        Decay     = (Decay < 0.0f) ? ULC_Expf(Decay) : 1.0f; //! <- Ensure E^LogDecay is <= 1.0
     }
 
     //! Quantize amplitude and decay
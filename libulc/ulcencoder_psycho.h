@@ -12,6 +12,28 @@
 #include "ulchelper.h"
 /**************************************/
 
+//! Temporal (forward) masking parameters
+//! After a masker stops, its masking threshold decays over roughly
+//! 100..200ms. We model this as a linear decay in the log domain
+//! (ie. an exponential decay in power), starting at some level below
+//! that of the masker itself. Levels are in Np of power.
+//! NOTE: The floor value is used instead of -INFINITY so that the
+//! arithmetic stays finite (we compile with -ffast-math).
+#define ULC_TEMPORAL_MASKING_OFFSET_NP  0x1.26BB1Cp1f //! 10dB = 10/(10*Log10[E]) = 2.302585Np
+#define ULC_TEMPORAL_MASKING_DECAY_NP   46.0f         //! Decay rate (Np/s; ~200dB/s)
+#define ULC_TEMPORAL_MASKING_FLOOR_NP (-1000.0f)
+
+//! Lines that lie entirely below the forward masking level are marked
+//! with this (finite) value in MaskingNp[] while the simultaneous
+//! masking is computed, and then have their masking level raised by
+//! the penalty. This only moves them further back in the sort order;
+//! they still count as codeable, so that CBR can still spend its full
+//! rate on them when nothing else is left.
+#define ULC_TEMPORAL_MASKING_MASKED_NP  0x1.0p100f
+#define ULC_TEMPORAL_MASKING_PENALTY_NP 2.0f //! ~8.7dB
+
+/**************************************/
+
 static inline void Block_Transform_CalculatePsychoacoustics_CalcFreqWeightTable(float *Dst, int BlockSize, float NyquistHz)
 {
     //! DCT+DST -> Pseudo-DFT
@@ -20,7 +42,7 @@ static inline void Block_Transform_CalculatePsychoacoustics_CalcFreqWeightTable(
     //! Compute window for all subblock sizes in a sequential window
     //! This should improve cache locality vs a single large window.
     int n, SubBlockSize = BlockSize / ULC_MAX_BLOCK_DECIMATION_FACTOR;
-    float LogFreqStep = logf(NyquistHz / SubBlockSize) + -0x1.BA18AAp2f; //! -0x1.BA18AAp2 = Log[1/1000]
+    float LogFreqStep = ULC_Logf(NyquistHz / SubBlockSize) + -0x1.BA18AAp2f; //! -0x1.BA18AAp2 = Log[1/1000]
     do
     {
         for(n=0; n<SubBlockSize; n++)
@@ -32,14 +54,15 @@ static inline void Block_Transform_CalculatePsychoacoustics_CalcFreqWeightTable(
             //! passages, as well as with smaller BlockSize.
             //! NOTE: We "protect" everything below 1kHz by forcing the
             //! masking calculations to rely only on the floor level.
-            float x = logf(n+0.5f) + LogFreqStep; //! Log[(n+0.5)*NyquistHz/SubBlockSize / 1000]
-            *Dst++ = (x > 0.0f) ? expf(-2.0f*SQR(x)) : 1.0f; //! If below 1kHz (x < 0), clip (E^0 == 1.0)
+            float x = ULC_Logf(n+0.5f) + LogFreqStep; //! Log[(n+0.5)*NyquistHz/SubBlockSize / 1000]
+            *Dst++ = (x > 0.0f) ? ULC_Expf(-2.0f*SQR(x)) : 1.0f; //! If below 1kHz (x < 0), clip (E^0 == 1.0)
         }
     }
     while(LogFreqStep += -0x1.62E430p-1f, (SubBlockSize *= 2) <= BlockSize);   //! -0x1.62E430p-1 = Log[0.5], ie. FreqStep *= 0.5
 }
 static inline void Block_Transform_CalculatePsychoacoustics(
     float *MaskingNp,
+    float *MaskingMemory,
     float *BufferAmp2,
     void  *BufferTemp,
     int    BlockSize,
@@ -63,6 +86,43 @@ static inline void Block_Transform_CalculatePsychoacoustics(
         //! Find the subblock's normalization factor
         float Norm = 0.0f;
         for(n=0; n<SubBlockSize; n++) if((v = BufferAmp2[n]) > Norm) Norm = v;
+#if ULC_USE_TEMPORAL_MASKING
+        //! Apply forward masking
+        //! MaskingMemory[] holds the decaying level of prior maskers (as
+        //! log power per sample, so that subblocks of different sizes
+        //! are comparable) at full frequency resolution, so each line of
+        //! a decimated subblock covers several entries. Lines that fall
+        //! below the forward masking threshold are marked in MaskingNp[]
+        //! and skipped when storing the simultaneous masking levels.
+        //! NOTE: If the subblock is silent, we only apply the decay.
+        {
+            int k, Decimation = BlockSize / SubBlockSize;
+            float Decay   = SubBlockSize * 2 * (ULC_TEMPORAL_MASKING_DECAY_NP / RateHz);
+            float LogSize = ULC_Logf((float)SubBlockSize);
+            float *Mem = MaskingMemory;
+            for(n=0; n<SubBlockSize; n++)
+            {
+                float Fwd = ULC_TEMPORAL_MASKING_FLOOR_NP;
+                for(k=0; k<Decimation; k++)
+                {
+                    v = Mem[k] - Decay;
+                    if(v < ULC_TEMPORAL_MASKING_FLOOR_NP) v = ULC_TEMPORAL_MASKING_FLOOR_NP;
+                    Mem[k] = v;
+                    if(v > Fwd) Fwd = v;
+                }
+                if(Norm != 0.0f)
+                {
+                    float LevelNp = BufferAmp2[n];
+                    LevelNp = (LevelNp < 0x1.0p-126f) ? ULC_TEMPORAL_MASKING_FLOOR_NP : (ULC_Logf(LevelNp) - LogSize);
+                    MaskingNp[n] = (LevelNp < Fwd - ULC_TEMPORAL_MASKING_OFFSET_NP) ? ULC_TEMPORAL_MASKING_MASKED_NP : 0.0f;
+                    for(k=0; k<Decimation; k++) if(LevelNp > Mem[k]) Mem[k] = LevelNp;
+                }
+                Mem += Decimation;
+            }
+        }
+#else
+        (void)MaskingMemory;
+#endif
         if(Norm != 0.0f)
         {
             //! Get the window bandwidth scaling constants
@@ -100,10 +160,10 @@ static inline void Block_Transform_CalculatePsychoacoustics(
                 v = BufferAmp2[n] * Norm;
                 float ve = v * (1.0f - 0x1.6B5434p-2f*ThisFreqWeightTable[n]); //! 0x1.6B5434p-2 = 10^(-9/20)
                 float vw = 0x1.0p16f * sqrtf(ve);
-                EnergyNp[n] = (ve <= 1.0f) ? 0 : (uint32_t)(logf(ve) * LogScale);
+                EnergyNp[n] = (ve <= 1.0f) ? 0 : (uint32_t)(ULC_Logf(ve) * LogScale);
                 Weight  [n] = (vw <= 1.0f) ? 1 : (uint32_t)vw;
             }
-            float LogNorm     = -logf(Norm); //! Log[1/Norm]
+            float LogNorm     = -ULC_Logf(Norm); //! Log[1/Norm]
             float InvLogScale = 0x1.62E430p-28f*SubBlockSize; //! Inverse (round up)
 
             //! Extract the masking levels for each line
@@ -148,7 +208,11 @@ static inline void Block_Transform_CalculatePsychoacoustics(
                 //! theoretical number of bands that would be in that bandwidth.
                 int64_t Mask  = MaskSum / MaskSumW;
                 int64_t Floor = ((int64_t)FloorSum << RangeScaleFxp) / ((n+1) * FloorRangePerLine);
-                MaskingNp[n] = (2*Mask - Floor)*InvLogScale + LogNorm;
+                v = (2*Mask - Floor)*InvLogScale + LogNorm;
+#if ULC_USE_TEMPORAL_MASKING
+                if(MaskingNp[n] == ULC_TEMPORAL_MASKING_MASKED_NP) v += ULC_TEMPORAL_MASKING_PENALTY_NP;
+#endif
+                MaskingNp[n] = v;
             }
         }
 
@@ -130,8 +130,8 @@ static inline void Block_Transform_GetWindowCtrl_TransientFiltering(
             //! Dev note: Closer to 0dB = Less sensitive
             float EnvPostMaskHP = TransientFilter[0];
             float EnvPostMaskBP = TransientFilter[1];
-            float EnvPostMaskHP_Rate = expf(-0x1.CC845Cp6f / RateHz); //! -1.0dB/ms (1000 * Log[10^(-0.2/20))])
-            float EnvPostMaskBP_Rate = expf(-0x1.9E771Ep6f / RateHz); //! -0.9dB/ms (1000 * Log[10^(-0.5/20))])
+            float EnvPostMaskHP_Rate = ULC_Expf(-0x1.CC845Cp6f / RateHz); //! -1.0dB/ms (1000 * Log[10^(-0.2/20))])
+            float EnvPostMaskBP_Rate = ULC_Expf(-0x1.9E771Ep6f / RateHz); //! -0.9dB/ms (1000 * Log[10^(-0.5/20))])
             for(n=0; n<BinSize; n++)
             {
                 //! NOTE: This calculation must be done in the amplitude
@@ -152,8 +152,8 @@ static inline void Block_Transform_GetWindowCtrl_TransientFiltering(
             //! Dev note: Closer to 0dB = More sensitive
             float EnvPreMaskHP = EnvPostMaskHP;
             float EnvPreMaskBP = EnvPostMaskBP;
-            float EnvPreMaskHP_Rate = expf(-0x1.CC845Cp7f / RateHz); //! -2.0dB/ms (1000 * Log[10^(-1.0/20)])
-            float EnvPreMaskBP_Rate = expf(-0x1.144F6Ap5f / RateHz); //! -0.3dB/ms (1000 * Log[10^(-1.0/20)])
+            float EnvPreMaskHP_Rate = ULC_Expf(-0x1.CC845Cp7f / RateHz); //! -2.0dB/ms (1000 * Log[10^(-1.0/20)])
+            float EnvPreMaskBP_Rate = ULC_Expf(-0x1.144F6Ap5f / RateHz); //! -0.3dB/ms (1000 * Log[10^(-1.0/20)])
             for(n=BinSize-1; n>=0; n--)
             {
                 //! NOTE: Cross-multiply HP with BP energy and vice-versa
@@ -170,7 +170,7 @@ static inline void Block_Transform_GetWindowCtrl_TransientFiltering(
             //! easily, smaller blocks get more smoothing because they
             //! don't need to capture smooth-ish changes.
             float EnvBlockMask = TransientFilter[2];
-            float EnvBlockMask_Rate = expf(-0x1.1AF110p-6f * BlockSize / RateHz); //! -0.00015dB/ms*BlockSize (1000 * Log[10^(-0.00015/20)])
+            float EnvBlockMask_Rate = ULC_Expf(-0x1.1AF110p-6f * BlockSize / RateHz); //! -0.00015dB/ms*BlockSize (1000 * Log[10^(-0.00015/20)])
             for(n=0; n<BinSize; n++)
             {
                 float vEnergy = BufEnergy[n*2+0], dEnergy = vEnergy - EnvBlockMask;
@@ -246,8 +246,8 @@ static inline int Block_Transform_GetWindowCtrl(
                     ADDSEGMENT(R, Src[n]);
 #undef ADDSEGMENT
                 }
-                L.Sum = L.Sum ? logf(L.Sum / L.SumW) : (-100.0f); //! -100 = Placeholder for Log[0]
-                R.Sum = R.Sum ? logf(R.Sum / R.SumW) : (-100.0f);
+                L.Sum = L.Sum ? ULC_Logf(L.Sum / L.SumW) : (-100.0f); //! -100 = Placeholder for Log[0]
+                R.Sum = R.Sum ? ULC_Logf(R.Sum / R.SumW) : (-100.0f);
 
                 //! Get final energy ratio
                 float Ratio = ABS(R.Sum - L.Sum);
@@ -0,0 +1,272 @@
+/**************************************/
+//! ulc-codec: Ultra-Low-Complexity Audio Codec
+//! Copyright (C) 2022, Ruben Nunez (Aikku; aik AT aol DOT com DOT au)
+//! Refer to the project README file for license terms.
+/**************************************/
+#include <stdint.h>
+#include <string.h>
+/**************************************/
+#if defined(__SSE2__)
+# include <emmintrin.h>
+#endif
+/**************************************/
+#include "ulcentropy.h"
+/**************************************/
+
+//! rANS lower bound (byte-wise renormalization)
+#define RANS_L (1u << 23)
+
+/**************************************/
+
+//! Context class of each nybble
+//!  0: 0h    (short zero run)
+//!  1: 1h    (long zero run)
+//!  2: 8h    (noise fill)
+//!  3: Fh    (escape)
+//!  4: 2h..7h (positive coefficient)
+//!  5: 9h..Eh (negative coefficient)
+static const uint8_t Entropy_ContextClass[16] = {0,1,4,4,4,4,4,4,2,5,5,5,5,5,5,3};
+static inline int Entropy_NextContext(int Sym, int LastSym)
+{
+    return Sym*ULC_ENTROPY_NCLASSES + Entropy_ContextClass[LastSym];
+}
+
+//! Find the symbol whose cumulative frequency range contains Slot
+//! This counts how many cumulative frequencies lie at or below the
+//! slot (minus the first, which is always 0). Symbols with zero
+//! frequency share their start with the next symbol, and so are
+//! skipped over.
+static inline int Entropy_FindSymbol(const uint16_t *Cum, uint32_t Slot)
+{
+#if defined(__SSE2__)
+    //! NOTE: Cumulative frequencies are < 8000h, so signed compares work.
+    __m128i s  = _mm_set1_epi16((int16_t)Slot);
+    __m128i c0 = _mm_loadu_si128((const __m128i*)Cum + 0);
+    __m128i c1 = _mm_loadu_si128((const __m128i*)Cum + 1);
+    __m128i Gt = _mm_packs_epi16(_mm_cmpgt_epi16(c0, s), _mm_cmpgt_epi16(c1, s));
+    return 15 - __builtin_popcount(_mm_movemask_epi8(Gt));
+#else
+    int k, Sym = 0;
+    for(k=1; k<16; k++) Sym += (Slot >= Cum[k]);
+    return Sym;
+#endif
+}
+
+/**************************************/
+
+void ULC_EntropyModel_Count(uint32_t *Counts, const uint8_t *Block, int nBytes)
+{
+    int n, Ctx = 0, Last = 0;
+    for(n=0; n<nBytes*2; n++)
+    {
+        int Sym = (Block[n/2] >> (4*(n&1))) & 0xF;
+        Counts[Ctx*16 + Sym]++;
+        Ctx  = Entropy_NextContext(Sym, Last);
+        Last = Sym;
+    }
+}
+
+void ULC_EntropyModel_Build(struct ULC_EntropyModel_t *Model, const uint32_t *Counts)
+{
+    int Ctx, s;
+    for(Ctx=0; Ctx<ULC_ENTROPY_NCONTEXTS; Ctx++)
+    {
+        const uint32_t *c = Counts + Ctx*16;
+        uint16_t *Freq = Model->Freq[Ctx];
+
+        //! Scale frequencies to the probability range, making sure
+        //! that every symbol that occurs keeps a non-zero frequency
+        uint64_t Total = 0;
+        for(s=0; s<16; s++) Total += c[s];
+        if(Total == 0)
+        {
+            for(s=0; s<16; s++) Freq[s] = 0;
+        }
+        else
+        {
+            int Sum = 0, MaxSym = 0;
+            for(s=0; s<16; s++)
+            {
+                int f = 0;
+                if(c[s])
+                {
+                    f = (int)((c[s] * (uint64_t)ULC_ENTROPY_PROB_SCALE) / Total);
+                    if(f < 1) f = 1;
+                }
+                Freq[s] = f, Sum += f;
+                if(c[s] > c[MaxSym]) MaxSym = s;
+            }
+
+            //! Give any rounding error to the most probable symbol
+            //! NOTE: It is always at least PROB_SCALE/16, so this can
+            //! never take it down to 0 (at most 15 symbols round up).
+            Freq[MaxSym] += ULC_ENTROPY_PROB_SCALE - Sum;
+        }
+
+        //! Form cumulative frequencies
+        int Cum = 0;
+        for(s=0; s<16; s++) Model->Cum[Ctx][s] = Cum, Cum += Freq[s];
+    }
+}
+
+/**************************************/
+
+//! Serialized format, for each context:
+//!  uint16_t Mask (LSB first): Symbols with non-zero frequency
+//!  For each symbol in Mask:
+//!   Freq-1 (7 bits if < 80h; else 80h|Hi,Lo)
+int ULC_EntropyModel_Write(const struct ULC_EntropyModel_t *Model, uint8_t *Dst)
+{
+    int Ctx, s;
+    uint8_t *Start = Dst;
+    for(Ctx=0; Ctx<ULC_ENTROPY_NCONTEXTS; Ctx++)
+    {
+        int Mask = 0;
+        for(s=0; s<16; s++) if(Model->Freq[Ctx][s]) Mask |= 1 << s;
+        *Dst++ = (uint8_t)(Mask);
+        *Dst++ = (uint8_t)(Mask >> 8);
+        for(s=0; s<16; s++) if(Mask & (1 << s))
+            {
+                int f = Model->Freq[Ctx][s] - 1;
+                if(f < 0x80) *Dst++ = (uint8_t)f;
+                else
+                {
+                    *Dst++ = (uint8_t)(0x80 | (f >> 8));
+                    *Dst++ = (uint8_t)(f);
+                }
+            }
+    }
+    return Dst - Start;
+}
+
+int ULC_EntropyModel_Read(struct ULC_EntropyModel_t *Model, const uint8_t *Src, int SrcSize)
+{
+    int Ctx, s;
+    const uint8_t *Start = Src, *End = Src + SrcSize;
+    for(Ctx=0; Ctx<ULC_ENTROPY_NCONTEXTS; Ctx++)
+    {
+        if(End - Src < 2) return -1;
+        int Mask = Src[0] | Src[1]<<8;
+        Src += 2;
+
+        int Cum = 0;
+        for(s=0; s<16; s++)
+        {
+            int f = 0;
+            if(Mask & (1 << s))
+            {
+                if(Src >= End) return -1;
+                f = *Src++;
+                if(f & 0x80)
+                {
+                    if(Src >= End) return -1;
+                    f = (f&0x7F)<<8 | *Src++;
+                }
+                f++;
+            }
+            Model->Freq[Ctx][s] = f;
+            Model->Cum [Ctx][s] = Cum;
+            Cum += f;
+        }
+        if(Cum != 0 && Cum != ULC_ENTROPY_PROB_SCALE) return -1;
+    }
+    return Src - Start;
+}
+
+/**************************************/
+
+int ULC_Entropy_EncodeBlock(const struct ULC_EntropyModel_t *Model, uint8_t *Dst, const uint8_t *Src, int nBytes)
+{
+    int n, nSym = nBytes*2;
+
+    //! rANS codes in reverse, so write the stream backwards from the
+    //! end of the output space, and move it into place afterwards.
+    //! The context of each symbol depends on the two before it,
+    //! which we read directly from the source data.
+    uint8_t *End = Dst + ULC_ENTROPY_MAX_ENCODED_SIZE(nBytes);
+    uint8_t *Ptr = End;
+    uint32_t x = RANS_L;
+    for(n=nSym-1; n>=0; n--)
+    {
+        int Sym   = (Src[n/2] >> (4*(n&1))) & 0xF;
+        int Ctx   = 0;
+        if(n >= 1)
+        {
+            int Last  = (Src[(n-1)/2] >> (4*((n-1)&1))) & 0xF;
+            int Last2 = (n >= 2) ? ((Src[(n-2)/2] >> (4*((n-2)&1))) & 0xF) : 0;
+            Ctx = Entropy_NextContext(Last, Last2);
+        }
+        uint32_t Freq = Model->Freq[Ctx][Sym];
+        uint32_t Cum  = Model->Cum [Ctx][Sym];
+
+        //! Renormalize and encode
+        uint32_t xMax = ((RANS_L >> ULC_ENTROPY_PROB_BITS) << 8) * Freq;
+        while(x >= xMax) *--Ptr = (uint8_t)x, x >>= 8;
+        x = ((x / Freq) << ULC_ENTROPY_PROB_BITS) + (x % Freq) + Cum;
+    }
+    Ptr -= 4;
+    Ptr[0] = (uint8_t)(x);
+    Ptr[1] = (uint8_t)(x >>  8);
+    Ptr[2] = (uint8_t)(x >> 16);
+    Ptr[3] = (uint8_t)(x >> 24);
+
+    //! Write the block size prefix and move the stream after it
+    uint8_t *Out = Dst;
+    uint32_t v = nBytes;
+    while(v >= 0x80) *Out++ = (uint8_t)(0x80 | v), v >>= 7;
+    *Out++ = (uint8_t)v;
+    memmove(Out, Ptr, End - Ptr);
+    return (Out - Dst) + (End - Ptr);
+}
+
+int ULC_Entropy_DecodeBlock(const struct ULC_EntropyModel_t *Model, uint8_t *Dst, int DstSize, int *nBytes, const uint8_t *Src, int SrcSize)
+{
+    int n;
+    const uint8_t *Start = Src, *End = Src + SrcSize;
+
+    //! Read the block size prefix
+    uint32_t Size = 0;
+    for(n=0;; n+=7)
+    {
+        if(Src >= End || n > 28) return 0;
+        uint8_t b = *Src++;
+        Size |= (uint32_t)(b & 0x7F) << n;
+        if(!(b & 0x80)) break;
+    }
+    if(Size > (uint32_t)DstSize) return 0;
+    *nBytes = Size;
+
+    //! Initialize state
+    if(End - Src < 4) return 0;
+    uint32_t x = Src[0] | Src[1]<<8 | Src[2]<<16 | (uint32_t)Src[3]<<24;
+    Src += 4;
+
+    //! Decode nybbles
+    int Ctx = 0, Last = 0;
+    for(n=0; n<(int)Size*2; n++)
+    {
+        const uint16_t *Cum = Model->Cum[Ctx];
+        uint32_t Slot = x & (ULC_ENTROPY_PROB_SCALE-1);
+        int Sym = Entropy_FindSymbol(Cum, Slot);
+        x = Model->Freq[Ctx][Sym] * (x >> ULC_ENTROPY_PROB_BITS) + Slot - Cum[Sym];
+        while(x < RANS_L)
+        {
+            if(Src >= End) return 0;
+            x = (x << 8) | *Src++;
+        }
+
+        //! Store nybble and update context
+        if(n&1) Dst[n/2] |= Sym << 4;
+        else    Dst[n/2]  = Sym;
+        Ctx  = Entropy_NextContext(Sym, Last);
+        Last = Sym;
+    }
+
+    //! The encoder starts from RANS_L, so we must end there
+    if(x != RANS_L) return 0;
+    return Src - Start;
+}
+
+/**************************************/
+//! EOF
+/**************************************/
@@ -16,6 +16,61 @@
 #define ULC_FORCED_INLINE static inline __attribute__((always_inline))
 /**************************************/
 
+//! Natural logarithm and exponential for the encoder
+//! libm may select a different implementation depending on the
+//! CPU (eg. FMA variants), which can change the last bit of its
+//! results and, through rounding decisions, the coded stream.
+//! Deterministic builds use these versions instead, which rely
+//! only on basic IEEE arithmetic; accuracy is within about 1ulp
+//! for positive normal inputs to Log[] and inputs to E^x that
+//! give a normal result (smaller results are flushed to 0).
+#if ULC_DETERMINISTIC
+ULC_FORCED_INLINE float ULC_Logf(float x)
+{
+    //! x = m*2^e with m in [Sqrt[1/2], Sqrt[2]), and then
+    //! Log[m] = 2*AtanH[s] with s = (m-1)/(m+1), |s| < 0.172
+    union { float f; uint32_t u; } v = { x };
+    int e = 0;
+    if(!(x > 0.0f)) return -INFINITY;
+    if(x < 0x1.0p-126f) v.f = x * 0x1.0p23f, e = -23;
+    e += (int)(v.u >> 23) - 127;
+    v.u = (v.u & 0x007FFFFFu) | 0x3F800000u;
+    if(v.f > 0x1.6A09E6p0f) v.f *= 0.5f, e++;
+    float s  = (v.f - 1.0f) / (v.f + 1.0f);
+    float s2 = s*s;
+    float p  = 2.0f/9;
+    p = p*s2 + 2.0f/7;
+    p = p*s2 + 2.0f/5;
+    p = p*s2 + 2.0f/3;
+    p = p*s2 + 2.0f;
+    return e*0x1.62E400p-1f + (s*p + e*0x1.7F7D1Cp-20f); //! Log[2] split into Hi+Lo parts
+}
+ULC_FORCED_INLINE float ULC_Expf(float x)
+{
+    //! E^x = 2^k * E^r, with k = Round[x/Log[2]] and |r| <= Log[2]/2
+    if(x < -0x1.5D58A0p6f) return 0.0f;     //! Log[2^-126]
+    if(x >  0x1.61814Ap6f) return INFINITY; //! Log[2^127.5]
+    int   k = (int)lrintf(x * 0x1.715476p0f);
+    float r = (x - k*0x1.62E400p-1f) - k*0x1.7F7D1Cp-20f;
+    float p = 1.0f/5040;
+    p = p*r + 1.0f/720;
+    p = p*r + 1.0f/120;
+    p = p*r + 1.0f/24;
+    p = p*r + 1.0f/6;
+    p = p*r + 0.5f;
+    p = p*r + 1.0f;
+    p = p*r + 1.0f;
+    union { float f; uint32_t u; } Scale;
+    Scale.u = (uint32_t)(k + 127) << 23;
+    return p * Scale.f;
+}
+#else
+# define ULC_Logf logf
+# define ULC_Expf expf
+#endif
+
+/**************************************/
+
 //! Subblock decimation pattern
 //! Each subblock is coded in 4 bits (LSB to MSB):
 //!  Bit0..2: Subblock shift (ie. BlockSize >> Shift)
@@ -47,6 +102,48 @@ ULC_FORCED_INLINE ULC_SubBlockDecimationPattern_t ULC_SubBlockDecimationPattern(
 
 /**************************************/
 
+//! Parametric stereo bands
+//! The S channel of a parametric pair is coded as two nybbles per band
+//! in each [sub]block, with band edges at fixed fractions (in 1/64ths)
+//! of the [sub]block size; this gives bands of roughly constant width
+//! on a log-frequency scale, while staying independent of the rate.
+//!  Xh: Level  (signed; S = Xh/7 * M)
+//!  Yh: Spread (S += Yh/8 * Decorrelated[M])
+#define ULC_PARAMETRIC_STEREO_NBANDS 8
+ULC_FORCED_INLINE int ULC_ParametricStereoBandEnd(int Band, int SubBlockSize)
+{
+    static const uint8_t BandEnd[ULC_PARAMETRIC_STEREO_NBANDS] = {1,2,4,8,12,20,32,64};
+    return (BandEnd[Band] * SubBlockSize) / 64;
+}
+
+/**************************************/
+
+//! Long-term prediction (see ULC_DecodeBlock_Predict())
+//! In streams that use it, each channel of a block made of a single
+//! [sub]block (and not part of a parametric pair) starts with:
+//!  Xh:                   Number of predicted bands (0 = Off)
+//!  Zh,Yh,Xh:             Lag-ULC_LTP_MIN_LAG (only when Xh != 0)
+//!  Gh[Number of bands]:  Gain of each band (0 = Off; Gain = Gh/16)
+//! Band edges are at fixed fractions (in 1/64ths) of the block size,
+//! and stop at half the bandwidth, as the prediction of the upper
+//! lines is rarely any good. Gains stay below 1.0, so that any error
+//! in the history (eg. after seeking) decays away.
+#define ULC_LTP_NBANDS        8
+#define ULC_LTP_MIN_LAG       16
+#define ULC_LTP_MAX_LAG      (ULC_LTP_MIN_LAG + 0xFFF)
+#define ULC_LTP_HISTORY_SIZE ((ULC_LTP_MAX_LAG + 15) &~ 15)
+ULC_FORCED_INLINE int ULC_LTPBandEnd(int Band, int BlockSize)
+{
+    static const uint8_t BandEnd[ULC_LTP_NBANDS] = {2,4,6,8,12,16,24,32};
+    return (BandEnd[Band] * BlockSize) / 64;
+}
+ULC_FORCED_INLINE int ULC_LTPAllowed(int WindowCtrl)
+{
+    return (ULC_SubBlockDecimationPattern(WindowCtrl) >> 4) == 0;
+}
+
+/**************************************/
+
 //! Quantize value (mathematically optimal)
 ULC_FORCED_INLINE int ULC_CompandedQuantizeUnsigned(float v)
 {
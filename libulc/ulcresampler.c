@@ -0,0 +1,350 @@
+/**************************************/
+//! ulc-codec: Ultra-Low-Complexity Audio Codec
+//! Copyright (C) 2022, Ruben Nunez (Aikku; aik AT aol DOT com DOT au)
+//! Refer to the project README file for license terms.
+/**************************************/
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+/**************************************/
+#if defined(__AVX__)
+# include <immintrin.h>
+#elif defined(__SSE__)
+# include <xmmintrin.h>
+#elif defined(__ARM_NEON)
+# include <arm_neon.h>
+#endif
+/**************************************/
+#include "ulcresampler.h"
+#include "ulchelper.h"
+/**************************************/
+#define BUFFER_ALIGNMENT 64u //! Always align memory to 64-byte boundaries (preparation for AVX-512)
+/**************************************/
+
+//! Filter cutoff, relative to the lower of the two Nyquist rates
+//! This leaves some room for the transition band, which would
+//! otherwise alias/image right at the Nyquist frequency.
+#define CUTOFF_SCALE 0.92
+
+/**************************************/
+
+//! Filter kernel (Blackman-windowed sinc)
+//! u is the distance from the output sample (in input samples),
+//! c is the cutoff (relative to the input Nyquist), and H is
+//! the half-width of the filter (in input samples).
+static double Resampler_Kernel(double u, double c, double H)
+{
+    if(u <= -H || u >= +H) return 0.0;
+    double x = u * c;
+    double Sinc = (x == 0.0) ? 1.0 : (sin(M_PI*x) / (M_PI*x));
+    double w = u / H;
+    double Window = 0.42 + 0.5*cos(M_PI*w) + 0.08*cos(2.0*M_PI*w);
+    return c * Sinc * Window;
+}
+
+//! Build the polyphase table
+//! Tap k of phase f corresponds to u = k-(H-1)-f. Each phase is
+//! normalized to unity DC gain, and followed by its delta to the
+//! next phase for linear interpolation between phases.
+static void Resampler_BuildFilterTable(float *Table, int nTaps, double c)
+{
+    int p, k;
+    double Coef[2][ULC_RESAMPLER_MAX_TAPS];
+    int H = nTaps / 2;
+    for(p=0; p<=ULC_RESAMPLER_PHASES; p++)
+    {
+        double *Cur = Coef[p&1];
+        double f = p * (1.0 / ULC_RESAMPLER_PHASES);
+        double Sum = 0.0;
+        for(k=0; k<nTaps; k++) Sum += (Cur[k] = Resampler_Kernel(k - (H-1) - f, c, H));
+        for(k=0; k<nTaps; k++) Cur[k] /= Sum;
+        if(p > 0)
+        {
+            const double *Prev = Coef[(p-1)&1];
+            float *Dst = Table + (p-1)*nTaps*2;
+            for(k=0; k<nTaps; k++)
+            {
+                Dst[k]       = (float)Prev[k];
+                Dst[k+nTaps] = (float)(Cur[k] - Prev[k]);
+            }
+        }
+    }
+}
+
+/**************************************/
+
+//! Initialize resampler state
+int ULC_ResamplerState_Init(struct ULC_ResamplerState_t *State)
+{
+    //! Clear anything that is needed for ResamplerState_Destroy()
+    State->BufferData = NULL;
+
+    //! Verify parameters
+    int nChan        = State->nChan;
+    int RateHz       = State->RateHz;
+    int OutputRateHz = State->OutputRateHz;
+    int MaxInputSize = State->MaxInputSize;
+    if(nChan < 1 || RateHz < 1 || OutputRateHz < 1 || MaxInputSize < 1) return -1;
+
+    //! Get filter parameters
+    //! When downsampling, we must lower the cutoff to the output Nyquist
+    //! rate, and widen the filter by the same ratio to keep its shape.
+    double Ratio = (double)OutputRateHz / RateHz;
+    int nTaps = ULC_RESAMPLER_BASE_TAPS;
+    if(Ratio < 1.0)
+    {
+        nTaps = (int)ceil(ULC_RESAMPLER_BASE_TAPS / Ratio);
+        nTaps = (nTaps + 7) &~ 7;
+        if(nTaps > ULC_RESAMPLER_MAX_TAPS) nTaps = ULC_RESAMPLER_MAX_TAPS;
+    }
+    double Cutoff = CUTOFF_SCALE * ((Ratio < 1.0) ? Ratio : 1.0);
+
+    //! Get buffer offsets and allocation size
+    int HistorySize = (nTaps-1 + (BUFFER_ALIGNMENT/sizeof(float)-1)) &~ (BUFFER_ALIGNMENT/sizeof(float)-1);
+    int InputStride = (HistorySize + MaxInputSize + (BUFFER_ALIGNMENT/sizeof(float)-1)) &~ (BUFFER_ALIGNMENT/sizeof(float)-1);
+    int AllocSize = 0;
+#define CREATE_BUFFER(Name, Sz) int Name##_Offs = AllocSize; AllocSize += Sz
+    CREATE_BUFFER(FilterTable, sizeof(float) * (ULC_RESAMPLER_PHASES*nTaps*2));
+    CREATE_BUFFER(InputBuffer, sizeof(float) * (nChan*InputStride));
+#undef CREATE_BUFFER
+
+    //! Allocate buffer space
+    char *Buf = State->BufferData = malloc(BUFFER_ALIGNMENT-1 + AllocSize);
+    if(!Buf) return -1;
+
+    //! Initialize state
+    //! NOTE: The initial position is set so that the first filter
+    //! window is centered on the first input sample, treating all
+    //! prior samples as silence. This way, there is no delay.
+    int i;
+    Buf += (-(uintptr_t)Buf) & (BUFFER_ALIGNMENT-1);
+    State->nTaps       = nTaps;
+    State->HistorySize = HistorySize;
+    State->InputStride = InputStride;
+    State->Pos         = nTaps / 2;
+    State->PosFrac     = 0;
+    State->StepInt     = RateHz / OutputRateHz;
+    State->StepFrac    = (uint32_t)((((uint64_t)(RateHz % OutputRateHz)) << 32) / OutputRateHz);
+    State->FilterTable = (float*)(Buf + FilterTable_Offs);
+    State->InputBuffer = (float*)(Buf + InputBuffer_Offs);
+    for(i=0; i<nChan*InputStride; i++) State->InputBuffer[i] = 0.0f;
+    Resampler_BuildFilterTable(State->FilterTable, nTaps, Cutoff);
+
+    //! Success
+    return 1;
+}
+
+/**************************************/
+
+//! Destroy resampler state
+void ULC_ResamplerState_Destroy(struct ULC_ResamplerState_t *State)
+{
+    //! Free buffer space
+    free(State->BufferData);
+}
+
+/**************************************/
+
+//! Get the maximum number of output samples (per channel) for nIn input samples
+int ULC_Resampler_MaxOutputSize(const struct ULC_ResamplerState_t *State, int nIn)
+{
+    //! +1 for rounding, +1 for the fractional position carried over
+    return (int)(((int64_t)nIn * State->OutputRateHz) / State->RateHz) + 2;
+}
+
+//! Get the input buffer for a channel
+float *ULC_Resampler_GetInputBuffer(const struct ULC_ResamplerState_t *State, int Chan)
+{
+    return State->InputBuffer + Chan*State->InputStride + State->HistorySize;
+}
+
+/**************************************/
+
+//! Vector helpers for filtering
+//! NOTE: nTaps is always a multiple of 8, so no tail handling is needed.
+//! NOTE: Deterministic builds always use the scalar path, as the
+//! order of summation depends on the vector width.
+#if defined(__AVX__) && !ULC_DETERMINISTIC
+# define RESAMPLER_VSTRIDE 8
+typedef __m256 Resampler_Vec_t;
+# define RESAMPLER_VZERO()       _mm256_setzero_ps()
+# define RESAMPLER_VSET1(x)      _mm256_set1_ps(x)
+# define RESAMPLER_VLOAD(Src)    _mm256_load_ps(Src)
+# define RESAMPLER_VLOADU(Src)   _mm256_loadu_ps(Src)
+# if defined(__FMA__)
+#  define RESAMPLER_VFMA(x, y, a) _mm256_fmadd_ps(x, y, a)
+# else
+#  define RESAMPLER_VFMA(x, y, a) _mm256_add_ps(_mm256_mul_ps(x, y), a)
+# endif
+ULC_FORCED_INLINE float RESAMPLER_VSUM(Resampler_Vec_t x)
+{
+    __m128 y = _mm_add_ps(_mm256_castps256_ps128(x), _mm256_extractf128_ps(x, 1));
+    y = _mm_add_ps(y, _mm_movehl_ps(y, y));
+    y = _mm_add_ss(y, _mm_shuffle_ps(y, y, 0x55));
+    return _mm_cvtss_f32(y);
+}
+#elif defined(__SSE__) && !ULC_DETERMINISTIC
+# define RESAMPLER_VSTRIDE 4
+typedef __m128 Resampler_Vec_t;
+# define RESAMPLER_VZERO()       _mm_setzero_ps()
+# define RESAMPLER_VSET1(x)      _mm_set1_ps(x)
+# define RESAMPLER_VLOAD(Src)    _mm_load_ps(Src)
+# define RESAMPLER_VLOADU(Src)   _mm_loadu_ps(Src)
+# define RESAMPLER_VFMA(x, y, a) _mm_add_ps(_mm_mul_ps(x, y), a)
+ULC_FORCED_INLINE float RESAMPLER_VSUM(Resampler_Vec_t x)
+{
+    x = _mm_add_ps(x, _mm_movehl_ps(x, x));
+    x = _mm_add_ss(x, _mm_shuffle_ps(x, x, 0x55));
+    return _mm_cvtss_f32(x);
+}
+#elif defined(__ARM_NEON) && !ULC_DETERMINISTIC
+# define RESAMPLER_VSTRIDE 4
+typedef float32x4_t Resampler_Vec_t;
+# define RESAMPLER_VZERO()       vdupq_n_f32(0.0f)
+# define RESAMPLER_VSET1(x)      vdupq_n_f32(x)
+# define RESAMPLER_VLOAD(Src)    vld1q_f32(Src)
+# define RESAMPLER_VLOADU(Src)   vld1q_f32(Src)
+# if defined(__ARM_FEATURE_FMA)
+#  define RESAMPLER_VFMA(x, y, a) vfmaq_f32(a, x, y)
+# else
+#  define RESAMPLER_VFMA(x, y, a) vaddq_f32(vmulq_f32(x, y), a)
+# endif
+ULC_FORCED_INLINE float RESAMPLER_VSUM(Resampler_Vec_t x)
+{
+    float32x2_t y = vadd_f32(vget_low_f32(x), vget_high_f32(x));
+    return vget_lane_f32(vpadd_f32(y, y), 0);
+}
+#else
+# define RESAMPLER_VSTRIDE 1
+typedef float Resampler_Vec_t;
+# define RESAMPLER_VZERO()       0.0f
+# define RESAMPLER_VSET1(x)      (x)
+# define RESAMPLER_VLOAD(Src)    (*(Src))
+# define RESAMPLER_VLOADU(Src)   (*(Src))
+# define RESAMPLER_VFMA(x, y, a) ((x)*(y) + (a))
+# define RESAMPLER_VSUM(x)       (x)
+#endif
+
+//! Apply the filter to one channel's window
+//! The coefficients are interpolated from the phase table on the
+//! fly (Coef = Phase[k] + w*Delta[k]), so they are never stored.
+ULC_FORCED_INLINE float Resampler_Filter(const float *Src, const float *Phase, float w, int nTaps)
+{
+    int k;
+    Resampler_Vec_t vw  = RESAMPLER_VSET1(w);
+    Resampler_Vec_t Sum = RESAMPLER_VZERO();
+    for(k=0; k<nTaps; k+=RESAMPLER_VSTRIDE)
+    {
+        Resampler_Vec_t c = RESAMPLER_VFMA(vw, RESAMPLER_VLOAD(Phase + nTaps + k), RESAMPLER_VLOAD(Phase + k));
+        Sum = RESAMPLER_VFMA(RESAMPLER_VLOADU(Src + k), c, Sum);
+    }
+    return RESAMPLER_VSUM(Sum);
+}
+
+//! Apply the filter to two channels' windows (sharing the coefficients)
+ULC_FORCED_INLINE void Resampler_FilterPair(float *a, float *b, const float *SrcA, const float *SrcB, const float *Phase, float w, int nTaps)
+{
+    int k;
+    Resampler_Vec_t vw   = RESAMPLER_VSET1(w);
+    Resampler_Vec_t SumA = RESAMPLER_VZERO();
+    Resampler_Vec_t SumB = RESAMPLER_VZERO();
+    for(k=0; k<nTaps; k+=RESAMPLER_VSTRIDE)
+    {
+        Resampler_Vec_t c = RESAMPLER_VFMA(vw, RESAMPLER_VLOAD(Phase + nTaps + k), RESAMPLER_VLOAD(Phase + k));
+        SumA = RESAMPLER_VFMA(RESAMPLER_VLOADU(SrcA + k), c, SumA);
+        SumB = RESAMPLER_VFMA(RESAMPLER_VLOADU(SrcB + k), c, SumB);
+    }
+    *a = RESAMPLER_VSUM(SumA);
+    *b = RESAMPLER_VSUM(SumB);
+}
+
+//! Store an output sample
+ULC_FORCED_INLINE void Resampler_Store(void *Dst, int Idx, float x, int Flags)
+{
+    if(Flags & ULC_RESAMPLER_OUTPUT_PCM16)
+    {
+        x *= 0x1.0p15f;
+        x = (x < -0x8000) ? -0x8000 : (x > +0x7FFF) ? +0x7FFF : x;
+        ((int16_t*)Dst)[Idx] = (int16_t)lrintf(x);
+    }
+    else ((float*)Dst)[Idx] = x;
+}
+
+//! Process nIn samples from the input buffers
+int ULC_Resampler_Process(struct ULC_ResamplerState_t *State, void *Dst, int nIn, int Flags)
+{
+    int Chan;
+    int nChan       = State->nChan;
+    int nTaps       = State->nTaps;
+    int InputStride = State->InputStride;
+    int Pos         = State->Pos;
+    uint32_t PosFrac  = State->PosFrac;
+    int      StepInt  = State->StepInt;
+    uint32_t StepFrac = State->StepFrac;
+    const float *FilterTable = State->FilterTable;
+    float *WindowBase = State->InputBuffer + State->HistorySize - (nTaps-1);
+
+    //! Generate outputs for as long as we have a full window of input
+    int nOut = 0;
+    while(Pos < nIn)
+    {
+        //! Get the phase for this output
+        const float *Phase = FilterTable + (PosFrac >> (32-ULC_RESAMPLER_PHASES_LOG2))*nTaps*2;
+        float w = (PosFrac & ((1u << (32-ULC_RESAMPLER_PHASES_LOG2)) - 1)) * (1.0f / (1u << (32-ULC_RESAMPLER_PHASES_LOG2)));
+
+        //! Filter each channel (in pairs where possible), undoing M/S if needed
+        const float *Src = WindowBase + Pos;
+        for(Chan=0; Chan+1<nChan; Chan+=2)
+        {
+            float a, b;
+            Resampler_FilterPair(&a, &b, Src + Chan*InputStride, Src + (Chan+1)*InputStride, Phase, w, nTaps);
+            if(Flags & ULC_RESAMPLER_MIDSIDE)
+            {
+                float t = a;
+                a = t + b;
+                b = t - b;
+            }
+            Resampler_Store(Dst, nOut*nChan + Chan,   a, Flags);
+            Resampler_Store(Dst, nOut*nChan + Chan+1, b, Flags);
+        }
+        if(Chan < nChan)
+        {
+            float a = Resampler_Filter(Src + Chan*InputStride, Phase, w, nTaps);
+            Resampler_Store(Dst, nOut*nChan + Chan, a, Flags);
+        }
+        nOut++;
+
+        //! Advance position
+        uint32_t t = PosFrac + StepFrac;
+        Pos += StepInt + (t < PosFrac);
+        PosFrac = t;
+    }
+
+    //! Keep the last nTaps-1 samples as history for the next call
+    for(Chan=0; Chan<nChan; Chan++)
+    {
+        float *Buf = WindowBase + Chan*InputStride;
+        memmove(Buf, Buf + nIn, sizeof(float)*(nTaps-1));
+    }
+    State->Pos     = Pos - nIn;
+    State->PosFrac = PosFrac;
+    return nOut;
+}
+
+//! Process nIn samples from interleaved input data
+int ULC_Resampler_ProcessInterleaved(struct ULC_ResamplerState_t *State, void *Dst, const float *Src, int nIn, int Flags)
+{
+    int n, Chan;
+    int nChan = State->nChan;
+    for(Chan=0; Chan<nChan; Chan++)
+    {
+        float *Buf = ULC_Resampler_GetInputBuffer(State, Chan);
+        for(n=0; n<nIn; n++) Buf[n] = Src[n*nChan + Chan];
+    }
+    return ULC_Resampler_Process(State, Dst, nIn, Flags);
+}
+
+/**************************************/
+//! EOF
+/**************************************/
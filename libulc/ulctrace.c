@@ -0,0 +1,165 @@
+/**************************************/
+//! ulc-codec: Ultra-Low-Complexity Audio Codec
+//! Copyright (C) 2022, Ruben Nunez (Aikku; aik AT aol DOT com DOT au)
+//! Refer to the project README file for license terms.
+/**************************************/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+/**************************************/
+#include "ulctrace.h"
+/**************************************/
+#if ULC_TRACING
+/**************************************/
+
+struct ULC_TraceEvent_t
+{
+    const char *Name;
+    const char *ArgName;
+    uint64_t    Start, End;
+    int         Arg;
+};
+
+//! Per-thread ring
+//! Only the owning thread writes to a ring, so no locking is needed;
+//! Head is published with release semantics so that a dump sees the
+//! complete events. Rings are linked into a global list on creation
+//! (lock-free push) and are never freed, so that the events of
+//! threads that have since exited can still be dumped.
+struct ULC_TraceRing_t
+{
+    struct ULC_TraceRing_t *Next;
+    int      ThreadIdx;
+    uint32_t Head;     //! Number of events recorded so far
+    uint64_t RefTicks; //! Timestamp at creation, for calibration
+    uint64_t RefNs;
+    struct ULC_TraceEvent_t Events[ULC_TRACE_RING_SIZE];
+};
+
+static __thread struct ULC_TraceRing_t *ULC_Trace_ThreadRing;
+static struct ULC_TraceRing_t *ULC_Trace_Rings;
+static int ULC_Trace_nThreads;
+
+/**************************************/
+
+static uint64_t ULC_Trace_GetNs(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec*1000000000ull + t.tv_nsec;
+}
+
+#if !(defined(__x86_64__) || defined(__i386__))
+uint64_t ULC_Trace_Now(void)
+{
+    return ULC_Trace_GetNs();
+}
+#endif
+
+/**************************************/
+
+static struct ULC_TraceRing_t *ULC_Trace_CreateRing(void)
+{
+    struct ULC_TraceRing_t *Ring = malloc(sizeof(struct ULC_TraceRing_t));
+    if(!Ring) return NULL;
+    Ring->ThreadIdx = __atomic_fetch_add(&ULC_Trace_nThreads, 1, __ATOMIC_RELAXED);
+    Ring->Head      = 0;
+    Ring->RefNs     = ULC_Trace_GetNs();
+    Ring->RefTicks  = ULC_Trace_Now();
+
+    //! Push onto the global list
+    Ring->Next = __atomic_load_n(&ULC_Trace_Rings, __ATOMIC_RELAXED);
+    while(!__atomic_compare_exchange_n(&ULC_Trace_Rings, &Ring->Next, Ring, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    return ULC_Trace_ThreadRing = Ring;
+}
+
+void ULC_Trace_Event(const char *Name, const char *ArgName, int Arg, uint64_t Start, uint64_t End)
+{
+    struct ULC_TraceRing_t *Ring = ULC_Trace_ThreadRing;
+    if(!Ring && !(Ring = ULC_Trace_CreateRing())) return;
+
+    uint32_t Head = Ring->Head;
+    struct ULC_TraceEvent_t *Event = &Ring->Events[Head % ULC_TRACE_RING_SIZE];
+    Event->Name    = Name;
+    Event->ArgName = ArgName;
+    Event->Start   = Start;
+    Event->End     = End;
+    Event->Arg     = Arg;
+    __atomic_store_n(&Ring->Head, Head+1, __ATOMIC_RELEASE);
+}
+
+/**************************************/
+
+int ULC_Trace_Dump(const char *Filename)
+{
+    struct ULC_TraceRing_t *Ring, *Rings = __atomic_load_n(&ULC_Trace_Rings, __ATOMIC_ACQUIRE);
+    FILE *File = fopen(Filename, "w");
+    if(!File) return -1;
+
+    //! Convert ticks to microseconds, relative to the earliest event
+    //! NOTE: The tick rate is measured over the lifetime of the first
+    //! ring that was created.
+    double UsPerTick = 1.0e-3;
+    uint64_t BaseTicks = UINT64_MAX;
+    if(Rings)
+    {
+        const struct ULC_TraceRing_t *First = Rings;
+        for(Ring=Rings; Ring; Ring=Ring->Next)
+        {
+            uint32_t Head = __atomic_load_n(&Ring->Head, __ATOMIC_ACQUIRE);
+            uint32_t Idx  = (Head > ULC_TRACE_RING_SIZE) ? (Head - ULC_TRACE_RING_SIZE) : 0;
+            for(; Idx<Head; Idx++)
+            {
+                uint64_t Start = Ring->Events[Idx % ULC_TRACE_RING_SIZE].Start;
+                if(Start < BaseTicks) BaseTicks = Start;
+            }
+            if(Ring->RefNs < First->RefNs) First = Ring;
+        }
+        uint64_t Ns    = ULC_Trace_GetNs();
+        uint64_t Ticks = ULC_Trace_Now();
+        if(Ticks > First->RefTicks) UsPerTick = (Ns - First->RefNs)*1.0e-3 / (Ticks - First->RefTicks);
+    }
+
+    //! Write events as "complete" (ph=X) events, one track per thread
+    int nWritten = 0;
+    fprintf(File, "{\"traceEvents\":[\n");
+    for(Ring=Rings; Ring; Ring=Ring->Next)
+    {
+        uint32_t Head = __atomic_load_n(&Ring->Head, __ATOMIC_ACQUIRE);
+        uint32_t Idx  = (Head > ULC_TRACE_RING_SIZE) ? (Head - ULC_TRACE_RING_SIZE) : 0;
+        for(; Idx<Head; Idx++)
+        {
+            const struct ULC_TraceEvent_t *Event = &Ring->Events[Idx % ULC_TRACE_RING_SIZE];
+            fprintf(File,
+                "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+                nWritten ? ",\n" : "",
+                Event->Name,
+                Ring->ThreadIdx,
+                (Event->Start - BaseTicks) * UsPerTick,
+                (Event->End - Event->Start) * UsPerTick
+            );
+            if(Event->ArgName) fprintf(File, ",\"args\":{\"%s\":%d}", Event->ArgName, Event->Arg);
+            fputc('}', File);
+            nWritten++;
+        }
+    }
+    fprintf(File, "\n]}\n");
+    return (fclose(File) == 0) ? 1 : -1;
+}
+
+/**************************************/
+#else
+/**************************************/
+
+int ULC_Trace_Dump(const char *Filename)
+{
+    (void)Filename;
+    return 0;
+}
+
+/**************************************/
+#endif
+/**************************************/
+//! EOF
+/**************************************/
@@ -0,0 +1,596 @@
+/**************************************/
+#define _GNU_SOURCE //! AT_EMPTY_PATH
+/**************************************/
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+/**************************************/
+#if defined(__linux__)
+# include <linux/io_uring.h>
+# include <linux/stat.h>
+# include <sys/mman.h>
+# include <sys/syscall.h>
+#endif
+/**************************************/
+#include "ulc_asyncio.h"
+/**************************************/
+
+//! Largest number of threads for ASYNCIO_BACKEND_THREADS
+#define ASYNCIO_MAX_THREADS 64
+
+//! Largest transfer per read/write call
+#define ASYNCIO_MAX_TRANSFER (1u << 30)
+
+/**************************************/
+
+static void AsyncIO_Push(struct AsyncIO_Request_t **Head, struct AsyncIO_Request_t **Tail, struct AsyncIO_Request_t *Req)
+{
+    Req->Next = NULL;
+    if(*Tail) (*Tail)->Next = Req;
+    else *Head = Req;
+    *Tail = Req;
+}
+
+static struct AsyncIO_Request_t *AsyncIO_Pop(struct AsyncIO_Request_t **Head, struct AsyncIO_Request_t **Tail)
+{
+    struct AsyncIO_Request_t *Req = *Head;
+    if(Req)
+    {
+        *Head = Req->Next;
+        if(!*Head) *Tail = NULL;
+    }
+    return Req;
+}
+
+//! Hand a finished request over to AsyncIO_Wait() (with IO->Lock held)
+static void AsyncIO_Complete(struct AsyncIO_t *IO, struct AsyncIO_Request_t *Req)
+{
+    if(Req->Op == ASYNCIO_OP_READ && Req->Result < 0)
+    {
+        free(Req->Data);
+        Req->Data = NULL;
+        Req->Size = 0;
+    }
+    AsyncIO_Push(&IO->DoneHead, &IO->DoneTail, Req);
+    pthread_cond_signal(&IO->DoneCond);
+}
+
+/**************************************/
+//! Blocking I/O (ASYNCIO_BACKEND_THREADS, ASYNCIO_BACKEND_SYNC)
+/**************************************/
+
+static void AsyncIO_DoBlocking(struct AsyncIO_Request_t *Req)
+{
+    int Reading = (Req->Op == ASYNCIO_OP_READ);
+    Req->Result = 0;
+    if(Req->Op == ASYNCIO_OP_NOP) return;
+    if(Reading) Req->Data = NULL;
+
+    //! Open the file, and size the buffer when reading
+    int Fd = Reading ? open(Req->Path, O_RDONLY | O_CLOEXEC) : open(Req->Path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if(Fd < 0)
+    {
+        Req->Result = -errno;
+        return;
+    }
+    if(Reading)
+    {
+        struct stat St;
+        if(fstat(Fd, &St) < 0) Req->Result = -errno;
+        else
+        {
+            Req->Size = St.st_size;
+            Req->Data = malloc(Req->Size ? Req->Size : 1);
+            if(!Req->Data) Req->Result = -ENOMEM;
+        }
+    }
+
+    //! Transfer the data
+    //! NOTE: A read that hits the end early means that the file
+    //! shrank after we sized it; we just keep what was there.
+    size_t Done = 0;
+    while(Req->Result == 0 && Done < Req->Size)
+    {
+        size_t  Len = Req->Size - Done;
+        if(Len > ASYNCIO_MAX_TRANSFER) Len = ASYNCIO_MAX_TRANSFER;
+        ssize_t n = Reading ? pread(Fd, Req->Data + Done, Len, Done) : pwrite(Fd, Req->Data + Done, Len, Done);
+        if(n < 0)
+        {
+            if(errno != EINTR) Req->Result = -errno;
+        }
+        else if(n == 0)
+        {
+            if(Reading) Req->Size = Done;
+            else Req->Result = -EIO;
+        }
+        else Done += n;
+    }
+    if(close(Fd) < 0 && Req->Result == 0) Req->Result = -errno;
+}
+
+static void *AsyncIO_Thread(void *User)
+{
+    struct AsyncIO_t *IO = (struct AsyncIO_t*)User;
+    pthread_mutex_lock(&IO->Lock);
+    for(;;)
+    {
+        struct AsyncIO_Request_t *Req = AsyncIO_Pop(&IO->PendingHead, &IO->PendingTail);
+        if(!Req)
+        {
+            if(IO->Quit) break;
+            pthread_cond_wait(&IO->PendingCond, &IO->Lock);
+            continue;
+        }
+        pthread_mutex_unlock(&IO->Lock);
+        AsyncIO_DoBlocking(Req);
+        pthread_mutex_lock(&IO->Lock);
+        AsyncIO_Complete(IO, Req);
+    }
+    pthread_mutex_unlock(&IO->Lock);
+    return NULL;
+}
+
+/**************************************/
+//! io_uring (ASYNCIO_BACKEND_URING)
+/**************************************/
+#if defined(__linux__) && defined(__NR_io_uring_setup)
+/**************************************/
+
+//! Request stages
+//! Each request in flight owns a slot, which holds its progress
+//! through the stages; a slot has at most one operation queued at a
+//! time, so that a ring with as many entries as slots never fills.
+#define URING_STAGE_OPEN  0 //! openat()
+#define URING_STAGE_STAT  1 //! statx() (reads only; to size the buffer)
+#define URING_STAGE_XFER  2 //! read()/write(), until Size bytes are done
+#define URING_STAGE_CLOSE 3 //! close()
+#define URING_STAGE_NOP   4 //! ASYNCIO_OP_NOP
+struct AsyncIO_UringSlot_t
+{
+    struct AsyncIO_Request_t *Req;
+    int    Stage;
+    int    Fd;
+    size_t Done;
+    struct statx Stx;
+    struct AsyncIO_UringSlot_t *NextFree;
+};
+
+struct AsyncIO_Uring_t
+{
+    int RingFd;
+    unsigned *SqTail, *SqMask, *SqArray;
+    unsigned *CqHead, *CqTail, *CqMask;
+    struct io_uring_sqe *Sqes;
+    struct io_uring_cqe *Cqes;
+    void  *SqRing, *CqRing;
+    size_t SqRingSize, CqRingSize, SqesSize;
+    unsigned nUnsubmitted;
+    struct AsyncIO_UringSlot_t *Slots, *FreeSlots;
+};
+
+/**************************************/
+
+//! Queue the operation for a slot's current stage
+static void Uring_Queue(struct AsyncIO_Uring_t *Ring, struct AsyncIO_UringSlot_t *Slot)
+{
+    struct AsyncIO_Request_t *Req = Slot->Req;
+    unsigned Tail = *Ring->SqTail;
+    unsigned Idx  = Tail & *Ring->SqMask;
+    struct io_uring_sqe *Sqe = &Ring->Sqes[Idx];
+    memset(Sqe, 0, sizeof(*Sqe));
+    switch(Slot->Stage)
+    {
+    case URING_STAGE_OPEN:
+    {
+        Sqe->opcode = IORING_OP_OPENAT;
+        Sqe->fd     = AT_FDCWD;
+        Sqe->addr   = (uintptr_t)Req->Path;
+        if(Req->Op == ASYNCIO_OP_READ) Sqe->open_flags = O_RDONLY | O_CLOEXEC;
+        else Sqe->open_flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, Sqe->len = 0666;
+    } break;
+    case URING_STAGE_STAT:
+    {
+        Sqe->opcode      = IORING_OP_STATX;
+        Sqe->fd          = Slot->Fd;
+        Sqe->addr        = (uintptr_t)"";
+        Sqe->len         = STATX_SIZE;
+        Sqe->statx_flags = AT_EMPTY_PATH;
+        Sqe->addr2       = (uintptr_t)&Slot->Stx;
+    } break;
+    case URING_STAGE_XFER:
+    {
+        size_t Len = Req->Size - Slot->Done;
+        if(Len > ASYNCIO_MAX_TRANSFER) Len = ASYNCIO_MAX_TRANSFER;
+        Sqe->opcode = (Req->Op == ASYNCIO_OP_READ) ? IORING_OP_READ : IORING_OP_WRITE;
+        Sqe->fd     = Slot->Fd;
+        Sqe->addr   = (uintptr_t)(Req->Data + Slot->Done);
+        Sqe->len    = Len;
+        Sqe->off    = Slot->Done;
+    } break;
+    case URING_STAGE_CLOSE:
+    {
+        Sqe->opcode = IORING_OP_CLOSE;
+        Sqe->fd     = Slot->Fd;
+    } break;
+    case URING_STAGE_NOP:
+    {
+        Sqe->opcode = IORING_OP_NOP;
+    } break;
+    }
+    Sqe->user_data = (uintptr_t)Slot;
+    Ring->SqArray[Idx] = Idx;
+    __atomic_store_n(Ring->SqTail, Tail+1, __ATOMIC_RELEASE);
+    Ring->nUnsubmitted++;
+}
+
+//! Pass all queued operations to the kernel
+static void Uring_Flush(struct AsyncIO_Uring_t *Ring)
+{
+    while(Ring->nUnsubmitted)
+    {
+        long n = syscall(__NR_io_uring_enter, Ring->RingFd, Ring->nUnsubmitted, 0, 0, NULL, 0);
+        if(n < 0)
+        {
+            if(errno == EINTR || errno == EAGAIN) continue;
+            break;
+        }
+        Ring->nUnsubmitted -= n;
+    }
+}
+
+//! Start a request on a free slot
+static void Uring_Start(struct AsyncIO_Uring_t *Ring, struct AsyncIO_Request_t *Req)
+{
+    struct AsyncIO_UringSlot_t *Slot = Ring->FreeSlots;
+    Ring->FreeSlots = Slot->NextFree;
+    Slot->Req   = Req;
+    Slot->Stage = (Req->Op == ASYNCIO_OP_NOP) ? URING_STAGE_NOP : URING_STAGE_OPEN;
+    Slot->Fd    = -1;
+    Slot->Done  = 0;
+    Req->Result = 0;
+    if(Req->Op == ASYNCIO_OP_READ) Req->Data = NULL;
+    Uring_Queue(Ring, Slot);
+}
+
+//! Move a slot on to its next stage, given the result of the last one
+//! Returns 1 when the request is finished.
+static int Uring_Advance(struct AsyncIO_Uring_t *Ring, struct AsyncIO_UringSlot_t *Slot, int Res)
+{
+    struct AsyncIO_Request_t *Req = Slot->Req;
+    switch(Slot->Stage)
+    {
+    case URING_STAGE_OPEN:
+    {
+        if(Res < 0)
+        {
+            Req->Result = Res;
+            return 1;
+        }
+        Slot->Fd    = Res;
+        Slot->Stage = (Req->Op == ASYNCIO_OP_READ) ? URING_STAGE_STAT : URING_STAGE_XFER;
+    } break;
+    case URING_STAGE_STAT:
+    {
+        Slot->Stage = URING_STAGE_XFER;
+        if(Res < 0) Req->Result = Res;
+        else
+        {
+            Req->Size = Slot->Stx.stx_size;
+            Req->Data = malloc(Req->Size ? Req->Size : 1);
+            if(!Req->Data) Req->Result = -ENOMEM;
+        }
+    } break;
+    case URING_STAGE_XFER:
+    {
+        //! NOTE: See AsyncIO_DoBlocking() for short reads
+        if(Res < 0)
+        {
+            if(Res != -EINTR && Res != -EAGAIN) Req->Result = Res;
+        }
+        else if(Res == 0)
+        {
+            if(Req->Op == ASYNCIO_OP_READ) Req->Size = Slot->Done;
+            else Req->Result = -EIO;
+        }
+        else Slot->Done += Res;
+    } break;
+    case URING_STAGE_CLOSE:
+    {
+        if(Res < 0 && Req->Result == 0) Req->Result = Res;
+        return 1;
+    }
+    case URING_STAGE_NOP:
+        return 1;
+    }
+
+    //! Close once done or failed
+    if(Slot->Stage == URING_STAGE_XFER && (Req->Result < 0 || Slot->Done >= Req->Size))
+    {
+        Slot->Stage = URING_STAGE_CLOSE;
+    }
+    Uring_Queue(Ring, Slot);
+    return 0;
+}
+
+/**************************************/
+
+static void Uring_Destroy(struct AsyncIO_Uring_t *Ring)
+{
+    if(Ring->Sqes) munmap(Ring->Sqes, Ring->SqesSize);
+    if(Ring->CqRing && Ring->CqRing != Ring->SqRing) munmap(Ring->CqRing, Ring->CqRingSize);
+    if(Ring->SqRing) munmap(Ring->SqRing, Ring->SqRingSize);
+    close(Ring->RingFd);
+    free(Ring->Slots);
+    free(Ring);
+}
+
+static struct AsyncIO_Uring_t *Uring_Init(int Depth)
+{
+    int n;
+    struct io_uring_params Params;
+    memset(&Params, 0, sizeof(Params));
+    struct AsyncIO_Uring_t *Ring = calloc(1, sizeof(struct AsyncIO_Uring_t));
+    if(!Ring) return NULL;
+    Ring->RingFd = syscall(__NR_io_uring_setup, Depth, &Params);
+    if(Ring->RingFd < 0)
+    {
+        free(Ring);
+        return NULL;
+    }
+
+    //! Check that every operation that we use is supported
+    //! (openat/statx/read/write/close appeared in Linux 5.6)
+    {
+        static const uint8_t Ops[] =
+        {
+            IORING_OP_NOP, IORING_OP_OPENAT, IORING_OP_STATX,
+            IORING_OP_READ, IORING_OP_WRITE, IORING_OP_CLOSE,
+        };
+        int Ok = 0;
+        struct io_uring_probe *Probe = calloc(1, sizeof(struct io_uring_probe) + 256*sizeof(struct io_uring_probe_op));
+        if(Probe && syscall(__NR_io_uring_register, Ring->RingFd, IORING_REGISTER_PROBE, Probe, 256) >= 0)
+        {
+            for(Ok=1, n=0; n<(int)sizeof(Ops); n++)
+            {
+                if(Ops[n] >= Probe->ops_len || !(Probe->ops[Ops[n]].flags & IO_URING_OP_SUPPORTED)) Ok = 0;
+            }
+        }
+        free(Probe);
+        if(!Ok) goto Fail;
+    }
+
+    //! Map the rings
+    Ring->SqRingSize = Params.sq_off.array + Params.sq_entries*sizeof(unsigned);
+    Ring->CqRingSize = Params.cq_off.cqes  + Params.cq_entries*sizeof(struct io_uring_cqe);
+    Ring->SqesSize   = Params.sq_entries*sizeof(struct io_uring_sqe);
+    if(Params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if(Ring->CqRingSize > Ring->SqRingSize) Ring->SqRingSize = Ring->CqRingSize;
+        Ring->CqRingSize = Ring->SqRingSize;
+    }
+    Ring->SqRing = mmap(NULL, Ring->SqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, Ring->RingFd, IORING_OFF_SQ_RING);
+    if(Ring->SqRing == MAP_FAILED)
+    {
+        Ring->SqRing = NULL;
+        goto Fail;
+    }
+    if(Params.features & IORING_FEAT_SINGLE_MMAP) Ring->CqRing = Ring->SqRing;
+    else
+    {
+        Ring->CqRing = mmap(NULL, Ring->CqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, Ring->RingFd, IORING_OFF_CQ_RING);
+        if(Ring->CqRing == MAP_FAILED)
+        {
+            Ring->CqRing = NULL;
+            goto Fail;
+        }
+    }
+    Ring->Sqes = mmap(NULL, Ring->SqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, Ring->RingFd, IORING_OFF_SQES);
+    if(Ring->Sqes == MAP_FAILED)
+    {
+        Ring->Sqes = NULL;
+        goto Fail;
+    }
+    Ring->SqTail  = (unsigned*)((uint8_t*)Ring->SqRing + Params.sq_off.tail);
+    Ring->SqMask  = (unsigned*)((uint8_t*)Ring->SqRing + Params.sq_off.ring_mask);
+    Ring->SqArray = (unsigned*)((uint8_t*)Ring->SqRing + Params.sq_off.array);
+    Ring->CqHead  = (unsigned*)((uint8_t*)Ring->CqRing + Params.cq_off.head);
+    Ring->CqTail  = (unsigned*)((uint8_t*)Ring->CqRing + Params.cq_off.tail);
+    Ring->CqMask  = (unsigned*)((uint8_t*)Ring->CqRing + Params.cq_off.ring_mask);
+    Ring->Cqes    = (struct io_uring_cqe*)((uint8_t*)Ring->CqRing + Params.cq_off.cqes);
+
+    //! Create the slots
+    //! NOTE: The kernel may round the ring size up, but never down.
+    Ring->Slots = malloc(sizeof(struct AsyncIO_UringSlot_t) * Depth);
+    if(!Ring->Slots) goto Fail;
+    for(n=0; n<Depth; n++)
+    {
+        Ring->Slots[n].NextFree = (n+1 < Depth) ? &Ring->Slots[n+1] : NULL;
+    }
+    Ring->FreeSlots = Ring->Slots;
+    return Ring;
+
+Fail:
+    Uring_Destroy(Ring);
+    return NULL;
+}
+
+/**************************************/
+
+static void Uring_Submit(struct AsyncIO_t *IO, struct AsyncIO_Request_t *Req)
+{
+    struct AsyncIO_Uring_t *Ring = IO->Uring;
+    if(Ring->FreeSlots)
+    {
+        Uring_Start(Ring, Req);
+        Uring_Flush(Ring);
+    }
+    else AsyncIO_Push(&IO->PendingHead, &IO->PendingTail, Req);
+}
+
+//! Reap completions, moving requests through their stages
+//! Only called from AsyncIO_Wait(), with IO->Lock held.
+static void Uring_Reap(struct AsyncIO_t *IO)
+{
+    struct AsyncIO_Uring_t *Ring = IO->Uring;
+    unsigned Head = *Ring->CqHead;
+    unsigned Tail = __atomic_load_n(Ring->CqTail, __ATOMIC_ACQUIRE);
+    for(; Head != Tail; Head++)
+    {
+        const struct io_uring_cqe *Cqe = &Ring->Cqes[Head & *Ring->CqMask];
+        struct AsyncIO_UringSlot_t *Slot = (struct AsyncIO_UringSlot_t*)(uintptr_t)Cqe->user_data;
+        if(Uring_Advance(Ring, Slot, Cqe->res))
+        {
+            AsyncIO_Complete(IO, Slot->Req);
+            Slot->NextFree  = Ring->FreeSlots;
+            Ring->FreeSlots = Slot;
+            struct AsyncIO_Request_t *Next = AsyncIO_Pop(&IO->PendingHead, &IO->PendingTail);
+            if(Next) Uring_Start(Ring, Next);
+        }
+    }
+    __atomic_store_n(Ring->CqHead, Head, __ATOMIC_RELEASE);
+    Uring_Flush(Ring);
+}
+
+/**************************************/
+#else
+/**************************************/
+
+struct AsyncIO_Uring_t { int Unused; };
+static struct AsyncIO_Uring_t *Uring_Init(int Depth) { (void)Depth; return NULL; }
+static void Uring_Destroy(struct AsyncIO_Uring_t *Ring) { (void)Ring; }
+static void Uring_Submit(struct AsyncIO_t *IO, struct AsyncIO_Request_t *Req) { (void)IO, (void)Req; }
+static void Uring_Reap(struct AsyncIO_t *IO) { (void)IO; }
+
+/**************************************/
+#endif
+/**************************************/
+
+int AsyncIO_Init(struct AsyncIO_t *IO, int Backend, int Depth)
+{
+    if(Depth < 1) return -1;
+    IO->Backend     = Backend;
+    IO->Quit        = 0;
+    IO->PendingHead = IO->PendingTail = NULL;
+    IO->DoneHead    = IO->DoneTail    = NULL;
+    IO->nThreads    = 0;
+    IO->Threads     = NULL;
+    IO->Uring       = NULL;
+    pthread_mutex_init(&IO->Lock, NULL);
+    pthread_cond_init(&IO->PendingCond, NULL);
+    pthread_cond_init(&IO->DoneCond, NULL);
+
+    //! Set up io_uring, falling back to threads
+    if(Backend == ASYNCIO_BACKEND_URING)
+    {
+        IO->Uring = Uring_Init(Depth);
+        if(!IO->Uring) IO->Backend = ASYNCIO_BACKEND_THREADS;
+    }
+
+    //! Start the I/O threads
+    if(IO->Backend == ASYNCIO_BACKEND_THREADS)
+    {
+        int n, nThreads = (Depth < ASYNCIO_MAX_THREADS) ? Depth : ASYNCIO_MAX_THREADS;
+        IO->Threads = malloc(sizeof(pthread_t) * nThreads);
+        if(!IO->Threads)
+        {
+            AsyncIO_Destroy(IO);
+            return -1;
+        }
+        for(n=0; n<nThreads; n++)
+        {
+            if(pthread_create(&IO->Threads[n], NULL, AsyncIO_Thread, IO) != 0) break;
+        }
+        IO->nThreads = n;
+        if(n == 0)
+        {
+            AsyncIO_Destroy(IO);
+            return -1;
+        }
+    }
+    return IO->Backend;
+}
+
+void AsyncIO_Destroy(struct AsyncIO_t *IO)
+{
+    int n;
+    pthread_mutex_lock(&IO->Lock);
+    IO->Quit = 1;
+    pthread_cond_broadcast(&IO->PendingCond);
+    pthread_mutex_unlock(&IO->Lock);
+    for(n=0; n<IO->nThreads; n++) pthread_join(IO->Threads[n], NULL);
+    free(IO->Threads);
+    if(IO->Uring) Uring_Destroy(IO->Uring);
+    pthread_cond_destroy(&IO->DoneCond);
+    pthread_cond_destroy(&IO->PendingCond);
+    pthread_mutex_destroy(&IO->Lock);
+}
+
+/**************************************/
+
+void AsyncIO_Submit(struct AsyncIO_t *IO, struct AsyncIO_Request_t *Req)
+{
+    if(IO->Backend == ASYNCIO_BACKEND_SYNC) AsyncIO_DoBlocking(Req);
+    pthread_mutex_lock(&IO->Lock);
+    switch(IO->Backend)
+    {
+    case ASYNCIO_BACKEND_URING:
+        Uring_Submit(IO, Req);
+        break;
+    case ASYNCIO_BACKEND_THREADS:
+        AsyncIO_Push(&IO->PendingHead, &IO->PendingTail, Req);
+        pthread_cond_signal(&IO->PendingCond);
+        break;
+    case ASYNCIO_BACKEND_SYNC:
+        AsyncIO_Complete(IO, Req);
+        break;
+    }
+    pthread_mutex_unlock(&IO->Lock);
+}
+
+struct AsyncIO_Request_t *AsyncIO_Wait(struct AsyncIO_t *IO)
+{
+    struct AsyncIO_Request_t *Req;
+    pthread_mutex_lock(&IO->Lock);
+    for(;;)
+    {
+        if(IO->Backend == ASYNCIO_BACKEND_URING) Uring_Reap(IO);
+        Req = AsyncIO_Pop(&IO->DoneHead, &IO->DoneTail);
+        if(Req) break;
+
+        //! Sleep until something completes
+        //! NOTE: io_uring completions arrive on the ring rather than
+        //! through DoneCond, so the kernel does the waiting there.
+        if(IO->Backend == ASYNCIO_BACKEND_URING)
+        {
+#if defined(__linux__) && defined(__NR_io_uring_setup)
+            pthread_mutex_unlock(&IO->Lock);
+            syscall(__NR_io_uring_enter, IO->Uring->RingFd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+            pthread_mutex_lock(&IO->Lock);
+#endif
+        }
+        else pthread_cond_wait(&IO->DoneCond, &IO->Lock);
+    }
+    pthread_mutex_unlock(&IO->Lock);
+    return Req;
+}
+
+/**************************************/
+
+const char *AsyncIO_BackendName(int Backend)
+{
+    switch(Backend)
+    {
+    case ASYNCIO_BACKEND_URING:   return "io_uring";
+    case ASYNCIO_BACKEND_THREADS: return "threads";
+    case ASYNCIO_BACKEND_SYNC:    return "sync";
+    }
+    return NULL;
+}
+
+/**************************************/
+//! EOF
+/**************************************/
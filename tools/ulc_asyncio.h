@@ -0,0 +1,104 @@
+/**************************************/
+#pragma once
+/**************************************/
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+/**************************************/
+
+//! Asynchronous whole-file I/O
+//! Batch tools spend most of their time on small files waiting for
+//! the storage: every file costs a directory lookup, an inode read
+//! and a data read, each of which stalls a blocking reader on a cold
+//! cache. This layer keeps many such requests in flight, so that the
+//! device queue stays full while the codec works on files that have
+//! already arrived.
+//! Requests are handed over with AsyncIO_Submit() (from any thread),
+//! and come back from AsyncIO_Wait() (from a single thread) once they
+//! are done, in the order that they complete.
+//! Backends:
+//!  ASYNCIO_BACKEND_URING:   Linux io_uring. Each request runs as a
+//!                           chain of open/statx/read|write/close
+//!                           operations, with no thread per request.
+//!  ASYNCIO_BACKEND_THREADS: A pool of threads doing blocking I/O.
+//!                           Used when io_uring is unavailable (older
+//!                           kernels, or disabled by a sandbox).
+//!  ASYNCIO_BACKEND_SYNC:    Blocking I/O in the submitting thread
+//!                           (ie. no overlap; for comparison).
+#define ASYNCIO_BACKEND_URING   0
+#define ASYNCIO_BACKEND_THREADS 1
+#define ASYNCIO_BACKEND_SYNC    2
+
+/**************************************/
+
+//! Request
+//! Operations:
+//!  ASYNCIO_OP_READ:  Read the whole of Path into Data (allocated by
+//!                    this layer with malloc(); caller frees), and
+//!                    store its size to Size.
+//!  ASYNCIO_OP_WRITE: Create (or truncate) Path, and write Size bytes
+//!                    of Data to it.
+//!  ASYNCIO_OP_NOP:   Do nothing; this passes a request back through
+//!                    AsyncIO_Wait() (eg. after a failed job).
+//! On completion, Result is 0 on success, or a negative errno value.
+#define ASYNCIO_OP_READ  0
+#define ASYNCIO_OP_WRITE 1
+#define ASYNCIO_OP_NOP   2
+struct AsyncIO_Request_t
+{
+    int         Op;
+    int         Result;
+    const char *Path;
+    uint8_t    *Data;
+    size_t      Size;
+    void       *User;
+    struct AsyncIO_Request_t *Next; //! Internal queueing
+};
+
+//! Internal state
+struct AsyncIO_Uring_t;
+struct AsyncIO_t
+{
+    int Backend;
+    int Quit;
+    pthread_mutex_t Lock;
+    pthread_cond_t  PendingCond; //! Signalled when Pending gains a request
+    pthread_cond_t  DoneCond;    //! Signalled when Done gains a request
+    struct AsyncIO_Request_t *PendingHead, *PendingTail; //! Waiting for a thread or ring slot
+    struct AsyncIO_Request_t *DoneHead,    *DoneTail;    //! Completed
+    int        nThreads;
+    pthread_t *Threads;
+    struct AsyncIO_Uring_t *Uring;
+};
+
+/**************************************/
+
+//! Create the I/O state
+//! Depth is the number of requests that may be in flight at once;
+//! further requests queue up until one completes.
+//! When io_uring is requested but unavailable, this falls back to
+//! ASYNCIO_BACKEND_THREADS.
+//! Returns the backend used, or -1 on failure.
+int AsyncIO_Init(struct AsyncIO_t *IO, int Backend, int Depth);
+
+//! Destroy the I/O state
+//! NOTE: All requests must have completed.
+void AsyncIO_Destroy(struct AsyncIO_t *IO);
+
+//! Submit a request
+//! This may be called from any thread. The request must stay valid
+//! until it is returned by AsyncIO_Wait().
+void AsyncIO_Submit(struct AsyncIO_t *IO, struct AsyncIO_Request_t *Req);
+
+//! Wait for a request to complete
+//! Only one thread may wait at a time, and only while at least one
+//! request is in flight (or about to be submitted by another thread),
+//! as this blocks until then.
+struct AsyncIO_Request_t *AsyncIO_Wait(struct AsyncIO_t *IO);
+
+//! Get the name of a backend
+const char *AsyncIO_BackendName(int Backend);
+
+/**************************************/
+//! EOF
+/**************************************/
@@ -0,0 +1,185 @@
+/**************************************/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+/**************************************/
+#include "ulc_cache.h"
+#include "ulcencoder.h"
+/**************************************/
+
+//! Build tag
+//! Non-deterministic builds can round differently on each CPU
+//! target, so their results are kept apart. Deterministic builds
+//! match on every target with 128-bit vectors (SSE, AVX and NEON),
+//! but the scalar transforms round differently.
+#if ULC_DETERMINISTIC && (defined(__SSE__) || defined(__ARM_NEON))
+# define ENCODECACHE_TARGET "deterministic"
+#elif ULC_DETERMINISTIC
+# define ENCODECACHE_TARGET "deterministic-scalar"
+#elif defined(__AVX__) && defined(__FMA__)
+# define ENCODECACHE_TARGET "avx+fma"
+#elif defined(__AVX__)
+# define ENCODECACHE_TARGET "avx"
+#elif defined(__SSE__)
+# define ENCODECACHE_TARGET "sse"
+#elif defined(__ARM_NEON)
+# define ENCODECACHE_TARGET "neon"
+#else
+# define ENCODECACHE_TARGET "scalar"
+#endif
+
+/**************************************/
+
+//! 64-bit FNV-1a hash
+#define FNV1A_OFFSET 0xCBF29CE484222325ull
+#define FNV1A_PRIME  0x00000100000001B3ull
+static uint64_t EncodeCache_Hash(uint64_t h, const void *Data, size_t Size)
+{
+    const uint8_t *Src = (const uint8_t*)Data;
+    while(Size--) h = (h ^ *Src++) * FNV1A_PRIME;
+    return h;
+}
+
+//! Copy a file, returning 1 on success or -1 on failure
+static int EncodeCache_CopyFile(const char *DstFile, const char *SrcFile)
+{
+    int Result = 1;
+    FILE *Src = fopen(SrcFile, "rb");
+    if(!Src) return -1;
+    FILE *Dst = fopen(DstFile, "wb");
+    if(!Dst)
+    {
+        fclose(Src);
+        return -1;
+    }
+    size_t Size;
+    uint8_t Buf[64*1024];
+    while((Size = fread(Buf, 1, sizeof(Buf), Src)) != 0)
+    {
+        if(fwrite(Buf, 1, Size, Dst) != Size) { Result = -1; break; }
+    }
+    if(ferror(Src)) Result = -1;
+    if(fclose(Dst) != 0) Result = -1;
+    fclose(Src);
+    return Result;
+}
+
+/**************************************/
+
+//! Hash the build tag and parameters (these come before the input data)
+static uint64_t EncodeCache_HashParams(const char *Params)
+{
+    char Tag[64];
+    snprintf(Tag, sizeof(Tag), "ulc-cache %d %s", ENCODECACHE_VERSION, ENCODECACHE_TARGET);
+    uint64_t h = FNV1A_OFFSET;
+    h = EncodeCache_Hash(h, Tag,    strlen(Tag)+1);
+    h = EncodeCache_Hash(h, Params, strlen(Params)+1);
+    return h;
+}
+
+//! Set the key and form the path of the cache entry
+static int EncodeCache_SetKey(struct EncodeCache_t *Cache, const char *Dir, uint64_t Key)
+{
+    Cache->Key = Key;
+    int Len = snprintf(Cache->Path, sizeof(Cache->Path), "%s/%016llx.ulc", Dir, (unsigned long long)Key);
+    return (Len > 0 && (size_t)Len < sizeof(Cache->Path)) ? 1 : -1;
+}
+
+//! Form a temporary path to write an entry to before renaming it
+//! The path includes a counter as well as the process ID, as the
+//! threads of a process may store the same entry at once.
+static void EncodeCache_GetTmpPath(char *TmpPath, size_t Size, const struct EncodeCache_t *Cache)
+{
+    static unsigned int Counter = 0;
+    unsigned int Idx = __atomic_fetch_add(&Counter, 1, __ATOMIC_RELAXED);
+    snprintf(TmpPath, Size, "%s.%ld.%u.tmp", Cache->Path, (long)getpid(), Idx);
+}
+
+/**************************************/
+
+int EncodeCache_Init(struct EncodeCache_t *Cache, const char *Dir, const char *InputFile, const char *Params)
+{
+    uint64_t h = EncodeCache_HashParams(Params);
+    {
+        size_t Size;
+        uint8_t Buf[64*1024];
+        FILE *File = fopen(InputFile, "rb");
+        if(!File) return -1;
+        while((Size = fread(Buf, 1, sizeof(Buf), File)) != 0) h = EncodeCache_Hash(h, Buf, Size);
+        int Error = ferror(File);
+        fclose(File);
+        if(Error) return -1;
+    }
+    return EncodeCache_SetKey(Cache, Dir, h);
+}
+
+int EncodeCache_InitFromMemory(struct EncodeCache_t *Cache, const char *Dir, const void *Input, size_t InputSize, const char *Params)
+{
+    uint64_t h = EncodeCache_HashParams(Params);
+    h = EncodeCache_Hash(h, Input, InputSize);
+    return EncodeCache_SetKey(Cache, Dir, h);
+}
+
+/**************************************/
+
+int EncodeCache_Fetch(const struct EncodeCache_t *Cache, const char *OutputFile)
+{
+    if(access(Cache->Path, R_OK) != 0) return 0;
+    return EncodeCache_CopyFile(OutputFile, Cache->Path);
+}
+
+int EncodeCache_FetchToMemory(const struct EncodeCache_t *Cache, uint8_t **Data, size_t *Size)
+{
+    FILE *File = fopen(Cache->Path, "rb");
+    if(!File) return (access(Cache->Path, F_OK) != 0) ? 0 : -1;
+    fseek(File, 0, SEEK_END);
+    long FileSize = ftell(File);
+    fseek(File, 0, SEEK_SET);
+    uint8_t *Buf = (FileSize > 0) ? malloc(FileSize) : NULL;
+    if(!Buf || fread(Buf, 1, FileSize, File) != (size_t)FileSize)
+    {
+        free(Buf);
+        fclose(File);
+        return -1;
+    }
+    fclose(File);
+    *Data = Buf;
+    *Size = FileSize;
+    return 1;
+}
+
+/**************************************/
+
+int EncodeCache_Store(const struct EncodeCache_t *Cache, const char *OutputFile)
+{
+    char TmpPath[sizeof(Cache->Path) + 48];
+    EncodeCache_GetTmpPath(TmpPath, sizeof(TmpPath), Cache);
+    if(EncodeCache_CopyFile(TmpPath, OutputFile) < 0 || rename(TmpPath, Cache->Path) != 0)
+    {
+        remove(TmpPath);
+        return -1;
+    }
+    return 1;
+}
+
+int EncodeCache_StoreFromMemory(const struct EncodeCache_t *Cache, const void *Data, size_t Size)
+{
+    char TmpPath[sizeof(Cache->Path) + 48];
+    EncodeCache_GetTmpPath(TmpPath, sizeof(TmpPath), Cache);
+    FILE *File = fopen(TmpPath, "wb");
+    if(!File) return -1;
+    int Ok = (fwrite(Data, 1, Size, File) == Size);
+    if(fclose(File) != 0) Ok = 0;
+    if(!Ok || rename(TmpPath, Cache->Path) != 0)
+    {
+        remove(TmpPath);
+        return -1;
+    }
+    return 1;
+}
+
+/**************************************/
+//! EOF
+/**************************************/
@@ -0,0 +1,72 @@
+/**************************************/
+#pragma once
+/**************************************/
+#include <stddef.h>
+#include <stdint.h>
+/**************************************/
+
+//! Encoding result cache
+//! Encoded streams are stored in a cache directory, named after a
+//! 64-bit key formed from the input file's contents, the encoding
+//! parameters, and a tag identifying the build. Matching inputs can
+//! then skip encoding altogether by copying the cached stream.
+//! Keys only include the CPU target for non-deterministic builds;
+//! with ULC_DETERMINISTIC, every vector target produces the same
+//! streams, so a cache directory can be shared between machines.
+//! NOTE: ENCODECACHE_VERSION must be bumped whenever a change to the
+//! encoder (or to the file format) changes its output.
+#define ENCODECACHE_VERSION 7
+
+//! Encoding parameters (Params argument of EncodeCache_Init())
+//! Every tool that encodes must describe its options with this
+//! format (passing the defaults for options it doesn't have), so
+//! that the same encode gives the same key in every tool:
+//!  RateKbps, AvgComplexity (as double), BlockSize, InternalRateHz,
+//!  ReservoirBytes, Lookahead, EntropyCoding, StereoSwitching,
+//!  ParametricStereo, NoiseCoupling, LongTermPrediction, ChanGroupSize, Looping (int), LoopStart,
+//!  LoopEnd (unsigned int)
+#define ENCODECACHE_PARAMS_FORMAT "%a,%a blocksize=%d internalrate=%d reservoir=%d lookahead=%d entropy=%d lrstereo=%d pstereo=%d ncouple=%d ltp=%d chgroup=%d loop=%d:%u,%u"
+#define ENCODECACHE_PARAMS_SIZE   256
+
+struct EncodeCache_t
+{
+    uint64_t Key;
+    char Path[4096]; //! <Dir>/<Key>.ulc
+};
+
+//! Compute the cache key and path for an input file
+//! Params should describe every option that affects the encoded
+//! stream (eg. "RateKbps,AvgComplexity BlockSize ...").
+//! Returns 1 on success, or -1 if the input can't be read (or the
+//! path is too long).
+int EncodeCache_Init(struct EncodeCache_t *Cache, const char *Dir, const char *InputFile, const char *Params);
+
+//! Compute the cache key and path for an input file held in memory
+//! This gives the same key as EncodeCache_Init() on the same data.
+//! Returns 1 on success, or -1 if the path is too long.
+int EncodeCache_InitFromMemory(struct EncodeCache_t *Cache, const char *Dir, const void *Input, size_t InputSize, const char *Params);
+
+//! Copy the cached stream to OutputFile
+//! Returns 1 on a cache hit, 0 on a miss, or -1 on failure.
+int EncodeCache_Fetch(const struct EncodeCache_t *Cache, const char *OutputFile);
+
+//! Read the cached stream into memory
+//! On a hit, *Data receives a malloc()ed copy of the stream, which
+//! the caller must free().
+//! Returns 1 on a cache hit, 0 on a miss, or -1 on failure.
+int EncodeCache_FetchToMemory(const struct EncodeCache_t *Cache, uint8_t **Data, size_t *Size);
+
+//! Store OutputFile into the cache
+//! The file is copied to a temporary name first and then renamed,
+//! so that concurrent encoders sharing a cache never see partially
+//! written entries.
+//! Returns 1 on success, or -1 on failure.
+int EncodeCache_Store(const struct EncodeCache_t *Cache, const char *OutputFile);
+
+//! Store a stream held in memory into the cache (as EncodeCache_Store())
+//! Returns 1 on success, or -1 on failure.
+int EncodeCache_StoreFromMemory(const struct EncodeCache_t *Cache, const void *Data, size_t Size);
+
+/**************************************/
+//! EOF
+/**************************************/
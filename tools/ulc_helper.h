@@ -1,13 +1,22 @@
 /**************************************/
 #pragma once
 /**************************************/
+#include <math.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+/**************************************/
+#include "ulcentropy.h"
 /**************************************/
 #define BUFFER_ALIGNMENT 64u //! __mm512
 /**************************************/
 
 //! File header
-#define HEADER_MAGIC (uint32_t)('U' | 'L'<<8 | 'C'<<16 | '2'<<24)
+//! HEADER_MAGIC_ENTROPY marks streams whose blocks are entropy coded
+//! (see ulcentropy.h). In this case, the data stream starts with the
+//! serialized entropy model, followed by the coded blocks.
+#define HEADER_MAGIC         (uint32_t)('U' | 'L'<<8 | 'C'<<16 | '2'<<24)
+#define HEADER_MAGIC_ENTROPY (uint32_t)('U' | 'L'<<8 | 'C'<<16 | '3'<<24)
 struct FileHeader_t
 {
     uint32_t Magic;        //! [00h] Magic value/signature
@@ -18,6 +27,100 @@ struct FileHeader_t
     uint16_t nChan;        //! [10h] Channels in stream
     uint16_t RateKbps;     //! [12h] Nominal coding rate
     uint32_t StreamOffs;   //! [14h] Offset of data stream
+
+    //! Extended header
+    //! These fields are only present when StreamOffs is large
+    //! enough to contain them; otherwise, they are read as 0.
+    uint32_t SourceRateHz;    //! [18h] Rate before internal resampling (0 = Same as RateHz)
+    uint32_t MaxRawBlockSize; //! [1Ch] Largest block size before entropy coding (in bytes; HEADER_MAGIC_ENTROPY only)
+    uint32_t StreamBufferSize; //! [20h] CBR bit reservoir size (in bytes; 0 = None). No block is larger than this
+    uint32_t LoopBlock;        //! [24h] Block to continue from after the last block (0 = No loop)
+    uint32_t LoopOffs;         //! [28h] File offset of LoopBlock
+    int32_t  PlaybackGain;     //! [2Ch] Gain to apply on playback (in 0.01dB; 0 = None). See ulcgaintool
+    uint32_t Profile;          //! [30h] Coding tools that the decoder must enable (HEADER_PROFILE_*)
+};
+#define HEADER_BASE_SIZE 0x18
+
+//! Profile flags
+//! A decoder must refuse streams with flags that it does not know.
+#define HEADER_PROFILE_LTP            0x1 //! Long-term prediction (see ULC_DecodeBlock_Predict())
+#define HEADER_PROFILE_STEREO         0x2 //! L/R and parametric channel pairs (Eh,Dh prefixes)
+#define HEADER_PROFILE_NOISE_COUPLING 0x4 //! Coupled noise fill in channel pairs (Fh,Eh,Eh,Xh stop codes)
+#define HEADER_PROFILE_ALL (HEADER_PROFILE_LTP | HEADER_PROFILE_STEREO | HEADER_PROFILE_NOISE_COUPLING)
+
+//! Read file header (including any extended fields)
+//! Returns 1 on success, or -1 on failure (including streams that
+//! need a coding tool that we don't support).
+static inline int FileHeader_Read(struct FileHeader_t *Header, FILE *File)
+{
+    memset(Header, 0, sizeof(*Header));
+    if(fread(Header, HEADER_BASE_SIZE, 1, File) != 1) return -1;
+    if(Header->Magic != HEADER_MAGIC && Header->Magic != HEADER_MAGIC_ENTROPY) return -1;
+    if(Header->StreamOffs > HEADER_BASE_SIZE)
+    {
+        size_t ExtSize = Header->StreamOffs - HEADER_BASE_SIZE;
+        if(ExtSize > sizeof(*Header) - HEADER_BASE_SIZE) ExtSize = sizeof(*Header) - HEADER_BASE_SIZE;
+        if(fread((char*)Header + HEADER_BASE_SIZE, ExtSize, 1, File) != 1) return -1;
+    }
+    if(Header->Profile &~ HEADER_PROFILE_ALL) return -1;
+    return 1;
+}
+
+//! Read the entropy model of a HEADER_MAGIC_ENTROPY stream
+//! On success, the file is left at the first block, and the
+//! size of the serialized model is returned.
+//! On failure, returns -1.
+static inline int FileHeader_ReadEntropyModel(const struct FileHeader_t *Header, struct ULC_EntropyModel_t *Model, FILE *File)
+{
+    uint8_t Buf[ULC_ENTROPY_MODEL_MAX_SIZE];
+    fseek(File, Header->StreamOffs, SEEK_SET);
+    int Size = fread(Buf, 1, sizeof(Buf), File);
+    Size = ULC_EntropyModel_Read(Model, Buf, Size);
+    if(Size < 0 || Header->MaxRawBlockSize == 0) return -1;
+    fseek(File, Header->StreamOffs + Size, SEEK_SET);
+    return Size;
+}
+
+//! Get the playback gain of a stream (as a linear factor)
+static inline float FileHeader_PlaybackGain(const struct FileHeader_t *Header)
+{
+    return (Header->PlaybackGain != 0) ? powf(10.0f, Header->PlaybackGain * (1.0f/2000)) : 1.0f;
+}
+
+/**************************************/
+
+//! Multi-stream container header
+//! This holds several plain (HEADER_MAGIC) streams of the same rate,
+//! cut into time slices of SliceSize samples (the largest BlockSize),
+//! so that a player can fetch all the streams of a slice with a single
+//! read. The header is followed by a MultiStreamInfo_t for each stream,
+//! and then the slices. Each slice is laid out as:
+//!  uint32_t StreamSize[nStreams]; //! Size of each stream's data (in bytes)
+//!  uint8_t  StreamData[];         //! SliceSize/BlockSize blocks of each stream, in stream order
+//!  uint32_t NextSliceSize;        //! Size of the next slice (0 = Last slice)
+//! Streams with a smaller BlockSize are delayed (by repeating their
+//! silent first block) so that all streams have the same codec delay
+//! of 2*SliceSize, and padded with silent blocks at the end.
+#define MULTI_HEADER_MAGIC  (uint32_t)('U' | 'L'<<8 | 'C'<<16 | 'M'<<24)
+#define MULTI_MAX_STREAMS   32
+struct MultiHeader_t
+{
+    uint32_t Magic;          //! [00h] Magic value/signature
+    uint16_t nStreams;       //! [04h] Number of streams
+    uint16_t Reserved;       //! [06h] Reserved (0)
+    uint32_t RateHz;         //! [08h] Playback rate (of all streams)
+    uint32_t SliceSize;      //! [0Ch] Samples per slice
+    uint32_t nSlices;        //! [10h] Number of slices
+    uint32_t MaxSliceSize;   //! [14h] Largest slice size (in bytes)
+    uint32_t FirstSliceSize; //! [18h] Size of the first slice (in bytes)
+    uint32_t StreamOffs;     //! [1Ch] Offset of the first slice
+};
+struct MultiStreamInfo_t
+{
+    uint16_t BlockSize;    //! [00h] Transform block size
+    uint16_t nChan;        //! [02h] Channels in stream
+    uint16_t RateKbps;     //! [04h] Nominal coding rate
+    uint16_t MaxBlockSize; //! [06h] Largest block size (in bytes)
 };
 
 /**************************************/
@@ -0,0 +1,179 @@
+/**************************************/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+/**************************************/
+#include "ulc_multistream.h"
+/**************************************/
+
+static uint32_t MultiStream_ReadU32(const uint8_t *Src)
+{
+    return Src[0] | Src[1]<<8 | Src[2]<<16 | (uint32_t)Src[3]<<24;
+}
+
+/**************************************/
+
+int MultiStream_Open(struct MultiStream_Reader_t *Reader, const char *Filename, uint32_t ActiveMask)
+{
+    int n;
+    memset(Reader, 0, sizeof(*Reader));
+
+    //! Read and verify the header
+    struct MultiHeader_t *Header = &Reader->Header;
+    Reader->File = fopen(Filename, "rb");
+    if(!Reader->File) return -1;
+    if(fread(Header, sizeof(*Header), 1, Reader->File) != 1 ||
+       Header->Magic != MULTI_HEADER_MAGIC ||
+       Header->nStreams == 0 || Header->nStreams > MULTI_MAX_STREAMS ||
+       fread(Reader->Streams, sizeof(struct MultiStreamInfo_t), Header->nStreams, Reader->File) != Header->nStreams)
+    {
+        fclose(Reader->File);
+        return -1;
+    }
+
+    //! Allocate the slice buffer
+    //! NOTE: We pad the end of the buffer with zeros so that decoding
+    //! a corrupted slice cannot run off the end (see ulcreencodetool).
+    size_t Padding = 16;
+    for(n=0; n<Header->nStreams; n++)
+    {
+        const struct MultiStreamInfo_t *Info = &Reader->Streams[n];
+        if(!Info->BlockSize || Header->SliceSize % Info->BlockSize)
+        {
+            fclose(Reader->File);
+            return -1;
+        }
+        size_t p = (size_t)Info->nChan*Info->BlockSize + 16;
+        if(p > Padding) Padding = p;
+    }
+    Reader->SliceBuffer = calloc(Header->MaxSliceSize + Padding, 1);
+    if(!Reader->SliceBuffer)
+    {
+        fclose(Reader->File);
+        return -1;
+    }
+
+    //! Allocate the scratch area shared by all decoders
+    //! NOTE: Streams are decoded one after another, so only their
+    //! lapping buffers need to be kept apart.
+    int ScratchSize = 0;
+    for(n=0; n<Header->nStreams; n++)
+    {
+        struct ULC_DecoderState_t *Decoder = &Reader->Decoders[n];
+        Decoder->nChan     = Reader->Streams[n].nChan;
+        Decoder->BlockSize = Reader->Streams[n].BlockSize;
+        Decoder->LongTermPrediction = 0;
+        int Size = ULC_DecoderState_ScratchSize(Decoder);
+        if(Size < 0)
+        {
+            free(Reader->SliceBuffer);
+            fclose(Reader->File);
+            return -1;
+        }
+        if(Size > ScratchSize) ScratchSize = Size;
+    }
+    Reader->Scratch = malloc(ScratchSize);
+    if(!Reader->Scratch)
+    {
+        free(Reader->SliceBuffer);
+        fclose(Reader->File);
+        return -1;
+    }
+    fseek(Reader->File, Header->StreamOffs, SEEK_SET);
+    Reader->NextSliceSize = Header->FirstSliceSize;
+
+    //! Create decoders for the active streams
+    if(MultiStream_SetActive(Reader, ActiveMask) < 0)
+    {
+        MultiStream_Close(Reader);
+        return -1;
+    }
+    return 1;
+}
+
+void MultiStream_Close(struct MultiStream_Reader_t *Reader)
+{
+    MultiStream_SetActive(Reader, 0);
+    free(Reader->Scratch);
+    free(Reader->SliceBuffer);
+    fclose(Reader->File);
+}
+
+/**************************************/
+
+int MultiStream_SetActive(struct MultiStream_Reader_t *Reader, uint32_t ActiveMask)
+{
+    int n, Result = 1;
+    if(Reader->Header.nStreams < 32) ActiveMask &= (1u << Reader->Header.nStreams) - 1;
+    for(n=0; n<Reader->Header.nStreams; n++)
+    {
+        uint32_t Bit = 1u << n;
+        struct ULC_DecoderState_t *Decoder = &Reader->Decoders[n];
+        if((ActiveMask & Bit) && !(Reader->ActiveMask & Bit))
+        {
+            Decoder->nChan        = Reader->Streams[n].nChan;
+            Decoder->BlockSize    = Reader->Streams[n].BlockSize;
+            Decoder->RateHz       = Reader->Header.RateHz;
+            Decoder->OutputRateHz = 0;
+            Decoder->OutputFormat = ULC_DECODER_OUTPUT_FLOAT32;
+            Decoder->Flags        = 0;
+            Decoder->LongTermPrediction = 0;
+            Decoder->ScratchBuffer      = Reader->Scratch;
+            if(ULC_DecoderState_Init(Decoder) > 0) Reader->ActiveMask |= Bit;
+            else Result = -1;
+        }
+        else if(!(ActiveMask & Bit) && (Reader->ActiveMask & Bit))
+        {
+            ULC_DecoderState_Destroy(Decoder);
+            Reader->ActiveMask &= ~Bit;
+        }
+    }
+    return Result;
+}
+
+/**************************************/
+
+int MultiStream_DecodeSlice(struct MultiStream_Reader_t *Reader, float *const *Dst)
+{
+    int n;
+    const struct MultiHeader_t *Header = &Reader->Header;
+
+    //! Read the whole slice at once
+    uint32_t SliceSize = Reader->NextSliceSize;
+    uint32_t DataOffs  = Header->nStreams * sizeof(uint32_t);
+    if(!SliceSize) return 0;
+    if(SliceSize > Header->MaxSliceSize || SliceSize < DataOffs + sizeof(uint32_t)) return -1;
+    if(fread(Reader->SliceBuffer, SliceSize, 1, Reader->File) != 1) return -1;
+
+    //! Decode active streams, skipping over the rest
+    const uint8_t *Data = Reader->SliceBuffer + DataOffs;
+    const uint8_t *End  = Reader->SliceBuffer + SliceSize - sizeof(uint32_t);
+    for(n=0; n<Header->nStreams; n++)
+    {
+        uint32_t StreamSize = MultiStream_ReadU32(Reader->SliceBuffer + n*sizeof(uint32_t));
+        if(StreamSize > (uint32_t)(End - Data)) return -1;
+        if(Reader->ActiveMask & (1u << n))
+        {
+            int Blk, nBlk = Header->SliceSize / Reader->Streams[n].BlockSize;
+            struct ULC_DecoderState_t *Decoder = &Reader->Decoders[n];
+            uint32_t Offs = 0;
+            for(Blk=0; Blk<nBlk; Blk++)
+            {
+                int Size = (ULC_DecodeBlock(Decoder, Dst[n] + Blk*Decoder->BlockSize*Decoder->nChan, Data + Offs) + 7) / 8u;
+                if(!Size) return -1;
+                Offs += Size;
+            }
+            if(Offs != StreamSize) return -1;
+        }
+        Data += StreamSize;
+    }
+    if(Data != End) return -1;
+    Reader->NextSliceSize = MultiStream_ReadU32(End);
+    Reader->Slice++;
+    return 1;
+}
+
+/**************************************/
+//! EOF
+/**************************************/
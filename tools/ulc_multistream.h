@@ -0,0 +1,53 @@
+/**************************************/
+#pragma once
+/**************************************/
+#include <stdint.h>
+#include <stdio.h>
+/**************************************/
+#include "ulc_helper.h"
+#include "ulcdecoder.h"
+/**************************************/
+
+//! Multi-stream reader
+//! Each call to MultiStream_DecodeSlice() reads one slice of the file
+//! (a single fread() of a known size, with no seeking), and decodes
+//! only the streams selected in ActiveMask (bit N = Stream N); the
+//! data of inactive streams is skipped over in memory.
+//! NOTE: A stream that is activated mid-way through starts from
+//! a cleared decoder state, and so fades in over its first block.
+struct MultiStream_Reader_t
+{
+    FILE    *File;
+    struct MultiHeader_t Header;
+    struct MultiStreamInfo_t Streams[MULTI_MAX_STREAMS];
+    struct ULC_DecoderState_t Decoders[MULTI_MAX_STREAMS];
+    uint32_t ActiveMask;
+    uint32_t Slice;         //! Next slice to decode
+    uint32_t NextSliceSize; //! Size of the next slice (0 = End of file)
+    uint8_t *SliceBuffer;   //! [MaxSliceSize + Padding]
+    void    *Scratch;       //! Decoder scratch area (shared by all streams)
+};
+
+//! Open a multi-stream file
+//! Returns 1 on success, or -1 on failure.
+int MultiStream_Open(struct MultiStream_Reader_t *Reader, const char *Filename, uint32_t ActiveMask);
+
+//! Close a multi-stream file
+void MultiStream_Close(struct MultiStream_Reader_t *Reader);
+
+//! Set the active streams
+//! Returns 1 on success, or -1 on failure (a decoder couldn't be created).
+int MultiStream_SetActive(struct MultiStream_Reader_t *Reader, uint32_t ActiveMask);
+
+//! Decode the next slice
+//! For each active stream N, Dst[N] receives SliceSize samples of
+//! interleaved float data (and must have space for nChan*SliceSize
+//! floats, aligned to BUFFER_ALIGNMENT). Entries for inactive streams
+//! are not accessed.
+//! Returns 1 on success, 0 at the end of the file, or -1 on a read
+//! error or a corrupted slice.
+int MultiStream_DecodeSlice(struct MultiStream_Reader_t *Reader, float *const *Dst);
+
+/**************************************/
+//! EOF
+/**************************************/
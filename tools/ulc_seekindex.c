@@ -0,0 +1,174 @@
+/**************************************/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+/**************************************/
+#include "ulc_seekindex.h"
+#include "ulcdecoder.h"
+#include "ulcentropy.h"
+/**************************************/
+
+//! File offset of entry N of an index
+#define SEEKINDEX_ENTRY_OFFS(n) (sizeof(struct SeekIndexHeader_t) + (uint64_t)(n)*sizeof(uint32_t))
+
+/**************************************/
+
+int SeekIndex_Build(FILE *File, FILE *IndexFile, uint32_t BlockStride)
+{
+    int Result = -1;
+    struct FileHeader_t Header;
+    struct ULC_EntropyModel_t Model;
+    uint8_t  *Stream  = NULL;
+    uint8_t  *Raw     = NULL;
+    uint32_t *Entries = NULL;
+    if(BlockStride < 1 || FileHeader_Read(&Header, File) < 0) return -1;
+
+    //! Read the stream into memory
+    //! NOTE: The end of the buffer is padded with zeros so that scanning
+    //! a truncated stream cannot run off the end (see ulcreencodetool).
+    size_t FirstBlockOffs = Header.StreamOffs;
+    if(Header.Magic == HEADER_MAGIC_ENTROPY)
+    {
+        int ModelSize = FileHeader_ReadEntropyModel(&Header, &Model, File);
+        if(ModelSize < 0) return -1;
+        FirstBlockOffs += ModelSize;
+    }
+    fseek(File, 0, SEEK_END);
+    size_t FileSize = ftell(File);
+    if(FileSize < FirstBlockOffs || FileSize > UINT32_MAX) return -1;
+    size_t StreamSize = FileSize - FirstBlockOffs;
+    size_t Padding    = (size_t)Header.nChan*Header.BlockSize + 16;
+    fseek(File, FirstBlockOffs, SEEK_SET);
+    uint32_t nEntries = (Header.nBlocks + BlockStride-1) / BlockStride + 1;
+    Stream  = calloc(StreamSize + Padding, 1);
+    Entries = malloc(sizeof(uint32_t) * nEntries);
+    if(Header.Magic == HEADER_MAGIC_ENTROPY) Raw = malloc(Header.MaxRawBlockSize + Padding);
+    if(!Stream || !Entries || (Header.Magic == HEADER_MAGIC_ENTROPY && !Raw)) goto Exit;
+    if(fread(Stream, 1, StreamSize, File) != StreamSize) goto Exit;
+
+    //! Find the start of every BlockStride-th block
+    //! NOTE: Entropy-coded blocks are size-prefixed, but the prefix
+    //! is itself coded, so these have to be decoded to be skipped.
+    uint32_t Blk;
+    size_t Offs = 0;
+    struct ULC_DecoderState_t Scanner;
+    Scanner.nChan     = Header.nChan;
+    Scanner.BlockSize = Header.BlockSize;
+    Scanner.LongTermPrediction = (Header.Profile & HEADER_PROFILE_LTP) != 0;
+    for(Blk=0; Blk<Header.nBlocks; Blk++)
+    {
+        size_t Size;
+        if(Blk % BlockStride == 0) Entries[Blk / BlockStride] = FirstBlockOffs + Offs;
+        if(Raw)
+        {
+            int RawSize;
+            Size = ULC_Entropy_DecodeBlock(&Model, Raw, Header.MaxRawBlockSize, &RawSize, Stream + Offs, StreamSize - Offs);
+        }
+        else Size = (ULC_ScanBlock(&Scanner, Stream + Offs) + 7) / 8u;
+        Offs += Size;
+        if(!Size || Offs > StreamSize) goto Exit;
+    }
+    Entries[nEntries-1] = FirstBlockOffs + Offs;
+
+    //! Write the index
+    struct SeekIndexHeader_t Index;
+    Index.Magic          = SEEKINDEX_MAGIC;
+    Index.nBlocks        = Header.nBlocks;
+    Index.BlockStride    = BlockStride;
+    Index.nEntries       = nEntries;
+    Index.FileSize       = FileSize;
+    Index.FirstBlockOffs = FirstBlockOffs;
+    Index.Reserved       = 0;
+    if(fwrite(&Index, sizeof(Index), 1, IndexFile) == 1 &&
+       fwrite(Entries, sizeof(uint32_t), nEntries, IndexFile) == nEntries) Result = 1;
+
+Exit:
+    free(Raw);
+    free(Entries);
+    free(Stream);
+    return Result;
+}
+
+int SeekIndex_ReadHeader(struct SeekIndexHeader_t *Index, FILE *IndexFile, const struct FileHeader_t *Header, uint64_t FileSize)
+{
+    if(fread(Index, sizeof(*Index), 1, IndexFile) != 1) return -1;
+    if(Index->Magic != SEEKINDEX_MAGIC || Index->BlockStride < 1) return -1;
+    if(Index->nBlocks != Header->nBlocks || Index->FileSize != FileSize) return -1;
+    if(Index->nEntries != (Index->nBlocks + Index->BlockStride-1) / Index->BlockStride + 1) return -1;
+    return 1;
+}
+
+/**************************************/
+
+int SeekPlan_AssetRanges(struct SeekPlan_Range_t *Dst, const struct FileHeader_t *Header, const struct SeekIndexHeader_t *Index)
+{
+    //! File header (and entropy model), and index header
+    (void)Header;
+    Dst[0].Object = SEEKPLAN_OBJECT_STREAM;
+    Dst[0].Start  = 0;
+    Dst[0].End    = Index->FirstBlockOffs;
+    Dst[1].Object = SEEKPLAN_OBJECT_INDEX;
+    Dst[1].Start  = 0;
+    Dst[1].End    = sizeof(struct SeekIndexHeader_t);
+    return 2;
+}
+
+int SeekPlan_Init(struct SeekPlan_t *Plan, struct SeekPlan_Range_t *PageRange, const struct FileHeader_t *Header, const struct SeekIndexHeader_t *Index, uint64_t StartSample, uint64_t EndSample, uint32_t PrefetchBytes)
+{
+    //! Map samples to blocks
+    //! The output of block N covers input samples [(N-2)*BlockSize, (N-1)*BlockSize),
+    //! as the encoder and the MDCT each delay the signal by one block.
+    uint32_t BlockSize = Header->BlockSize;
+    uint32_t nBlocks   = Index->nBlocks;
+    uint64_t nSamples  = (nBlocks > 2) ? (uint64_t)(nBlocks-2)*BlockSize : 0;
+    if(EndSample > nSamples) EndSample = nSamples;
+    if(StartSample >= EndSample) return -1;
+    Plan->OutputBlk   = StartSample / BlockSize + 2;
+    Plan->LastBlk     = (EndSample-1) / BlockSize + 2;
+    Plan->SkipSamples = StartSample % BlockSize;
+
+    //! Start decoding on an index entry, at least the preroll before
+    //! the first block played
+    uint32_t Preroll = (Header->Profile & HEADER_PROFILE_LTP) ? SEEKPLAN_LTP_PREROLL_BLOCKS : SEEKPLAN_PREROLL_BLOCKS;
+    uint32_t FirstBlk = (Plan->OutputBlk > Preroll) ? (Plan->OutputBlk - Preroll) : 0;
+    Plan->FirstEntry = FirstBlk / Index->BlockStride;
+    Plan->FirstBlk   = Plan->FirstEntry * Index->BlockStride;
+
+    //! Read ahead by PrefetchBytes, at the nominal coding rate
+    uint32_t nPrefetch = 0;
+    if(PrefetchBytes && Header->RateKbps)
+    {
+        double BlockBytes = Header->RateKbps * (1000.0/8) * BlockSize / Header->RateHz;
+        nPrefetch = (uint32_t)(PrefetchBytes / BlockBytes + 0.999);
+    }
+    Plan->PrefetchBlk = Plan->LastBlk + nPrefetch;
+    if(Plan->PrefetchBlk >= nBlocks || Plan->PrefetchBlk < Plan->LastBlk) Plan->PrefetchBlk = nBlocks-1;
+
+    //! The stream range ends at the entry after the last block read,
+    //! or at the end of the last block of the stream
+    Plan->LastEntry = (Plan->PrefetchBlk+1 + Index->BlockStride-1) / Index->BlockStride;
+
+    //! Pages holding these entries
+    uint32_t FirstPage = Plan->FirstEntry / SEEKINDEX_PAGE_ENTRIES;
+    uint32_t EndEntry  = (Plan->LastEntry / SEEKINDEX_PAGE_ENTRIES + 1) * SEEKINDEX_PAGE_ENTRIES;
+    if(EndEntry > Index->nEntries) EndEntry = Index->nEntries;
+    PageRange->Object = SEEKPLAN_OBJECT_INDEX;
+    PageRange->Start  = SEEKINDEX_ENTRY_OFFS(FirstPage * SEEKINDEX_PAGE_ENTRIES);
+    PageRange->End    = SEEKINDEX_ENTRY_OFFS(EndEntry);
+    return 1;
+}
+
+int SeekPlan_Finish(const struct SeekPlan_t *Plan, struct SeekPlan_Range_t *StreamRange, const struct SeekIndexHeader_t *Index, const uint32_t *Entries)
+{
+    uint32_t Base = (Plan->FirstEntry / SEEKINDEX_PAGE_ENTRIES) * SEEKINDEX_PAGE_ENTRIES;
+    StreamRange->Object = SEEKPLAN_OBJECT_STREAM;
+    StreamRange->Start  = Entries[Plan->FirstEntry - Base];
+    StreamRange->End    = Entries[Plan->LastEntry  - Base];
+    if(StreamRange->Start < Index->FirstBlockOffs || StreamRange->End <= StreamRange->Start || StreamRange->End > Index->FileSize) return -1;
+    return 1;
+}
+
+/**************************************/
+//! EOF
+/**************************************/
@@ -0,0 +1,115 @@
+/**************************************/
+#pragma once
+/**************************************/
+#include <stdint.h>
+#include <stdio.h>
+/**************************************/
+#include "ulc_helper.h"
+/**************************************/
+
+//! Seek index
+//! Streams have no block synchronization, so finding a block means
+//! parsing every block before it. A seek index is a separate file
+//! (usually stored next to the stream as Stream.ulcx) holding the
+//! file offset of every BlockStride-th block, plus the end of the
+//! last block, so that a player can jump straight to any block and
+//! knows exactly how many bytes to read from there.
+//! Entries are grouped into pages of SEEKINDEX_PAGE_ENTRIES, so that
+//! a player reading from remote storage only needs to fetch the
+//! header and the page(s) covering a seek, rather than the full
+//! index (one page covers about 47 seconds of a 44.1kHz stream with
+//! 2048-sample blocks, at BlockStride = 1).
+//! Layout:
+//!  SeekIndexHeader_t Header;
+//!  uint32_t Entries[nEntries]; //! Entry N = File offset of block N*BlockStride
+#define SEEKINDEX_MAGIC        (uint32_t)('U' | 'L'<<8 | 'C'<<16 | 'X'<<24)
+#define SEEKINDEX_PAGE_ENTRIES 1024
+struct SeekIndexHeader_t
+{
+    uint32_t Magic;          //! [00h] Magic value/signature
+    uint32_t nBlocks;        //! [04h] Number of blocks in the stream
+    uint32_t BlockStride;    //! [08h] Blocks between entries
+    uint32_t nEntries;       //! [0Ch] Number of entries (including the end of the last block)
+    uint64_t FileSize;       //! [10h] Size of the stream file (to detect a stale index)
+    uint32_t FirstBlockOffs; //! [18h] File offset of the first block (after any entropy model)
+    uint32_t Reserved;       //! [1Ch] Reserved (0)
+};
+
+//! Build a seek index of a stream
+//! File is read from the start, and the index is written to IndexFile.
+//! Returns 1 on success, or -1 on failure (unreadable or corrupted
+//! stream, or unable to write the index).
+int SeekIndex_Build(FILE *File, FILE *IndexFile, uint32_t BlockStride);
+
+//! Read a seek index header, and verify it against its stream
+//! Returns 1 on success, or -1 on failure (including a stale index).
+int SeekIndex_ReadHeader(struct SeekIndexHeader_t *Index, FILE *IndexFile, const struct FileHeader_t *Header, uint64_t FileSize);
+
+/**************************************/
+
+//! Byte range of a file (Start inclusive, End exclusive)
+#define SEEKPLAN_OBJECT_STREAM 0
+#define SEEKPLAN_OBJECT_INDEX  1
+struct SeekPlan_Range_t
+{
+    int      Object; //! SEEKPLAN_OBJECT_*
+    uint64_t Start, End;
+};
+
+//! Seek plan
+//! This maps a range of playback samples to the smallest reads needed
+//! to play it, in two steps, so that a remote player only fetches the
+//! parts of the index that it uses:
+//!  1. SeekPlan_Init() maps the samples to blocks, and gives the range
+//!     of index pages holding their entries.
+//!  2. SeekPlan_Finish() takes these entries and gives the range of the
+//!     stream to read, which starts at the preroll block and carries on
+//!     past the end of the playback range by PrefetchBytes (estimated
+//!     from the nominal coding rate, and rounded to whole blocks).
+//! The file header (and entropy model) and the index header are needed
+//! by both steps; SeekPlan_AssetRanges() gives their ranges, which only
+//! need to be fetched once per stream.
+//! Playback samples are counted from the start of the encoder's input
+//! (ie. the codec delay is removed), at the coding rate. Decoding runs
+//! from FirstBlk, and the output of the first OutputBlk-FirstBlk blocks,
+//! plus SkipSamples samples of OutputBlk, is discarded; the rest of the
+//! output up to LastBlk plays the range.
+//! NOTE: Streams using long-term prediction are given a much longer
+//! preroll (about 3 seconds at 44.1kHz with 2048-sample blocks), so
+//! that the error from the missing history can decay first: gains can
+//! be as high as 15/16, which takes around 64 blocks to fall by 36dB.
+//! These never decode exactly as from the start of the stream.
+#define SEEKPLAN_PREROLL_BLOCKS     1
+#define SEEKPLAN_LTP_PREROLL_BLOCKS 64
+struct SeekPlan_t
+{
+    uint32_t FirstBlk;     //! First block to decode (on an index entry)
+    uint32_t OutputBlk;    //! First block whose output is played
+    uint32_t LastBlk;      //! Last block whose output is played
+    uint32_t PrefetchBlk;  //! Last block to read (>= LastBlk)
+    uint32_t SkipSamples;  //! Samples to discard from the output of OutputBlk
+    uint32_t FirstEntry;   //! Entries needed for the stream range
+    uint32_t LastEntry;
+};
+
+//! Get the ranges to fetch once for a stream
+//! Dst must have space for 2 ranges.
+//! Returns the number of ranges stored.
+int SeekPlan_AssetRanges(struct SeekPlan_Range_t *Dst, const struct FileHeader_t *Header, const struct SeekIndexHeader_t *Index);
+
+//! Plan the blocks for a range of samples
+//! The index page range that holds the needed entries is stored to
+//! PageRange.
+//! Returns 1 on success, or -1 if the range is empty or outside the
+//! stream.
+int SeekPlan_Init(struct SeekPlan_t *Plan, struct SeekPlan_Range_t *PageRange, const struct FileHeader_t *Header, const struct SeekIndexHeader_t *Index, uint64_t StartSample, uint64_t EndSample, uint32_t PrefetchBytes);
+
+//! Get the stream range for a plan
+//! Entries must hold the entries of the pages given by SeekPlan_Init(),
+//! starting from the first entry of the first page.
+//! Returns 1 on success, or -1 on a corrupted index.
+int SeekPlan_Finish(const struct SeekPlan_t *Plan, struct SeekPlan_Range_t *StreamRange, const struct SeekIndexHeader_t *Index, const uint32_t *Entries);
+
+/**************************************/
+//! EOF
+/**************************************/
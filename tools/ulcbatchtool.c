@@ -0,0 +1,897 @@
+/**************************************/
+#include <math.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+/**************************************/
+#include "fourier.h"
+#include "miniriff.h"
+#include "ulc_asyncio.h"
+#include "ulc_cache.h"
+#include "ulc_helper.h"
+#include "ulcdecoder.h"
+#include "ulcencoder.h"
+#include "wavio.h"
+#include "wavio_helper.h"
+/**************************************/
+
+//! Batch modes
+#define MODE_ENCODE 0
+#define MODE_DECODE 1
+
+//! Coding parameters (shared by all jobs)
+struct BatchParams_t
+{
+    int   Mode;
+    int   BlockSize;
+    int   StereoSwitching;
+    int   ParametricStereo;
+    int   NoiseCoupling;
+    float RateKbps;
+    float AvgComplexity;
+    const char *CacheDir; //! Result cache directory (NULL = None)
+    char  CacheParams[ENCODECACHE_PARAMS_SIZE];
+};
+
+//! Job (one per input file)
+//! Each job is read, coded by a worker, and then written, all
+//! through the same request; Data holds the input while coding,
+//! and the output while writing.
+#define JOB_READING 0
+#define JOB_CODING  1
+#define JOB_WRITING 2
+struct BatchJob_t
+{
+    struct AsyncIO_Request_t Req;
+    int         Stage;
+    const char *InPath;
+    char       *OutPath;
+    const char *Error;   //! Reason for failure (static string; NULL = Ok)
+    const char *Warning; //! Non-fatal problem (static string; NULL = None)
+    int         CacheHit;
+    struct BatchJob_t *Next;
+};
+
+//! Queue of jobs waiting for a worker
+struct BatchQueue_t
+{
+    pthread_mutex_t Lock;
+    pthread_cond_t  Cond;
+    struct BatchJob_t *Head, *Tail;
+    int Quit;
+    struct AsyncIO_t *IO;
+    const struct BatchParams_t *Params;
+};
+
+//! Creating an encoder or decoder may measure transform plans,
+//! which are kept in a global table (see fourier_plan.c), so
+//! workers take turns at it
+static pthread_mutex_t CodecInitLock = PTHREAD_MUTEX_INITIALIZER;
+
+/**************************************/
+
+//! Growable output buffer
+struct BatchOutput_t
+{
+    uint8_t *Data;
+    size_t   Size, Capacity;
+};
+
+//! Reserve space for Size more bytes, and return a pointer to it
+//! (the caller then adds Size to Out->Size). Returns NULL on failure.
+static uint8_t *BatchOutput_Reserve(struct BatchOutput_t *Out, size_t Size)
+{
+    if(Out->Size + Size > Out->Capacity)
+    {
+        size_t NewCapacity = Out->Capacity ? Out->Capacity : (64*1024);
+        while(NewCapacity < Out->Size + Size) NewCapacity *= 2;
+        uint8_t *NewData = realloc(Out->Data, NewCapacity);
+        if(!NewData) return NULL;
+        Out->Data = NewData, Out->Capacity = NewCapacity;
+    }
+    return Out->Data + Out->Size;
+}
+
+static int BatchOutput_Append(struct BatchOutput_t *Out, const void *Src, size_t Size)
+{
+    uint8_t *Dst = BatchOutput_Reserve(Out, Size);
+    if(!Dst) return -1;
+    memcpy(Dst, Src, Size);
+    Out->Size += Size;
+    return 1;
+}
+
+/**************************************/
+
+//! Encode a WAV file held in memory
+//! This follows ulcencodetool (in CBR, ABR and VBR modes), so that
+//! the output is identical to encoding the file with it.
+//! Returns 1 on success, or -1 on failure (with the reason in Error).
+static int EncodeFile(struct BatchOutput_t *Out, const struct BatchParams_t *Params, uint8_t *Data, size_t Size, const char **Error)
+{
+    int Result = -1;
+    int BlockSize = Params->BlockSize;
+    struct WAV_State_t FileIn;
+    struct ULC_EncoderState_t Encoder;
+    struct FileHeader_t FileHeader;
+
+    //! Open input file and verify
+    FILE *f = fmemopen(Data, Size, "rb");
+    if(!f)
+    {
+        *Error = "Input file is empty, or out of memory";
+        return -1;
+    }
+    {
+        int Err = WAV_OpenRFromFile(&FileIn, f);
+        if(Err < 0)
+        {
+            fclose(f);
+            *Error = WAV_ErrorCodeToString(Err);
+            return -1;
+        }
+    }
+    if(FileIn.fmt->nSamplesPerSec < 1)
+    {
+        *Error = "Unsupported playback rate";
+        goto Exit_FailInFileValidation;
+    }
+
+    //! Create file header
+    FileHeader.Magic        = HEADER_MAGIC;
+    FileHeader.BlockSize    = BlockSize;
+    FileHeader.MaxBlockSize = 0;
+    FileHeader.nBlocks      = ((uint64_t)FileIn.nSamplePoints + BlockSize-1) / BlockSize + 2;
+    FileHeader.RateHz       = FileIn.fmt->nSamplesPerSec;
+    FileHeader.nChan        = FileIn.fmt->nChannels;
+    FileHeader.StreamOffs   = sizeof(FileHeader);
+    FileHeader.SourceRateHz = 0;
+    FileHeader.MaxRawBlockSize  = 0;
+    FileHeader.StreamBufferSize = 0;
+    FileHeader.LoopBlock    = 0;
+    FileHeader.LoopOffs     = 0;
+    FileHeader.PlaybackGain = 0;
+    FileHeader.Profile      = 0;
+    if(Params->StereoSwitching || Params->ParametricStereo) FileHeader.Profile |= HEADER_PROFILE_STEREO;
+    if(Params->NoiseCoupling)                               FileHeader.Profile |= HEADER_PROFILE_NOISE_COUPLING;
+
+    //! Create encoder
+    Encoder.RateHz    = FileHeader.RateHz;
+    Encoder.nChan     = FileHeader.nChan;
+    Encoder.BlockSize = BlockSize;
+    Encoder.BitReservoirSize = 0;
+    Encoder.StereoSwitching  = Params->StereoSwitching;
+    Encoder.ParametricStereo = Params->ParametricStereo;
+    Encoder.NoiseCoupling    = Params->NoiseCoupling;
+    Encoder.ChanGroupSize    = 0;
+    Encoder.ABRLookahead     = 0;
+    Encoder.LongTermPrediction = 0;
+    pthread_mutex_lock(&CodecInitLock);
+    int InitOk = ULC_EncoderState_Init(&Encoder) > 0;
+    pthread_mutex_unlock(&CodecInitLock);
+    if(!InitOk)
+    {
+        *Error = "Unable to initialize encoder";
+        goto Exit_FailInFileValidation;
+    }
+
+    //! Allocate reading buffer
+    char *AllocBuffer = malloc(BUFFER_ALIGNMENT-1 + sizeof(float)*BlockSize*FileHeader.nChan);
+    if(!AllocBuffer)
+    {
+        *Error = "Couldn't allocate reading buffer";
+        goto Exit_FailCreateAllocBuffer;
+    }
+    float *ReadBuffer = (float*)(AllocBuffer + (-(uintptr_t)AllocBuffer % BUFFER_ALIGNMENT));
+
+    //! Skip header, and process blocks
+    size_t Blk, nBlk = FileHeader.nBlocks;
+    uint64_t TotalSize = 0;
+    Out->Size = sizeof(FileHeader);
+    if(!BatchOutput_Reserve(Out, 0)) goto Exit_FailOutOfMemory;
+    for(Blk=0; Blk<nBlk; Blk++)
+    {
+        int BlkSize;
+        const uint8_t *EncData;
+        WAV_ReadAsFloat(&FileIn, ReadBuffer, BlockSize);
+        if(Params->RateKbps < 0.0f)           EncData = ULC_EncodeBlock_VBR(&Encoder, ReadBuffer, &BlkSize, -Params->RateKbps);
+        else if(Params->AvgComplexity > 0.0f) EncData = ULC_EncodeBlock_ABR(&Encoder, ReadBuffer, &BlkSize,  Params->RateKbps, Params->AvgComplexity);
+        else                                  EncData = ULC_EncodeBlock_CBR(&Encoder, ReadBuffer, &BlkSize,  Params->RateKbps);
+        BlkSize = (BlkSize+7) / 8u;
+        TotalSize += BlkSize;
+        if((size_t)BlkSize > FileHeader.MaxBlockSize) FileHeader.MaxBlockSize = BlkSize;
+        if(BatchOutput_Append(Out, EncData, BlkSize) < 0) goto Exit_FailOutOfMemory;
+    }
+
+    //! Store RateKbps, and write the header
+    double AvgKbps = TotalSize * 8.0 * FileHeader.RateHz/1000.0 / ((size_t)BlockSize * nBlk);
+    FileHeader.RateKbps = lrint(AvgKbps);
+    memcpy(Out->Data, &FileHeader, sizeof(FileHeader));
+    Result = 1;
+
+    //! Exit points
+Exit_FailOutOfMemory:
+    if(Result < 0) *Error = "Couldn't allocate output buffer";
+    free(AllocBuffer);
+Exit_FailCreateAllocBuffer:
+    ULC_EncoderState_Destroy(&Encoder);
+Exit_FailInFileValidation:
+    WAV_Close(&FileIn);
+    return Result;
+}
+
+/**************************************/
+
+//! Encode the input of a job, going through the result cache
+//! The cache is keyed the same way as ulcencodetool's -cache:Dir,
+//! so that both tools can share a cache directory.
+//! Returns 1 on success, or -1 on failure (with the reason in Job->Error).
+static int EncodeJob(struct BatchOutput_t *Out, const struct BatchParams_t *Params, struct BatchJob_t *Job)
+{
+    struct EncodeCache_t Cache;
+    struct AsyncIO_Request_t *Req = &Job->Req;
+
+    //! Look up the result cache
+    int UseCache = (Params->CacheDir != NULL);
+    if(UseCache && EncodeCache_InitFromMemory(&Cache, Params->CacheDir, Req->Data, Req->Size, Params->CacheParams) < 0)
+    {
+        Job->Warning = "Unable to form cache key for input; not caching";
+        UseCache = 0;
+    }
+    if(UseCache)
+    {
+        int Result = EncodeCache_FetchToMemory(&Cache, &Out->Data, &Out->Size);
+        if(Result < 0)
+        {
+            Job->Error = "Unable to read cached result";
+            return -1;
+        }
+        if(Result > 0)
+        {
+            Out->Capacity = Out->Size;
+            Job->CacheHit = 1;
+            return 1;
+        }
+    }
+
+    //! Encode, and store the result on a miss
+    if(EncodeFile(Out, Params, Req->Data, Req->Size, &Job->Error) < 0) return -1;
+    if(UseCache && EncodeCache_StoreFromMemory(&Cache, Out->Data, Out->Size) < 0)
+    {
+        Job->Warning = "Unable to store result in cache";
+    }
+    return 1;
+}
+
+/**************************************/
+
+//! Decode a stream held in memory to PCM16 (at the source rate)
+//! This follows ulcdecodetool, so that the output is identical to
+//! decoding the file with it. Data may be reallocated (to pad it
+//! for decoding).
+//! Returns 1 on success, or -1 on failure (with the reason in Error).
+static int DecodeFile(struct BatchOutput_t *Out, uint8_t **Data, size_t Size, const char **Error)
+{
+    int Result = -1;
+    struct ULC_DecoderState_t Decoder;
+    struct FileHeader_t FileHeader;
+    struct ULC_EntropyModel_t EntropyModel;
+
+    //! Read the header (and entropy model)
+    int EntropyCoded;
+    size_t StreamOffs;
+    {
+        FILE *f = fmemopen(*Data, Size, "rb");
+        if(!f)
+        {
+            *Error = "Input file is empty, or out of memory";
+            return -1;
+        }
+        int Ok = FileHeader_Read(&FileHeader, f) > 0;
+        EntropyCoded = (FileHeader.Magic == HEADER_MAGIC_ENTROPY);
+        StreamOffs   = FileHeader.StreamOffs;
+        if(Ok && EntropyCoded)
+        {
+            int ModelSize = FileHeader_ReadEntropyModel(&FileHeader, &EntropyModel, f);
+            if(ModelSize < 0) Ok = 0;
+            StreamOffs += ModelSize;
+        }
+        fclose(f);
+        if(!Ok || StreamOffs > Size)
+        {
+            *Error = "Input file is not a valid ULC container";
+            return -1;
+        }
+    }
+
+    //! Pad the end of the stream with zeros, so that decoding a
+    //! truncated stream cannot run off the end (see ulcreencodetool)
+    size_t Padding = (size_t)FileHeader.nChan*FileHeader.BlockSize + 16;
+    {
+        uint8_t *Padded = realloc(*Data, Size + Padding);
+        if(!Padded)
+        {
+            *Error = "Couldn't allocate decoding buffer";
+            return -1;
+        }
+        memset(Padded + Size, 0, Padding);
+        *Data = Padded;
+    }
+    const uint8_t *Stream = *Data + StreamOffs;
+    size_t StreamSize = Size - StreamOffs;
+
+    //! Create decoder
+    float PlaybackGain = FileHeader_PlaybackGain(&FileHeader);
+    Decoder.nChan        = FileHeader.nChan;
+    Decoder.BlockSize    = FileHeader.BlockSize;
+    Decoder.RateHz       = FileHeader.RateHz;
+    Decoder.OutputRateHz = FileHeader.SourceRateHz;
+    Decoder.OutputFormat = ULC_DECODER_OUTPUT_FLOAT32;
+    Decoder.Flags        = 0;
+    Decoder.LongTermPrediction = (FileHeader.Profile & HEADER_PROFILE_LTP) != 0;
+    Decoder.ScratchBuffer      = NULL;
+    pthread_mutex_lock(&CodecInitLock);
+    int InitOk = ULC_DecoderState_Init(&Decoder) > 0;
+    pthread_mutex_unlock(&CodecInitLock);
+    if(!InitOk)
+    {
+        *Error = "Unable to initialize decoder";
+        return -1;
+    }
+    uint32_t OutputRateHz = FileHeader.SourceRateHz ? FileHeader.SourceRateHz : FileHeader.RateHz;
+
+    //! Allocate decoding buffer (and raw block buffer)
+    int DecodeBufferSize = FileHeader.BlockSize;
+    int RawBufferSize = EntropyCoded ? (int)FileHeader.MaxRawBlockSize : 0;
+    if(Decoder.MaxOutputSize > DecodeBufferSize) DecodeBufferSize = Decoder.MaxOutputSize;
+    DecodeBufferSize = (DecodeBufferSize * FileHeader.nChan + (BUFFER_ALIGNMENT/sizeof(float)-1)) &~ (BUFFER_ALIGNMENT/sizeof(float)-1);
+    char *AllocBuffer = malloc(BUFFER_ALIGNMENT-1 + sizeof(float)*DecodeBufferSize + (EntropyCoded ? (RawBufferSize + Padding) : 0));
+    if(!AllocBuffer)
+    {
+        *Error = "Couldn't allocate decoding buffer";
+        goto Exit_FailCreateAllocBuffer;
+    }
+    float   *DecodeBuffer = (float*)(AllocBuffer + (-(uintptr_t)AllocBuffer % BUFFER_ALIGNMENT));
+    uint8_t *RawBuffer    = (uint8_t*)(DecodeBuffer + DecodeBufferSize);
+
+    //! Write the WAV header (sizes are filled in at the end)
+    //! This is the same layout as WAV_OpenW() writes.
+    struct
+    {
+        uint32_t RIFFType, RIFFSize, WAVEType;
+        uint32_t fmtType,  fmtSize;
+        struct WAVE_fmt_t fmt;
+        uint32_t dataType, dataSize;
+    } WavHeader;
+    WavHeader.RIFFType = RIFF_FOURCC("RIFF");
+    WavHeader.RIFFSize = 0;
+    WavHeader.WAVEType = RIFF_FOURCC("WAVE");
+    WavHeader.fmtType  = RIFF_FOURCC("fmt ");
+    WavHeader.fmtSize  = sizeof(struct WAVE_fmt_t);
+    WavHeader.fmt.wFormatTag      = WAVE_FORMAT_PCM;
+    WavHeader.fmt.nChannels       = FileHeader.nChan;
+    WavHeader.fmt.nSamplesPerSec  = OutputRateHz;
+    WavHeader.fmt.nAvgBytesPerSec = sizeof(int16_t) * FileHeader.nChan * OutputRateHz;
+    WavHeader.fmt.nBlockAlign     = sizeof(int16_t) * FileHeader.nChan;
+    WavHeader.fmt.wBitsPerSample  = 16;
+    WavHeader.dataType = RIFF_FOURCC("data");
+    WavHeader.dataSize = 0;
+    Out->Size = 0;
+    if(BatchOutput_Append(Out, &WavHeader, sizeof(WavHeader)) < 0) goto Exit_FailOutOfMemory;
+
+    //! Process blocks
+    uint32_t Blk;
+    size_t Offs = 0;
+    for(Blk=0; Blk<FileHeader.nBlocks; Blk++)
+    {
+        //! Decode block
+        //! Entropy-coded blocks must decode back to exactly the
+        //! number of bytes stored in their size prefix.
+        int BlkSize;
+        if(EntropyCoded)
+        {
+            int RawSize;
+            BlkSize = ULC_Entropy_DecodeBlock(&EntropyModel, RawBuffer, RawBufferSize, &RawSize, Stream + Offs, StreamSize + Padding - Offs);
+            if(BlkSize && (ULC_DecodeBlock(&Decoder, DecodeBuffer, RawBuffer) + 7) / 8u != (unsigned)RawSize) BlkSize = 0;
+        }
+        else BlkSize = (ULC_DecodeBlock(&Decoder, DecodeBuffer, Stream + Offs) + 7) / 8u;
+        Offs += BlkSize;
+        if(!BlkSize || Offs > StreamSize)
+        {
+            *Error = "Corrupted stream";
+            goto Exit_FailCorruptStream;
+        }
+
+        //! Apply any residual gain and store samples
+        size_t n, nSmp = (size_t)Decoder.nOutputSamples*FileHeader.nChan;
+        if(PlaybackGain != 1.0f)
+        {
+            for(n=0; n<nSmp; n++) DecodeBuffer[n] *= PlaybackGain;
+        }
+        uint8_t *Dst = BatchOutput_Reserve(Out, sizeof(int16_t)*nSmp);
+        if(!Dst) goto Exit_FailOutOfMemory;
+        WAV_ConvertFromFloat_PCM16(Dst, DecodeBuffer, nSmp);
+        Out->Size += sizeof(int16_t)*nSmp;
+    }
+
+    //! Finish up the header
+    WavHeader.dataSize = Out->Size - sizeof(WavHeader);
+    WavHeader.RIFFSize = Out->Size - 8;
+    memcpy(Out->Data, &WavHeader, sizeof(WavHeader));
+    Result = 1;
+
+    //! Exit points
+Exit_FailOutOfMemory:
+    if(Result < 0) *Error = "Couldn't allocate output buffer";
+Exit_FailCorruptStream:
+    free(AllocBuffer);
+Exit_FailCreateAllocBuffer:
+    ULC_DecoderState_Destroy(&Decoder);
+    return Result;
+}
+
+/**************************************/
+
+//! Coding thread
+//! Takes jobs whose input has been read, codes them, and submits
+//! the output to be written (or a no-op, to report a failure).
+static void *BatchWorker(void *User)
+{
+    struct BatchQueue_t *Queue = (struct BatchQueue_t*)User;
+    for(;;)
+    {
+        //! Get the next job
+        pthread_mutex_lock(&Queue->Lock);
+        while(!Queue->Head && !Queue->Quit) pthread_cond_wait(&Queue->Cond, &Queue->Lock);
+        struct BatchJob_t *Job = Queue->Head;
+        if(Job)
+        {
+            Queue->Head = Job->Next;
+            if(!Queue->Head) Queue->Tail = NULL;
+        }
+        pthread_mutex_unlock(&Queue->Lock);
+        if(!Job) break;
+
+        //! Code it, and replace the input with the output
+        int Result;
+        struct AsyncIO_Request_t *Req = &Job->Req;
+        struct BatchOutput_t Output = {NULL, 0, 0};
+        if(Queue->Params->Mode == MODE_ENCODE)
+            Result = EncodeJob(&Output, Queue->Params, Job);
+        else
+            Result = DecodeFile(&Output, &Req->Data, Req->Size, &Job->Error);
+        free(Req->Data);
+        if(Result < 0)
+        {
+            free(Output.Data);
+            Output.Data = NULL, Output.Size = 0;
+        }
+        Job->Stage = JOB_WRITING;
+        Req->Op    = (Result < 0) ? ASYNCIO_OP_NOP : ASYNCIO_OP_WRITE;
+        Req->Path  = Job->OutPath;
+        Req->Data  = Output.Data;
+        Req->Size  = Output.Size;
+        AsyncIO_Submit(Queue->IO, Req);
+    }
+    return NULL;
+}
+
+/**************************************/
+
+//! Read the list of input files (one per line; blank lines are skipped)
+//! Returns the number of files, or -1 on failure.
+static int ReadFileList(const char *Filename, char **ListData, const char ***Files)
+{
+    FILE *f = fopen(Filename, "rb");
+    if(!f) return -1;
+    fseek(f, 0, SEEK_END);
+    long Size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *Data = malloc(Size + 1);
+    if(!Data || fread(Data, 1, Size, f) != (size_t)Size)
+    {
+        free(Data);
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+    Data[Size] = '\0';
+
+    //! Split into lines (this only shrinks the data, so the list
+    //! can't need more entries than there are bytes)
+    int nFiles = 0;
+    const char **List = malloc(sizeof(const char*) * (Size/2 + 1));
+    if(!List)
+    {
+        free(Data);
+        return -1;
+    }
+    char *Line = Data;
+    while(*Line)
+    {
+        size_t Len = strcspn(Line, "\r\n");
+        char  *Next = Line + Len;
+        if(*Next) *Next++ = '\0';
+        if(Len) List[nFiles++] = Line;
+        Line = Next;
+    }
+    *ListData = Data;
+    *Files    = List;
+    return nFiles;
+}
+
+//! Form the output path for an input file
+//! This is OutDir, plus the name of the input with its extension
+//! replaced by Ext.
+static char *MakeOutputPath(const char *OutDir, const char *InPath, const char *Ext)
+{
+    const char *Name = strrchr(InPath, '/');
+    Name = Name ? (Name + 1) : InPath;
+    const char *Dot = strrchr(Name, '.');
+    int NameLen = Dot ? (int)(Dot - Name) : (int)strlen(Name);
+    size_t Len = strlen(OutDir) + 1 + NameLen + strlen(Ext) + 1;
+    char *Path = malloc(Len);
+    if(Path) snprintf(Path, Len, "%s/%.*s%s", OutDir, NameLen, Name, Ext);
+    return Path;
+}
+
+//! Wall-clock time (in seconds)
+static double GetTime(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec*1.0e-9;
+}
+
+/**************************************/
+
+int main(int argc, const char *argv[])
+{
+    int   ExitCode = 0;
+    char *ListData;
+    const char **Files;
+    struct BatchJob_t *Jobs;
+    pthread_t *Workers;
+    struct AsyncIO_t IO;
+    struct BatchQueue_t Queue;
+    struct BatchParams_t Params;
+
+    //! Check arguments
+    if(argc < 4 || (strcmp(argv[1], "encode") && strcmp(argv[1], "decode")) || (!strcmp(argv[1], "encode") && argc < 5))
+    {
+        printf(
+            "ulcBatchTool - Ultra-Low Complexity Codec Batch Tool\n"
+            "Usage:\n"
+            " ulcbatchtool encode List.txt OutDir RateKbps[,AvgComplexity]|-Quality [Opt]\n"
+            " ulcbatchtool decode List.txt OutDir [Opt]\n"
+            "List.txt holds one input file per line. Outputs are written to OutDir,\n"
+            "named after their input (with a .ulc or .wav extension).\n"
+            "Options:\n"
+            " -blocksize:2048 - Set number of coefficients per block (encode only).\n"
+            " -lrstereo       - Let channel pairs switch to L/R stereo (encode only).\n"
+            " -pstereo        - Use parametric stereo for channel pairs (encode only).\n"
+            " -noisecoupling  - Let channel pairs share noise fill (encode only).\n"
+            " -cache:Dir      - Look up/store encoded results in Dir, as ulcencodetool\n"
+            "                   does (encode only).\n"
+            " -threads:N      - Use N coding threads (default: number of CPUs).\n"
+            " -depth:64       - Keep up to this many files in flight (reading, coding,\n"
+            "                   or writing).\n"
+            " -io:uring       - I/O backend: uring (io_uring, falling back to threads\n"
+            "                   when unavailable), threads, or sync (no overlap).\n"
+            " -wisdom:File    - Load/save transform planning from/to File.\n"
+            "Encoding is as ulcencodetool in CBR/ABR/VBR mode; decoding is as\n"
+            "ulcdecodetool, to PCM16 at the source rate.\n"
+        );
+        return 1;
+    }
+
+    //! Parse arguments
+    int Backend  = ASYNCIO_BACKEND_URING;
+    int nWorkers = sysconf(_SC_NPROCESSORS_ONLN);
+    int Depth    = 64;
+    const char *WisdomFile = NULL;
+    Params.Mode      = strcmp(argv[1], "encode") ? MODE_DECODE : MODE_ENCODE;
+    Params.BlockSize = 2048;
+    Params.StereoSwitching  = 0;
+    Params.ParametricStereo = 0;
+    Params.NoiseCoupling    = 0;
+    Params.RateKbps      = 0.0f;
+    Params.AvgComplexity = 0.0f;
+    Params.CacheDir      = NULL;
+    if(nWorkers < 1) nWorkers = 1;
+    if(Params.Mode == MODE_ENCODE)
+    {
+        sscanf(argv[4], "%f,%f", &Params.RateKbps, &Params.AvgComplexity);
+        if(Params.RateKbps == 0.0f)
+        {
+            printf("ERROR: Invalid coding rate (%.2f).\n", Params.RateKbps);
+            ExitCode = -1;
+            goto Exit_BadArgs;
+        }
+        if(Params.AvgComplexity < 0.0f)
+        {
+            printf("ERROR: Invalid AvgComplexity parameter (%.2f).\n", Params.AvgComplexity);
+            ExitCode = -1;
+            goto Exit_BadArgs;
+        }
+    }
+    {
+        int n;
+        for(n=(Params.Mode == MODE_ENCODE) ? 5 : 4; n<argc; n++)
+        {
+            if(!memcmp(argv[n], "-blocksize:", 11))
+            {
+                int x = atoi(argv[n] + 11);
+                if(x >= 256 && x <= 32768 && (x & (-x)) == x) Params.BlockSize = x;
+                else
+                {
+                    printf("ERROR: Unsupported block size (%d).\n", x);
+                    ExitCode = -1;
+                    goto Exit_BadArgs;
+                }
+            }
+
+            else if(!strcmp(argv[n], "-lrstereo"))
+            {
+                Params.StereoSwitching = 1;
+            }
+
+            else if(!strcmp(argv[n], "-pstereo"))
+            {
+                Params.ParametricStereo = 1;
+            }
+
+            else if(!strcmp(argv[n], "-noisecoupling"))
+            {
+                Params.NoiseCoupling = 1;
+            }
+
+            else if(!memcmp(argv[n], "-cache:", 7))
+            {
+                Params.CacheDir = argv[n] + 7;
+            }
+
+            else if(!memcmp(argv[n], "-threads:", 9))
+            {
+                nWorkers = atoi(argv[n] + 9);
+                if(nWorkers < 1 || nWorkers > 256)
+                {
+                    printf("ERROR: Invalid number of threads (%s).\n", argv[n] + 9);
+                    ExitCode = -1;
+                    goto Exit_BadArgs;
+                }
+            }
+
+            else if(!memcmp(argv[n], "-depth:", 7))
+            {
+                Depth = atoi(argv[n] + 7);
+                if(Depth < 1 || Depth > 4096)
+                {
+                    printf("ERROR: Invalid depth (%s).\n", argv[n] + 7);
+                    ExitCode = -1;
+                    goto Exit_BadArgs;
+                }
+            }
+
+            else if(!memcmp(argv[n], "-io:", 4))
+            {
+                const char *Name = argv[n] + 4;
+                if(!strcmp(Name, "uring"))        Backend = ASYNCIO_BACKEND_URING;
+                else if(!strcmp(Name, "threads")) Backend = ASYNCIO_BACKEND_THREADS;
+                else if(!strcmp(Name, "sync"))    Backend = ASYNCIO_BACKEND_SYNC;
+                else
+                {
+                    printf("ERROR: Invalid I/O backend (%s).\n", Name);
+                    ExitCode = -1;
+                    goto Exit_BadArgs;
+                }
+            }
+
+            else if(!memcmp(argv[n], "-wisdom:", 8))
+            {
+                WisdomFile = argv[n] + 8;
+            }
+
+            else printf("WARNING: Ignoring unknown argument (%s).\n", argv[n]);
+        }
+    }
+
+    //! Describe the encoding options for the result cache
+    //! NOTE: Options of ulcencodetool that this tool doesn't have
+    //! are passed at their defaults, so that keys match between the
+    //! two tools.
+    if(Params.Mode == MODE_ENCODE && Params.CacheDir)
+    {
+        snprintf(
+            Params.CacheParams, sizeof(Params.CacheParams), ENCODECACHE_PARAMS_FORMAT,
+            Params.RateKbps, Params.AvgComplexity, Params.BlockSize, 0, 0, 0, 0, Params.StereoSwitching, Params.ParametricStereo, Params.NoiseCoupling, 0, 0, 0, 0u, 0u
+        );
+        if(!ULC_DETERMINISTIC) printf("WARNING: Cached results are only reproducible with a DETERMINISTIC=1 build.\n");
+    }
+    else Params.CacheDir = NULL;
+
+    //! Read the list of inputs
+    int nFiles = ReadFileList(argv[2], &ListData, &Files);
+    if(nFiles < 0)
+    {
+        printf("ERROR: Unable to read file list (%s).\n", argv[2]);
+        ExitCode = -1;
+        goto Exit_FailReadList;
+    }
+    Jobs = calloc(nFiles ? nFiles : 1, sizeof(struct BatchJob_t));
+    if(!Jobs)
+    {
+        printf("ERROR: Couldn't allocate jobs.\n");
+        ExitCode = -1;
+        goto Exit_FailCreateJobs;
+    }
+
+    //! Load transform plans before creating any encoder/decoder
+    if(WisdomFile) Fourier_Plan_LoadWisdom(WisdomFile);
+
+    //! Create the I/O state, and start the workers
+    Backend = AsyncIO_Init(&IO, Backend, Depth);
+    if(Backend < 0)
+    {
+        printf("ERROR: Unable to initialize I/O.\n");
+        ExitCode = -1;
+        goto Exit_FailCreateIO;
+    }
+    pthread_mutex_init(&Queue.Lock, NULL);
+    pthread_cond_init(&Queue.Cond, NULL);
+    Queue.Head   = Queue.Tail = NULL;
+    Queue.Quit   = 0;
+    Queue.IO     = &IO;
+    Queue.Params = &Params;
+    Workers = malloc(sizeof(pthread_t) * nWorkers);
+    if(!Workers)
+    {
+        printf("ERROR: Couldn't allocate threads.\n");
+        ExitCode = -1;
+        goto Exit_FailCreateWorkers;
+    }
+    {
+        int n;
+        for(n=0; n<nWorkers; n++)
+        {
+            if(pthread_create(&Workers[n], NULL, BatchWorker, &Queue) != 0) break;
+        }
+        nWorkers = n;
+        if(nWorkers == 0)
+        {
+            printf("ERROR: Unable to start threads.\n");
+            ExitCode = -1;
+            goto Exit_FailStartWorkers;
+        }
+    }
+
+    //! Process files
+    //! Up to Depth files are in flight at once; reads are topped up
+    //! whenever a file finishes, so that the I/O backend always has
+    //! work queued while the workers code what has arrived.
+    double StartTime = GetTime();
+    {
+        const double DISPLAY_UPDATE_RATE = 0.5; //! Update every 0.5 seconds
+        int NextFile = 0, nActive = 0, nDone = 0, nFailed = 0, nCacheHits = 0;
+        uint64_t TotalRead = 0, TotalWritten = 0;
+        double LastUpdateTime = StartTime - DISPLAY_UPDATE_RATE;
+        const char *OutExt = (Params.Mode == MODE_ENCODE) ? ".ulc" : ".wav";
+        while(nDone < nFiles)
+        {
+            //! Start reading more files
+            while(NextFile < nFiles && nActive < Depth)
+            {
+                struct BatchJob_t *Job = &Jobs[NextFile++];
+                Job->Stage   = JOB_READING;
+                Job->InPath  = Files[NextFile-1];
+                Job->OutPath = MakeOutputPath(argv[3], Job->InPath, OutExt);
+                Job->Error   = NULL;
+                Job->Warning = NULL;
+                Job->CacheHit = 0;
+                Job->Req.Op   = ASYNCIO_OP_READ;
+                Job->Req.Path = Job->InPath;
+                Job->Req.User = Job;
+                if(!Job->OutPath)
+                {
+                    Job->Error  = "Couldn't allocate output path";
+                    Job->Stage  = JOB_WRITING;
+                    Job->Req.Op = ASYNCIO_OP_NOP;
+                }
+                AsyncIO_Submit(&IO, &Job->Req);
+                nActive++;
+            }
+
+            //! Show progress
+            double Now = GetTime();
+            if(Now - LastUpdateTime >= DISPLAY_UPDATE_RATE)
+            {
+                printf("\rFile %d/%d (%.2f%%)", nDone, nFiles, nDone*100.0/nFiles);
+                fflush(stdout);
+                LastUpdateTime = Now;
+            }
+
+            //! Hand read files to the workers, and finish written ones
+            struct AsyncIO_Request_t *Req = AsyncIO_Wait(&IO);
+            struct BatchJob_t *Job = (struct BatchJob_t*)Req->User;
+            if(Job->Stage == JOB_READING && Req->Result == 0)
+            {
+                TotalRead += Req->Size;
+                Job->Stage = JOB_CODING;
+                pthread_mutex_lock(&Queue.Lock);
+                Job->Next = NULL;
+                if(Queue.Tail) Queue.Tail->Next = Job;
+                else Queue.Head = Job;
+                Queue.Tail = Job;
+                pthread_cond_signal(&Queue.Cond);
+                pthread_mutex_unlock(&Queue.Lock);
+                continue;
+            }
+            if(Req->Result < 0 && !Job->Error) Job->Error = strerror(-Req->Result);
+            if(Job->Warning) printf("\rWARNING: %s: %s.\n", Job->InPath, Job->Warning);
+            if(Job->Error)
+            {
+                printf("\rERROR: %s: %s.\n", Job->InPath, Job->Error);
+                nFailed++;
+            }
+            else
+            {
+                TotalWritten += Req->Size;
+                nCacheHits   += Job->CacheHit;
+            }
+            free(Req->Data);
+            free(Job->OutPath);
+            nActive--;
+            nDone++;
+        }
+
+        //! Show statistics
+        double Elapsed = GetTime() - StartTime;
+        printf(
+            "\rProcessed %d files (%d failed) in %.3fs, with %s I/O and %d threads\n"
+            "%.2f files/s | Read %.2fMiB (%.2fMiB/s) | Wrote %.2fMiB (%.2fMiB/s)\n",
+            nFiles, nFailed, Elapsed, AsyncIO_BackendName(Backend), nWorkers,
+            nFiles / Elapsed,
+            TotalRead    / (1024.0*1024.0), TotalRead    / (1024.0*1024.0) / Elapsed,
+            TotalWritten / (1024.0*1024.0), TotalWritten / (1024.0*1024.0) / Elapsed
+        );
+        if(Params.CacheDir) printf("Result cache: %d hits, %d misses\n", nCacheHits, nFiles - nFailed - nCacheHits);
+        if(nFailed) ExitCode = -1;
+    }
+    if(WisdomFile && Fourier_Plan_SaveWisdom(WisdomFile) < 0)
+    {
+        printf("WARNING: Unable to save transform plans (%s).\n", WisdomFile);
+    }
+
+    //! Exit points
+Exit_FailStartWorkers:
+    {
+        int n;
+        pthread_mutex_lock(&Queue.Lock);
+        Queue.Quit = 1;
+        pthread_cond_broadcast(&Queue.Cond);
+        pthread_mutex_unlock(&Queue.Lock);
+        for(n=0; n<nWorkers; n++) pthread_join(Workers[n], NULL);
+    }
+    free(Workers);
+Exit_FailCreateWorkers:
+    pthread_cond_destroy(&Queue.Cond);
+    pthread_mutex_destroy(&Queue.Lock);
+    AsyncIO_Destroy(&IO);
+Exit_FailCreateIO:
+    free(Jobs);
+Exit_FailCreateJobs:
+    free(Files);
+    free(ListData);
+Exit_FailReadList:
+Exit_BadArgs:
+    return ExitCode;
+}
+
+/**************************************/
+//! EOF
+/**************************************/
@@ -0,0 +1,487 @@
+/**************************************/
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+# include <x86intrin.h>
+#endif
+/**************************************/
+#include "fourier.h"
+#include "ulc_helper.h"
+#include "ulcdecoder.h"
+/**************************************/
+
+//! Encoded stream, loaded into memory
+//! For entropy-coded streams, Model is non-NULL.
+struct BenchStream_t
+{
+    struct FileHeader_t Header;
+    const uint8_t *Data;
+    size_t DataSize;
+    size_t ModelSize;
+    const struct ULC_EntropyModel_t *Model;
+};
+
+//! Benchmark configuration
+struct BenchConfig_t
+{
+    const char *Name;
+    int OutputRateHz; //! 0 = No resampling
+    int OutputFormat; //! ULC_DECODER_OUTPUT_*
+    int Flags;        //! ULC_DECODER_FLAG_*
+};
+
+//! Benchmark result
+struct BenchResult_t
+{
+    double   Seconds;  //! Best time over all passes
+    uint64_t Cycles;   //! Cycles taken by the best pass (0 = Unavailable)
+    uint64_t nSamples; //! Samples (per channel) output per pass
+};
+
+/**************************************/
+
+static double Bench_GetTime(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec*1.0e-9;
+}
+
+static uint64_t Bench_GetCycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+//! Load a stream into memory
+//! NOTE: Pad the end, in case of a truncated file.
+//! Returns the stream data (to be freed by the caller), or NULL on failure.
+static uint8_t *Bench_LoadStream(const char *Filename, struct BenchStream_t *Stream, struct ULC_EntropyModel_t *Model)
+{
+    uint8_t *Data = NULL;
+    FILE *File = fopen(Filename, "rb");
+    if(!File)
+    {
+        printf("ERROR: Unable to open input file (%s).\n", Filename);
+        return NULL;
+    }
+    if(FileHeader_Read(&Stream->Header, File) < 0)
+    {
+        printf("ERROR: Input file is not a valid ULC container (%s).\n", Filename);
+        goto Exit;
+    }
+    long StreamOffs = Stream->Header.StreamOffs;
+    Stream->Model     = NULL;
+    Stream->ModelSize = 0;
+    if(Stream->Header.Magic == HEADER_MAGIC_ENTROPY)
+    {
+        int ModelSize = FileHeader_ReadEntropyModel(&Stream->Header, Model, File);
+        if(ModelSize < 0)
+        {
+            printf("ERROR: Invalid entropy model (%s).\n", Filename);
+            goto Exit;
+        }
+        StreamOffs += ModelSize;
+        Stream->Model     = Model;
+        Stream->ModelSize = ModelSize;
+    }
+    fseek(File, 0, SEEK_END);
+    long StreamSize = ftell(File) - StreamOffs;
+    if(StreamSize < 0) StreamSize = 0;
+    Data = calloc(StreamSize + 64, 1);
+    if(!Data)
+    {
+        printf("ERROR: Couldn't allocate stream buffer.\n");
+        goto Exit;
+    }
+    fseek(File, StreamOffs, SEEK_SET);
+    if(fread(Data, 1, StreamSize, File) != (size_t)StreamSize)
+    {
+        printf("ERROR: Unable to read stream data (%s).\n", Filename);
+        free(Data);
+        Data = NULL;
+        goto Exit;
+    }
+    Stream->Data     = Data;
+    Stream->DataSize = StreamSize;
+Exit:
+    fclose(File);
+    return Data;
+}
+
+//! Undo the entropy coding of a stream, giving the plain stream
+//! Returns the stream data (to be freed by the caller), or NULL on failure.
+static uint8_t *Bench_UnpackStream(const struct BenchStream_t *Src, struct BenchStream_t *Dst)
+{
+    uint32_t Blk;
+    size_t SrcOffs = 0, DstOffs = 0;
+    uint8_t *Data = calloc((size_t)Src->Header.nBlocks * Src->Header.MaxRawBlockSize + 64, 1);
+    if(!Data) return NULL;
+    for(Blk=0; Blk<Src->Header.nBlocks; Blk++)
+    {
+        int RawSize;
+        int Size = ULC_Entropy_DecodeBlock(Src->Model, Data + DstOffs, Src->Header.MaxRawBlockSize, &RawSize, Src->Data + SrcOffs, Src->DataSize - SrcOffs);
+        if(!Size)
+        {
+            free(Data);
+            return NULL;
+        }
+        SrcOffs += Size;
+        DstOffs += RawSize;
+    }
+    *Dst = *Src;
+    Dst->Data     = Data;
+    Dst->DataSize = DstOffs;
+    Dst->Model    = NULL;
+    return Data;
+}
+
+//! Decode a full stream from memory, nPasses times, keeping the best time
+//! NOTE: The decoder is created fresh for each pass, but its creation
+//! is not timed (nor is transform planning, which happens only once).
+//! NOTE: Entropy-coded blocks are decoded one at a time into a small
+//! buffer, as a player would, so that their cost is included.
+static int Bench_Decode(const struct BenchStream_t *Stream, const struct BenchConfig_t *Config, int nPasses, struct BenchResult_t *Result)
+{
+    int Pass;
+    struct ULC_DecoderState_t Decoder;
+    Result->Seconds  = -1.0;
+    Result->Cycles   = 0;
+    Result->nSamples = 0;
+    for(Pass=0; Pass<nPasses; Pass++)
+    {
+        Decoder.nChan        = Stream->Header.nChan;
+        Decoder.BlockSize    = Stream->Header.BlockSize;
+        Decoder.RateHz       = Stream->Header.RateHz;
+        Decoder.OutputRateHz = Config->OutputRateHz;
+        Decoder.OutputFormat = Config->OutputFormat;
+        Decoder.Flags        = Config->Flags;
+        Decoder.LongTermPrediction = (Stream->Header.Profile & HEADER_PROFILE_LTP) != 0;
+        Decoder.ScratchBuffer      = NULL;
+        if(ULC_DecoderState_Init(&Decoder) <= 0) return -1;
+
+        //! Allocate output buffer (and entropy decoding buffer)
+        int BufferSize = Decoder.BlockSize;
+        int RawBufferSize = Stream->Model ? (int)Stream->Header.MaxRawBlockSize : 0;
+        if(Decoder.MaxOutputSize > BufferSize) BufferSize = Decoder.MaxOutputSize;
+        char *AllocBuffer = malloc(BUFFER_ALIGNMENT-1 + sizeof(float)*BufferSize*Decoder.nChan + RawBufferSize);
+        if(!AllocBuffer)
+        {
+            ULC_DecoderState_Destroy(&Decoder);
+            return -1;
+        }
+        float   *DecodeBuffer = (float*)(AllocBuffer + (-(uintptr_t)AllocBuffer % BUFFER_ALIGNMENT));
+        uint8_t *RawBuffer    = (uint8_t*)(DecodeBuffer + BufferSize*Decoder.nChan);
+
+        //! Decode all blocks
+        uint32_t Blk;
+        uint64_t nSamples = 0;
+        const uint8_t *Src = Stream->Data, *SrcEnd = Stream->Data + Stream->DataSize;
+        double   t0 = Bench_GetTime();
+        uint64_t c0 = Bench_GetCycles();
+        for(Blk=0; Blk<Stream->Header.nBlocks; Blk++)
+        {
+            int Size;
+            if(Stream->Model)
+            {
+                int RawSize;
+                Size = ULC_Entropy_DecodeBlock(Stream->Model, RawBuffer, RawBufferSize, &RawSize, Src, SrcEnd - Src);
+                if(Size) ULC_DecodeBlock(&Decoder, DecodeBuffer, RawBuffer);
+            }
+            else Size = (ULC_DecodeBlock(&Decoder, DecodeBuffer, Src) + 7) / 8u;
+            if(!Size) break;
+            Src      += Size;
+            nSamples += Decoder.nOutputSamples;
+        }
+        double   t = Bench_GetTime() - t0;
+        uint64_t c = Bench_GetCycles() - c0;
+
+        free(AllocBuffer);
+        ULC_DecoderState_Destroy(&Decoder);
+        if(Blk != Stream->Header.nBlocks) return -1;
+        if(Result->Seconds < 0.0 || t < Result->Seconds) Result->Seconds = t, Result->Cycles = c;
+        Result->nSamples = nSamples;
+    }
+    return 1;
+}
+
+//! Print a result row
+static void Bench_PrintResult(const struct BenchStream_t *Stream, const struct BenchConfig_t *Config, const struct BenchResult_t *Result)
+{
+    double Duration = (double)Stream->Header.nBlocks * Stream->Header.BlockSize / Stream->Header.RateHz;
+    printf(
+        "%-24s %10.3f ms %10.2f us/block %10.1f X rt",
+        Config->Name,
+        Result->Seconds * 1.0e3,
+        Result->Seconds * 1.0e6 / Stream->Header.nBlocks,
+        Duration / Result->Seconds
+    );
+    if(Result->Cycles) printf(" %10.0f cycles/block", (double)Result->Cycles / Stream->Header.nBlocks);
+    printf("\n");
+}
+
+//! Low-power decoder presets
+//! NOTE: ULC_DECODER_FLAG_COARSE_SUBBLOCKS is not a preset, as it
+//! makes decoding slower with planned transforms (see ulcdecoder.h).
+static const struct { const char *Name; int Flags; } Bench_Presets[] =
+{
+    {"LowPower:NoNoise",  ULC_DECODER_FLAG_NO_NOISE_FILL},
+    {"LowPower:HalfRate", ULC_DECODER_FLAG_HALF_RATE},
+    {"LowPower:All",      ULC_DECODER_FLAG_NO_NOISE_FILL | ULC_DECODER_FLAG_HALF_RATE},
+};
+#define BENCH_NPRESETS (int)(sizeof(Bench_Presets) / sizeof(Bench_Presets[0]))
+
+//! Corpus totals (entropy-coded streams only)
+struct BenchTotals_t
+{
+    int    nStreams;
+    double PlainBytes,   CodedBytes;
+    double PlainSeconds, CodedSeconds;
+};
+
+//! Run all benchmarks on a file
+static int Bench_RunFile(const char *Filename, int OutputRateHz, int OutputFormat, int Presets, int nPasses, struct BenchTotals_t *Totals)
+{
+    int Result = -1;
+    struct BenchStream_t Stream, PlainStream;
+    struct ULC_EntropyModel_t Model;
+    uint8_t *StreamData, *PlainData = NULL;
+
+    //! Load stream, and undo entropy coding if needed
+    StreamData = Bench_LoadStream(Filename, &Stream, &Model);
+    if(!StreamData) return -1;
+    PlainStream = Stream;
+    if(Stream.Model)
+    {
+        PlainData = Bench_UnpackStream(&Stream, &PlainStream);
+        if(!PlainData)
+        {
+            printf("ERROR: Corrupted stream (%s).\n", Filename);
+            goto Exit;
+        }
+    }
+
+    //! Set up benchmarks
+    struct BenchConfig_t Configs[3 + BENCH_NPRESETS];
+    struct BenchResult_t Results[3 + BENCH_NPRESETS];
+    const struct BenchStream_t *Streams[3 + BENCH_NPRESETS];
+    int i, nConfigs = 0, EntropyIdx = -1, ResampleIdx = -1, PresetIdx = -1;
+    Streams[nConfigs]   = &PlainStream;
+    Configs[nConfigs++] = (struct BenchConfig_t){.Name = "Decode", .OutputRateHz = 0, .OutputFormat = ULC_DECODER_OUTPUT_FLOAT32};
+    if(Stream.Model)
+    {
+        Streams[EntropyIdx = nConfigs] = &Stream;
+        Configs[nConfigs++] = (struct BenchConfig_t){.Name = "Decode+Entropy", .OutputRateHz = 0, .OutputFormat = ULC_DECODER_OUTPUT_FLOAT32};
+    }
+    if(OutputRateHz)
+    {
+        Streams[ResampleIdx = nConfigs] = &PlainStream;
+        Configs[nConfigs++] = (struct BenchConfig_t){.Name = "Decode+Resample", .OutputRateHz = OutputRateHz, .OutputFormat = OutputFormat};
+    }
+    if(Presets)
+    {
+        PresetIdx = nConfigs;
+        for(i=0; i<BENCH_NPRESETS; i++)
+        {
+            Streams[nConfigs]   = &PlainStream;
+            Configs[nConfigs++] = (struct BenchConfig_t){.Name = Bench_Presets[i].Name, .OutputRateHz = 0, .OutputFormat = ULC_DECODER_OUTPUT_FLOAT32, .Flags = Bench_Presets[i].Flags};
+        }
+    }
+
+    //! Run benchmarks
+    printf(
+        "%s: %u blocks of %u samples, %u channels, %uHz\n",
+        Filename, Stream.Header.nBlocks, Stream.Header.BlockSize, Stream.Header.nChan, Stream.Header.RateHz
+    );
+    for(i=0; i<nConfigs; i++)
+    {
+        if(Bench_Decode(Streams[i], &Configs[i], nPasses, &Results[i]) < 0)
+        {
+            printf("ERROR: Decoding failed (%s).\n", Configs[i].Name);
+            goto Exit;
+        }
+        Bench_PrintResult(Streams[i], &Configs[i], &Results[i]);
+    }
+    if(EntropyIdx != -1)
+    {
+        //! NOTE: The coded size includes the entropy model.
+        double PlainBytes = PlainStream.DataSize;
+        double CodedBytes = Stream.DataSize + Stream.ModelSize;
+        printf(
+            "Entropy coding: %.2fKiB -> %.2fKiB (%+.2f%%), decoding %+.2f us/block (%+.1f%%)\n",
+            PlainBytes / 1024.0, CodedBytes / 1024.0, (CodedBytes / PlainBytes - 1.0) * 100.0,
+            (Results[EntropyIdx].Seconds - Results[0].Seconds) * 1.0e6 / Stream.Header.nBlocks,
+            (Results[EntropyIdx].Seconds / Results[0].Seconds - 1.0) * 100.0
+        );
+        Totals->nStreams++;
+        Totals->PlainBytes   += PlainBytes;
+        Totals->CodedBytes   += CodedBytes;
+        Totals->PlainSeconds += Results[0].Seconds;
+        Totals->CodedSeconds += Results[EntropyIdx].Seconds;
+    }
+    if(ResampleIdx != -1)
+    {
+        printf(
+            "Resampling to %dHz (%s): %+.2f us/block (%+.1f%%)\n",
+            OutputRateHz, (OutputFormat == ULC_DECODER_OUTPUT_PCM16) ? "PCM16" : "FLOAT32",
+            (Results[ResampleIdx].Seconds - Results[0].Seconds) * 1.0e6 / Stream.Header.nBlocks,
+            (Results[ResampleIdx].Seconds / Results[0].Seconds - 1.0) * 100.0
+        );
+    }
+    if(PresetIdx != -1)
+    {
+        //! NOTE: Savings are relative to a full decode of the plain stream.
+        for(i=PresetIdx; i<PresetIdx+BENCH_NPRESETS; i++) printf(
+            "%s: saves %.2f us/block (%.1f%%)\n",
+            Configs[i].Name,
+            (Results[0].Seconds - Results[i].Seconds) * 1.0e6 / Stream.Header.nBlocks,
+            (1.0 - Results[i].Seconds / Results[0].Seconds) * 100.0
+        );
+    }
+    Result = 1;
+
+    //! Exit points
+Exit:
+    free(PlainData);
+    free(StreamData);
+    return Result;
+}
+
+/**************************************/
+
+int main(int argc, const char *argv[])
+{
+    int ExitCode = 0;
+
+    //! Check arguments
+    if(argc < 2)
+    {
+        printf(
+            "ulcBenchTool - Ultra-Low Complexity Codec Benchmark Tool\n"
+            "Usage: ulcbenchtool Input.ulc [Input2.ulc ...] [Opt]\n"
+            "Options:\n"
+            " -rate:48000   - Also benchmark decoding with resampling to this rate.\n"
+            " -format:PCM16 - Output format when resampling (PCM16, FLOAT32).\n"
+            " -passes:5     - Number of passes per benchmark (best time is kept).\n"
+            " -presets      - Also benchmark the low-power decoder presets.\n"
+            " -wisdom:File  - Load transform planning from File.\n"
+            "Entropy-coded inputs are also benchmarked against their plain stream,\n"
+            "and totals are shown when passing several files.\n"
+        );
+        return 1;
+    }
+
+    //! Parse arguments
+    int OutputRateHz = 0;
+    int OutputFormat = ULC_DECODER_OUTPUT_FLOAT32;
+    int Presets = 0;
+    int nPasses = 5;
+    int nInputs = 0;
+    const char *WisdomFile = NULL;
+    {
+        int n;
+        for(n=1; n<argc; n++)
+        {
+            if(argv[n][0] != '-')
+            {
+                nInputs++;
+            }
+
+            else if(!memcmp(argv[n], "-rate:", 6))
+            {
+                OutputRateHz = atoi(argv[n] + 6);
+                if(OutputRateHz < 1)
+                {
+                    printf("ERROR: Invalid output rate (%s).\n", argv[n] + 6);
+                    ExitCode = -1;
+                    goto Exit_BadArgs;
+                }
+            }
+
+            else if(!memcmp(argv[n], "-format:", 8))
+            {
+                const char *FmtStr = argv[n] + 8;
+                if(!strcmp(FmtStr, "PCM16") || !strcmp(FmtStr, "pcm16"))
+                    OutputFormat = ULC_DECODER_OUTPUT_PCM16;
+                else if(!strcmp(FmtStr, "FLOAT32") || !strcmp(FmtStr, "float32"))
+                    OutputFormat = ULC_DECODER_OUTPUT_FLOAT32;
+                else
+                {
+                    printf("ERROR: Invalid output format (%s).\n", FmtStr);
+                    ExitCode = -1;
+                    goto Exit_BadArgs;
+                }
+            }
+
+            else if(!memcmp(argv[n], "-passes:", 8))
+            {
+                nPasses = atoi(argv[n] + 8);
+                if(nPasses < 1)
+                {
+                    printf("ERROR: Invalid number of passes (%s).\n", argv[n] + 8);
+                    ExitCode = -1;
+                    goto Exit_BadArgs;
+                }
+            }
+
+            else if(!strcmp(argv[n], "-presets"))
+            {
+                Presets = 1;
+            }
+
+            else if(!memcmp(argv[n], "-wisdom:", 8))
+            {
+                WisdomFile = argv[n] + 8;
+            }
+
+            else printf("WARNING: Ignoring unknown argument (%s).\n", argv[n]);
+        }
+    }
+    if(!nInputs)
+    {
+        printf("ERROR: No input files.\n");
+        ExitCode = -1;
+        goto Exit_BadArgs;
+    }
+    if(WisdomFile) Fourier_Plan_LoadWisdom(WisdomFile);
+
+    //! Run benchmarks on all inputs
+    {
+        int n;
+        struct BenchTotals_t Totals = {0};
+        for(n=1; n<argc; n++)
+        {
+            if(argv[n][0] == '-') continue;
+            if(Bench_RunFile(argv[n], OutputRateHz, OutputFormat, Presets, nPasses, &Totals) < 0)
+            {
+                ExitCode = -1;
+                goto Exit_FailBench;
+            }
+        }
+        if(nInputs > 1 && Totals.nStreams)
+        {
+            printf(
+                "Corpus (%d entropy-coded streams): %.2fKiB -> %.2fKiB (%+.2f%%), decoding %+.1f%%\n",
+                Totals.nStreams,
+                Totals.PlainBytes / 1024.0, Totals.CodedBytes / 1024.0, (Totals.CodedBytes / Totals.PlainBytes - 1.0) * 100.0,
+                (Totals.CodedSeconds / Totals.PlainSeconds - 1.0) * 100.0
+            );
+        }
+    }
+
+    //! Exit points
+Exit_FailBench:
+Exit_BadArgs:
+    return ExitCode;
+}
+
+/**************************************/
+//! EOF
+/**************************************/
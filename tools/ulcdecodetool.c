@@ -7,8 +7,11 @@
 #include <string.h>
 #include <time.h>
 /**************************************/
+#include "fourier.h"
 #include "ulc_helper.h"
+#include "ulc_seekindex.h"
 #include "ulcdecoder.h"
+#include "ulctrace.h"
 #include "wavio.h"
 /**************************************/
 
@@ -28,6 +31,7 @@ int main(int argc, const char *argv[])
     struct WAV_State_t FileOut;
     struct ULC_DecoderState_t Decoder;
     struct FileHeader_t FileHeader;
+    struct ULC_EntropyModel_t EntropyModel;
 
     //! Check arguments
     if(argc < 3)
@@ -37,12 +41,32 @@ int main(int argc, const char *argv[])
             "Usage: ulcdecodetool Input.ulc Output.wav [Opt]\n"
             "Options:\n"
             " -format:PCM16 - Set output format (PCM8, PCM16, PCM24, FLOAT32).\n"
+            " -rate:48000   - Resample output to this rate (default: source rate).\n"
+            " -wisdom:File  - Load/save transform planning from/to File.\n"
+            " -loops:0      - Play looped streams through this many more times.\n"
+            " -seek:X[,Y]   - Only decode samples X..Y (default: end), using the\n"
+            "                 seek index given by -index:File (see ulcseektool).\n"
+            " -lowpower:X   - Trade quality for decoding speed, X is a comma-separated\n"
+            "                 list of: nonoise (skip noise fill), coarse (decode\n"
+            "                 transients without subblock resolution; only saves\n"
+            "                 per-transform overhead, and is usually slower),\n"
+            "                 halfrate (synthesize at half the coded rate).\n"
+            " -f16lap       - Store the lapping buffer as float16 (saves memory).\n"
+            " -trace:File   - Write a per-block timing trace to File (TRACING=1 builds).\n"
         );
         return 1;
     }
 
     //! Parse arguments
     int FormatType = FORMAT_PCM16;
+    int OutputRateHz = 0;
+    const char *WisdomFile = NULL;
+    const char *TraceFile = NULL;
+    int nLoops = 0;
+    int DecoderFlags = 0;
+    int Seeking = 0;
+    const char *IndexFile = NULL;
+    unsigned long long SeekStart = 0, SeekEnd = UINT64_MAX;
     {
         int n;
         for(n=3; n<argc; n++)
@@ -66,6 +90,85 @@ int main(int argc, const char *argv[])
                 }
             }
 
+            else if(!memcmp(argv[n], "-rate:", 6))
+            {
+                OutputRateHz = atoi(argv[n] + 6);
+                if(OutputRateHz < 1)
+                {
+                    printf("ERROR: Invalid output rate (%s).\n", argv[n] + 6);
+                    ExitCode = -1;
+                    goto Exit_BadArgs;
+                }
+            }
+
+            else if(!memcmp(argv[n], "-wisdom:", 8))
+            {
+                WisdomFile = argv[n] + 8;
+            }
+
+            else if(!memcmp(argv[n], "-trace:", 7))
+            {
+                TraceFile = argv[n] + 7;
+#if !ULC_TRACING
+                printf("WARNING: Built without tracing; ignoring -trace (see Makefile).\n");
+#endif
+            }
+
+            else if(!memcmp(argv[n], "-lowpower:", 10))
+            {
+                const char *Opt = argv[n] + 10;
+                while(*Opt)
+                {
+                    size_t Len = strcspn(Opt, ",");
+                    if(Len == 7 && !memcmp(Opt, "nonoise", 7))
+                        DecoderFlags |= ULC_DECODER_FLAG_NO_NOISE_FILL;
+                    else if(Len == 6 && !memcmp(Opt, "coarse", 6))
+                        DecoderFlags |= ULC_DECODER_FLAG_COARSE_SUBBLOCKS;
+                    else if(Len == 8 && !memcmp(Opt, "halfrate", 8))
+                        DecoderFlags |= ULC_DECODER_FLAG_HALF_RATE;
+                    else
+                    {
+                        printf("ERROR: Invalid low-power option (%.*s).\n", (int)Len, Opt);
+                        ExitCode = -1;
+                        goto Exit_BadArgs;
+                    }
+                    Opt += Len;
+                    if(*Opt) Opt++;
+                }
+            }
+
+            else if(!strcmp(argv[n], "-f16lap"))
+            {
+                DecoderFlags |= ULC_DECODER_FLAG_F16_LAP;
+            }
+
+            else if(!memcmp(argv[n], "-loops:", 7))
+            {
+                nLoops = atoi(argv[n] + 7);
+                if(nLoops < 0)
+                {
+                    printf("ERROR: Invalid loop count (%s).\n", argv[n] + 7);
+                    ExitCode = -1;
+                    goto Exit_BadArgs;
+                }
+            }
+
+            else if(!memcmp(argv[n], "-seek:", 6))
+            {
+                if(sscanf(argv[n] + 6, "%llu,%llu", &SeekStart, &SeekEnd) < 1 || SeekEnd <= SeekStart)
+                {
+                    printf("ERROR: Invalid seek range (%s).\n", argv[n] + 6);
+                    ExitCode = -1;
+                    goto Exit_BadArgs;
+                }
+                Seeking = 1;
+            }
+
+            else if(!memcmp(argv[n], "-index:", 7))
+            {
+                IndexFile = argv[n] + 7;
+            }
+
             else printf("WARNING: Ignoring unknown argument (%s).\n", argv[n]);
         }
     }
@@ -78,37 +181,140 @@ int main(int argc, const char *argv[])
         ExitCode = -1;
         goto Exit_FailOpenInFile;
     }
-    if(fread(&FileHeader, sizeof(FileHeader), 1, FileIn) != 1 || FileHeader.Magic != HEADER_MAGIC)
+    if(FileHeader_Read(&FileHeader, FileIn) < 0)
     {
         printf("ERROR: Input file is not a valid ULC container.\n");
         ExitCode = -1;
         goto Exit_FailVerifyInFile;
     }
 
+    //! Read the entropy model, and skip over it
+    int EntropyCoded = (FileHeader.Magic == HEADER_MAGIC_ENTROPY);
+    size_t StreamOffs = FileHeader.StreamOffs;
+    if(EntropyCoded)
+    {
+        int ModelSize = FileHeader_ReadEntropyModel(&FileHeader, &EntropyModel, FileIn);
+        if(ModelSize < 0)
+        {
+            printf("ERROR: Invalid entropy model.\n");
+            ExitCode = -1;
+            goto Exit_FailVerifyInFile;
+        }
+        StreamOffs += ModelSize;
+    }
+
+    if(nLoops && !FileHeader.LoopBlock)
+    {
+        printf("WARNING: Stream has no loop; ignoring loop count.\n");
+        nLoops = 0;
+    }
+
+    //! Plan the blocks to decode when seeking
+    //! NOTE: Only the index page(s) covering the range are read, as a
+    //! player streaming from remote storage would (see ulc_seekindex.h).
+    struct SeekPlan_t SeekPlan;
+    uint64_t SeekEndSample = 0;
+    if(Seeking)
+    {
+        struct SeekIndexHeader_t Index;
+        struct SeekPlan_Range_t PageRange, StreamRange;
+        FILE *FileIndex = IndexFile ? fopen(IndexFile, "rb") : NULL;
+        if(!FileIndex)
+        {
+            printf("ERROR: Seeking needs a valid seek index (-index:File).\n");
+            ExitCode = -1;
+            goto Exit_FailVerifyInFile;
+        }
+        fseek(FileIn, 0, SEEK_END);
+        int Ok = SeekIndex_ReadHeader(&Index, FileIndex, &FileHeader, ftell(FileIn)) > 0 &&
+                 SeekPlan_Init(&SeekPlan, &PageRange, &FileHeader, &Index, SeekStart, SeekEnd, 0) > 0;
+        if(Ok)
+        {
+            size_t PageSize = PageRange.End - PageRange.Start;
+            uint32_t *Entries = malloc(PageSize);
+            fseek(FileIndex, PageRange.Start, SEEK_SET);
+            Ok = Entries && fread(Entries, 1, PageSize, FileIndex) == PageSize && SeekPlan_Finish(&SeekPlan, &StreamRange, &Index, Entries) > 0;
+            free(Entries);
+        }
+        fclose(FileIndex);
+        if(!Ok)
+        {
+            printf("ERROR: Invalid seek index, or seek range outside of the stream.\n");
+            ExitCode = -1;
+            goto Exit_FailVerifyInFile;
+        }
+        StreamOffs    = StreamRange.Start;
+        SeekEndSample = (SeekEnd < (uint64_t)(FileHeader.nBlocks-2)*FileHeader.BlockSize) ? SeekEnd : (uint64_t)(FileHeader.nBlocks-2)*FileHeader.BlockSize;
+        if(nLoops)
+        {
+            printf("WARNING: Loops are not played when seeking; ignoring loop count.\n");
+            nLoops = 0;
+        }
+    }
+
     //! Define the stream buffer size
+    //! Streams coded with a bit reservoir give the exact size needed.
+    //! When entropy coding, we also need space for the decoded block.
     int StreamBufferSize = (16*1024);
+    int RawBufferSize = EntropyCoded ? (int)FileHeader.MaxRawBlockSize : 0;
     if((int)FileHeader.MaxBlockSize > StreamBufferSize) StreamBufferSize = FileHeader.MaxBlockSize;
+    if(FileHeader.StreamBufferSize) StreamBufferSize = FileHeader.StreamBufferSize;
 
-    //! Allocate decoding buffer and stream buffer
-    AllocBuffer = malloc(BUFFER_ALIGNMENT-1 + sizeof(float)*2*FileHeader.BlockSize*FileHeader.nChan + StreamBufferSize);
-    if(!AllocBuffer)
+    //! Fine gain that was left to the player (see ulcgaintool)
+    float PlaybackGain = FileHeader_PlaybackGain(&FileHeader);
+
+    //! Restore the original rate of streams that were encoded at a
+    //! lower internal rate, unless another rate was explicitly given
+    //! NOTE: Seek ranges are counted at the coded rate, so the output
+    //! must stay at this rate.
+    if(Seeking && OutputRateHz && OutputRateHz != (int)FileHeader.RateHz)
     {
-        printf("ERROR: Couldn't allocate decoding buffer.\n");
+        printf("ERROR: Seeking can't be combined with resampling.\n");
         ExitCode = -1;
-        goto Exit_FailCreateAllocBuffer;
+        goto Exit_FailVerifyInFile;
     }
-    float   *DecodeBuffer = (float  *)(AllocBuffer + (-(uintptr_t)AllocBuffer % BUFFER_ALIGNMENT));
-    uint8_t *StreamBuffer = (uint8_t*)(DecodeBuffer + FileHeader.BlockSize*FileHeader.nChan);
+    if(OutputRateHz == 0 && !Seeking) OutputRateHz = FileHeader.SourceRateHz;
+
+    //! Load transform plans before creating the decoder
+    if(WisdomFile) Fourier_Plan_LoadWisdom(WisdomFile);
 
     //! Create decoder
-    Decoder.nChan      = FileHeader.nChan;
-    Decoder.BlockSize  = FileHeader.BlockSize;
+    Decoder.nChan        = FileHeader.nChan;
+    Decoder.BlockSize    = FileHeader.BlockSize;
+    Decoder.RateHz       = FileHeader.RateHz;
+    Decoder.OutputRateHz = OutputRateHz;
+    Decoder.OutputFormat = ULC_DECODER_OUTPUT_FLOAT32;
+    Decoder.Flags        = DecoderFlags;
+    Decoder.LongTermPrediction = (FileHeader.Profile & HEADER_PROFILE_LTP) != 0;
+    Decoder.ScratchBuffer      = NULL;
     if(ULC_DecoderState_Init(&Decoder) <= 0)
     {
         printf("ERROR: Unable to initialize decoder.\n");
         ExitCode = -1;
         goto Exit_FailCreateDecoder;
     }
+    if(WisdomFile && Fourier_Plan_SaveWisdom(WisdomFile) < 0)
+    {
+        printf("WARNING: Unable to save transform plans (%s).\n", WisdomFile);
+    }
+    if(OutputRateHz == 0) OutputRateHz = FileHeader.RateHz >> ((DecoderFlags & ULC_DECODER_FLAG_HALF_RATE) ? 1 : 0);
+
+    //! Allocate decoding buffer and stream buffer
+    //! NOTE: The decoding buffer must hold a full block of (planar)
+    //! float data, or a full block of resampled output data.
+    int DecodeBufferSize = FileHeader.BlockSize;
+    if(Decoder.MaxOutputSize > DecodeBufferSize) DecodeBufferSize = Decoder.MaxOutputSize;
+    DecodeBufferSize = (DecodeBufferSize * FileHeader.nChan + (BUFFER_ALIGNMENT/sizeof(float)-1)) &~ (BUFFER_ALIGNMENT/sizeof(float)-1);
+    AllocBuffer = malloc(BUFFER_ALIGNMENT-1 + sizeof(float)*DecodeBufferSize + StreamBufferSize + RawBufferSize);
+    if(!AllocBuffer)
+    {
+        printf("ERROR: Couldn't allocate decoding buffer.\n");
+        ExitCode = -1;
+        goto Exit_FailCreateAllocBuffer;
+    }
+    float   *DecodeBuffer = (float  *)(AllocBuffer + (-(uintptr_t)AllocBuffer % BUFFER_ALIGNMENT));
+    uint8_t *StreamBuffer = (uint8_t*)(DecodeBuffer + DecodeBufferSize);
+    uint8_t *RawBuffer    = StreamBuffer + StreamBufferSize;
 
     //! Create output file
     {
@@ -131,8 +337,8 @@ int main(int argc, const char *argv[])
         struct WAVE_fmt_t fmt;
         fmt.wFormatTag      = (FormatType == FORMAT_FLOAT32) ? WAVE_FORMAT_IEEE_FLOAT : WAVE_FORMAT_PCM;
         fmt.nChannels       = FileHeader.nChan;
-        fmt.nSamplesPerSec  = FileHeader.RateHz;
-        fmt.nAvgBytesPerSec = BytesPerSmp * FileHeader.nChan * FileHeader.RateHz;
+        fmt.nSamplesPerSec  = OutputRateHz;
+        fmt.nAvgBytesPerSec = BytesPerSmp * FileHeader.nChan * OutputRateHz;
         fmt.nBlockAlign     = BytesPerSmp * FileHeader.nChan;
         fmt.wBitsPerSample  = BytesPerSmp * 8;
         int Error = WAV_OpenW(&FileOut, argv[2], &fmt);
@@ -149,15 +355,17 @@ int main(int argc, const char *argv[])
         const clock_t DISPLAY_UPDATE_RATE = (clock_t)(CLOCKS_PER_SEC * 0.5); //! Update every 0.5 seconds
 
         //! Pre-fill the streaming buffer
-        fseek(FileIn, FileHeader.StreamOffs, SEEK_SET);
+        fseek(FileIn, StreamOffs, SEEK_SET);
         fread(StreamBuffer, StreamBufferSize, 1, FileIn);
 
         //! Process blocks
         int      BlockSize   = FileHeader.BlockSize;
         uint32_t Blk, nBlk = FileHeader.nBlocks;
-        size_t BlkLastUpdate = 0;
+        uint32_t FirstBlk = 0;
+        if(Seeking) FirstBlk = SeekPlan.FirstBlk, nBlk = SeekPlan.LastBlk+1;
+        size_t BlkLastUpdate = FirstBlk;
         clock_t LastUpdateTime = clock() - DISPLAY_UPDATE_RATE;
-        for(Blk=0; Blk<nBlk; Blk++)
+        for(Blk=FirstBlk; Blk<nBlk; Blk++)
         {
             //! Show progress
             //! NOTE: Take difference and use unsigned comparison to
@@ -177,7 +385,16 @@ int main(int argc, const char *argv[])
             }
 
             //! Decode block
-            int Size = (ULC_DecodeBlock(&Decoder, DecodeBuffer, StreamBuffer) + 7) / 8u;
+            //! Entropy-coded blocks must decode back to exactly the
+            //! number of bytes stored in their size prefix.
+            int Size;
+            if(EntropyCoded)
+            {
+                int RawSize;
+                Size = ULC_Entropy_DecodeBlock(&EntropyModel, RawBuffer, RawBufferSize, &RawSize, StreamBuffer, StreamBufferSize);
+                if(Size && (ULC_DecodeBlock(&Decoder, DecodeBuffer, RawBuffer) + 7) / 8u != (unsigned)RawSize) Size = 0;
+            }
+            else Size = (ULC_DecodeBlock(&Decoder, DecodeBuffer, StreamBuffer) + 7) / 8u;
             if(!Size)
             {
                 printf("ERROR: Corrupted stream.\n");
@@ -185,24 +402,61 @@ int main(int argc, const char *argv[])
                 goto Exit_FailCorruptStream;
             }
 
-            //! Write samples
-            WAV_WriteFromFloat(&FileOut, DecodeBuffer, BlockSize);
+            //! Apply any residual gain and write samples
+            if(PlaybackGain != 1.0f)
+            {
+                size_t n;
+                for(n=0; n<(size_t)Decoder.nOutputSamples*FileHeader.nChan; n++) DecodeBuffer[n] *= PlaybackGain;
+            }
+            if(Seeking)
+            {
+                //! Drop the preroll, and trim the output to the seek range
+                //! NOTE: Without resampling, each block outputs BlockSize
+                //! samples (halved for ULC_DECODER_FLAG_HALF_RATE).
+                int Shift = (DecoderFlags & ULC_DECODER_FLAG_HALF_RATE) ? 1 : 0;
+                int Start = (Blk == SeekPlan.OutputBlk) ? (int)SeekPlan.SkipSamples : 0;
+                int End   = (Blk == SeekPlan.LastBlk) ? (int)((SeekEndSample-1) % BlockSize + 1) : BlockSize;
+                Start >>= Shift, End >>= Shift;
+                if(Blk >= SeekPlan.OutputBlk && End > Start)
+                {
+                    WAV_WriteFromFloat(&FileOut, DecodeBuffer + Start*FileHeader.nChan, End - Start);
+                }
+            }
+            else WAV_WriteFromFloat(&FileOut, DecodeBuffer, Decoder.nOutputSamples);
 
             //! Slide stream buffer
             memcpy(StreamBuffer, StreamBuffer+Size, StreamBufferSize-Size);
             fread(StreamBuffer + StreamBufferSize-Size, Size, 1, FileIn);
+
+            //! Jump back to the loop block after the last block
+            //! NOTE: No preroll is needed, as the last block was coded
+            //! to lap directly into the loop block.
+            if(Blk == nBlk-1 && nLoops)
+            {
+                nLoops--;
+                BlkLastUpdate -= Blk+1 - FileHeader.LoopBlock;
+                Blk = FileHeader.LoopBlock-1;
+                fseek(FileIn, FileHeader.LoopOffs, SEEK_SET);
+                fread(StreamBuffer, StreamBufferSize, 1, FileIn);
+            }
         }
     }
 
+    //! Write the trace of all blocks
+    if(TraceFile && ULC_Trace_Dump(TraceFile) < 0)
+    {
+        printf("WARNING: Unable to write trace (%s).\n", TraceFile);
+    }
+
     //! Exit points
     printf("\nOk\n");
 Exit_FailCorruptStream:
     WAV_Close(&FileOut);
 Exit_FailCreateOutFile:
-    ULC_DecoderState_Destroy(&Decoder);
-Exit_FailCreateDecoder:
     free(AllocBuffer);
 Exit_FailCreateAllocBuffer:
+    ULC_DecoderState_Destroy(&Decoder);
+Exit_FailCreateDecoder:
 Exit_FailVerifyInFile:
     fclose(FileIn);
 Exit_FailOpenInFile:
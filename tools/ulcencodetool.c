@@ -7,19 +7,91 @@
 #include <string.h>
 #include <time.h>
 /**************************************/
+#include "fourier.h"
+#include "ulc_cache.h"
 #include "ulc_helper.h"
 #include "ulcencoder.h"
+#include "ulcresampler.h"
+#include "ulctrace.h"
 #include "wavio.h"
 /**************************************/
 
+//! Loop points
+//! The input is led in with Pad samples of silence, so that the loop
+//! starts on a block boundary (its length is a whole number of blocks,
+//! so that it also ends on one). Past the loop end, reading carries on
+//! from the loop start, so that the last block laps into the loop.
+struct LoopInfo_t
+{
+    unsigned int Start, End, Pad;
+};
+
+//! Number of blocks to warm up the window analysis for the loop start
+#define LOOP_PROBE_BLOCKS 8
+
+//! Read block Blk of a looped input
+static void ReadLoopBlock(struct WAV_State_t *File, float *Dst, uint64_t Blk, int BlockSize, const struct LoopInfo_t *Loop)
+{
+    int nChan = File->fmt->nChannels;
+    int nPad  = 0;
+    uint64_t Pos = Blk*BlockSize;
+    uint64_t End = (uint64_t)Loop->End + Loop->Pad;
+    if(Pos >= End) Pos = Loop->Start + Loop->Pad + (Pos - End) % (Loop->End - Loop->Start);
+    if(Pos < Loop->Pad)
+    {
+        nPad = Loop->Pad - Pos;
+        memset(Dst, 0, sizeof(float)*nPad*nChan);
+        File->SamplePosition = 0;
+    }
+    else File->SamplePosition = Pos - Loop->Pad;
+    WAV_ReadAsFloat(File, Dst + nPad*nChan, BlockSize - nPad);
+}
+
+//! Get the window decisions for blocks Blk and Blk+1 of a looped input
+//! The window analysis depends on the blocks before, so this warms up
+//! a separate encoder on the blocks leading up to Blk.
+//! Returns 1 on success, or -1 if the encoder can't be created.
+static int GetLoopWindowCtrl(int *Ctrl, struct WAV_State_t *File, float *Buf, uint64_t Blk, const struct ULC_EncoderState_t *Encoder, const struct LoopInfo_t *Loop)
+{
+    struct ULC_EncoderState_t Probe;
+    Probe.RateHz    = Encoder->RateHz;
+    Probe.nChan     = Encoder->nChan;
+    Probe.BlockSize = Encoder->BlockSize;
+    Probe.BitReservoirSize = 0;
+    Probe.StereoSwitching  = 0;
+    Probe.ParametricStereo = 0;
+    Probe.NoiseCoupling    = 0;
+    Probe.ChanGroupSize    = 0;
+    Probe.ABRLookahead     = 0;
+    Probe.LongTermPrediction = 0;
+    if(ULC_EncoderState_Init(&Probe) <= 0) return -1;
+
+    //! Window analysis does not depend on the coding rate, so
+    //! just use the fastest mode
+    uint64_t b = (Blk > LOOP_PROBE_BLOCKS) ? (Blk - LOOP_PROBE_BLOCKS) : 0;
+    for(; b<=Blk+1; b++)
+    {
+        ReadLoopBlock(File, Buf, b, Probe.BlockSize, Loop);
+        ULC_EncodeBlock_VBR(&Probe, Buf, NULL, 50.0f);
+        if(b >= Blk) Ctrl[b-Blk] = Probe.NextWindowCtrl;
+    }
+    ULC_EncoderState_Destroy(&Probe);
+    return 1;
+}
+
+/**************************************/
+
 int main(int argc, const char *argv[])
 {
     int   ExitCode = 0;
     FILE *FileOut;
     char *AllocBuffer;
+    uint8_t *RawStream = NULL;
     struct WAV_State_t FileIn;
     struct ULC_EncoderState_t Encoder;
+    struct ULC_ResamplerState_t Resampler;
     struct FileHeader_t FileHeader;
+    struct EncodeCache_t Cache;
 
     //! Check arguments
     if(argc < 4)
@@ -30,7 +102,20 @@ int main(int argc, const char *argv[])
             " ulcencodetool Input.wav Output.ulc RateKbps[,AvgComplexity]|-Quality [Opt]\n"
             "Options:\n"
             " -blocksize:2048 - Set number of coefficients per block (must be a power of 2).\n"
-            "Passing AvgComplexity uses ABR mode.\n"
+            " -internalrate:X - Downsample to X Hz before encoding (for low-rate coding).\n"
+            " -reservoir:X    - Use a bit reservoir of X bytes in CBR mode.\n"
+            " -lookahead:X    - Use ABR mode, planning bits over X blocks ahead.\n"
+            " -entropy        - Entropy-code the output (smaller, slower to decode).\n"
+            " -lrstereo       - Let channel pairs switch to L/R stereo (needs a decoder with L/R stereo).\n"
+            " -pstereo        - Use parametric stereo for channel pairs (for low rates; needs a decoder with L/R stereo).\n"
+            " -noisecoupling  - Let channel pairs share noise fill (needs a decoder with noise coupling).\n"
+            " -ltp            - Use long-term prediction (for tonal inputs; needs a decoder with LTP).\n"
+            " -chgroup:X      - Analyze channels in groups of X (even; for many-channel inputs).\n"
+            " -loop:X[,Y]     - Encode a seamless loop from sample X to Y (default: end).\n"
+            " -wisdom:File    - Load/save transform planning from/to File.\n"
+            " -cache:Dir      - Reuse/store encoded results in Dir (keyed on input and options).\n"
+            " -trace:File     - Write a per-block timing trace to File (TRACING=1 builds).\n"
+            "Passing AvgComplexity uses ABR mode (with -lookahead, it is optional).\n"
             "Passing negative RateKbps (-Quality) uses VBR mode.\n"
             "Input file must be 8-bit, 16-bit, 24-bit, 32-bit, or 32-bit float.\n"
         );
@@ -39,6 +124,21 @@ int main(int argc, const char *argv[])
 
     //! Parse arguments
     int   BlockSize = 2048;
+    int   InternalRateHz = 0;
+    int   EntropyCoding = 0;
+    int   StereoSwitching = 0;
+    int   ParametricStereo = 0;
+    int   NoiseCoupling = 0;
+    int   LongTermPrediction = 0;
+    int   ChanGroupSize = 0;
+    int   ReservoirBytes = 0;
+    int   Lookahead = 0;
+    int   Looping = 0;
+    struct LoopInfo_t Loop = {0, 0, 0};
+    int   LoopWindowCtrl[2] = {0, 0};
+    const char *WisdomFile = NULL;
+    const char *CacheDir = NULL;
+    const char *TraceFile = NULL;
     float RateKbps;
     float AvgComplexity = 0.0f;
     sscanf(argv[3], "%f,%f", &RateKbps, &AvgComplexity);
@@ -70,10 +170,141 @@ int main(int argc, const char *argv[])
                 }
             }
 
+            else if(!memcmp(argv[n], "-internalrate:", 14))
+            {
+                InternalRateHz = atoi(argv[n] + 14);
+                if(InternalRateHz < 1)
+                {
+                    printf("ERROR: Invalid internal rate (%s).\n", argv[n] + 14);
+                    ExitCode = -1;
+                    goto Exit_BadArgs;
+                }
+            }
+
+            else if(!memcmp(argv[n], "-reservoir:", 11))
+            {
+                ReservoirBytes = atoi(argv[n] + 11);
+                if(ReservoirBytes < 1 || ReservoirBytes > 0x0FFFFFFF)
+                {
+                    printf("ERROR: Invalid bit reservoir size (%s).\n", argv[n] + 11);
+                    ExitCode = -1;
+                    goto Exit_BadArgs;
+                }
+            }
+
+            else if(!memcmp(argv[n], "-lookahead:", 11))
+            {
+                Lookahead = atoi(argv[n] + 11);
+                if(Lookahead < 1 || Lookahead > 256)
+                {
+                    printf("ERROR: Invalid lookahead (%s).\n", argv[n] + 11);
+                    ExitCode = -1;
+                    goto Exit_BadArgs;
+                }
+            }
+
+            else if(!memcmp(argv[n], "-loop:", 6))
+            {
+                if(sscanf(argv[n] + 6, "%u,%u", &Loop.Start, &Loop.End) < 1)
+                {
+                    printf("ERROR: Invalid loop points (%s).\n", argv[n] + 6);
+                    ExitCode = -1;
+                    goto Exit_BadArgs;
+                }
+                Looping = 1;
+            }
+
+            else if(!strcmp(argv[n], "-entropy"))
+            {
+                EntropyCoding = 1;
+            }
+
+            else if(!strcmp(argv[n], "-lrstereo"))
+            {
+                StereoSwitching = 1;
+            }
+
+            else if(!strcmp(argv[n], "-pstereo"))
+            {
+                ParametricStereo = 1;
+            }
+
+            else if(!strcmp(argv[n], "-noisecoupling"))
+            {
+                NoiseCoupling = 1;
+            }
+
+            else if(!strcmp(argv[n], "-ltp"))
+            {
+                LongTermPrediction = 1;
+            }
+
+            else if(!memcmp(argv[n], "-chgroup:", 9))
+            {
+                ChanGroupSize = atoi(argv[n] + 9);
+                if(ChanGroupSize < 2 || (ChanGroupSize & 1))
+                {
+                    printf("ERROR: Invalid channel group size (%s; must be even).\n", argv[n] + 9);
+                    ExitCode = -1;
+                    goto Exit_BadArgs;
+                }
+            }
+
+            else if(!memcmp(argv[n], "-wisdom:", 8))
+            {
+                WisdomFile = argv[n] + 8;
+            }
+
+            else if(!memcmp(argv[n], "-trace:", 7))
+            {
+                TraceFile = argv[n] + 7;
+#if !ULC_TRACING
+                printf("WARNING: Built without tracing; ignoring -trace (see Makefile).\n");
+#endif
+            }
+
+            else if(!memcmp(argv[n], "-cache:", 7))
+            {
+                CacheDir = argv[n] + 7;
+            }
+
             else printf("WARNING: Ignoring unknown argument (%s).\n", argv[n]);
         }
     }
 
+    //! Look up the result cache
+    //! NOTE: Options that don't apply to the chosen mode are still
+    //! part of the key; this only costs an occasional cache miss.
+    if(CacheDir)
+    {
+        char Params[ENCODECACHE_PARAMS_SIZE];
+        snprintf(
+            Params, sizeof(Params), ENCODECACHE_PARAMS_FORMAT,
+            RateKbps, AvgComplexity, BlockSize, InternalRateHz, ReservoirBytes, Lookahead, EntropyCoding, StereoSwitching, ParametricStereo, NoiseCoupling, LongTermPrediction, ChanGroupSize, Looping, Loop.Start, Loop.End
+        );
+        if(!ULC_DETERMINISTIC) printf("WARNING: Cached results are only reproducible with a DETERMINISTIC=1 build.\n");
+        if(EncodeCache_Init(&Cache, CacheDir, argv[1], Params) < 0)
+        {
+            printf("WARNING: Unable to form cache key for input (%s); not caching.\n", argv[1]);
+            CacheDir = NULL;
+        }
+        else
+        {
+            int Result = EncodeCache_Fetch(&Cache, argv[2]);
+            if(Result > 0)
+            {
+                printf("Cache hit (%016llx); skipping encoding.\n", (unsigned long long)Cache.Key);
+                goto Exit_CacheHit;
+            }
+            if(Result < 0)
+            {
+                printf("ERROR: Unable to copy cached result to output file (%s).\n", argv[2]);
+                ExitCode = -1;
+                goto Exit_BadArgs;
+            }
+        }
+    }
+
     //! Open input file and verify
     {
         int Error = WAV_OpenR(&FileIn, argv[1]);
@@ -97,36 +328,175 @@ int main(int argc, const char *argv[])
         goto Exit_FailInFileValidation;
     }
 
+    if(Lookahead && RateKbps < 0.0f)
+    {
+        printf("WARNING: Lookahead is only used in ABR mode; ignoring.\n");
+        Lookahead = 0;
+    }
+    if(LongTermPrediction && Lookahead)
+    {
+        printf("WARNING: Lookahead can't be used with long-term prediction; ignoring.\n");
+        Lookahead = 0;
+    }
+    if(LongTermPrediction && Looping)
+    {
+        //! The loop start would be predicted from the intro, but
+        //! decoded after the loop end; the mismatch would be heard
+        printf("WARNING: Long-term prediction can't be used with loops; ignoring.\n");
+        LongTermPrediction = 0;
+    }
+    if(ReservoirBytes && (RateKbps < 0.0f || AvgComplexity > 0.0f || Lookahead))
+    {
+        printf("WARNING: Bit reservoir is only used in CBR mode; ignoring.\n");
+        ReservoirBytes = 0;
+    }
+    if(InternalRateHz >= (int)FileIn.fmt->nSamplesPerSec)
+    {
+        printf("WARNING: Internal rate (%d) is not below the input rate; ignoring.\n", InternalRateHz);
+        InternalRateHz = 0;
+    }
+
+    //! Check loop points
+    //! The loop length must be a whole number of blocks, so that
+    //! both ends of the loop fall on block boundaries; the start is
+    //! then aligned by padding the beginning with silence.
+    if(Looping)
+    {
+        if(InternalRateHz)
+        {
+            printf("WARNING: Internal rate is not supported with loops; ignoring.\n");
+            InternalRateHz = 0;
+        }
+        if(ReservoirBytes)
+        {
+            printf("WARNING: Bit reservoir is not supported with loops; ignoring.\n");
+            ReservoirBytes = 0;
+        }
+        if(Loop.End == 0) Loop.End = FileIn.nSamplePoints;
+        if(Loop.Start >= Loop.End || Loop.End > FileIn.nSamplePoints)
+        {
+            printf("ERROR: Invalid loop points (%u,%u).\n", Loop.Start, Loop.End);
+            ExitCode = -1;
+            goto Exit_FailInFileValidation;
+        }
+        if((Loop.End - Loop.Start) % BlockSize || Loop.End - Loop.Start < 2u*BlockSize)
+        {
+            printf("ERROR: Loop length (%u) must be a multiple of the block size, and at least two blocks.\n", Loop.End - Loop.Start);
+            ExitCode = -1;
+            goto Exit_FailInFileValidation;
+        }
+        Loop.Pad = (BlockSize - Loop.Start%BlockSize) % BlockSize;
+    }
+
+    //! Create resampler for internal rate
+    //! The input is read in chunks of BlockSize samples, and the
+    //! resampled output collects in ReadBuffer until we have a
+    //! full block; this needs space for up to a block's worth of
+    //! leftover samples, plus a full chunk of resampled output.
+    Resampler.BufferData = NULL;
+    if(InternalRateHz)
+    {
+        Resampler.nChan        = FileIn.fmt->nChannels;
+        Resampler.RateHz       = FileIn.fmt->nSamplesPerSec;
+        Resampler.OutputRateHz = InternalRateHz;
+        Resampler.MaxInputSize = BlockSize;
+        if(ULC_ResamplerState_Init(&Resampler) < 0)
+        {
+            printf("ERROR: Unable to initialize resampler.\n");
+            ExitCode = -1;
+            goto Exit_FailCreateResampler;
+        }
+    }
+
     //! Allocate reading buffer
-    AllocBuffer = malloc(BUFFER_ALIGNMENT-1 + sizeof(float)*BlockSize*FileIn.fmt->nChannels);
+    int ReadBufferSize = BlockSize;
+    if(InternalRateHz) ReadBufferSize = BlockSize + ULC_Resampler_MaxOutputSize(&Resampler, BlockSize);
+    ReadBufferSize = (ReadBufferSize*FileIn.fmt->nChannels + (BUFFER_ALIGNMENT/sizeof(float)-1)) &~ (BUFFER_ALIGNMENT/sizeof(float)-1);
+    AllocBuffer = malloc(BUFFER_ALIGNMENT-1 + sizeof(float)*(ReadBufferSize + (InternalRateHz ? BlockSize*FileIn.fmt->nChannels : 0)));
     if(!AllocBuffer)
     {
         printf("ERROR: Couldn't allocate reading buffer.\n");
         ExitCode = -1;
         goto Exit_FailCreateAllocBuffer;
     }
-    float *ReadBuffer = (float*)(AllocBuffer + (-(uintptr_t)AllocBuffer % BUFFER_ALIGNMENT));
+    float *ReadBuffer  = (float*)(AllocBuffer + (-(uintptr_t)AllocBuffer % BUFFER_ALIGNMENT));
+    float *InputBuffer = ReadBuffer + ReadBufferSize;
+    int    nReadBuffered = 0;
 
     //! Create file header
     //! nBlocks is +1 to account for coding delay, +1 to account for MDCT delay
     //! ::RateKbps and ::StreamOffs are written later
-    FileHeader.Magic        = HEADER_MAGIC;
+    uint64_t nSamplePoints = FileIn.nSamplePoints;
+    if(InternalRateHz) nSamplePoints = (nSamplePoints*InternalRateHz + FileIn.fmt->nSamplesPerSec-1) / FileIn.fmt->nSamplesPerSec;
+    if(Looping) nSamplePoints = Loop.End + Loop.Pad;
+    FileHeader.Magic        = EntropyCoding ? HEADER_MAGIC_ENTROPY : HEADER_MAGIC;
     FileHeader.BlockSize    = BlockSize;
     FileHeader.MaxBlockSize = 0;
-    FileHeader.nBlocks      = (FileIn.nSamplePoints + BlockSize-1) / BlockSize + 2;
-    FileHeader.RateHz       = FileIn.fmt->nSamplesPerSec;
+    FileHeader.nBlocks      = (nSamplePoints + BlockSize-1) / BlockSize + 2;
+    FileHeader.RateHz       = InternalRateHz ? InternalRateHz : (int)FileIn.fmt->nSamplesPerSec;
     FileHeader.nChan        = FileIn.fmt->nChannels;
+    FileHeader.SourceRateHz = InternalRateHz ? FileIn.fmt->nSamplesPerSec : 0;
+    FileHeader.MaxRawBlockSize = 0;
+    FileHeader.StreamBufferSize = 0;
+    FileHeader.LoopBlock    = Looping ? ((Loop.Start + Loop.Pad) / BlockSize + 2) : 0;
+    FileHeader.LoopOffs     = 0;
+    FileHeader.PlaybackGain = 0;
+    FileHeader.Profile      = 0;
+    if(StereoSwitching || ParametricStereo) FileHeader.Profile |= HEADER_PROFILE_STEREO;
+    if(NoiseCoupling)                       FileHeader.Profile |= HEADER_PROFILE_NOISE_COUPLING;
+    if(LongTermPrediction)                  FileHeader.Profile |= HEADER_PROFILE_LTP;
+
+    //! Load transform plans before creating the encoder (so that
+    //! it can skip measuring), and save them again after creating
+    //! it (so that any newly-measured sizes are kept).
+    //! NOTE: A missing wisdom file is not an error; it'll be created.
+    if(WisdomFile) Fourier_Plan_LoadWisdom(WisdomFile);
 
     //! Create encoder
     Encoder.RateHz    = FileHeader.RateHz;
     Encoder.nChan     = FileHeader.nChan;
     Encoder.BlockSize = FileHeader.BlockSize;
+    Encoder.BitReservoirSize = ReservoirBytes * 8;
+    Encoder.StereoSwitching  = StereoSwitching;
+    Encoder.ParametricStereo = ParametricStereo;
+    Encoder.NoiseCoupling    = NoiseCoupling;
+    Encoder.ChanGroupSize    = ChanGroupSize;
+    Encoder.ABRLookahead     = Lookahead;
+    Encoder.LongTermPrediction = LongTermPrediction;
     if(ULC_EncoderState_Init(&Encoder) <= 0)
     {
         printf("ERROR: Unable to initialize encoder.\n");
         ExitCode = -1;
         goto Exit_FailCreateEncoder;
     }
+    if(WisdomFile && Fourier_Plan_SaveWisdom(WisdomFile) < 0)
+    {
+        printf("WARNING: Unable to save transform plans (%s).\n", WisdomFile);
+    }
+
+    //! Choose the window decisions for the start of the loop
+    //! These are analyzed both coming from the intro and coming from
+    //! the loop end; where these differ, a decimated (transient) window
+    //! is preferred, as using a long window over a transient smears it
+    //! into the preceding block. Otherwise, the loop end wins, as it is
+    //! heard on every repeat.
+    if(Looping)
+    {
+        int i, IntroCtrl[2], SeamCtrl[2];
+        uint64_t LoopBlk = FileHeader.LoopBlock-2;
+        if(GetLoopWindowCtrl(IntroCtrl, &FileIn, ReadBuffer, LoopBlk,                 &Encoder, &Loop) < 0 ||
+           GetLoopWindowCtrl(SeamCtrl,  &FileIn, ReadBuffer, FileHeader.nBlocks-2, &Encoder, &Loop) < 0)
+        {
+            printf("ERROR: Unable to initialize encoder.\n");
+            ExitCode = -1;
+            goto Exit_FailOpenFileOut;
+        }
+        for(i=0; i<2; i++)
+        {
+            LoopWindowCtrl[i] = ((SeamCtrl[i] & 0x8) || !(IntroCtrl[i] & 0x8)) ? SeamCtrl[i] : IntroCtrl[i];
+        }
+        FileIn.SamplePosition = 0;
+    }
 
     //! Open output file and skip header
     FileOut = fopen(argv[2], "wb");
@@ -147,12 +517,19 @@ int main(int argc, const char *argv[])
         FileHeader.StreamOffs = ftell(FileOut);
 
         //! Process blocks
+        //! When entropy coding, blocks are collected in RawStream
+        //! (preceded by their size), as the model can only be built
+        //! once we have seen the whole stream.
+        //! With lookahead, each block is output Lookahead blocks after
+        //! its input was read, so the loop runs that much further (on
+        //! silence) to flush the last blocks out of the encoder.
         size_t Blk, nBlk = FileHeader.nBlocks;
+        size_t RawStreamSize = 0, RawStreamCapacity = 0;
         uint64_t TotalSize = 0;
         double ComplexitySum = 0.0;
         size_t BlkLastUpdate = 0;
         clock_t LastUpdateTime = clock() - DISPLAY_UPDATE_RATE;
-        for(Blk=0; Blk<nBlk; Blk++)
+        for(Blk=0; Blk<nBlk+Lookahead; Blk++)
         {
             //! Show progress
             //! NOTE: Take difference and use unsigned comparison to
@@ -173,26 +550,133 @@ int main(int argc, const char *argv[])
             }
 
             //! Read samples
-            WAV_ReadAsFloat(&FileIn, ReadBuffer, BlockSize);
+            //! When using an internal rate, keep reading and resampling
+            //! until we have a full block, and keep any leftovers.
+            const float *SrcData = ReadBuffer;
+            if(Blk >= nBlk) SrcData = NULL; //! <- Flushing the lookahead
+            else if(InternalRateHz)
+            {
+                while(nReadBuffered < BlockSize)
+                {
+                    WAV_ReadAsFloat(&FileIn, InputBuffer, BlockSize);
+                    nReadBuffered += ULC_Resampler_ProcessInterleaved(&Resampler, ReadBuffer + nReadBuffered*FileHeader.nChan, InputBuffer, BlockSize, 0);
+                }
+            }
+            else if(Looping) ReadLoopBlock(&FileIn, ReadBuffer, Blk, BlockSize, &Loop);
+            else WAV_ReadAsFloat(&FileIn, ReadBuffer, BlockSize);
+
+            //! Use the same window decisions for the first two blocks
+            //! of the loop, whether coming from the intro or from the
+            //! end of the loop (the last two blocks read), so that the
+            //! lapping into the loop block is the same in both cases
+            if(Looping)
+            {
+                size_t LoopBlk = FileHeader.LoopBlock-2;
+                if(Blk == LoopBlk   || Blk == nBlk-2) Encoder.WindowCtrlOverride = LoopWindowCtrl[0];
+                if(Blk == LoopBlk+1 || Blk == nBlk-1) Encoder.WindowCtrlOverride = LoopWindowCtrl[1];
+            }
 
             //! Encode block
             int Size;
             const uint8_t *EncData;
             if(RateKbps      < 0.0f) EncData = ULC_EncodeBlock_VBR(&Encoder, ReadBuffer, &Size, -RateKbps);
+            else if(Lookahead)            EncData = ULC_EncodeBlock_ABR_Lookahead(&Encoder, SrcData, &Size, RateKbps, AvgComplexity);
             else if(AvgComplexity > 0.0f) EncData = ULC_EncodeBlock_ABR(&Encoder, ReadBuffer, &Size,  RateKbps, AvgComplexity);
             else                          EncData = ULC_EncodeBlock_CBR(&Encoder, ReadBuffer, &Size,  RateKbps);
 
+            //! Drop the resampled samples that were just encoded
+            if(InternalRateHz && Blk < nBlk)
+            {
+                nReadBuffered -= BlockSize;
+                memmove(ReadBuffer, ReadBuffer + BlockSize*FileHeader.nChan, sizeof(float)*nReadBuffered*FileHeader.nChan);
+            }
+            if(!EncData) continue; //! <- Still filling the lookahead
+            size_t OutBlk = Blk - Lookahead;
+
             //! Convert size to bytes and accumulate statistics
             Size = (Size+7) / 8u;
             TotalSize     += Size;
             ComplexitySum += Encoder.BlockComplexity;
             if((size_t)Size > FileHeader.MaxBlockSize) FileHeader.MaxBlockSize = Size;
 
-            //! Write block to file
-            fwrite(EncData, sizeof(uint8_t), Size, FileOut);
+            //! Write block to file (or store it for entropy coding)
+            if(EntropyCoding)
+            {
+                if(RawStreamSize + sizeof(uint32_t) + Size > RawStreamCapacity)
+                {
+                    size_t NewCapacity = RawStreamCapacity ? (RawStreamCapacity * 2) : (1024*1024);
+                    uint8_t *NewStream = realloc(RawStream, NewCapacity);
+                    if(!NewStream)
+                    {
+                        printf("\nERROR: Couldn't allocate entropy coding buffer.\n");
+                        ExitCode = -1;
+                        goto Exit_FailEntropyCoding;
+                    }
+                    RawStream = NewStream, RawStreamCapacity = NewCapacity;
+                }
+                uint32_t RawSize = Size;
+                memcpy(RawStream + RawStreamSize, &RawSize, sizeof(uint32_t));
+                memcpy(RawStream + RawStreamSize + sizeof(uint32_t), EncData, Size);
+                RawStreamSize += sizeof(uint32_t) + Size;
+            }
+            else
+            {
+                if(Looping && OutBlk == FileHeader.LoopBlock) FileHeader.LoopOffs = ftell(FileOut);
+                fwrite(EncData, sizeof(uint8_t), Size, FileOut);
+            }
         }
 
-        //! Show statistics and store RateKbps to header
+        //! Build the entropy model, and code all blocks with it
+        if(EntropyCoding)
+        {
+            size_t Offs;
+            uint64_t RawTotalSize = TotalSize;
+            uint8_t *CodedBlock = malloc(ULC_ENTROPY_MAX_ENCODED_SIZE(FileHeader.MaxBlockSize));
+            uint32_t *Counts = calloc(ULC_ENTROPY_NCONTEXTS*16, sizeof(uint32_t));
+            struct ULC_EntropyModel_t *Model = malloc(sizeof(struct ULC_EntropyModel_t));
+            if(!CodedBlock || !Counts || !Model)
+            {
+                printf("\nERROR: Couldn't allocate entropy coding buffer.\n");
+                free(Model), free(Counts), free(CodedBlock);
+                ExitCode = -1;
+                goto Exit_FailEntropyCoding;
+            }
+            for(Offs=0; Offs<RawStreamSize; )
+            {
+                uint32_t RawSize;
+                memcpy(&RawSize, RawStream + Offs, sizeof(uint32_t));
+                ULC_EntropyModel_Count(Counts, RawStream + Offs + sizeof(uint32_t), RawSize);
+                Offs += sizeof(uint32_t) + RawSize;
+            }
+            ULC_EntropyModel_Build(Model, Counts);
+            {
+                uint8_t ModelData[ULC_ENTROPY_MODEL_MAX_SIZE];
+                int ModelSize = ULC_EntropyModel_Write(Model, ModelData);
+                fwrite(ModelData, sizeof(uint8_t), ModelSize, FileOut);
+                TotalSize = ModelSize;
+            }
+            FileHeader.MaxRawBlockSize = FileHeader.MaxBlockSize;
+            FileHeader.MaxBlockSize    = 0;
+            for(Blk=0, Offs=0; Offs<RawStreamSize; Blk++)
+            {
+                uint32_t RawSize;
+                if(Looping && Blk == FileHeader.LoopBlock) FileHeader.LoopOffs = ftell(FileOut);
+                memcpy(&RawSize, RawStream + Offs, sizeof(uint32_t));
+                int Size = ULC_Entropy_EncodeBlock(Model, CodedBlock, RawStream + Offs + sizeof(uint32_t), RawSize);
+                fwrite(CodedBlock, sizeof(uint8_t), Size, FileOut);
+                TotalSize += Size;
+                if((size_t)Size > FileHeader.MaxBlockSize) FileHeader.MaxBlockSize = Size;
+                Offs += sizeof(uint32_t) + RawSize;
+            }
+            printf(
+                "\nEntropy coding: %.2fKiB -> %.2fKiB (%+.2f%%)",
+                RawTotalSize / 1024.0, TotalSize / 1024.0,
+                (TotalSize * 100.0 / RawTotalSize) - 100.0
+            );
+            free(Model), free(Counts), free(CodedBlock);
+        }
+
+        //! Show statistics
         size_t nEncodedSamples = BlockSize * nBlk;
         double TotalSizeKiB  = TotalSize               * 1.0 / 1024;
         double AvgKbps       = TotalSize               * 8.0 * FileHeader.RateHz/1000.0 / nEncodedSamples;
@@ -211,23 +695,63 @@ int main(int argc, const char *argv[])
             MaxKbps, MaxBitsPerSmp,
             Complexity
         );
-        FileHeader.RateKbps = lrint(AvgKbps);
+
+        //! Store the nominal rate
+        //! NOTE: This is the target rate in CBR/ABR mode (which is also
+        //! the rate that the bit reservoir is filled at, so it's rounded
+        //! up to never fill it slower than the encoder assumed), and the
+        //! measured average rate in VBR mode, which has no target.
+        if(RateKbps < 0.0f)
+            FileHeader.RateKbps = lrint(AvgKbps);
+        else
+            FileHeader.RateKbps = (uint16_t)(ReservoirBytes ? ceilf(RateKbps) : lrintf(RateKbps));
+        if(Looping)
+        {
+            printf("Loop = Block %u (offset %u; %u samples of silence were added to the start)\n", FileHeader.LoopBlock, FileHeader.LoopOffs, Loop.Pad);
+        }
+
+        //! Store the bit reservoir size
+        //! NOTE: This applies to the plain stream only, as entropy
+        //! coding changes the size of each block.
+        //! NOTE: The encoder treats reservoirs smaller than a block's
+        //! budget as exactly that, so store the real value.
+        if(ReservoirBytes && !EntropyCoding)
+        {
+            int BitBudget = (int)((BlockSize * RateKbps) * 1000.0f/FileHeader.RateHz);
+            if(ReservoirBytes < (BitBudget+7)/8) ReservoirBytes = (BitBudget+7)/8;
+            FileHeader.StreamBufferSize = ReservoirBytes;
+        }
     }
 
     //! Write file header
     fseek(FileOut, FileHeaderOffs, SEEK_SET);
     fwrite(&FileHeader, sizeof(FileHeader), 1, FileOut);
 
+    //! Write the trace of all blocks
+    if(TraceFile && ULC_Trace_Dump(TraceFile) < 0)
+    {
+        printf("WARNING: Unable to write trace (%s).\n", TraceFile);
+    }
+
     //! Exit points
+Exit_FailEntropyCoding:
+    free(RawStream);
     fclose(FileOut);
+    if(CacheDir && ExitCode == 0 && EncodeCache_Store(&Cache, argv[2]) < 0)
+    {
+        printf("WARNING: Unable to store result in cache (%s).\n", Cache.Path);
+    }
 Exit_FailOpenFileOut:
     ULC_EncoderState_Destroy(&Encoder);
 Exit_FailCreateEncoder:
     free(AllocBuffer);
 Exit_FailCreateAllocBuffer:
+    ULC_ResamplerState_Destroy(&Resampler);
+Exit_FailCreateResampler:
 Exit_FailInFileValidation:
     WAV_Close(&FileIn);
 Exit_FailOpenInFile:
+Exit_CacheHit:
 Exit_BadArgs:
     return ExitCode;
 }
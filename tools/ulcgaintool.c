@@ -0,0 +1,188 @@
+/**************************************/
+#include <limits.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+/**************************************/
+#include "ulc_helper.h"
+#include "ulcdecoder.h"
+/**************************************/
+
+//! Gain of a single quantizer step (20*Log10[2], in 0.01dB)
+#define GAIN_STEP_CENTIBELS 602.06
+
+/**************************************/
+
+int main(int argc, const char *argv[])
+{
+    int   ExitCode = 0;
+    FILE *FileIn;
+    FILE *FileOut;
+    uint8_t *InStream  = NULL;
+    uint8_t *OutStream = NULL;
+    struct ULC_DecoderState_t Scanner;
+    struct FileHeader_t FileHeader;
+
+    //! Check arguments
+    if(argc < 4)
+    {
+        printf(
+            "ulcGainTool - Ultra-Low Complexity Codec Gain Tool\n"
+            "Usage:\n"
+            " ulcgaintool Input.ulc Output.ulc GainDb [Opt]\n"
+            "Options:\n"
+            " -nofine         - Don't leave the residual (non-6dB) gain to the player.\n"
+            "The gain is applied in steps of 6.02dB by re-writing the quantizers\n"
+            "of each block, which is exact (the stream is not re-encoded). The\n"
+            "remainder, along with any gain already stored in Input.ulc, is kept\n"
+            "in the header for the player to apply.\n"
+        );
+        return 1;
+    }
+
+    //! Parse arguments
+    int    NoFine = 0;
+    double GainDb = atof(argv[3]);
+    {
+        int n;
+        for(n=4; n<argc; n++)
+        {
+            if(!strcmp(argv[n], "-nofine"))
+            {
+                NoFine = 1;
+            }
+
+            else printf("WARNING: Ignoring unknown argument (%s)\n", argv[n]);
+        }
+    }
+
+    //! Open input file and verify
+    //! NOTE: Entropy-coded streams would need a new model, and bit
+    //! reservoir streams could overflow the reservoir as blocks grow.
+    FileIn = fopen(argv[1], "rb");
+    if(!FileIn)
+    {
+        printf("ERROR: Unable to open input stream (%s).\n", argv[1]);
+        ExitCode = -1;
+        goto Exit_FailOpenInFile;
+    }
+    if(FileHeader_Read(&FileHeader, FileIn) < 0)
+    {
+        printf("ERROR: Invalid input stream.\n");
+        ExitCode = -1;
+        goto Exit_FailReadInStream;
+    }
+    if(FileHeader.Magic != HEADER_MAGIC || FileHeader.StreamBufferSize != 0)
+    {
+        printf("ERROR: Input stream uses entropy coding or a bit reservoir.\n");
+        ExitCode = -1;
+        goto Exit_FailReadInStream;
+    }
+    size_t Blk, nBlk = FileHeader.nBlocks;
+
+    //! Read the input stream into memory
+    //! NOTE: The end of the buffer is padded with zeros so that scanning
+    //! a truncated stream cannot run off the end (see ulcreencodetool).
+    size_t InStreamSize;
+    {
+        fseek(FileIn, 0, SEEK_END);
+        InStreamSize = ftell(FileIn) - FileHeader.StreamOffs;
+        fseek(FileIn, FileHeader.StreamOffs, SEEK_SET);
+    }
+    InStream  = calloc(InStreamSize + (size_t)FileHeader.nChan*FileHeader.BlockSize + 16, 1);
+    OutStream = malloc(InStreamSize*2 + 16);
+    if(!InStream || !OutStream || fread(InStream, 1, InStreamSize, FileIn) != InStreamSize)
+    {
+        printf("ERROR: Unable to read input stream.\n");
+        ExitCode = -1;
+        goto Exit_FailReadInStream;
+    }
+
+    //! Find the range of shifts that every block allows
+    int MinShift = INT_MIN, MaxShift = INT_MAX;
+    Scanner.nChan     = FileHeader.nChan;
+    Scanner.BlockSize = FileHeader.BlockSize;
+    Scanner.LongTermPrediction = (FileHeader.Profile & HEADER_PROFILE_LTP) != 0;
+    {
+        size_t Offs = 0;
+        for(Blk=0; Blk<nBlk; Blk++)
+        {
+            size_t Size = (ULC_BlockGainRange(&Scanner, InStream + Offs, &MinShift, &MaxShift) + 7) / 8u;
+            Offs += Size;
+            if(!Size || Offs > InStreamSize)
+            {
+                printf("ERROR: Corrupted input stream (block %zu).\n", Blk);
+                ExitCode = -1;
+                goto Exit_FailReadInStream;
+            }
+        }
+    }
+
+    //! Split the total gain into 6dB steps and a residual
+    int32_t TotalGain = FileHeader.PlaybackGain + (int32_t)lrint(GainDb * 100.0);
+    int Shift = (int)lrint(TotalGain / GAIN_STEP_CENTIBELS);
+    if(Shift < MinShift || Shift > MaxShift)
+    {
+        Shift = (Shift < MinShift) ? MinShift : MaxShift;
+        printf("WARNING: Gain limited by the quantizer range (%+.2fdB..%+.2fdB).\n", MinShift * GAIN_STEP_CENTIBELS / 100.0, MaxShift * GAIN_STEP_CENTIBELS / 100.0);
+    }
+    int32_t FineGain = TotalGain - (int32_t)lrint(Shift * GAIN_STEP_CENTIBELS);
+    if(NoFine) FineGain = 0;
+
+    //! Apply gain to each block
+    size_t InOffs = 0, OutOffs = 0;
+    FileHeader.MaxBlockSize = 0;
+    FileHeader.StreamOffs   = sizeof(FileHeader);
+    for(Blk=0; Blk<nBlk; Blk++)
+    {
+        int OutSize;
+        size_t Size = (ULC_BlockGain(&Scanner, OutStream + OutOffs, &OutSize, InStream + InOffs, Shift) + 7) / 8u;
+        if(!Size)
+        {
+            printf("ERROR: Unable to apply gain (block %zu).\n", Blk);
+            ExitCode = -1;
+            goto Exit_FailReadInStream;
+        }
+        if(FileHeader.LoopBlock && Blk == FileHeader.LoopBlock) FileHeader.LoopOffs = FileHeader.StreamOffs + OutOffs;
+        OutSize = (OutSize + 7) / 8u;
+        if((size_t)OutSize > FileHeader.MaxBlockSize) FileHeader.MaxBlockSize = OutSize;
+        InOffs  += Size;
+        OutOffs += OutSize;
+    }
+    FileHeader.RateKbps     = lrint(OutOffs * 8.0 * FileHeader.RateHz/1000.0 / ((double)FileHeader.BlockSize * nBlk));
+    FileHeader.PlaybackGain = FineGain;
+
+    //! Write output
+    FileOut = fopen(argv[2], "wb");
+    if(!FileOut)
+    {
+        printf("ERROR: Unable to open output file (%s).\n", argv[2]);
+        ExitCode = -1;
+        goto Exit_FailOpenOutFile;
+    }
+    fwrite(&FileHeader, sizeof(FileHeader), 1, FileOut);
+    fwrite(OutStream, 1, OutOffs, FileOut);
+    fclose(FileOut);
+    printf(
+        "Applied %+.2fdB (%+d steps), with %+.2fdB left to the player\n"
+        "Total size = %.2fKiB (was %.2fKiB)\n",
+        Shift * GAIN_STEP_CENTIBELS / 100.0, Shift, FineGain / 100.0,
+        OutOffs / 1024.0, InStreamSize / 1024.0
+    );
+
+    //! Exit points
+Exit_FailOpenOutFile:
+Exit_FailReadInStream:
+    free(OutStream);
+    free(InStream);
+    fclose(FileIn);
+Exit_FailOpenInFile:
+    return ExitCode;
+}
+
+/**************************************/
+//! EOF
+/**************************************/
@@ -0,0 +1,528 @@
+/**************************************/
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+/**************************************/
+#include "fourier.h"
+#include "ulc_helper.h"
+#include "ulcdecoder.h"
+#include "ulcencoder.h"
+/**************************************/
+#define MIX_MAX_INPUTS 32
+#define MIX_RING_SIZE   4 //! Parsed blocks kept per input (Blk-1 .. Blk+2)
+/**************************************/
+
+//! Mixer input
+//! Blocks are parsed ahead of the block being mixed into a ring, so
+//! that PCM mixing (which needs the decoded output of block Blk+2, as
+//! decoding block N outputs the samples coded by the encoder at block
+//! N-2) and the window checks (which need the next block) can peek
+//! ahead. Blocks past the end of the stream are treated as silence.
+struct MixInput_t
+{
+    uint8_t *Stream;
+    size_t   StreamSize;
+    size_t   StreamPos;
+    size_t   nBlocks;
+    size_t   nParsed;   //! Number of blocks parsed so far
+    size_t   NextSynth; //! Block that the decoder's lapping state leads into
+    float    Gain;      //! Playback gain of the stream (applied when mixing)
+    struct ULC_DecoderState_t Decoder;
+    struct ULC_DecoderBlock_t Ring[MIX_RING_SIZE];
+};
+
+/**************************************/
+
+//! Open an input stream
+//! On success, Header is filled in and 1 is returned. On failure,
+//! -1 is returned (and the input needs no cleanup).
+static int Mix_OpenInput(struct MixInput_t *Input, struct FileHeader_t *Header, const char *Filename)
+{
+    int n;
+    FILE *File = fopen(Filename, "rb");
+    if(!File)
+    {
+        printf("ERROR: Unable to open input stream (%s).\n", Filename);
+        return -1;
+    }
+    if(FileHeader_Read(Header, File) < 0)
+    {
+        printf("ERROR: Invalid input stream (%s).\n", Filename);
+        goto Exit_Fail;
+    }
+    if(Header->Magic != HEADER_MAGIC)
+    {
+        printf("ERROR: Input stream uses entropy coding (%s); decode it first.\n", Filename);
+        goto Exit_Fail;
+    }
+    if(Header->Profile & HEADER_PROFILE_LTP)
+    {
+        //! Predicted coefficients only make sense against their own
+        //! stream's history, so they can't be summed with others
+        printf("ERROR: Input stream uses long-term prediction (%s); decode it first.\n", Filename);
+        goto Exit_Fail;
+    }
+
+    //! Read the stream into memory
+    //! NOTE: The end of the buffer is padded with zeros so that parsing
+    //! a truncated stream cannot run off the end (see ulcreencodetool).
+    fseek(File, 0, SEEK_END);
+    Input->StreamSize = ftell(File) - Header->StreamOffs;
+    fseek(File, Header->StreamOffs, SEEK_SET);
+    Input->Stream = calloc(Input->StreamSize + (size_t)Header->nChan*Header->BlockSize + 16, 1);
+    if(!Input->Stream || fread(Input->Stream, 1, Input->StreamSize, File) != Input->StreamSize)
+    {
+        printf("ERROR: Unable to read input stream (%s).\n", Filename);
+        goto Exit_FailRead;
+    }
+    fclose(File);
+
+    //! Create decoder and parsing ring
+    Input->StreamPos = 0;
+    Input->nBlocks   = Header->nBlocks;
+    Input->nParsed   = 0;
+    Input->NextSynth = 0;
+    Input->Gain      = FileHeader_PlaybackGain(Header);
+    Input->Decoder.nChan        = Header->nChan;
+    Input->Decoder.BlockSize    = Header->BlockSize;
+    Input->Decoder.RateHz       = Header->RateHz;
+    Input->Decoder.OutputRateHz = 0;
+    Input->Decoder.OutputFormat = ULC_DECODER_OUTPUT_FLOAT32;
+    Input->Decoder.Flags        = 0;
+    Input->Decoder.LongTermPrediction = 0;
+    Input->Decoder.ScratchBuffer      = NULL;
+    if(ULC_DecoderState_Init(&Input->Decoder) <= 0)
+    {
+        printf("ERROR: Unable to initialize decoder (%s).\n", Filename);
+        goto Exit_FailRead;
+    }
+    for(n=0; n<MIX_RING_SIZE; n++) if(ULC_DecoderBlock_Init(&Input->Decoder, &Input->Ring[n]) <= 0)
+        {
+            printf("ERROR: Unable to initialize decoder (%s).\n", Filename);
+            while(--n >= 0) ULC_DecoderBlock_Destroy(&Input->Ring[n]);
+            ULC_DecoderState_Destroy(&Input->Decoder);
+            free(Input->Stream);
+            return -1;
+        }
+    return 1;
+
+Exit_FailRead:
+    free(Input->Stream);
+Exit_Fail:
+    fclose(File);
+    return -1;
+}
+
+//! Close an input stream
+static void Mix_CloseInput(struct MixInput_t *Input)
+{
+    int n;
+    for(n=0; n<MIX_RING_SIZE; n++) ULC_DecoderBlock_Destroy(&Input->Ring[n]);
+    ULC_DecoderState_Destroy(&Input->Decoder);
+    free(Input->Stream);
+}
+
+/**************************************/
+
+//! Parse blocks up to and including Blk
+//! Returns 1 on success, or -1 on a corrupted stream.
+static int Mix_ParseAhead(struct MixInput_t *Input, size_t Blk)
+{
+    while(Input->nParsed <= Blk && Input->nParsed < Input->nBlocks)
+    {
+        struct ULC_DecoderBlock_t *Block = &Input->Ring[Input->nParsed % MIX_RING_SIZE];
+        int Size = (ULC_DecodeBlock_Parse(&Input->Decoder, Block, Input->Stream + Input->StreamPos) + 7) / 8u;
+        Input->StreamPos += Size;
+        if(!Size || Input->StreamPos > Input->StreamSize) return -1;
+        Input->nParsed++;
+    }
+    return 1;
+}
+
+//! Get a parsed block (NULL if past the end of the stream)
+static const struct ULC_DecoderBlock_t *Mix_GetBlock(const struct MixInput_t *Input, size_t Blk)
+{
+    return (Blk < Input->nBlocks) ? &Input->Ring[Blk % MIX_RING_SIZE] : NULL;
+}
+
+//! Synthesize a block into Dst[nChan*BlockSize]
+//! The lapping state after a block depends only on that block, so when
+//! the decoder has not just synthesized the previous block (ie. after
+//! mixing in the coefficient domain), that block is synthesized first
+//! to restore it.
+static void Mix_Synthesize(struct MixInput_t *Input, float *Dst, size_t Blk)
+{
+    const struct ULC_DecoderBlock_t *Block = Mix_GetBlock(Input, Blk);
+    if(!Block)
+    {
+        int n;
+        for(n=0; n<Input->Decoder.nChan*Input->Decoder.BlockSize; n++) Dst[n] = 0.0f;
+        return;
+    }
+    if(Input->NextSynth != Blk && Blk > 0)
+    {
+        ULC_DecodeBlock_Synthesize(&Input->Decoder, Dst, Mix_GetBlock(Input, Blk-1));
+    }
+    ULC_DecodeBlock_Synthesize(&Input->Decoder, Dst, Block);
+    Input->NextSynth = Blk+1;
+}
+
+/**************************************/
+
+//! Get the overlap of the first [sub]block of a window
+//! NOTE: This is the first nybble of each decimation pattern (see
+//! ULC_SubBlockDecimationPattern() in libulc/ulchelper.h), ie. the
+//! subblock shift (Bit0..2) and the transient flag (Bit3).
+static int Mix_GetFirstOverlap(int WindowCtrl, int BlockSize)
+{
+    static const uint8_t FirstSubBlock[16] =
+    {
+        0x0,0x8,0x9,0x1,0xA,0x2,0x1,0x1,0xB,0x3,0x2,0x2,0x1,0x1,0x1,0x1,
+    };
+    int Pattern = FirstSubBlock[WindowCtrl >> 4];
+    int Overlap = BlockSize >> (Pattern&0x7);
+    if(Pattern&0x8) Overlap >>= (WindowCtrl&0x7);
+    return Overlap;
+}
+
+//! Select the output window for a block
+//! Returns the window shared by all inputs that have this block (with
+//! *Agree = 1), or else the most decimated of their windows (ie. the
+//! largest WindowCtrl; with *Agree = 0). *FirstOverlap is set to -1
+//! unless all of these windows have the same first-[sub]block overlap.
+static int Mix_SelectWindow(const struct MixInput_t *Inputs, int nInputs, size_t Blk, int BlockSize, int *Agree, int *FirstOverlap)
+{
+    int n, WindowCtrl = -1;
+    *Agree = 1;
+    *FirstOverlap = 0;
+    for(n=0; n<nInputs; n++)
+    {
+        const struct ULC_DecoderBlock_t *Block = Mix_GetBlock(&Inputs[n], Blk);
+        if(!Block) continue;
+        int Overlap = Mix_GetFirstOverlap(Block->WindowCtrl, BlockSize);
+        if(WindowCtrl < 0)
+        {
+            WindowCtrl    = Block->WindowCtrl;
+            *FirstOverlap = Overlap;
+            continue;
+        }
+        if(Block->WindowCtrl != WindowCtrl) *Agree = 0;
+        if(Overlap != *FirstOverlap) *FirstOverlap = -1;
+        if(Block->WindowCtrl > WindowCtrl) WindowCtrl = Block->WindowCtrl;
+    }
+    return (WindowCtrl < 0) ? 0x10 : WindowCtrl; //! <- No decimation, full overlap when all inputs have ended
+}
+
+//! Sum the coefficients of all inputs (in M/S for channel pairs)
+static void Mix_SumCoefs(const struct MixInput_t *Inputs, int nInputs, float *Dst, size_t Blk, int nChan, int BlockSize)
+{
+    int n, Chan, Input;
+    for(n=0; n<nChan*BlockSize; n++) Dst[n] = 0.0f;
+    for(Input=0; Input<nInputs; Input++)
+    {
+        const struct ULC_DecoderBlock_t *Block = Mix_GetBlock(&Inputs[Input], Blk);
+        if(!Block) continue;
+        float Gain = Inputs[Input].Gain;
+        for(Chan=0; Chan<nChan; Chan++)
+        {
+            float *Buf = Dst + Chan*BlockSize;
+            const float *Src = Block->Coef + Chan*BlockSize;
+            if((Chan&1) == 0 && Chan+1 < nChan && Block->StereoMode[Chan/2] == 1)
+            {
+                //! L/R pair: Convert to M/S (L = M+S, R = M-S)
+                const float *SrcR = Src + BlockSize;
+                float *BufS = Buf + BlockSize;
+                for(n=0; n<BlockSize; n++)
+                {
+                    Buf [n] += (Src[n] + SrcR[n]) * (0.5f*Gain);
+                    BufS[n] += (Src[n] - SrcR[n]) * (0.5f*Gain);
+                }
+                Chan++;
+            }
+            else for(n=0; n<BlockSize; n++) Buf[n] += Src[n] * Gain;
+        }
+    }
+}
+
+//! Mix the decoded output of all inputs (PCM path)
+static void Mix_SumPCM(struct MixInput_t *Inputs, int nInputs, float *Dst, float *Tmp, size_t Blk, int nChan, int BlockSize)
+{
+    int n, Input;
+    for(n=0; n<nChan*BlockSize; n++) Dst[n] = 0.0f;
+    for(Input=0; Input<nInputs; Input++)
+    {
+        Mix_Synthesize(&Inputs[Input], Tmp, Blk);
+        float Gain = Inputs[Input].Gain;
+        for(n=0; n<nChan*BlockSize; n++) Dst[n] += Tmp[n] * Gain;
+    }
+}
+
+/**************************************/
+
+int main(int argc, const char *argv[])
+{
+    int   ExitCode = 0;
+    FILE *FileOut;
+    char *AllocBuffer;
+    struct MixInput_t Inputs[MIX_MAX_INPUTS];
+    struct FileHeader_t FileHeader;
+    struct ULC_EncoderState_t Encoder;
+
+    //! Check arguments
+    if(argc < 4)
+    {
+        printf(
+            "ulcMixTool - Ultra-Low Complexity Codec Stream Mixing Tool\n"
+            "Usage:\n"
+            " ulcmixtool Output.ulc RateKbps|-Quality Input1.ulc [Input2.ulc...] [Opt]\n"
+            "Options:\n"
+            " -pcm            - Always mix decoded PCM (for comparison).\n"
+            " -wisdom:File    - Load transform planning from File.\n"
+            "Inputs must have the same BlockSize, rate, and number of channels,\n"
+            "and must not use entropy coding. Blocks where all inputs use the\n"
+            "same window are mixed by summing their coefficients, and then only\n"
+            "go through rate control; other blocks are decoded, mixed, and fully\n"
+            "re-encoded.\n"
+        );
+        return 1;
+    }
+
+    //! Parse arguments
+    int   nInputs = 0;
+    int   ForcePCM = 0;
+    const char *WisdomFile = NULL;
+    const char *InputFiles[MIX_MAX_INPUTS];
+    float RateKbps = (float)atof(argv[2]);
+    if(RateKbps == 0.0f)
+    {
+        printf("ERROR: Invalid coding rate (%.2f).\n", RateKbps);
+        ExitCode = -1;
+        goto Exit_BadArgs;
+    }
+    {
+        int n;
+        for(n=3; n<argc; n++)
+        {
+            if(!strcmp(argv[n], "-pcm"))
+            {
+                ForcePCM = 1;
+            }
+
+            else if(!memcmp(argv[n], "-wisdom:", 8))
+            {
+                WisdomFile = argv[n] + 8;
+            }
+
+            else if(argv[n][0] == '-') printf("WARNING: Ignoring unknown argument (%s).\n", argv[n]);
+
+            else
+            {
+                if(nInputs >= MIX_MAX_INPUTS)
+                {
+                    printf("ERROR: Too many inputs (maximum %d).\n", MIX_MAX_INPUTS);
+                    ExitCode = -1;
+                    goto Exit_BadArgs;
+                }
+                InputFiles[nInputs++] = argv[n];
+            }
+        }
+    }
+    if(!nInputs)
+    {
+        printf("ERROR: No inputs.\n");
+        ExitCode = -1;
+        goto Exit_BadArgs;
+    }
+
+    //! Open inputs and verify
+    int nOpened;
+    for(nOpened=0; nOpened<nInputs; nOpened++)
+    {
+        struct FileHeader_t Header;
+        if(Mix_OpenInput(&Inputs[nOpened], &Header, InputFiles[nOpened]) < 0)
+        {
+            ExitCode = -1;
+            goto Exit_FailOpenInputs;
+        }
+        if(nOpened == 0)
+        {
+            FileHeader = Header;
+            continue;
+        }
+        if(Header.BlockSize != FileHeader.BlockSize || Header.RateHz != FileHeader.RateHz || Header.nChan != FileHeader.nChan || Header.SourceRateHz != FileHeader.SourceRateHz)
+        {
+            printf("ERROR: Input stream format does not match the first input (%s).\n", InputFiles[nOpened]);
+            Mix_CloseInput(&Inputs[nOpened]);
+            ExitCode = -1;
+            goto Exit_FailOpenInputs;
+        }
+        if(Header.nBlocks > FileHeader.nBlocks) FileHeader.nBlocks = Header.nBlocks;
+    }
+    int    BlockSize = FileHeader.BlockSize;
+    int    nChan     = FileHeader.nChan;
+    size_t Blk, nBlk = FileHeader.nBlocks;
+
+    //! Allocate mixing buffers
+    int MixBufferSize = (BlockSize*nChan + (BUFFER_ALIGNMENT/sizeof(float)-1)) &~ (BUFFER_ALIGNMENT/sizeof(float)-1);
+    AllocBuffer = malloc(BUFFER_ALIGNMENT-1 + sizeof(float)*MixBufferSize*2);
+    if(!AllocBuffer)
+    {
+        printf("ERROR: Couldn't allocate mixing buffer.\n");
+        ExitCode = -1;
+        goto Exit_FailCreateAllocBuffer;
+    }
+    float *MixBuffer   = (float*)(AllocBuffer + (-(uintptr_t)AllocBuffer % BUFFER_ALIGNMENT));
+    float *SynthBuffer = MixBuffer + MixBufferSize;
+
+    //! Create encoder
+    if(WisdomFile) Fourier_Plan_LoadWisdom(WisdomFile);
+    Encoder.RateHz    = FileHeader.RateHz;
+    Encoder.nChan     = nChan;
+    Encoder.BlockSize = BlockSize;
+    Encoder.BitReservoirSize = 0;
+    Encoder.StereoSwitching  = 0;
+    Encoder.ParametricStereo = 0;
+    Encoder.NoiseCoupling    = 0;
+    Encoder.ChanGroupSize    = 0;
+    Encoder.ABRLookahead     = 0;
+    Encoder.LongTermPrediction = 0;
+    if(ULC_EncoderState_Init(&Encoder) <= 0)
+    {
+        printf("ERROR: Unable to initialize encoder.\n");
+        ExitCode = -1;
+        goto Exit_FailCreateEncoder;
+    }
+
+    //! Open output file
+    FileOut = fopen(argv[1], "wb");
+    if(!FileOut)
+    {
+        printf("ERROR: Unable to open output file (%s).\n", argv[1]);
+        ExitCode = -1;
+        goto Exit_FailOpenFileOut;
+    }
+    FileHeader.Magic        = HEADER_MAGIC;
+    FileHeader.MaxBlockSize = 0;
+    FileHeader.StreamOffs   = sizeof(FileHeader);
+    FileHeader.MaxRawBlockSize  = 0;
+    FileHeader.StreamBufferSize = 0;
+    FileHeader.LoopBlock    = 0;
+    FileHeader.LoopOffs     = 0;
+    FileHeader.PlaybackGain = 0;
+    FileHeader.Profile      = 0;
+    fseek(FileOut, sizeof(FileHeader), SEEK_SET);
+
+    //! Mix blocks
+    //! Block Blk can be mixed in the coefficient domain when all inputs
+    //! code it with the same window, and agree on the overlap into the
+    //! next block (as that shapes the end of this one). Otherwise, the
+    //! inputs are decoded and mixed, and the result re-encoded. When
+    //! switching from coefficients to PCM, the encoder is first primed
+    //! with the mixed data of the two previous blocks, so that its
+    //! lapping continues from the coefficient-domain blocks.
+    //! NOTE: The output always uses the windows of the inputs (as seen
+    //! by Mix_SelectWindow()), so that the encoder's own transient
+    //! analysis can't keep the two paths from lining up again.
+    size_t nCoefBlocks = 0, nPCMBlocks = 0, TotalSize = 0;
+    clock_t StartTime = clock();
+    {
+        int Agree, NextAgree, FirstOverlap, NextFirstOverlap;
+        int PrevCoefs = 0;
+        for(Blk=0; Blk<nBlk; Blk++)
+        {
+            int n;
+            for(n=0; n<nInputs; n++) if(Mix_ParseAhead(&Inputs[n], Blk+2) < 0)
+                {
+                    printf("ERROR: Corrupted input stream (%s).\n", InputFiles[n]);
+                    ExitCode = -1;
+                    goto Exit_FailMix;
+                }
+            int WindowCtrl     = Mix_SelectWindow(Inputs, nInputs, Blk,   BlockSize, &Agree,     &FirstOverlap);
+            int NextWindowCtrl = Mix_SelectWindow(Inputs, nInputs, Blk+1, BlockSize, &NextAgree, &NextFirstOverlap);
+            (void)FirstOverlap, (void)NextAgree;
+
+            //! Encode block
+            int Size;
+            const uint8_t *EncData;
+            if(!ForcePCM && Agree && NextFirstOverlap >= 0)
+            {
+                Mix_SumCoefs(Inputs, nInputs, MixBuffer, Blk, nChan, BlockSize);
+                if(RateKbps < 0.0f)
+                    EncData = ULC_EncodeBlock_VBR_Coefs(&Encoder, MixBuffer, WindowCtrl, NextWindowCtrl, &Size, -RateKbps);
+                else
+                    EncData = ULC_EncodeBlock_CBR_Coefs(&Encoder, MixBuffer, WindowCtrl, NextWindowCtrl, &Size,  RateKbps);
+                PrevCoefs = 1;
+                nCoefBlocks++;
+            }
+            else
+            {
+                if(PrevCoefs)
+                {
+                    //! NOTE: Blk >= 1 here. Encoder call Blk codes the mixed
+                    //! output of decoding block Blk+1, so prime with the
+                    //! output of blocks Blk and Blk+1, using the windows of
+                    //! the blocks they were coded in.
+                    int Unused;
+                    Encoder.WindowCtrlOverride = Mix_SelectWindow(Inputs, nInputs, Blk-1, BlockSize, &Unused, &Unused);
+                    Mix_SumPCM(Inputs, nInputs, MixBuffer, SynthBuffer, Blk, nChan, BlockSize);
+                    ULC_EncodeBlock_Prime(&Encoder, MixBuffer);
+                    Encoder.WindowCtrlOverride = WindowCtrl;
+                    Mix_SumPCM(Inputs, nInputs, MixBuffer, SynthBuffer, Blk+1, nChan, BlockSize);
+                    ULC_EncodeBlock_Prime(&Encoder, MixBuffer);
+                    PrevCoefs = 0;
+                }
+                Mix_SumPCM(Inputs, nInputs, MixBuffer, SynthBuffer, Blk+2, nChan, BlockSize);
+                Encoder.WindowCtrlOverride = NextWindowCtrl;
+                if(RateKbps < 0.0f)
+                    EncData = ULC_EncodeBlock_VBR(&Encoder, MixBuffer, &Size, -RateKbps);
+                else
+                    EncData = ULC_EncodeBlock_CBR(&Encoder, MixBuffer, &Size,  RateKbps);
+                nPCMBlocks++;
+            }
+
+            //! Store block
+            Size = (Size+7) / 8u;
+            fwrite(EncData, Size, 1, FileOut);
+            if((size_t)Size > FileHeader.MaxBlockSize) FileHeader.MaxBlockSize = Size;
+            TotalSize += Size;
+        }
+    }
+    double Elapsed = (double)(clock() - StartTime) / CLOCKS_PER_SEC;
+
+    //! Write the header
+    FileHeader.RateKbps = lrint(TotalSize * 8.0 * FileHeader.RateHz/1000.0 / (BlockSize * nBlk));
+    fseek(FileOut, 0, SEEK_SET);
+    fwrite(&FileHeader, sizeof(FileHeader), 1, FileOut);
+    {
+        double Duration = nBlk * BlockSize / (double)FileHeader.RateHz;
+        printf(
+            "Mixed %d inputs; %zu blocks (%zu in the coefficient domain, %zu via PCM)\n"
+            "Total size = %.2fKiB (%.2fkbps)\n"
+            "Mixing time = %.3fs (%.1fx realtime)\n",
+            nInputs, nBlk, nCoefBlocks, nPCMBlocks,
+            TotalSize / 1024.0, TotalSize * 8.0 * FileHeader.RateHz/1000.0 / (BlockSize * nBlk),
+            Elapsed, (Elapsed > 0.0) ? (Duration / Elapsed) : 0.0
+        );
+    }
+
+    //! Exit points
+Exit_FailMix:
+    fclose(FileOut);
+Exit_FailOpenFileOut:
+    ULC_EncoderState_Destroy(&Encoder);
+Exit_FailCreateEncoder:
+    free(AllocBuffer);
+Exit_FailCreateAllocBuffer:
+Exit_FailOpenInputs:
+    while(--nOpened >= 0) Mix_CloseInput(&Inputs[nOpened]);
+Exit_BadArgs:
+    return ExitCode;
+}
+
+/**************************************/
+//! EOF
+/**************************************/
@@ -0,0 +1,406 @@
+/**************************************/
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+/**************************************/
+#include "ulc_helper.h"
+#include "ulc_multistream.h"
+#include "ulcdecoder.h"
+#include "wavio.h"
+/**************************************/
+
+//! Input stream state
+struct MuxStream_t
+{
+    struct FileHeader_t Header;
+    uint8_t *Data;      //! Stream data (with padding)
+    size_t  *BlockOffs; //! [nBlocks+1]
+    uint32_t nPreBlocks; //! Silent blocks to insert before the stream
+    uint32_t nSliceBlocks; //! Blocks per slice
+};
+
+//! Get the (offset, size) of the block coded in slot Blk of a slice stream
+//! Slots outside of the stream are filled with the first block, which
+//! is always silent.
+static const uint8_t *Mux_GetBlock(const struct MuxStream_t *Stream, uint32_t Blk, size_t *Size)
+{
+    Blk = (Blk < Stream->nPreBlocks) ? 0 : (Blk - Stream->nPreBlocks);
+    if(Blk >= Stream->Header.nBlocks) Blk = 0;
+    *Size = Stream->BlockOffs[Blk+1] - Stream->BlockOffs[Blk];
+    return Stream->Data + Stream->BlockOffs[Blk];
+}
+
+//! Get the size of a slice stream's data
+static size_t Mux_GetSliceStreamSize(const struct MuxStream_t *Stream, uint32_t Slice)
+{
+    uint32_t Blk;
+    size_t Size, Total = 0;
+    for(Blk=0; Blk<Stream->nSliceBlocks; Blk++)
+    {
+        Mux_GetBlock(Stream, Slice*Stream->nSliceBlocks + Blk, &Size);
+        Total += Size;
+    }
+    return Total;
+}
+
+/**************************************/
+
+//! Load a stream into memory and find its blocks
+//! Returns 1 on success, or -1 on failure.
+static int Mux_LoadStream(struct MuxStream_t *Stream, const char *Filename)
+{
+    FILE *File = fopen(Filename, "rb");
+    if(!File)
+    {
+        printf("ERROR: Unable to open input file (%s).\n", Filename);
+        return -1;
+    }
+    if(FileHeader_Read(&Stream->Header, File) < 0)
+    {
+        printf("ERROR: Input file is not a valid ULC container (%s).\n", Filename);
+        fclose(File);
+        return -1;
+    }
+    const struct FileHeader_t *Header = &Stream->Header;
+    if(Header->Magic != HEADER_MAGIC || Header->SourceRateHz != 0 || Header->LoopBlock != 0 || Header->PlaybackGain != 0 || Header->Profile != 0)
+    {
+        printf("ERROR: Input uses entropy coding, an internal rate, a loop, a playback gain, or long-term prediction (%s).\n", Filename);
+        fclose(File);
+        return -1;
+    }
+
+    //! Read the stream, padding the end with zeros (see ulcreencodetool)
+    size_t StreamSize;
+    fseek(File, 0, SEEK_END);
+    StreamSize = ftell(File) - Header->StreamOffs;
+    fseek(File, Header->StreamOffs, SEEK_SET);
+    Stream->Data      = calloc(StreamSize + (size_t)Header->nChan*Header->BlockSize + 16, 1);
+    Stream->BlockOffs = malloc(sizeof(size_t) * (Header->nBlocks+1));
+    if(!Stream->Data || !Stream->BlockOffs || fread(Stream->Data, 1, StreamSize, File) != StreamSize)
+    {
+        printf("ERROR: Unable to read input file (%s).\n", Filename);
+        fclose(File);
+        return -1;
+    }
+    fclose(File);
+
+    //! Find the start of each block
+    uint32_t Blk;
+    struct ULC_DecoderState_t Scanner;
+    Scanner.nChan     = Header->nChan;
+    Scanner.BlockSize = Header->BlockSize;
+    Scanner.LongTermPrediction = 0;
+    Stream->BlockOffs[0] = 0;
+    for(Blk=0; Blk<Header->nBlocks; Blk++)
+    {
+        size_t Size = (ULC_ScanBlock(&Scanner, Stream->Data + Stream->BlockOffs[Blk]) + 7) / 8u;
+        Stream->BlockOffs[Blk+1] = Stream->BlockOffs[Blk] + Size;
+        if(!Size || Stream->BlockOffs[Blk+1] > StreamSize)
+        {
+            printf("ERROR: Corrupted stream (%s, block %u).\n", Filename, Blk);
+            return -1;
+        }
+    }
+    if(Header->nBlocks == 0)
+    {
+        printf("ERROR: Empty stream (%s).\n", Filename);
+        return -1;
+    }
+    return 1;
+}
+
+/**************************************/
+
+//! Mux streams into a multi-stream file
+static int Mux(const char *OutputFile, const char *const *InputFiles, int nStreams)
+{
+    int n, ExitCode = 0;
+    uint32_t Slice;
+    FILE *FileOut = NULL;
+    uint32_t *SliceSizes = NULL;
+    struct MuxStream_t Streams[MULTI_MAX_STREAMS];
+    struct MultiHeader_t Header;
+    struct MultiStreamInfo_t Info[MULTI_MAX_STREAMS];
+    memset(Streams, 0, sizeof(Streams));
+    memset(&Header, 0, sizeof(Header));
+    memset(Info, 0, sizeof(Info));
+
+    //! Load streams and verify that they can be sliced together
+    for(n=0; n<nStreams; n++)
+    {
+        if(Mux_LoadStream(&Streams[n], InputFiles[n]) < 0)
+        {
+            ExitCode = -1;
+            goto Exit;
+        }
+        const struct FileHeader_t *h = &Streams[n].Header;
+        if(n == 0) Header.RateHz = h->RateHz;
+        if(h->RateHz != Header.RateHz)
+        {
+            printf("ERROR: All inputs must have the same rate (%s).\n", InputFiles[n]);
+            ExitCode = -1;
+            goto Exit;
+        }
+        if(h->BlockSize > Header.SliceSize) Header.SliceSize = h->BlockSize;
+    }
+    for(n=0; n<nStreams; n++)
+    {
+        struct MuxStream_t *s = &Streams[n];
+        if(Header.SliceSize % s->Header.BlockSize)
+        {
+            printf("ERROR: Block sizes must divide the largest block size (%s).\n", InputFiles[n]);
+            ExitCode = -1;
+            goto Exit;
+        }
+
+        //! Align the codec delay of every stream to 2*SliceSize
+        s->nSliceBlocks = Header.SliceSize / s->Header.BlockSize;
+        s->nPreBlocks   = 2*(s->nSliceBlocks-1);
+        uint32_t nSlices = (s->nPreBlocks + s->Header.nBlocks + s->nSliceBlocks-1) / s->nSliceBlocks;
+        if(nSlices > Header.nSlices) Header.nSlices = nSlices;
+
+        Info[n].BlockSize    = s->Header.BlockSize;
+        Info[n].nChan        = s->Header.nChan;
+        Info[n].RateKbps     = s->Header.RateKbps;
+        Info[n].MaxBlockSize = s->Header.MaxBlockSize;
+    }
+
+    //! Find the size of each slice
+    SliceSizes = malloc(sizeof(uint32_t) * Header.nSlices);
+    if(!SliceSizes)
+    {
+        printf("ERROR: Couldn't allocate slice table.\n");
+        ExitCode = -1;
+        goto Exit;
+    }
+    for(Slice=0; Slice<Header.nSlices; Slice++)
+    {
+        size_t Size = (nStreams+1) * sizeof(uint32_t);
+        for(n=0; n<nStreams; n++) Size += Mux_GetSliceStreamSize(&Streams[n], Slice);
+        SliceSizes[Slice] = Size;
+        if(Size > Header.MaxSliceSize) Header.MaxSliceSize = Size;
+    }
+    Header.Magic          = MULTI_HEADER_MAGIC;
+    Header.nStreams       = nStreams;
+    Header.FirstSliceSize = SliceSizes[0];
+    Header.StreamOffs     = sizeof(Header) + nStreams*sizeof(struct MultiStreamInfo_t);
+
+    //! Write output
+    FileOut = fopen(OutputFile, "wb");
+    if(!FileOut)
+    {
+        printf("ERROR: Unable to create output file (%s).\n", OutputFile);
+        ExitCode = -1;
+        goto Exit;
+    }
+    fwrite(&Header, sizeof(Header), 1, FileOut);
+    fwrite(Info, sizeof(struct MultiStreamInfo_t), nStreams, FileOut);
+    for(Slice=0; Slice<Header.nSlices; Slice++)
+    {
+        uint32_t Blk;
+        for(n=0; n<nStreams; n++)
+        {
+            uint32_t StreamSize = Mux_GetSliceStreamSize(&Streams[n], Slice);
+            fwrite(&StreamSize, sizeof(StreamSize), 1, FileOut);
+        }
+        for(n=0; n<nStreams; n++) for(Blk=0; Blk<Streams[n].nSliceBlocks; Blk++)
+        {
+            size_t Size;
+            const uint8_t *Data = Mux_GetBlock(&Streams[n], Slice*Streams[n].nSliceBlocks + Blk, &Size);
+            fwrite(Data, 1, Size, FileOut);
+        }
+        uint32_t NextSliceSize = (Slice+1 < Header.nSlices) ? SliceSizes[Slice+1] : 0;
+        fwrite(&NextSliceSize, sizeof(NextSliceSize), 1, FileOut);
+    }
+    printf(
+        "Muxed %d streams into %u slices of %u samples\n"
+        "Total size = %.2fKiB (largest slice = %u bytes)\n",
+        nStreams, Header.nSlices, Header.SliceSize,
+        ftell(FileOut) / 1024.0, Header.MaxSliceSize
+    );
+
+    //! Exit point
+Exit:
+    if(FileOut) fclose(FileOut);
+    free(SliceSizes);
+    for(n=0; n<nStreams; n++)
+    {
+        free(Streams[n].BlockOffs);
+        free(Streams[n].Data);
+    }
+    return ExitCode;
+}
+
+/**************************************/
+
+//! Decode the active streams of a multi-stream file, mixed together
+static int Demux(const char *InputFile, const char *OutputFile, uint32_t ActiveMask)
+{
+    int n, ExitCode = 0;
+    char  *AllocBuffer;
+    struct WAV_State_t FileOut;
+    struct MultiStream_Reader_t Reader;
+
+    //! Open input file and verify
+    if(MultiStream_Open(&Reader, InputFile, ActiveMask) < 0)
+    {
+        printf("ERROR: Unable to open input file (%s), or it is not a valid multi-stream container.\n", InputFile);
+        ExitCode = -1;
+        goto Exit_FailOpenInFile;
+    }
+    if(!Reader.ActiveMask)
+    {
+        printf("ERROR: No streams selected.\n");
+        ExitCode = -1;
+        goto Exit_FailVerifyInFile;
+    }
+    int nChan = 0, nActive = 0;
+    for(n=0; n<Reader.Header.nStreams; n++) if(Reader.ActiveMask & (1u << n))
+        {
+            if(nChan && Reader.Streams[n].nChan != nChan)
+            {
+                printf("ERROR: Selected streams must have the same number of channels.\n");
+                ExitCode = -1;
+                goto Exit_FailVerifyInFile;
+            }
+            nChan = Reader.Streams[n].nChan;
+            nActive++;
+        }
+
+    //! Allocate a decoding buffer for each active stream, plus the mix
+    //! NOTE: SliceSize is a multiple of BlockSize, so each buffer stays aligned.
+    size_t SliceSamples = (size_t)nChan * Reader.Header.SliceSize;
+    float *Dst[MULTI_MAX_STREAMS];
+    AllocBuffer = malloc(BUFFER_ALIGNMENT-1 + sizeof(float) * SliceSamples * (nActive+1));
+    if(!AllocBuffer)
+    {
+        printf("ERROR: Couldn't allocate decoding buffer.\n");
+        ExitCode = -1;
+        goto Exit_FailCreateAllocBuffer;
+    }
+    float *MixBuffer = (float*)(AllocBuffer + (-(uintptr_t)AllocBuffer % BUFFER_ALIGNMENT));
+    {
+        float *Buf = MixBuffer + SliceSamples;
+        for(n=0; n<Reader.Header.nStreams; n++)
+        {
+            Dst[n] = NULL;
+            if(Reader.ActiveMask & (1u << n)) Dst[n] = Buf, Buf += SliceSamples;
+        }
+    }
+
+    //! Create output file
+    {
+        struct WAVE_fmt_t fmt;
+        fmt.wFormatTag      = WAVE_FORMAT_PCM;
+        fmt.nChannels       = nChan;
+        fmt.nSamplesPerSec  = Reader.Header.RateHz;
+        fmt.nAvgBytesPerSec = 2 * nChan * Reader.Header.RateHz;
+        fmt.nBlockAlign     = 2 * nChan;
+        fmt.wBitsPerSample  = 16;
+        int Error = WAV_OpenW(&FileOut, OutputFile, &fmt);
+        if(Error < 0)
+        {
+            printf("ERROR: Unable to create output file (%s); error %s.\n", OutputFile, WAV_ErrorCodeToString(Error));
+            ExitCode = -1;
+            goto Exit_FailCreateOutFile;
+        }
+    }
+
+    //! Decode and mix slices
+    int Result;
+    while((Result = MultiStream_DecodeSlice(&Reader, Dst)) > 0)
+    {
+        size_t i;
+        memset(MixBuffer, 0, sizeof(float) * SliceSamples);
+        for(n=0; n<Reader.Header.nStreams; n++) if(Dst[n])
+            {
+                for(i=0; i<SliceSamples; i++) MixBuffer[i] += Dst[n][i];
+            }
+        WAV_WriteFromFloat(&FileOut, MixBuffer, Reader.Header.SliceSize);
+    }
+    if(Result < 0)
+    {
+        printf("ERROR: Corrupted stream (slice %u).\n", Reader.Slice);
+        ExitCode = -1;
+    }
+    else printf("Decoded %u slices (%d of %u streams)\n", Reader.Slice, nActive, Reader.Header.nStreams);
+
+    //! Exit points
+    WAV_Close(&FileOut);
+Exit_FailCreateOutFile:
+    free(AllocBuffer);
+Exit_FailCreateAllocBuffer:
+Exit_FailVerifyInFile:
+    MultiStream_Close(&Reader);
+Exit_FailOpenInFile:
+    return ExitCode;
+}
+
+/**************************************/
+
+int main(int argc, const char *argv[])
+{
+    //! Check arguments
+    if(argc < 3)
+    {
+        printf(
+            "ulcMuxTool - Ultra-Low Complexity Codec Multi-Stream Tool\n"
+            "Usage:\n"
+            " ulcmuxtool Output.ulcm Input1.ulc [Input2.ulc ...]\n"
+            " ulcmuxtool -decode Input.ulcm Output.wav [-streams:0,1,...]\n"
+            "Inputs must be plain streams of the same rate. When decoding,\n"
+            "the selected streams (default: all) are mixed together.\n"
+        );
+        return 1;
+    }
+
+    //! Decode mode
+    if(!strcmp(argv[1], "-decode"))
+    {
+        if(argc < 4)
+        {
+            printf("ERROR: Missing input or output file.\n");
+            return -1;
+        }
+        int n;
+        uint32_t ActiveMask = ~0u;
+        for(n=4; n<argc; n++)
+        {
+            if(!memcmp(argv[n], "-streams:", 9))
+            {
+                const char *s = argv[n] + 9;
+                ActiveMask = 0;
+                for(;;)
+                {
+                    char *End;
+                    long Idx = strtol(s, &End, 10);
+                    if(End == s || Idx < 0 || Idx >= MULTI_MAX_STREAMS)
+                    {
+                        printf("ERROR: Invalid stream list (%s).\n", argv[n] + 9);
+                        return -1;
+                    }
+                    ActiveMask |= 1u << Idx;
+                    if(*End != ',') break;
+                    s = End + 1;
+                }
+            }
+            else printf("WARNING: Ignoring unknown argument (%s).\n", argv[n]);
+        }
+        return Demux(argv[2], argv[3], ActiveMask);
+    }
+
+    //! Mux mode
+    int nStreams = argc - 2;
+    if(nStreams > MULTI_MAX_STREAMS)
+    {
+        printf("ERROR: Too many inputs (maximum is %d).\n", MULTI_MAX_STREAMS);
+        return -1;
+    }
+    return Mux(argv[1], argv + 2, nStreams);
+}
+
+/**************************************/
+//! EOF
+/**************************************/
@@ -0,0 +1,583 @@
+/**************************************/
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+/**************************************/
+#include "fourier.h"
+#include "ulc_helper.h"
+#include "ulcdecoder.h"
+#include "ulcencoder.h"
+#include "wavio.h"
+/**************************************/
+
+//! Encode a block using the same rate control as ulcencodetool
+//! Returns the block data, and its size (in bytes) in Size.
+static const uint8_t *Reencode_EncodeBlock(struct ULC_EncoderState_t *Encoder, const float *Src, int *Size, float RateKbps, float AvgComplexity)
+{
+    const uint8_t *EncData;
+    if(RateKbps      < 0.0f) EncData = ULC_EncodeBlock_VBR(Encoder, Src, Size, -RateKbps);
+    else if(AvgComplexity > 0.0f) EncData = ULC_EncodeBlock_ABR(Encoder, Src, Size,  RateKbps, AvgComplexity);
+    else                          EncData = ULC_EncodeBlock_CBR(Encoder, Src, Size,  RateKbps);
+    *Size = (*Size+7) / 8u;
+    return EncData;
+}
+
+//! Find the range of sample points that differ between two files
+//! On return, [Start,End) contains all differing sample points.
+//! Returns 1 if the files differ, or 0 if they are identical.
+static int Reencode_FindEditRange(struct WAV_State_t *FileA, struct WAV_State_t *FileB, float *BufA, float *BufB, int BlockSize, uint64_t *Start, uint64_t *End)
+{
+    int n, nChan = FileA->fmt->nChannels;
+    uint64_t Pos, nSamplePoints = FileA->nSamplePoints;
+    if(FileB->nSamplePoints > nSamplePoints) nSamplePoints = FileB->nSamplePoints;
+    *Start = *End = 0;
+    FileA->SamplePosition = FileB->SamplePosition = 0;
+    for(Pos=0; Pos<nSamplePoints; Pos+=BlockSize)
+    {
+        WAV_ReadAsFloat(FileA, BufA, BlockSize);
+        WAV_ReadAsFloat(FileB, BufB, BlockSize);
+        for(n=0; n<BlockSize*nChan; n++) if(BufA[n] != BufB[n])
+            {
+                uint64_t x = Pos + n/nChan;
+                if(*Start == *End) *Start = x;
+                *End = x+1;
+            }
+    }
+    return (*Start != *End);
+}
+
+/**************************************/
+
+int main(int argc, const char *argv[])
+{
+    int   ExitCode = 0;
+    FILE *FileOld;
+    FILE *FileOut;
+    char *AllocBuffer;
+    uint8_t *OldStream = NULL;
+    uint8_t *NewStream = NULL;
+    size_t  *OldBlockOffs;
+    struct WAV_State_t FileIn;
+    struct WAV_State_t FileInOld;
+    struct ULC_EncoderState_t Encoder;
+    struct ULC_DecoderState_t Scanner;
+    struct FileHeader_t FileHeader;
+
+    //! Check arguments
+    if(argc < 5)
+    {
+        printf(
+            "ulcReencodeTool - Ultra-Low Complexity Codec Incremental Re-encoding Tool\n"
+            "Usage:\n"
+            " ulcreencodetool Old.ulc New.wav Output.ulc RateKbps[,AvgComplexity]|-Quality [Opt]\n"
+            "Options:\n"
+            " -old:Old.wav    - Find the edited range by comparing against the old input.\n"
+            " -range:X,Y      - Sample points X (inclusive) to Y (exclusive) were edited.\n"
+            " -margin:4       - Minimum number of blocks used to warm up/settle the encoder.\n"
+            " -lrstereo       - Use L/R stereo switching (must match the original encode).\n"
+            " -pstereo        - Use parametric stereo (must match the original encode).\n"
+            " -noisecoupling  - Use noise coupling (must match the original encode).\n"
+            " -chgroup:X      - Channel group size (must match the original encode).\n"
+            " -verify         - Compare the result against a full re-encode.\n"
+            " -wisdom:File    - Load transform planning from File.\n"
+            "The rate settings must match those used to encode Old.ulc.\n"
+            "Only blocks around the edited range are re-encoded; the rest\n"
+            "are copied from Old.ulc.\n"
+        );
+        return 1;
+    }
+
+    //! Parse arguments
+    int   Margin = 4;
+    int   Verify = 0;
+    int   StereoSwitching = 0;
+    int   ParametricStereo = 0;
+    int   NoiseCoupling = 0;
+    int   ChanGroupSize = 0;
+    int   HaveRange = 0;
+    uint64_t EditStart = 0, EditEnd = 0;
+    const char *OldWavFile = NULL;
+    const char *WisdomFile = NULL;
+    float RateKbps;
+    float AvgComplexity = 0.0f;
+    sscanf(argv[4], "%f,%f", &RateKbps, &AvgComplexity);
+    if(RateKbps == 0.0f)
+    {
+        printf("ERROR: Invalid coding rate (%.2f).\n", RateKbps);
+        ExitCode = -1;
+        goto Exit_BadArgs;
+    }
+    if(AvgComplexity < 0.0f)
+    {
+        printf("ERROR: Invalid AvgComplexity parameter (%.2f).\n", AvgComplexity);
+        ExitCode = -1;
+        goto Exit_BadArgs;
+    }
+    {
+        int n;
+        for(n=5; n<argc; n++)
+        {
+            if(!memcmp(argv[n], "-old:", 5))
+            {
+                OldWavFile = argv[n] + 5;
+            }
+
+            else if(!memcmp(argv[n], "-range:", 7))
+            {
+                unsigned long long x, y;
+                if(sscanf(argv[n] + 7, "%llu,%llu", &x, &y) != 2 || x >= y)
+                {
+                    printf("ERROR: Invalid range (%s).\n", argv[n] + 7);
+                    ExitCode = -1;
+                    goto Exit_BadArgs;
+                }
+                EditStart = x, EditEnd = y;
+                HaveRange = 1;
+            }
+
+            else if(!memcmp(argv[n], "-margin:", 8))
+            {
+                Margin = atoi(argv[n] + 8);
+                if(Margin < 1)
+                {
+                    printf("ERROR: Invalid margin (%s).\n", argv[n] + 8);
+                    ExitCode = -1;
+                    goto Exit_BadArgs;
+                }
+            }
+
+            else if(!strcmp(argv[n], "-lrstereo"))
+            {
+                StereoSwitching = 1;
+            }
+
+            else if(!strcmp(argv[n], "-pstereo"))
+            {
+                ParametricStereo = 1;
+            }
+
+            else if(!strcmp(argv[n], "-noisecoupling"))
+            {
+                NoiseCoupling = 1;
+            }
+
+            else if(!memcmp(argv[n], "-chgroup:", 9))
+            {
+                ChanGroupSize = atoi(argv[n] + 9);
+                if(ChanGroupSize < 2 || (ChanGroupSize & 1))
+                {
+                    printf("ERROR: Invalid channel group size (%s; must be even).\n", argv[n] + 9);
+                    ExitCode = -1;
+                    goto Exit_BadArgs;
+                }
+            }
+
+            else if(!strcmp(argv[n], "-verify"))
+            {
+                Verify = 1;
+            }
+
+            else if(!memcmp(argv[n], "-wisdom:", 8))
+            {
+                WisdomFile = argv[n] + 8;
+            }
+
+            else printf("WARNING: Ignoring unknown argument (%s).\n", argv[n]);
+        }
+    }
+    if(!HaveRange && !OldWavFile)
+    {
+        printf("ERROR: Need either -old:Old.wav or -range:X,Y.\n");
+        ExitCode = -1;
+        goto Exit_BadArgs;
+    }
+
+    //! Open old stream and verify
+    //! NOTE: Entropy-coded streams use a model built from the whole
+    //! file, internal-rate streams carry resampler state across the
+    //! whole file, and bit reservoir streams carry the fill level,
+    //! so none of these can be spliced.
+    FileOld = fopen(argv[1], "rb");
+    if(!FileOld)
+    {
+        printf("ERROR: Unable to open old stream (%s).\n", argv[1]);
+        ExitCode = -1;
+        goto Exit_FailOpenOldFile;
+    }
+    if(FileHeader_Read(&FileHeader, FileOld) < 0)
+    {
+        printf("ERROR: Invalid old stream.\n");
+        ExitCode = -1;
+        goto Exit_FailReadOldStream;
+    }
+    if(FileHeader.Magic != HEADER_MAGIC || FileHeader.SourceRateHz != 0 || FileHeader.StreamBufferSize != 0 || FileHeader.LoopBlock != 0 || FileHeader.PlaybackGain != 0 || (FileHeader.Profile & ~(HEADER_PROFILE_STEREO | HEADER_PROFILE_NOISE_COUPLING)) != 0)
+    {
+        printf("ERROR: Old stream uses entropy coding, an internal rate, a bit reservoir, a loop, a playback gain, or long-term prediction; use a full re-encode.\n");
+        ExitCode = -1;
+        goto Exit_FailReadOldStream;
+    }
+    int    BlockSize = FileHeader.BlockSize;
+    int    nChan     = FileHeader.nChan;
+    size_t Blk, nBlk = FileHeader.nBlocks;
+
+    //! Read the old stream into memory
+    //! NOTE: We pad the end of the buffer with zeros so that scanning
+    //! a truncated stream cannot run off the end (zeros decode as zero
+    //! runs, so any [sub]block ends within BlockSize nybbles).
+    size_t OldStreamSize;
+    {
+        fseek(FileOld, 0, SEEK_END);
+        OldStreamSize = ftell(FileOld) - FileHeader.StreamOffs;
+        fseek(FileOld, FileHeader.StreamOffs, SEEK_SET);
+    }
+    size_t OldStreamPadding = (size_t)nChan*BlockSize + 16;
+    OldStream = calloc(OldStreamSize + OldStreamPadding, 1);
+    if(!OldStream || fread(OldStream, 1, OldStreamSize, FileOld) != OldStreamSize)
+    {
+        printf("ERROR: Unable to read old stream.\n");
+        ExitCode = -1;
+        goto Exit_FailReadOldStream;
+    }
+
+    //! Find the start of each block
+    OldBlockOffs = malloc(sizeof(size_t) * (nBlk+1));
+    if(!OldBlockOffs)
+    {
+        printf("ERROR: Couldn't allocate block table.\n");
+        ExitCode = -1;
+        goto Exit_FailScanOldStream;
+    }
+    Scanner.nChan     = nChan;
+    Scanner.BlockSize = BlockSize;
+    Scanner.LongTermPrediction = 0;
+    OldBlockOffs[0] = 0;
+    for(Blk=0; Blk<nBlk; Blk++)
+    {
+        int Size = (ULC_ScanBlock(&Scanner, OldStream + OldBlockOffs[Blk]) + 7) / 8u;
+        OldBlockOffs[Blk+1] = OldBlockOffs[Blk] + Size;
+        if(!Size || OldBlockOffs[Blk+1] > OldStreamSize)
+        {
+            printf("ERROR: Corrupted old stream (block %zu).\n", Blk);
+            ExitCode = -1;
+            goto Exit_FailScanOldStream;
+        }
+    }
+
+    //! Open new input file and verify
+    {
+        int Error = WAV_OpenR(&FileIn, argv[2]);
+        if(Error < 0)
+        {
+            printf("ERROR: Unable to open input file (%s); error %s.\n", argv[2], WAV_ErrorCodeToString(Error));
+            ExitCode = -1;
+            goto Exit_FailOpenInFile;
+        }
+    }
+    if(FileIn.fmt->nChannels != nChan || FileIn.fmt->nSamplesPerSec != FileHeader.RateHz)
+    {
+        printf("ERROR: Input file format does not match the old stream.\n");
+        ExitCode = -1;
+        goto Exit_FailInFileValidation;
+    }
+    if((FileIn.nSamplePoints + BlockSize-1) / BlockSize + 2 != nBlk)
+    {
+        printf("ERROR: Input file length does not match the old stream; use a full re-encode.\n");
+        ExitCode = -1;
+        goto Exit_FailInFileValidation;
+    }
+
+    //! Allocate reading buffers
+    int ReadBufferSize = (BlockSize*nChan + (BUFFER_ALIGNMENT/sizeof(float)-1)) &~ (BUFFER_ALIGNMENT/sizeof(float)-1);
+    AllocBuffer = malloc(BUFFER_ALIGNMENT-1 + sizeof(float)*ReadBufferSize*2);
+    if(!AllocBuffer)
+    {
+        printf("ERROR: Couldn't allocate reading buffer.\n");
+        ExitCode = -1;
+        goto Exit_FailCreateAllocBuffer;
+    }
+    float *ReadBuffer = (float*)(AllocBuffer + (-(uintptr_t)AllocBuffer % BUFFER_ALIGNMENT));
+    float *CompBuffer = ReadBuffer + ReadBufferSize;
+
+    //! Find the edited range
+    if(OldWavFile)
+    {
+        int Error = WAV_OpenR(&FileInOld, OldWavFile);
+        if(Error < 0)
+        {
+            printf("ERROR: Unable to open old input file (%s); error %s.\n", OldWavFile, WAV_ErrorCodeToString(Error));
+            ExitCode = -1;
+            goto Exit_FailFindEditRange;
+        }
+        if(FileInOld.fmt->nChannels != nChan)
+        {
+            printf("ERROR: Old input file format does not match the old stream.\n");
+            WAV_Close(&FileInOld);
+            ExitCode = -1;
+            goto Exit_FailFindEditRange;
+        }
+        int Differ = Reencode_FindEditRange(&FileIn, &FileInOld, ReadBuffer, CompBuffer, BlockSize, &EditStart, &EditEnd);
+        WAV_Close(&FileInOld);
+        if(!Differ)
+        {
+            printf("Input files are identical; nothing to re-encode.\n");
+            EditStart = EditEnd = 0;
+        }
+    }
+    if(EditEnd > FileIn.nSamplePoints)
+    {
+        printf("ERROR: Edited range lies outside of the input file.\n");
+        ExitCode = -1;
+        goto Exit_FailFindEditRange;
+    }
+
+    //! Load transform plans before creating the encoder
+    //! NOTE: The plans only affect rounding, but that is enough to
+    //! change the output, so pass the same wisdom file used for the
+    //! original encode (if any) to reproduce it exactly.
+    if(WisdomFile) Fourier_Plan_LoadWisdom(WisdomFile);
+
+    //! Create encoder
+    Encoder.RateHz    = FileHeader.RateHz;
+    Encoder.nChan     = nChan;
+    Encoder.BlockSize = BlockSize;
+    Encoder.BitReservoirSize = 0;
+    Encoder.StereoSwitching  = StereoSwitching;
+    Encoder.ParametricStereo = ParametricStereo;
+    Encoder.NoiseCoupling    = NoiseCoupling;
+    Encoder.ChanGroupSize    = ChanGroupSize;
+    Encoder.ABRLookahead     = 0;
+    Encoder.LongTermPrediction = 0;
+    if(ULC_EncoderState_Init(&Encoder) <= 0)
+    {
+        printf("ERROR: Unable to initialize encoder.\n");
+        ExitCode = -1;
+        goto Exit_FailCreateEncoder;
+    }
+
+    //! Re-encode the edited blocks
+    //! Block N is coded from input samples [N*BlockSize, (N+1)*BlockSize),
+    //! and the encoder is causal, so all blocks before the first edited
+    //! block are unchanged. Starting the encoder Margin blocks early lets
+    //! its state (lapping, transient detection, masking memory) settle to
+    //! that of the original encode, which we check by comparing the last
+    //! warm-up block against the old stream; if it differs, we restart
+    //! with twice the warm-up. After the edit, we keep encoding until
+    //! Margin consecutive blocks match the old stream again, at which
+    //! point the encoder state has settled back and the rest is copied.
+    size_t EditBlk0  = EditStart / BlockSize;
+    size_t EditBlk1  = (EditEnd + BlockSize-1) / BlockSize;
+    size_t StartBlk  = EditBlk0;
+    size_t SpliceIn  = EditBlk0;
+    size_t SpliceOut = EditBlk0;
+    size_t nBlkEncoded = 0;
+    size_t NewStreamSize = 0, NewStreamCapacity = 0;
+    if(EditStart != EditEnd)
+    {
+        //! Warm up
+        size_t nWarmup = Margin;
+        for(;;)
+        {
+            int Same = 1;
+            StartBlk = (EditBlk0 > nWarmup) ? (EditBlk0 - nWarmup) : 0;
+            FileIn.SamplePosition = StartBlk * BlockSize;
+            for(Blk=StartBlk; Blk<EditBlk0; Blk++)
+            {
+                int Size;
+                WAV_ReadAsFloat(&FileIn, ReadBuffer, BlockSize);
+                const uint8_t *EncData = Reencode_EncodeBlock(&Encoder, ReadBuffer, &Size, RateKbps, AvgComplexity);
+                Same = ((size_t)Size == OldBlockOffs[Blk+1] - OldBlockOffs[Blk] && !memcmp(EncData, OldStream + OldBlockOffs[Blk], Size));
+                nBlkEncoded++;
+            }
+            if(Same) break;
+            if(StartBlk == 0)
+            {
+                printf("WARNING: Encoder does not reproduce the old stream before the edit.\n");
+                printf("         Check that the rate settings and wisdom match the original encode.\n");
+                break;
+            }
+
+            //! Restart with a longer warm-up
+            nWarmup *= 2;
+            ULC_EncoderState_Destroy(&Encoder);
+            if(ULC_EncoderState_Init(&Encoder) <= 0)
+            {
+                printf("ERROR: Unable to initialize encoder.\n");
+                ExitCode = -1;
+                goto Exit_FailCreateEncoder;
+            }
+        }
+
+        //! Encode the edit and the blocks after it
+        int nMatching = 0;
+        for(Blk=EditBlk0; Blk<nBlk; Blk++)
+        {
+            //! Encode block and compare against the old stream
+            int Size;
+            WAV_ReadAsFloat(&FileIn, ReadBuffer, BlockSize);
+            const uint8_t *EncData = Reencode_EncodeBlock(&Encoder, ReadBuffer, &Size, RateKbps, AvgComplexity);
+            int Same = ((size_t)Size == OldBlockOffs[Blk+1] - OldBlockOffs[Blk] && !memcmp(EncData, OldStream + OldBlockOffs[Blk], Size));
+            nBlkEncoded++;
+
+            //! Store block
+            if(NewStreamSize + Size > NewStreamCapacity)
+            {
+                size_t NewCapacity = NewStreamCapacity ? (NewStreamCapacity * 2) : (64*1024);
+                uint8_t *Buf = realloc(NewStream, NewCapacity);
+                if(!Buf)
+                {
+                    printf("ERROR: Couldn't allocate output buffer.\n");
+                    ExitCode = -1;
+                    goto Exit_FailReencode;
+                }
+                NewStream = Buf, NewStreamCapacity = NewCapacity;
+            }
+            memcpy(NewStream + NewStreamSize, EncData, Size);
+            NewStreamSize += Size;
+
+            //! Settled back to the old stream after the edit?
+            //! NOTE: Matching blocks are kept in NewStream, so only
+            //! splice the old stream back in at the first of them.
+            if(Blk >= EditBlk1 && Same)
+            {
+                if(++nMatching == 1) SpliceOut = Blk;
+                if(nMatching >= Margin) break;
+            }
+            else nMatching = 0, SpliceOut = Blk+1;
+        }
+        if(Blk >= nBlk) SpliceOut = nBlk;
+    }
+
+    //! Open output file
+    FileOut = fopen(argv[3], "wb");
+    if(!FileOut)
+    {
+        printf("ERROR: Unable to open output file (%s).\n", argv[3]);
+        ExitCode = -1;
+        goto Exit_FailOpenFileOut;
+    }
+
+    //! Write the spliced stream
+    //! The header is re-written as the block sizes have changed.
+    size_t NewSplicedSize = 0;
+    {
+        size_t OldSpliceIn  = OldBlockOffs[SpliceIn];
+        size_t OldSpliceOut = OldBlockOffs[SpliceOut];
+        size_t NewSpliceOut = 0;
+
+        //! Find the size of the re-encoded blocks we keep
+        FileHeader.MaxBlockSize = 0;
+        for(Blk=0; Blk<nBlk; Blk++)
+        {
+            size_t Size = OldBlockOffs[Blk+1] - OldBlockOffs[Blk];
+            if(Blk >= SpliceIn && Blk < SpliceOut) continue;
+            if(Size > FileHeader.MaxBlockSize) FileHeader.MaxBlockSize = Size;
+        }
+        {
+            //! Rescan the new blocks to get their sizes
+            size_t Offs = 0;
+            for(Blk=SpliceIn; Blk<SpliceOut; Blk++)
+            {
+                size_t Size = (ULC_ScanBlock(&Scanner, NewStream + Offs) + 7) / 8u;
+                if(Size > FileHeader.MaxBlockSize) FileHeader.MaxBlockSize = Size;
+                Offs += Size;
+            }
+            NewSpliceOut = Offs;
+        }
+        NewSplicedSize = OldSpliceIn + NewSpliceOut + (OldStreamSize - OldSpliceOut);
+        FileHeader.RateKbps   = lrint(NewSplicedSize * 8.0 * FileHeader.RateHz/1000.0 / (BlockSize * nBlk));
+        FileHeader.StreamOffs = sizeof(FileHeader);
+        if(StereoSwitching || ParametricStereo) FileHeader.Profile |= HEADER_PROFILE_STEREO;
+        if(NoiseCoupling)                       FileHeader.Profile |= HEADER_PROFILE_NOISE_COUPLING;
+        fwrite(&FileHeader, sizeof(FileHeader), 1, FileOut);
+        fwrite(OldStream,                1, OldSpliceIn,                  FileOut);
+        fwrite(NewStream,                1, NewSpliceOut,                 FileOut);
+        fwrite(OldStream + OldSpliceOut, 1, OldStreamSize - OldSpliceOut, FileOut);
+    }
+    printf(
+        "Encoded %zu of %zu blocks; replaced blocks [%zu,%zu)\n"
+        "Total size = %.2fKiB (was %.2fKiB)\n",
+        nBlkEncoded, nBlk, SpliceIn, SpliceOut,
+        NewSplicedSize / 1024.0, OldStreamSize / 1024.0
+    );
+
+    //! Verify against a full re-encode
+    //! Blocks outside of [StartBlk, SpliceOut) must be identical, as these
+    //! were either never re-encoded or have been shown to have settled.
+    //! Blocks within that range may differ only if the encoder state did
+    //! not fully settle during warm-up.
+    if(Verify)
+    {
+        size_t nDiffer = 0, nDifferOutside = 0, NewOffs = 0;
+        ULC_EncoderState_Destroy(&Encoder);
+        if(ULC_EncoderState_Init(&Encoder) <= 0)
+        {
+            printf("ERROR: Unable to initialize encoder.\n");
+            ExitCode = -1;
+            goto Exit_FailVerify;
+        }
+        FileIn.SamplePosition = 0;
+        for(Blk=0; Blk<nBlk; Blk++)
+        {
+            int Size;
+            const uint8_t *RefData;
+            size_t RefSize;
+            if(Blk >= SpliceIn && Blk < SpliceOut)
+            {
+                RefData  = NewStream + NewOffs;
+                RefSize  = (ULC_ScanBlock(&Scanner, RefData) + 7) / 8u;
+                NewOffs += RefSize;
+            }
+            else
+            {
+                RefData = OldStream + OldBlockOffs[Blk];
+                RefSize = OldBlockOffs[Blk+1] - OldBlockOffs[Blk];
+            }
+            WAV_ReadAsFloat(&FileIn, ReadBuffer, BlockSize);
+            const uint8_t *EncData = Reencode_EncodeBlock(&Encoder, ReadBuffer, &Size, RateKbps, AvgComplexity);
+            if((size_t)Size != RefSize || memcmp(EncData, RefData, Size))
+            {
+                nDiffer++;
+                if(Blk < StartBlk || Blk >= SpliceOut) nDifferOutside++;
+            }
+        }
+        printf(
+            "Verify: %zu blocks differ from a full re-encode (%zu outside blocks [%zu,%zu))\n",
+            nDiffer, nDifferOutside, StartBlk, SpliceOut
+        );
+        if(nDifferOutside)
+        {
+            printf("ERROR: Verification failed.\n");
+            ExitCode = -1;
+        }
+    }
+
+    //! Exit points
+Exit_FailVerify:
+    fclose(FileOut);
+Exit_FailOpenFileOut:
+Exit_FailReencode:
+    ULC_EncoderState_Destroy(&Encoder);
+Exit_FailCreateEncoder:
+Exit_FailFindEditRange:
+    free(AllocBuffer);
+Exit_FailCreateAllocBuffer:
+Exit_FailInFileValidation:
+    WAV_Close(&FileIn);
+Exit_FailOpenInFile:
+Exit_FailScanOldStream:
+    free(OldBlockOffs);
+    free(NewStream);
+Exit_FailReadOldStream:
+    free(OldStream);
+    fclose(FileOld);
+Exit_FailOpenOldFile:
+Exit_BadArgs:
+    return ExitCode;
+}
+
+/**************************************/
+//! EOF
+/**************************************/
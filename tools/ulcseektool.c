@@ -0,0 +1,219 @@
+/**************************************/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+/**************************************/
+#include "ulc_helper.h"
+#include "ulc_seekindex.h"
+/**************************************/
+
+//! Print a range as an HTTP Range header value (inclusive end)
+static void PrintRange(const struct SeekPlan_Range_t *Range, const char *StreamName, const char *IndexName)
+{
+    printf(
+        " %s bytes=%llu-%llu\n",
+        (Range->Object == SEEKPLAN_OBJECT_INDEX) ? IndexName : StreamName,
+        (unsigned long long)Range->Start,
+        (unsigned long long)Range->End-1
+    );
+}
+
+/**************************************/
+
+int main(int argc, const char *argv[])
+{
+    int   ExitCode = 0;
+    FILE *FileIn;
+    FILE *FileIndex;
+    uint32_t *Entries = NULL;
+    struct FileHeader_t FileHeader;
+    struct SeekIndexHeader_t Index;
+
+    //! Check arguments
+    if(argc < 3)
+    {
+        printf(
+            "ulcSeekTool - Ultra-Low Complexity Codec Seek Index Tool\n"
+            "Usage:\n"
+            " ulcseektool Input.ulc Index.ulcx [Opt]\n"
+            "Options:\n"
+            " -stride:1       - Index every Xth block (smaller index, longer seeks).\n"
+            " -plan:X[,Y]     - Don't build the index; plan the reads needed to play\n"
+            "                   samples X..Y (default: end) from Index.ulcx.\n"
+            " -prefetch:65536 - With -plan, read ahead this many bytes past Y.\n"
+            "Plans are printed as HTTP Range requests, in the order that a player\n"
+            "would issue them; the first two only need fetching once per stream.\n"
+        );
+        return 1;
+    }
+
+    //! Parse arguments
+    int Planning = 0;
+    uint32_t BlockStride = 1;
+    uint32_t PrefetchBytes = 65536;
+    unsigned long long PlanStart = 0, PlanEnd = UINT64_MAX;
+    {
+        int n;
+        for(n=3; n<argc; n++)
+        {
+            if(!memcmp(argv[n], "-stride:", 8))
+            {
+                int x = atoi(argv[n] + 8);
+                if(x < 1)
+                {
+                    printf("ERROR: Invalid index stride (%s).\n", argv[n] + 8);
+                    ExitCode = -1;
+                    goto Exit_BadArgs;
+                }
+                BlockStride = x;
+            }
+
+            else if(!memcmp(argv[n], "-plan:", 6))
+            {
+                if(sscanf(argv[n] + 6, "%llu,%llu", &PlanStart, &PlanEnd) < 1 || PlanEnd <= PlanStart)
+                {
+                    printf("ERROR: Invalid playback range (%s).\n", argv[n] + 6);
+                    ExitCode = -1;
+                    goto Exit_BadArgs;
+                }
+                Planning = 1;
+            }
+
+            else if(!memcmp(argv[n], "-prefetch:", 10))
+            {
+                int x = atoi(argv[n] + 10);
+                if(x < 0)
+                {
+                    printf("ERROR: Invalid prefetch size (%s).\n", argv[n] + 10);
+                    ExitCode = -1;
+                    goto Exit_BadArgs;
+                }
+                PrefetchBytes = x;
+            }
+
+            else printf("WARNING: Ignoring unknown argument (%s).\n", argv[n]);
+        }
+    }
+
+    //! Open input file
+    FileIn = fopen(argv[1], "rb");
+    if(!FileIn)
+    {
+        printf("ERROR: Unable to open input file (%s).\n", argv[1]);
+        ExitCode = -1;
+        goto Exit_FailOpenInFile;
+    }
+    if(FileHeader_Read(&FileHeader, FileIn) < 0)
+    {
+        printf("ERROR: Input file is not a valid ULC container.\n");
+        ExitCode = -1;
+        goto Exit_FailVerifyInFile;
+    }
+    fseek(FileIn, 0, SEEK_SET);
+
+    //! Build the index
+    if(!Planning)
+    {
+        FileIndex = fopen(argv[2], "wb");
+        if(!FileIndex)
+        {
+            printf("ERROR: Unable to open output file (%s).\n", argv[2]);
+            ExitCode = -1;
+            goto Exit_FailOpenIndexFile;
+        }
+        if(SeekIndex_Build(FileIn, FileIndex, BlockStride) < 0)
+        {
+            printf("ERROR: Unable to build the index (corrupted stream, or unable to write).\n");
+            ExitCode = -1;
+        }
+        else
+        {
+            uint32_t nEntries = (FileHeader.nBlocks + BlockStride-1) / BlockStride + 1;
+            printf(
+                "Indexed %u blocks (%u entries, %u pages; %.2fKiB)\n",
+                FileHeader.nBlocks, nEntries,
+                (nEntries + SEEKINDEX_PAGE_ENTRIES-1) / SEEKINDEX_PAGE_ENTRIES,
+                (sizeof(struct SeekIndexHeader_t) + nEntries*sizeof(uint32_t)) / 1024.0
+            );
+        }
+        fclose(FileIndex);
+        goto Exit_Done;
+    }
+
+    //! Read and verify the index header
+    FileIndex = fopen(argv[2], "rb");
+    if(!FileIndex)
+    {
+        printf("ERROR: Unable to open index file (%s).\n", argv[2]);
+        ExitCode = -1;
+        goto Exit_FailOpenIndexFile;
+    }
+    fseek(FileIn, 0, SEEK_END);
+    if(SeekIndex_ReadHeader(&Index, FileIndex, &FileHeader, ftell(FileIn)) < 0)
+    {
+        printf("ERROR: Index is invalid, or doesn't match the input file.\n");
+        ExitCode = -1;
+        goto Exit_FailReadIndex;
+    }
+
+    //! Plan the reads
+    //! The asset headers were already read, so this only needs the
+    //! index pages, which a remote player would fetch at this point.
+    struct SeekPlan_t Plan;
+    struct SeekPlan_Range_t AssetRanges[2], PageRange, StreamRange;
+    int nAssetRanges = SeekPlan_AssetRanges(AssetRanges, &FileHeader, &Index);
+    if(SeekPlan_Init(&Plan, &PageRange, &FileHeader, &Index, PlanStart, PlanEnd, PrefetchBytes) < 0)
+    {
+        printf("ERROR: Playback range is outside of the stream.\n");
+        ExitCode = -1;
+        goto Exit_FailReadIndex;
+    }
+    size_t PageSize = PageRange.End - PageRange.Start;
+    Entries = malloc(PageSize);
+    fseek(FileIndex, PageRange.Start, SEEK_SET);
+    if(!Entries || fread(Entries, 1, PageSize, FileIndex) != PageSize || SeekPlan_Finish(&Plan, &StreamRange, &Index, Entries) < 0)
+    {
+        printf("ERROR: Corrupted index.\n");
+        ExitCode = -1;
+        goto Exit_FailReadIndex;
+    }
+
+    //! Show the plan
+    {
+        int n;
+        uint64_t AssetBytes = 0;
+        uint64_t SeekBytes  = (PageRange.End - PageRange.Start) + (StreamRange.End - StreamRange.Start);
+        printf("Per stream:\n");
+        for(n=0; n<nAssetRanges; n++)
+        {
+            PrintRange(&AssetRanges[n], argv[1], argv[2]);
+            AssetBytes += AssetRanges[n].End - AssetRanges[n].Start;
+        }
+        printf("Per seek:\n");
+        PrintRange(&PageRange,   argv[1], argv[2]);
+        PrintRange(&StreamRange, argv[1], argv[2]);
+        printf(
+            "Decode blocks %u..%u, playing from block %u (skipping %u samples) to block %u\n"
+            "Seek reads %.2fKiB (%.2fKiB with the headers); reading the prefix would take %.2fKiB\n",
+            Plan.FirstBlk, Plan.PrefetchBlk, Plan.OutputBlk, Plan.SkipSamples, Plan.LastBlk,
+            SeekBytes / 1024.0, (SeekBytes + AssetBytes) / 1024.0, StreamRange.End / 1024.0
+        );
+    }
+
+    //! Exit points
+Exit_FailReadIndex:
+    free(Entries);
+    fclose(FileIndex);
+Exit_Done:
+Exit_FailOpenIndexFile:
+Exit_FailVerifyInFile:
+    fclose(FileIn);
+Exit_FailOpenInFile:
+Exit_BadArgs:
+    return ExitCode;
+}
+
+/**************************************/
+//! EOF
+/**************************************/
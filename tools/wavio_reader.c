@@ -69,19 +69,26 @@ int WAV_OpenR(struct WAV_State_t *WavState, const char *Filename)
     FILE *f = fopen(Filename, "rb");
     if(!f) return WAV_ENOFILE;
 
+    //! Parse it
+    int RetVal = WAV_OpenRFromFile(WavState, f);
+    if(RetVal < 0) fclose(f);
+    return RetVal;
+}
+
+/**************************************/
+
+int WAV_OpenRFromFile(struct WAV_State_t *WavState, FILE *f)
+{
     //! Map out the RIFF structure
     WavState->Chunks = NULL;
+    WavState->fmt    = NULL;
+    WavState->dataCk = NULL;
     int RetVal = RIFF_CkRead(f, WavState, NULL, RIFF_WAVE);
-    if(RetVal < 0)
-    {
-        fclose(f);
-        return RetVal;
-    }
+    if(RetVal < 0) return RetVal;
 
-    //! Check to see if the format is supported
     //! Check to see if this format is supported
     struct WAVE_fmt_t *fmt = WavState->fmt;
-    if(!fmt->nChannels) return WAV_EINVALID;
+    if(!fmt || !WavState->dataCk || !fmt->nChannels) return WAV_EINVALID;
     WavState->nSamplePoints = WavState->dataCk->CkSize / fmt->nChannels;
     switch(fmt->wFormatTag)
     {
@@ -99,11 +106,7 @@ int WAV_OpenR(struct WAV_State_t *WavState, const char *Filename)
         {
             WavState->nSamplePoints /= 3; //! Yeah, looks ugly and out of place
         }
-        else
-        {
-            fclose(f);
-            return WAV_EUNSUPPORTED;
-        }
+        else return WAV_EUNSUPPORTED;
     }
     break;
     case WAVE_FORMAT_IEEE_FLOAT:
@@ -112,11 +115,7 @@ int WAV_OpenR(struct WAV_State_t *WavState, const char *Filename)
         {
             WavState->nSamplePoints /= sizeof(float);
         }
-        else
-        {
-            fclose(f);
-            return WAV_EUNSUPPORTED;
-        }
+        else return WAV_EUNSUPPORTED;
     }
     break;
     }